@@ -0,0 +1,38 @@
+#ifndef BENCH_H
+    #define BENCH_H
+
+    #include "tree.h"
+
+    struct Benchmark {
+        const char * name;
+        void (*run)(void);
+    };
+
+    double bench_now(void);
+    TError_t bench_make_tree(Tree * tree, const size_t depth);
+    TError_t bench_make_tree_variables(Tree * tree, const size_t depth, const size_t variables_number);
+    bool bench_is_equal_branch(const TreeNode * node1, const TreeNode * node2);
+
+    void bench_arena(void);
+    void bench_compact_tree(void);
+    void bench_bytecode(void);
+    void bench_batch(void);
+    void bench_jit(void);
+    void bench_grid(void);
+    void bench_autodiff(void);
+    void bench_gradient(void);
+    void bench_dag(void);
+    void bench_simplify(void);
+    void bench_rewrite(void);
+    void bench_egraph(void);
+    void bench_canonical(void);
+    void bench_cse(void);
+    void bench_strength(void);
+    void bench_horner(void);
+    void bench_parse(void);
+    void bench_traversal(void);
+    void bench_input(void);
+    void bench_batch_mode(void);
+    void bench_context(void);
+
+#endif // BENCH_H
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "differenciator.h"
+#include "my_assert.h"
+
+const size_t ARENA_BENCH_DEPTH = 10;
+const size_t ARENA_BENCH_REPEATS = 50;
+
+static TreeNode * heap_copy_branch(const TreeNode * src_node, TreeNode * parent, size_t * allocs_count);
+static void heap_free_branch(TreeNode * node);
+static TreeNode * arena_copy_branch(Arena * arena, const TreeNode * src_node, TreeNode * parent);
+
+
+void bench_arena(void)
+{
+    Tree tree = {};
+    Tree d_tree = {};
+    op_new_tree(&tree, TREE_NULL);
+    op_new_tree(&d_tree, TREE_NULL);
+
+    if (bench_make_tree(&tree, ARENA_BENCH_DEPTH) ||
+        dftr_create_diff_tree(&tree, &d_tree))
+    {
+        printf("Error. Can't build the benchmark tree.\n");
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+        return;
+    }
+
+    size_t heap_allocs = 0;
+    double start = bench_now();
+    for (size_t i = 0; i < ARENA_BENCH_REPEATS; i++)
+    {
+        heap_allocs = 0;
+        TreeNode * copy = heap_copy_branch(d_tree.root, NULL, &heap_allocs);
+        heap_free_branch(copy);
+    }
+    double heap_time = bench_now() - start;
+
+    size_t arena_allocs = 0;
+    start = bench_now();
+    for (size_t i = 0; i < ARENA_BENCH_REPEATS; i++)
+    {
+        Arena arena = {};
+        op_new_arena(&arena, sizeof(TreeNode), ARENA_DEFAULT_SLAB_CAPACITY);
+        arena_copy_branch(&arena, d_tree.root, NULL);
+        arena_allocs = arena.slabs_count;
+        op_delete_arena(&arena);
+    }
+    double arena_time = bench_now() - start;
+
+    size_t tree_allocs = 0;
+    start = bench_now();
+    for (size_t i = 0; i < ARENA_BENCH_REPEATS; i++)
+    {
+        Tree copy = {};
+        op_new_tree(&copy, TREE_NULL);
+        tree_copy_branch(&copy, copy.root, d_tree.root);
+        tree_allocs = copy.nodes.slabs_count;
+        op_delete_tree(&copy);
+    }
+    double tree_time = bench_now() - start;
+
+    printf("nodes in derivative:  %zu\n", d_tree.size);
+    printf("calloc per node:      %zu allocations, %.3lf ms per build+free\n",
+           heap_allocs, heap_time * 1e3 / ARENA_BENCH_REPEATS);
+    printf("arena:                %zu allocations, %.3lf ms per build+free\n",
+           arena_allocs, arena_time * 1e3 / ARENA_BENCH_REPEATS);
+    printf("tree_copy_branch:     %zu allocations, %.3lf ms per build+op_delete_tree\n",
+           tree_allocs, tree_time * 1e3 / ARENA_BENCH_REPEATS);
+
+    op_delete_tree(&tree);
+    op_delete_tree(&d_tree);
+}
+
+
+static TreeNode * heap_copy_branch(const TreeNode * src_node, TreeNode * parent, size_t * allocs_count)
+{
+    MY_ASSERT(src_node);
+    MY_ASSERT(allocs_count);
+
+    TreeNode * node = NULL;
+
+    if (!(node = (TreeNode *) calloc(1, sizeof(TreeNode))))
+        return NULL;
+    (*allocs_count)++;
+
+    node->value = src_node->value;
+    node->parent = parent;
+    node->left = src_node->left ? heap_copy_branch(src_node->left, node, allocs_count) : NULL;
+    node->right = src_node->right ? heap_copy_branch(src_node->right, node, allocs_count) : NULL;
+
+    return node;
+}
+
+
+static void heap_free_branch(TreeNode * node)
+{
+    if (!node)
+        return;
+
+    heap_free_branch(node->left);
+    heap_free_branch(node->right);
+    free(node);
+}
+
+
+static TreeNode * arena_copy_branch(Arena * arena, const TreeNode * src_node, TreeNode * parent)
+{
+    MY_ASSERT(arena);
+    MY_ASSERT(src_node);
+
+    TreeNode * node = NULL;
+
+    if (!(node = (TreeNode *) arena_alloc(arena)))
+        return NULL;
+
+    node->value = src_node->value;
+    node->parent = parent;
+    node->left = src_node->left ? arena_copy_branch(arena, src_node->left, node) : NULL;
+    node->right = src_node->right ? arena_copy_branch(arena, src_node->right, node) : NULL;
+
+    return node;
+}
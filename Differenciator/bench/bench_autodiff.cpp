@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "autodiff.h"
+#include "bytecode.h"
+#include "libdifferenciator.h"
+#include "my_assert.h"
+
+const size_t AUTODIFF_BENCH_DEPTH = 6;
+const size_t AUTODIFF_BENCH_REPEATS = 50;
+const size_t AUTODIFF_BENCH_CHECKS = 1000;
+
+static DError_t bench_symbolic_derivative(const Tree * tree, const double * variables, double * answer,
+                                          size_t * d_tree_size);
+
+
+void bench_autodiff(void)
+{
+    DftrContext context = {};
+    Tree tree = {};
+    Tree d_tree = {};
+    DftrProgram d_program = {};
+    op_new_dftr_context(&context);
+    op_new_tree(&tree, TREE_NULL);
+    op_new_tree(&d_tree, TREE_NULL);
+    op_new_dftr_program(&d_program);
+
+    if (bench_make_tree(&tree, AUTODIFF_BENCH_DEPTH) ||
+        dftr_create_diff_tree(&tree, &d_tree) ||
+        dftr_optimization(&context, &d_tree, NULL) ||
+        dftr_compile(&d_tree, &d_program))
+    {
+        printf("Error. Can't build the benchmark trees.\n");
+        op_delete_dftr_program(&d_program);
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+        return;
+    }
+
+    double variables[] = {0.5};
+    double symbolic_answer = 0;
+    size_t d_tree_size = 0;
+    DftrDual dual_answer = {};
+
+    double start = bench_now();
+    for (size_t i = 0; i < AUTODIFF_BENCH_REPEATS; i++)
+        bench_symbolic_derivative(&tree, variables, &symbolic_answer, &d_tree_size);
+    double symbolic_time = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < AUTODIFF_BENCH_REPEATS; i++)
+        dftr_program_eval(&d_program, variables, &symbolic_answer);
+    double program_time = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < AUTODIFF_BENCH_REPEATS; i++)
+        dftr_eval_dual(&tree, variables, 0, &dual_answer);
+    double dual_time = bench_now() - start;
+
+    double max_error = 0;
+    for (size_t i = 0; i < AUTODIFF_BENCH_CHECKS; i++)
+    {
+        variables[0] = -1 + 2.0 * (double) i / AUTODIFF_BENCH_CHECKS;
+        dftr_program_eval(&d_program, variables, &symbolic_answer);
+        dftr_eval_dual(&tree, variables, 0, &dual_answer);
+
+        double error = fabs(dual_answer.derivative - symbolic_answer) / (1 + fabs(symbolic_answer));
+        if (error > max_error)
+            max_error = error;
+    }
+
+    printf("f: %zu nodes, f' after simplification: %zu nodes\n", tree.size, d_tree_size);
+    printf("    symbolic (diff + simplify + compile + eval): %10.0lf evals/sec\n", AUTODIFF_BENCH_REPEATS / symbolic_time);
+    printf("    symbolic, prebuilt f' program:               %10.0lf evals/sec\n", AUTODIFF_BENCH_REPEATS / program_time);
+    printf("    forward mode dual numbers:                   %10.0lf evals/sec\n", AUTODIFF_BENCH_REPEATS / dual_time);
+    printf("    max relative difference on [-1, 1]: %lg\n", max_error);
+
+    op_delete_dftr_program(&d_program);
+    op_delete_tree(&tree);
+    op_delete_tree(&d_tree);
+}
+
+
+static DError_t bench_symbolic_derivative(const Tree * tree, const double * variables, double * answer,
+                                          size_t * d_tree_size)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(variables);
+    MY_ASSERT(answer);
+    MY_ASSERT(d_tree_size);
+
+    DError_t dftr_errors = 0;
+    DftrContext context = {};
+    Tree d_tree = {};
+    DftrProgram program = {};
+    op_new_dftr_context(&context);
+    op_new_tree(&d_tree, TREE_NULL);
+    op_new_dftr_program(&program);
+
+    if (!(dftr_errors = dftr_create_diff_tree(tree, &d_tree)) &&
+        !(dftr_errors = dftr_optimization(&context, &d_tree, NULL)) &&
+        !(dftr_errors = dftr_compile(&d_tree, &program)))
+    {
+        dftr_errors = dftr_program_eval(&program, variables, answer);
+    }
+
+    *d_tree_size = d_tree.size;
+
+    op_delete_dftr_program(&program);
+    op_delete_tree(&d_tree);
+
+    return dftr_errors;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "bytecode.h"
+#include "differenciator.h"
+#include "my_assert.h"
+
+const size_t BATCH_BENCH_DEPTH = 5;
+const size_t BATCH_BENCH_SAMPLES = 1 << 18;
+
+static double bench_batch_max_difference(const double * answers1, const double * answers2, size_t size);
+
+
+void bench_batch(void)
+{
+    Tree tree = {};
+    Tree d_tree = {};
+    DftrProgram programs[2] = {};
+    op_new_tree(&tree, TREE_NULL);
+    op_new_tree(&d_tree, TREE_NULL);
+    op_new_dftr_program(&programs[0]);
+    op_new_dftr_program(&programs[1]);
+
+    double * samples = (double *) calloc(BATCH_BENCH_SAMPLES, sizeof(double));
+    double * expected = (double *) calloc(BATCH_BENCH_SAMPLES, sizeof(double));
+    double * answers = (double *) calloc(BATCH_BENCH_SAMPLES, sizeof(double));
+
+    if (!samples || !expected || !answers ||
+        bench_make_tree(&tree, BATCH_BENCH_DEPTH) ||
+        dftr_create_diff_tree(&tree, &d_tree) ||
+        dftr_compile(&tree, &programs[0]) ||
+        dftr_compile(&d_tree, &programs[1]))
+    {
+        printf("Error. Can't build the benchmark programs.\n");
+    }
+    else
+    {
+        for (size_t i = 0; i < BATCH_BENCH_SAMPLES; i++)
+            samples[i] = -1 + 2.0 * (double) i / BATCH_BENCH_SAMPLES;
+
+        double variables[] = {SUPPORTED_VARIABLES[0].value};
+        const char * program_names[] = {"f", "f'"};
+
+        for (size_t p = 0; p < 2; p++)
+        {
+            printf("%s: %zu instructions\n", program_names[p], programs[p].size);
+
+            double start = bench_now();
+            for (size_t i = 0; i < BATCH_BENCH_SAMPLES; i++)
+            {
+                variables[0] = samples[i];
+                dftr_program_eval(&programs[p], variables, &expected[i]);
+            }
+            double time = bench_now() - start;
+            printf("    pointwise:        %.2lf Msamples/sec\n", BATCH_BENCH_SAMPLES / time * 1e-6);
+
+            for (int level = SIMD_LEVEL_SCALAR; level <= (int) simd_get_supported_level(); level++)
+            {
+                const SimdKernels * kernels = simd_get_kernels((SimdLevels) level);
+
+                start = bench_now();
+                dftr_program_eval_batch_kernels(&programs[p], variables, 0, samples, answers,
+                                                BATCH_BENCH_SAMPLES, kernels);
+                time = bench_now() - start;
+
+                printf("    batch %-6s:     %.2lf Msamples/sec, max difference %lg\n", kernels->name,
+                       BATCH_BENCH_SAMPLES / time * 1e-6,
+                       bench_batch_max_difference(expected, answers, BATCH_BENCH_SAMPLES));
+            }
+        }
+    }
+
+    free(samples);
+    free(expected);
+    free(answers);
+    op_delete_dftr_program(&programs[0]);
+    op_delete_dftr_program(&programs[1]);
+    op_delete_tree(&tree);
+    op_delete_tree(&d_tree);
+}
+
+
+static double bench_batch_max_difference(const double * answers1, const double * answers2, size_t size)
+{
+    MY_ASSERT(answers1);
+    MY_ASSERT(answers2);
+
+    double max_difference = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        double difference = fabs(answers1[i] - answers2[i]);
+        if (difference > max_difference)
+            max_difference = difference;
+    }
+
+    return max_difference;
+}
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "batch_mode.h"
+#include "cse.h"
+#include "libdifferenciator.h"
+#include "thread_pool.h"
+#include "my_assert.h"
+
+const size_t BATCH_MODE_BENCH_EXPRESSIONS = 20000;
+const size_t BATCH_MODE_BENCH_MIN_THREADS = 4;
+const size_t BATCH_MODE_BENCH_LINE_SIZE = 128;
+
+static char * bench_batch_mode_make_text(size_t expressions_number, size_t * size);
+static DError_t bench_batch_mode_fresh(const DftrContext * context, const char * text, FILE * fp,
+                                       size_t * expressions_number);
+static void bench_batch_mode_scaling(const char * text, size_t size);
+
+
+/// A fresh tree, CSE and parse per expression, as one process per expression
+/// does minus the process, against dftr_batch_run() reusing them.
+void bench_batch_mode(void)
+{
+    size_t size = 0;
+    char * text = NULL;
+
+    if (!(text = bench_batch_mode_make_text(BATCH_MODE_BENCH_EXPRESSIONS, &size)))
+    {
+        printf("Error. Can't allocate the input.\n");
+        return;
+    }
+
+    FILE * fp = NULL;
+    if (!(fp = fopen("/dev/null", "w")))
+    {
+        printf("Error. Can't open /dev/null.\n");
+        free(text);
+        return;
+    }
+    setvbuf(fp, NULL, _IOFBF, DFTR_BATCH_OUTPUT_BUFFER_SIZE);
+
+    DftrContext context = {};
+    op_new_dftr_context(&context);
+
+    size_t expressions_number = 0;
+    double start = bench_now();
+    DError_t dftr_errors = bench_batch_mode_fresh(&context, text, fp, &expressions_number);
+    double time = bench_now() - start;
+
+    printf("fresh %6zu expressions: %9.0lf expressions/s\n", expressions_number,
+           (double) expressions_number / time);
+
+    DftrBatchStats stats = {};
+    dftr_errors |= dftr_batch_run(&context, text, size, fp, &stats);
+
+    printf("batch %6zu expressions: %9.0lf expressions/s\n", stats.expressions_number,
+           (double) stats.expressions_number / stats.time);
+
+    if (dftr_errors || stats.errors_number || stats.expressions_number != expressions_number)
+        printf("MISMATCH: %zu errors\n", stats.errors_number);
+
+    fclose(fp);
+
+    bench_batch_mode_scaling(text, size);
+
+    free(text);
+}
+
+
+/// 1 to N threads, the output of every run must match the single thread one byte for byte.
+static void bench_batch_mode_scaling(const char * text, size_t size)
+{
+    MY_ASSERT(text);
+
+    size_t cpus_number = thread_pool_get_cpus_number();
+    size_t max_threads = cpus_number > BATCH_MODE_BENCH_MIN_THREADS ? cpus_number : BATCH_MODE_BENCH_MIN_THREADS;
+    char * expected = NULL;
+    size_t expected_size = 0;
+    double single_time = 0;
+
+    printf("scaling, %zu cpus\n", cpus_number);
+
+    for (size_t threads_number = 1; threads_number <= max_threads; threads_number++)
+    {
+        char * output = NULL;
+        size_t output_size = 0;
+        FILE * fp = NULL;
+
+        if (!(fp = open_memstream(&output, &output_size)))
+        {
+            printf("Error. Can't open the output stream.\n");
+            break;
+        }
+
+        DftrContext context = {};
+        op_new_dftr_context(&context);
+        context.threads_number = threads_number;
+
+        DftrBatchStats stats = {};
+        DError_t dftr_errors = dftr_batch_run(&context, text, size, fp, &stats);
+
+        fclose(fp);
+
+        if (threads_number == 1)
+        {
+            single_time = stats.time;
+            expected = output;
+            expected_size = output_size;
+        }
+
+        bool is_equal = output_size == expected_size && !memcmp(output, expected, output_size);
+
+        printf("    %2zu threads: %9.0lf expressions/s, speedup %5.2lf%s%s\n", threads_number,
+               (double) stats.expressions_number / stats.time, single_time / stats.time,
+               threads_number > cpus_number ? " (oversubscribed)" : "",
+               dftr_errors || !is_equal ? " MISMATCH" : "");
+
+        if (output != expected)
+            free(output);
+    }
+
+    free(expected);
+}
+
+
+static char * bench_batch_mode_make_text(size_t expressions_number, size_t * size)
+{
+    MY_ASSERT(size);
+
+    char * text = NULL;
+    if (!(text = (char *) calloc(expressions_number * BATCH_MODE_BENCH_LINE_SIZE, sizeof(char))))
+        return NULL;
+
+    char * text_ptr = text;
+    for (size_t i = 0; i < expressions_number; i++)
+    {
+        size_t number = i % 9 + 1;
+
+        switch (i % 4)
+        {
+            case 0:
+                text_ptr += sprintf(text_ptr, "{ { { x } ^ { %zu } } + { { { x } sin } * { %zu.5 } } }\n",
+                                    number, number);
+                break;
+            case 1:
+                text_ptr += sprintf(text_ptr, "{ { { x } cos } / { { x } + { %zu } } }\n", number);
+                break;
+            case 2:
+                text_ptr += sprintf(text_ptr, "{ { { { x } * { %zu } } - { %zu } } ^ { 2 } }\n", number, number);
+                break;
+            default:
+                text_ptr += sprintf(text_ptr, "{ { x } * { { { x } sin } + { %zu } } }\n", number);
+                break;
+        }
+    }
+
+    *size = (size_t) (text_ptr - text);
+
+    return text;
+}
+
+
+static DError_t bench_batch_mode_fresh(const DftrContext * context, const char * text, FILE * fp,
+                                       size_t * expressions_number)
+{
+    MY_ASSERT(context);
+    MY_ASSERT(text);
+    MY_ASSERT(fp);
+    MY_ASSERT(expressions_number);
+
+    DError_t dftr_errors = 0;
+    *expressions_number = 0;
+
+    for (const char * line = text; *line && !dftr_errors; line = strchr(line, '\n') + 1)
+    {
+        Tree tree = {};
+        Tree d_tree = {};
+        double answer = 0;
+
+        op_new_tree(&tree, TREE_NULL);
+        op_new_tree(&d_tree, TREE_NULL);
+
+        size_t line_size = (size_t) (strchr(line, '\n') - line);
+
+        if (!(dftr_errors |= create_dftr_tree_span(&tree, line, line_size)) &&
+            !(dftr_errors |= dftr_eval(&tree, &answer)) &&
+            !(dftr_errors |= dftr_create_diff_tree(&tree, &d_tree)) &&
+            !(dftr_errors |= dftr_optimization(context, &d_tree, NULL)))
+        {
+            fprintf(fp, "[%zu] Answer = %.2lf\n", *expressions_number, answer);
+            dftr_errors |= dftr_print(context, &d_tree, fp, "f'", DFTR_PRINT_TEXT);
+        }
+
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+        (*expressions_number)++;
+    }
+
+    return dftr_errors;
+}
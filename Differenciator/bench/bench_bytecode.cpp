@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "bytecode.h"
+#include "differenciator.h"
+#include "my_assert.h"
+
+const size_t BYTECODE_BENCH_DEPTH = 8;
+const size_t BYTECODE_BENCH_REPEATS = 200;
+
+
+void bench_bytecode(void)
+{
+    Tree tree = {};
+    Tree d_tree = {};
+    DftrProgram program = {};
+    op_new_tree(&tree, TREE_NULL);
+    op_new_tree(&d_tree, TREE_NULL);
+    op_new_dftr_program(&program);
+
+    if (bench_make_tree(&tree, BYTECODE_BENCH_DEPTH) ||
+        dftr_create_diff_tree(&tree, &d_tree) ||
+        dftr_compile(&d_tree, &program))
+    {
+        printf("Error. Can't build the benchmark program.\n");
+        op_delete_dftr_program(&program);
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+        return;
+    }
+
+    double variables[] = {SUPPORTED_VARIABLES[0].value};
+    double tree_answer = 0;
+    double vm_answer = 0;
+
+    double start = bench_now();
+    for (size_t i = 0; i < BYTECODE_BENCH_REPEATS; i++)
+        dftr_eval(&d_tree, &tree_answer);
+    double tree_time = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < BYTECODE_BENCH_REPEATS; i++)
+        dftr_program_eval(&program, variables, &vm_answer);
+    double vm_time = bench_now() - start;
+
+    printf("nodes in derivative:  %zu\n", d_tree.size);
+    printf("instructions:         %zu (stack %zu)\n", program.size, program.stack_size);
+    printf("tree walker:          %.0lf evals/sec, f' = %lg\n", BYTECODE_BENCH_REPEATS / tree_time, tree_answer);
+    printf("stack machine:        %.0lf evals/sec, f' = %lg\n", BYTECODE_BENCH_REPEATS / vm_time, vm_answer);
+
+    op_delete_dftr_program(&program);
+    op_delete_tree(&tree);
+    op_delete_tree(&d_tree);
+}
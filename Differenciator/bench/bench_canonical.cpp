@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "bench.h"
+#include "canonical.h"
+#include "egraph.h"
+#include "autodiff.h"
+#include "my_assert.h"
+
+const size_t CANONICAL_BENCH_DEPTHS[] = {4, 6, 8};
+const size_t CANONICAL_BENCH_DEPTHS_NUMBER = sizeof(CANONICAL_BENCH_DEPTHS) / sizeof(CANONICAL_BENCH_DEPTHS[0]);
+const char * CANONICAL_BENCH_EXPRESSIONS[] = {
+    "{ { { { x } + { 1 } } + { x } } + { 2 } }",
+    "{ { 2 } * { { 3 } * { x } } }",
+    "{ { { x } * { { x } ^ { 2 } } } - { { { x } ^ { 3 } } / { 2 } } }",
+};
+const size_t CANONICAL_BENCH_EXPRESSIONS_NUMBER = sizeof(CANONICAL_BENCH_EXPRESSIONS) /
+                                                  sizeof(CANONICAL_BENCH_EXPRESSIONS[0]);
+const double CANONICAL_BENCH_X = 0.7;
+
+static void bench_canonical_compare(const char * name, const Tree * tree);
+
+
+void bench_canonical(void)
+{
+    for (size_t i = 0; i < CANONICAL_BENCH_EXPRESSIONS_NUMBER; i++)
+    {
+        char buffer[128] = "";
+        Tree tree = {};
+        op_new_tree(&tree, TREE_NULL);
+
+        strncpy(buffer, CANONICAL_BENCH_EXPRESSIONS[i], sizeof(buffer) - 1);
+
+        if (create_dftr_tree(&tree, buffer))
+            printf("Error. Can't parse %s\n", CANONICAL_BENCH_EXPRESSIONS[i]);
+        else
+            bench_canonical_compare(CANONICAL_BENCH_EXPRESSIONS[i], &tree);
+
+        op_delete_tree(&tree);
+    }
+
+    for (size_t d = 0; d < CANONICAL_BENCH_DEPTHS_NUMBER; d++)
+    {
+        char name[64] = "";
+        Tree tree = {};
+        Tree d_tree = {};
+        Tree d2_tree = {};
+        op_new_tree(&tree, TREE_NULL);
+        op_new_tree(&d_tree, TREE_NULL);
+        op_new_tree(&d2_tree, TREE_NULL);
+
+        if (bench_make_tree(&tree, CANONICAL_BENCH_DEPTHS[d]) ||
+            dftr_create_diff_tree(&tree, &d_tree) ||
+            dftr_create_diff_tree(&d_tree, &d2_tree))
+        {
+            printf("Error. Can't build the benchmark trees.\n");
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "depth %zu, f'", CANONICAL_BENCH_DEPTHS[d]);
+            bench_canonical_compare(name, &d_tree);
+            snprintf(name, sizeof(name), "depth %zu, f''", CANONICAL_BENCH_DEPTHS[d]);
+            bench_canonical_compare(name, &d2_tree);
+        }
+
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+        op_delete_tree(&d2_tree);
+    }
+}
+
+
+static void bench_canonical_compare(const char * name, const Tree * tree)
+{
+    MY_ASSERT(name);
+    MY_ASSERT(tree);
+
+    Tree worklist_tree = {};
+    Tree canonical_tree = {};
+    op_new_tree(&worklist_tree, TREE_NULL);
+    op_new_tree(&canonical_tree, TREE_NULL);
+
+    if (tree_copy_branch(&worklist_tree, worklist_tree.root, tree->root) ||
+        tree_copy_branch(&canonical_tree, canonical_tree.root, tree->root))
+    {
+        printf("Error. Can't copy the benchmark tree.\n");
+    }
+    else
+    {
+        DftrOptimizationStats worklist_stats = {};
+        DftrOptimizationStats canonical_stats = {};
+        double variables[] = {CANONICAL_BENCH_X};
+        DftrDual expected = {};
+        DftrDual answer = {};
+
+        double start = bench_now();
+        dftr_worklist_optimization(&worklist_tree, &worklist_stats);
+        double worklist_time = bench_now() - start;
+
+        start = bench_now();
+        DError_t dftr_errors = dftr_canonical_optimization(&canonical_tree, &canonical_stats);
+        double canonical_time = bench_now() - start;
+
+        dftr_eval_dual(tree, variables, 0, &expected);
+        dftr_eval_dual(&canonical_tree, variables, 0, &answer);
+        double error = fabs(answer.value - expected.value) / fmax(1, fabs(expected.value));
+
+        printf("%s: %zu nodes, %s\n", name, tree->size,
+               !dftr_errors && error < 1e-9 ? "same value" : "DIFFERENT value");
+        printf("    worklist:  %7zu nodes, cost %9.0lf %8.3lf ms\n",
+               worklist_tree.size, dftr_get_cost(&worklist_tree), worklist_time * 1e3);
+        printf("    canonical: %7zu nodes, cost %9.0lf %8.3lf ms\n",
+               canonical_tree.size, dftr_get_cost(&canonical_tree), canonical_time * 1e3);
+    }
+
+    op_delete_tree(&worklist_tree);
+    op_delete_tree(&canonical_tree);
+}
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "compact_tree.h"
+#include "canonical.h"
+#include "libdifferenciator.h"
+#include "my_assert.h"
+
+const size_t COMPACT_BENCH_DEPTH = 12;
+const size_t COMPACT_BENCH_REPEATS = 50;
+const char * const COMPACT_BENCH_EXPRESSIONS[] = {
+    "{ { { x } ^ { 2 } } ^ { 2 } }",
+    "{ { { x } cos } / { { x } + { 3 } } }",
+    "{ { x } * { { { x } sin } + { 0 } } }",
+    "{ { { { x } * { 2 } } - { 2 } } ^ { 1 } }",
+    "{ { { 2 } * { 3 } } + { { y } / { x } } }",
+};
+const size_t COMPACT_BENCH_EXPRESSIONS_NUMBER = sizeof(COMPACT_BENCH_EXPRESSIONS) /
+                                                sizeof(COMPACT_BENCH_EXPRESSIONS[0]);
+
+static double sum_tree_numbers(const TreeNode * node);
+static double sum_ctree_numbers(const CompactTree * ctree, const CTreeIndex node);
+static void bench_compact_diff(const Tree * tree);
+static void bench_compact_output(const Tree * tree);
+static bool bench_compact_is_same_output(const Tree * tree);
+static DError_t bench_compact_print(const Tree * tree, bool is_compact, char * * output, size_t * output_size);
+
+
+void bench_compact_tree(void)
+{
+    Tree tree = {};
+    Tree d_tree = {};
+    CompactTree d_ctree = {};
+    op_new_tree(&tree, TREE_NULL);
+    op_new_tree(&d_tree, TREE_NULL);
+
+    if (bench_make_tree(&tree, COMPACT_BENCH_DEPTH) ||
+        dftr_create_diff_tree(&tree, &d_tree) ||
+        ctree_from_tree(&d_ctree, &d_tree, false))
+    {
+        printf("Error. Can't build the benchmark tree.\n");
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+        return;
+    }
+
+    double sum = 0;
+    double start = bench_now();
+    for (size_t i = 0; i < COMPACT_BENCH_REPEATS; i++)
+        sum += sum_tree_numbers(d_tree.root);
+    double tree_time = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < COMPACT_BENCH_REPEATS; i++)
+        sum -= sum_ctree_numbers(&d_ctree, d_ctree.root);
+    double ctree_time = bench_now() - start;
+
+    printf("nodes in derivative:  %zu\n", d_tree.size);
+    printf("pointer tree:         %zu bytes per node, %.3lf ms per traversal\n",
+           sizeof(TreeNode), tree_time * 1e3 / COMPACT_BENCH_REPEATS);
+    printf("compact tree:         %zu bytes per node, %.3lf ms per traversal\n",
+           ctree_node_size(&d_ctree), ctree_time * 1e3 / COMPACT_BENCH_REPEATS);
+    printf("checksum difference:  %lg\n", sum);
+
+    bench_compact_diff(&tree);
+    bench_compact_output(&tree);
+
+    op_delete_compact_tree(&d_ctree);
+    op_delete_tree(&tree);
+    op_delete_tree(&d_tree);
+}
+
+
+/// Diff and the worklist simplification on both layouts, the results must be the same tree.
+static void bench_compact_diff(const Tree * tree)
+{
+    MY_ASSERT(tree);
+
+    double tree_time = 0;
+    double ctree_time = 0;
+    size_t d_size = 0;
+    bool is_failed = false;
+    CompactTree d_ctree = {};
+
+    // Reused between the runs, as a batch worker does.
+    op_new_compact_tree(&d_ctree, TREE_NULL, true);
+
+    for (size_t i = 0; i < COMPACT_BENCH_REPEATS && !is_failed; i++)
+    {
+        Tree d_tree = {};
+        Tree d_compact_tree = {};
+        DftrOptimizationStats stats = {};
+        DftrOptimizationStats compact_stats = {};
+
+        op_new_tree(&d_tree, TREE_NULL);
+        op_new_tree(&d_compact_tree, TREE_NULL);
+
+        double start = bench_now();
+        is_failed |= dftr_create_diff_tree(tree, &d_tree) != 0;
+        d_size = d_tree.size;
+        is_failed |= dftr_worklist_optimization(&d_tree, &stats) != 0;
+        tree_time += bench_now() - start;
+
+        start = bench_now();
+        is_failed |= dftr_compact_diff(tree, &d_compact_tree, &d_ctree, 0, &compact_stats) != 0;
+        ctree_time += bench_now() - start;
+
+        is_failed |= dftr_compare_branch(d_tree.root, d_compact_tree.root) != 0 ||
+                     stats.rewrites != compact_stats.rewrites;
+
+        op_delete_tree(&d_tree);
+        op_delete_tree(&d_compact_tree);
+    }
+
+    printf("diff and simplify:    %zu nodes before simplification\n", d_size);
+    printf("pointer tree:         %8zu bytes, %.3lf ms\n", d_size * sizeof(TreeNode),
+           tree_time * 1e3 / COMPACT_BENCH_REPEATS);
+    printf("compact tree:         %8zu bytes, %.3lf ms%s\n", d_size * ctree_node_size(&d_ctree),
+           ctree_time * 1e3 / COMPACT_BENCH_REPEATS, is_failed ? " MISMATCH" : "");
+
+    op_delete_compact_tree(&d_ctree);
+}
+
+
+/// The default and the --compact pipeline must print the same derivative.
+static void bench_compact_output(const Tree * tree)
+{
+    MY_ASSERT(tree);
+
+    size_t mismatches_number = bench_compact_is_same_output(tree) ? 0 : 1;
+
+    for (size_t i = 0; i < COMPACT_BENCH_EXPRESSIONS_NUMBER; i++)
+    {
+        char buffer[128] = "";
+        Tree expression = {};
+        op_new_tree(&expression, TREE_NULL);
+
+        strncpy(buffer, COMPACT_BENCH_EXPRESSIONS[i], sizeof(buffer) - 1);
+
+        if (create_dftr_tree(&expression, buffer) || !bench_compact_is_same_output(&expression))
+        {
+            printf("MISMATCH: %s\n", COMPACT_BENCH_EXPRESSIONS[i]);
+            mismatches_number++;
+        }
+
+        op_delete_tree(&expression);
+    }
+
+    printf("same output:          %zu expressions%s\n", COMPACT_BENCH_EXPRESSIONS_NUMBER + 1,
+           mismatches_number ? " MISMATCH" : "");
+}
+
+
+static bool bench_compact_is_same_output(const Tree * tree)
+{
+    MY_ASSERT(tree);
+
+    char * output = NULL;
+    char * compact_output = NULL;
+    size_t output_size = 0;
+    size_t compact_output_size = 0;
+
+    bool is_same = !bench_compact_print(tree, false, &output, &output_size) &&
+                   !bench_compact_print(tree, true, &compact_output, &compact_output_size) &&
+                   output_size == compact_output_size && !memcmp(output, compact_output, output_size);
+
+    free(output);
+    free(compact_output);
+
+    return is_same;
+}
+
+
+/// Diff, simplification and print through a context, as the command line runs them.
+static DError_t bench_compact_print(const Tree * tree, bool is_compact, char * * output, size_t * output_size)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(output);
+    MY_ASSERT(output_size);
+
+    DError_t dftr_errors = 0;
+    DftrContext context = {};
+    Tree d_tree = {};
+    FILE * fp = NULL;
+
+    if (!(fp = open_memstream(output, output_size)))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    op_new_dftr_context(&context);
+    context.is_compact = is_compact;
+    dftr_context_new_tree(&context, &d_tree);
+
+    if (!(dftr_errors |= dftr_context_diff(&context, tree, &d_tree, 0)) &&
+        !(dftr_errors |= dftr_context_optimize(&context, &d_tree, NULL)))
+        dftr_errors |= dftr_context_print(&context, &d_tree, fp, "f'");
+
+    fclose(fp);
+    op_delete_tree(&d_tree);
+    op_delete_dftr_context(&context);
+
+    return dftr_errors;
+}
+
+
+static double sum_tree_numbers(const TreeNode * node)
+{
+    MY_ASSERT(node);
+
+    double sum = node->value.type == TREE_NODE_TYPES_NUMBER ? node->value.value.number : 0;
+
+    if (node->left)
+        sum += sum_tree_numbers(node->left);
+    if (node->right)
+        sum += sum_tree_numbers(node->right);
+
+    return sum;
+}
+
+
+static double sum_ctree_numbers(const CompactTree * ctree, const CTreeIndex node)
+{
+    MY_ASSERT(ctree);
+
+    double sum = ctree->types[node] == TREE_NODE_TYPES_NUMBER ? ctree->values[node].number : 0;
+
+    if (ctree->lefts[node] != CTREE_NULL_INDEX)
+        sum += sum_ctree_numbers(ctree, ctree->lefts[node]);
+    if (ctree->rights[node] != CTREE_NULL_INDEX)
+        sum += sum_ctree_numbers(ctree, ctree->rights[node]);
+
+    return sum;
+}
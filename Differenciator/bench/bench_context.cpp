@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "libdifferenciator.h"
+#include "thread_pool.h"
+#include "double_comparing.h"
+#include "my_assert.h"
+
+const size_t CONTEXT_BENCH_EXPRESSIONS = 5000;
+const size_t CONTEXT_BENCH_MIN_THREADS = 4;
+const size_t CONTEXT_BENCH_LINE_SIZE = 128;
+
+/// One caller of the library: its own context, its own x, the same expressions as the others.
+struct ContextBenchThread {
+    pthread_t thread;
+    const char * text;
+    double x;
+    double checksum;                                 ///< Sum of f(x) and f'(x) over the expressions.
+    DError_t errors;
+};
+
+static char * bench_context_make_text(size_t expressions_number, size_t * size);
+static void * bench_context_thread(void * arg);
+static DError_t bench_context_run(const char * text, double x, double * checksum);
+
+
+/// Weak scaling: every thread runs parse, eval, diff, optimize and eval again over all expressions
+/// with its own context, so with enough cores the time of a run stays that of one thread.
+/// Every thread has a different x and its checksum must equal the single thread one for that x.
+void bench_context(void)
+{
+    size_t size = 0;
+    char * text = NULL;
+
+    if (!(text = bench_context_make_text(CONTEXT_BENCH_EXPRESSIONS, &size)))
+    {
+        printf("Error. Can't allocate the input.\n");
+        return;
+    }
+
+    size_t cpus_number = thread_pool_get_cpus_number();
+    size_t max_threads = cpus_number > CONTEXT_BENCH_MIN_THREADS ? cpus_number : CONTEXT_BENCH_MIN_THREADS;
+
+    double * expected = NULL;
+    ContextBenchThread * threads = NULL;
+
+    if (!(expected = (double *) calloc(max_threads, sizeof(double))) ||
+        !(threads = (ContextBenchThread *) calloc(max_threads, sizeof(ContextBenchThread))))
+    {
+        printf("Error. Can't allocate the threads.\n");
+        free(expected);
+        free(text);
+        return;
+    }
+
+    for (size_t i = 0; i < max_threads; i++)
+    {
+        if (bench_context_run(text, 0.5 + (double) i, &expected[i]))
+            printf("Error. Single thread run %zu failed.\n", i);
+    }
+
+    double single_time = 0;
+
+    printf("%zu expressions per thread, %zu cpus\n", CONTEXT_BENCH_EXPRESSIONS, cpus_number);
+
+    for (size_t threads_number = 1; threads_number <= max_threads; threads_number++)
+    {
+        size_t started_number = 0;
+        double start = bench_now();
+
+        for (; started_number < threads_number; started_number++)
+        {
+            threads[started_number] = {.thread = {}, .text = text, .x = 0.5 + (double) started_number,
+                                       .checksum = 0, .errors = 0};
+
+            if (pthread_create(&threads[started_number].thread, NULL, bench_context_thread, &threads[started_number]))
+                break;
+        }
+
+        bool is_failed = started_number != threads_number;
+        for (size_t i = 0; i < started_number; i++)
+        {
+            pthread_join(threads[i].thread, NULL);
+            is_failed |= threads[i].errors || !is_equal_double(threads[i].checksum, expected[i]);
+        }
+
+        double time = bench_now() - start;
+        if (threads_number == 1)
+            single_time = time;
+
+        printf("    %2zu threads: %9.0lf expressions/s, speedup %5.2lf%s%s\n", threads_number,
+               (double) (threads_number * CONTEXT_BENCH_EXPRESSIONS) / time,
+               (double) threads_number * single_time / time,
+               threads_number > cpus_number ? " (oversubscribed)" : "",
+               is_failed ? " MISMATCH" : "");
+    }
+
+    free(threads);
+    free(expected);
+    free(text);
+}
+
+
+static void * bench_context_thread(void * arg)
+{
+    MY_ASSERT(arg);
+
+    ContextBenchThread * thread = (ContextBenchThread *) arg;
+    thread->errors = bench_context_run(thread->text, thread->x, &thread->checksum);
+
+    return NULL;
+}
+
+
+static DError_t bench_context_run(const char * text, double x, double * checksum)
+{
+    MY_ASSERT(text);
+    MY_ASSERT(checksum);
+
+    DError_t dftr_errors = 0;
+    DftrContext context = {};
+
+    *checksum = 0;
+
+    if ((dftr_errors |= op_new_dftr_context(&context)) ||
+        (dftr_errors |= dftr_context_set_variable(&context, "x", x)))
+        return dftr_errors;
+
+    for (const char * line = text; *line && !dftr_errors; line = strchr(line, '\n') + 1)
+    {
+        Tree tree = {};
+        Tree d_tree = {};
+        double answer = 0;
+        double d_answer = 0;
+
+        dftr_errors |= dftr_context_new_tree(&context, &tree);
+        dftr_errors |= dftr_context_new_tree(&context, &d_tree);
+
+        size_t line_size = (size_t) (strchr(line, '\n') - line);
+
+        if (!dftr_errors &&
+            !(dftr_errors |= dftr_context_parse(&context, &tree, line, line_size)) &&
+            !(dftr_errors |= dftr_context_eval(&context, &tree, &answer)) &&
+            !(dftr_errors |= dftr_context_diff(&context, &tree, &d_tree, 0)) &&
+            !(dftr_errors |= dftr_context_optimize(&context, &d_tree, NULL)) &&
+            !(dftr_errors |= dftr_context_eval(&context, &d_tree, &d_answer)))
+        {
+            *checksum += answer + d_answer;
+        }
+
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+    }
+
+    op_delete_dftr_context(&context);
+
+    return dftr_errors;
+}
+
+
+static char * bench_context_make_text(size_t expressions_number, size_t * size)
+{
+    MY_ASSERT(size);
+
+    char * text = NULL;
+    if (!(text = (char *) calloc(expressions_number * CONTEXT_BENCH_LINE_SIZE, sizeof(char))))
+        return NULL;
+
+    char * text_ptr = text;
+    for (size_t i = 0; i < expressions_number; i++)
+    {
+        size_t number = i % 9 + 1;
+
+        switch (i % 4)
+        {
+            case 0:
+                text_ptr += sprintf(text_ptr, "{ { { x } ^ { %zu } } + { { { x } sin } * { %zu.5 } } }\n",
+                                    number, number);
+                break;
+            case 1:
+                text_ptr += sprintf(text_ptr, "{ { { x } cos } / { { x } + { %zu } } }\n", number);
+                break;
+            case 2:
+                text_ptr += sprintf(text_ptr, "{ { { { x } * { %zu } } - { %zu } } ^ { 2 } }\n", number, number);
+                break;
+            default:
+                text_ptr += sprintf(text_ptr, "{ { x } * { { { x } sin } + { %zu } } }\n", number);
+                break;
+        }
+    }
+
+    *size = (size_t) (text_ptr - text);
+
+    return text;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+
+#include "bench.h"
+#include "cse.h"
+#include "bytecode.h"
+#include "libdifferenciator.h"
+#include "double_comparing.h"
+#include "my_assert.h"
+
+const size_t CSE_BENCH_DEPTHS[] = {4, 6, 8};
+const size_t CSE_BENCH_DEPTHS_NUMBER = sizeof(CSE_BENCH_DEPTHS) / sizeof(CSE_BENCH_DEPTHS[0]);
+const size_t CSE_BENCH_REPEATS = 200;
+const double CSE_BENCH_X = 0.7;
+
+static long bench_cse_output_size(const DftrCse * cse, DftrPrintStyles style);
+
+
+void bench_cse(void)
+{
+    for (size_t d = 0; d < CSE_BENCH_DEPTHS_NUMBER; d++)
+    {
+        DftrContext context = {};
+        Tree tree = {};
+        Tree d_tree = {};
+        DftrProgram program = {};
+        DftrCse cse = {};
+        op_new_dftr_context(&context);
+        op_new_tree(&tree, TREE_NULL);
+        op_new_tree(&d_tree, TREE_NULL);
+        op_new_dftr_program(&program);
+        op_new_dftr_cse(&cse);
+
+        printf("depth %zu\n", CSE_BENCH_DEPTHS[d]);
+
+        if (bench_make_tree(&tree, CSE_BENCH_DEPTHS[d]) ||
+            dftr_create_diff_tree(&tree, &d_tree) ||
+            dftr_optimization(&context, &d_tree, NULL) ||
+            dftr_compile(&d_tree, &program) ||
+            dftr_cse_build(&cse, &d_tree, SIZE_MAX))
+        {
+            printf("Error. Can't build the benchmark trees.\n");
+        }
+        else
+        {
+            long text_size = bench_cse_output_size(&cse, DFTR_PRINT_TEXT);
+            long latex_size = bench_cse_output_size(&cse, DFTR_PRINT_LATEX);
+
+            dftr_cse_build(&cse, &d_tree, DFTR_CSE_DEFAULT_MIN_SIZE);
+
+            printf("  nodes in f':          %zu tree, %zu DAG, %zu temporaries\n",
+                   d_tree.size, cse.dag.size, cse.temporaries_number);
+            printf("  text output:          %ld -> %ld chars\n",
+                   text_size, bench_cse_output_size(&cse, DFTR_PRINT_TEXT));
+            printf("  latex output:         %ld -> %ld chars\n",
+                   latex_size, bench_cse_output_size(&cse, DFTR_PRINT_LATEX));
+
+            double variables[] = {CSE_BENCH_X};
+            double vm_answer = 0;
+            double cse_answer = 0;
+
+            double start = bench_now();
+            for (size_t i = 0; i < CSE_BENCH_REPEATS; i++)
+                dftr_program_eval(&program, variables, &vm_answer);
+            double vm_time = bench_now() - start;
+
+            start = bench_now();
+            for (size_t i = 0; i < CSE_BENCH_REPEATS; i++)
+                dftr_cse_eval(&cse, variables, &cse_answer);
+            double cse_time = bench_now() - start;
+
+            printf("  stack machine:        %.0lf evals/sec, f' = %lg\n", CSE_BENCH_REPEATS / vm_time, vm_answer);
+            printf("  cse:                  %.0lf evals/sec, f' = %lg%s\n", CSE_BENCH_REPEATS / cse_time, cse_answer,
+                   is_equal_double(vm_answer, cse_answer) ? "" : " (MISMATCH)");
+        }
+
+        op_delete_dftr_cse(&cse);
+        op_delete_dftr_program(&program);
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+    }
+}
+
+
+static long bench_cse_output_size(const DftrCse * cse, DftrPrintStyles style)
+{
+    MY_ASSERT(cse);
+
+    FILE * fp = tmpfile();
+    if (!fp)
+        return -1;
+
+    dftr_cse_print(cse, fp, "f'", style);
+    long size = ftell(fp);
+
+    fclose(fp);
+
+    return size;
+}
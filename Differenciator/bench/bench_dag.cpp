@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "bytecode.h"
+#include "dag_diff.h"
+#include "differenciator.h"
+#include "my_assert.h"
+
+const size_t DAG_BENCH_DEPTHS[] = {4, 8, 16};
+const size_t DAG_BENCH_DEPTHS_NUMBER = sizeof(DAG_BENCH_DEPTHS) / sizeof(DAG_BENCH_DEPTHS[0]);
+const size_t DAG_BENCH_MAX_ORDER = 2;
+
+static TError_t bench_make_nested_product(Tree * tree, TreeNode * node, const size_t depth);
+static double bench_eval_tree(const Tree * tree, double x);
+
+
+void bench_dag(void)
+{
+    printf("f_k = x * sin(f_(k-1)), f_0 = x; TreeNode %zu bytes, DagNode %zu bytes\n",
+           sizeof(TreeNode), sizeof(DagNode));
+
+    for (size_t d = 0; d < DAG_BENCH_DEPTHS_NUMBER; d++)
+    {
+        Tree trees[DAG_BENCH_MAX_ORDER + 1] = {};
+        Dag dag = {};
+        DagIndex roots[DAG_BENCH_MAX_ORDER + 1] = {};
+        op_new_dag(&dag);
+
+        for (size_t order = 0; order <= DAG_BENCH_MAX_ORDER; order++)
+            op_new_tree(&trees[order], TREE_NULL);
+
+        if (bench_make_nested_product(&trees[0], trees[0].root, DAG_BENCH_DEPTHS[d]) ||
+            dag_from_tree(&dag, &trees[0], &roots[0]))
+        {
+            printf("Error. Can't build the benchmark tree.\n");
+        }
+
+        printf("depth %zu, f: %zu nodes\n", DAG_BENCH_DEPTHS[d], trees[0].size);
+
+        for (size_t order = 1; order <= DAG_BENCH_MAX_ORDER; order++)
+        {
+            double start = bench_now();
+            DError_t tree_errors = dftr_create_diff_tree(&trees[order - 1], &trees[order]);
+            double tree_time = bench_now() - start;
+
+            start = bench_now();
+            DError_t dag_errors = dftr_dag_diff(&dag, roots[order - 1], 0, &roots[order]);
+            double dag_time = bench_now() - start;
+
+            if (tree_errors || dag_errors)
+            {
+                printf("Error. Can't differentiate.\n");
+                break;
+            }
+
+            Tree expanded = {};
+            op_new_tree(&expanded, TREE_NULL);
+            dag_to_tree(&expanded, &dag, roots[order]);
+
+            double tree_answer = bench_eval_tree(&trees[order], 0.3);
+            double dag_answer = bench_eval_tree(&expanded, 0.3);
+
+            printf("    order %zu: tree %8zu nodes %9zu bytes %8.3lf ms | dag %6zu nodes (%.0lf expanded), "
+                   "store %7zu bytes %8.3lf ms | f(0.3) %lg vs %lg\n",
+                   order, trees[order].size, trees[order].size * sizeof(TreeNode), tree_time * 1e3,
+                   dag_count_nodes(&dag, roots[order]), dag_count_tree_nodes(&dag, roots[order]),
+                   dag_memory_size(&dag), dag_time * 1e3, tree_answer, dag_answer);
+
+            op_delete_tree(&expanded);
+        }
+
+        printf("    dag store: %zu nodes, %zu of %zu lookups shared an existing node\n",
+               dag.size, dag.hits_number, dag.lookups_number);
+
+        for (size_t order = 0; order <= DAG_BENCH_MAX_ORDER; order++)
+            op_delete_tree(&trees[order]);
+        op_delete_dag(&dag);
+    }
+}
+
+
+static TError_t bench_make_nested_product(Tree * tree, TreeNode * node, const size_t depth)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(node);
+
+    TError_t tree_errors = 0;
+
+    if (depth == 0)
+    {
+        dftr_set_variable(&node->value, 0);
+        return tree_errors;
+    }
+
+    dftr_set_operation(&node->value, MATH_OPERATIONS_MULTIPLICATION);
+    tree_errors |= tree_insert(tree, node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(tree, node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+
+    if (tree_errors)
+        return tree_errors;
+
+    dftr_set_variable(&node->left->value, 0);
+    dftr_set_operation(&node->right->value, MATH_OPERATIONS_SINUS);
+
+    if (tree_errors = tree_insert(tree, node->right, TREE_NODE_BRANCH_LEFT, TREE_NULL))
+        return tree_errors;
+
+    return bench_make_nested_product(tree, node->right->left, depth - 1);
+}
+
+
+static double bench_eval_tree(const Tree * tree, double x)
+{
+    MY_ASSERT(tree);
+
+    DftrProgram program = {};
+    double variables[] = {x};
+    double answer = NAN;
+
+    op_new_dftr_program(&program);
+    if (!dftr_compile(tree, &program))
+        dftr_program_eval(&program, variables, &answer);
+    op_delete_dftr_program(&program);
+
+    return answer;
+}
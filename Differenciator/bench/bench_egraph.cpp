@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "bench.h"
+#include "egraph.h"
+#include "autodiff.h"
+#include "my_assert.h"
+
+const size_t EGRAPH_BENCH_DEPTHS[] = {2, 3, 4, 5, 6};
+const size_t EGRAPH_BENCH_DEPTHS_NUMBER = sizeof(EGRAPH_BENCH_DEPTHS) / sizeof(EGRAPH_BENCH_DEPTHS[0]);
+const double EGRAPH_BENCH_X = 0.7;
+const char * EGRAPH_BENCH_STOPS[] = {"saturated", "node budget", "time budget", "iterations"};
+
+
+void bench_egraph(void)
+{
+    for (size_t d = 0; d < EGRAPH_BENCH_DEPTHS_NUMBER; d++)
+    {
+        Tree tree = {};
+        Tree d_tree = {};
+        op_new_tree(&tree, TREE_NULL);
+        op_new_tree(&d_tree, TREE_NULL);
+
+        if (bench_make_tree(&tree, EGRAPH_BENCH_DEPTHS[d]) ||
+            dftr_create_diff_tree(&tree, &d_tree))
+        {
+            printf("Error. Can't build the benchmark trees.\n");
+        }
+        else
+        {
+            double variables[] = {EGRAPH_BENCH_X};
+            DftrDual expected = {};
+            DftrDual answer = {};
+            DftrEGraphStats stats = {};
+
+            dftr_eval_dual(&d_tree, variables, 0, &expected);
+
+            double start = bench_now();
+            DError_t dftr_errors = dftr_egraph_optimization(&d_tree, &DFTR_EGRAPH_DEFAULT_LIMITS, &stats);
+            double egraph_time = bench_now() - start;
+
+            dftr_eval_dual(&d_tree, variables, 0, &answer);
+            double error = fabs(answer.value - expected.value) / fmax(1, fabs(expected.value));
+
+            printf("depth %zu, f': cost %7.0lf (greedy) -> %7.0lf (e-graph) %5.1lf%%, %zu nodes, %s\n",
+                   EGRAPH_BENCH_DEPTHS[d], stats.cost_before, stats.cost_after,
+                   100 * (1 - stats.cost_after / stats.cost_before), d_tree.size,
+                   !dftr_errors && error < 1e-9 ? "same value" : "DIFFERENT value");
+            printf("    %2zu iterations, %6zu e-nodes, %6zu classes, %8zu matches, stop: %-11s %8.3lf ms\n",
+                   stats.iterations, stats.nodes, stats.classes, stats.matches,
+                   EGRAPH_BENCH_STOPS[stats.stop], egraph_time * 1e3);
+        }
+
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+    }
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "autodiff.h"
+#include "bytecode.h"
+#include "libdifferenciator.h"
+#include "my_assert.h"
+
+const size_t GRADIENT_BENCH_DEPTH = 6;
+const size_t GRADIENT_BENCH_REPEATS = 50;
+const size_t GRADIENT_BENCH_CHECKS = 200;
+const size_t GRADIENT_BENCH_MAX_VARIABLES = 16;
+
+static DError_t bench_symbolic_gradient(const Tree * tree, const double * variables, size_t variables_number,
+                                        double * gradient);
+static double bench_relative_error(double answer, double expected);
+
+
+void bench_gradient(void)
+{
+    size_t variables_number = SUPPORTED_VARIABLES_NUMBER < GRADIENT_BENCH_MAX_VARIABLES ?
+                              SUPPORTED_VARIABLES_NUMBER : GRADIENT_BENCH_MAX_VARIABLES;
+    Tree tree = {};
+    DftrTape tape = {};
+    op_new_tree(&tree, TREE_NULL);
+    op_new_dftr_tape(&tape);
+
+    if (bench_make_tree_variables(&tree, GRADIENT_BENCH_DEPTH, variables_number))
+    {
+        printf("Error. Can't build the benchmark tree.\n");
+        op_delete_dftr_tape(&tape);
+        op_delete_tree(&tree);
+        return;
+    }
+
+    double variables[GRADIENT_BENCH_MAX_VARIABLES] = {};
+    double symbolic_gradient[GRADIENT_BENCH_MAX_VARIABLES] = {};
+    double tape_gradient[GRADIENT_BENCH_MAX_VARIABLES] = {};
+    double value = 0;
+    DftrDual dual = {};
+
+    for (size_t i = 0; i < variables_number; i++)
+        variables[i] = 0.1 * (double) (i + 1);
+
+    double start = bench_now();
+    for (size_t i = 0; i < GRADIENT_BENCH_REPEATS; i++)
+        bench_symbolic_gradient(&tree, variables, variables_number, symbolic_gradient);
+    double symbolic_time = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < GRADIENT_BENCH_REPEATS; i++)
+        for (size_t j = 0; j < variables_number; j++)
+            dftr_eval_dual(&tree, variables, j, &dual);
+    double dual_time = bench_now() - start;
+
+    dftr_eval_gradient(&tape, &tree, variables, variables_number, &value, tape_gradient);
+    size_t tape_capacity = tape.capacity;
+
+    start = bench_now();
+    for (size_t i = 0; i < GRADIENT_BENCH_REPEATS; i++)
+        dftr_eval_gradient(&tape, &tree, variables, variables_number, &value, tape_gradient);
+    double tape_time = bench_now() - start;
+
+    double max_symbolic_error = 0;
+    double max_dual_error = 0;
+    srand(1);
+    for (size_t i = 0; i < GRADIENT_BENCH_CHECKS; i++)
+    {
+        for (size_t j = 0; j < variables_number; j++)
+            variables[j] = -1 + 2.0 * rand() / RAND_MAX;
+
+        dftr_eval_gradient(&tape, &tree, variables, variables_number, &value, tape_gradient);
+        if (i % 10 == 0)
+            bench_symbolic_gradient(&tree, variables, variables_number, symbolic_gradient);
+
+        for (size_t j = 0; j < variables_number; j++)
+        {
+            dftr_eval_dual(&tree, variables, j, &dual);
+
+            double dual_error = bench_relative_error(tape_gradient[j], dual.derivative);
+            if (dual_error > max_dual_error)
+                max_dual_error = dual_error;
+
+            double symbolic_error = bench_relative_error(tape_gradient[j], symbolic_gradient[j]);
+            if (i % 10 == 0 && symbolic_error > max_symbolic_error)
+                max_symbolic_error = symbolic_error;
+        }
+    }
+
+    printf("f: %zu nodes, %zu variables, tape of %zu entries\n", tree.size, variables_number, tape.size);
+    printf("    symbolic partials (diff + simplify + compile + eval): %10.0lf gradients/sec\n",
+           GRADIENT_BENCH_REPEATS / symbolic_time);
+    printf("    forward mode, one pass per variable:                  %10.0lf gradients/sec\n",
+           GRADIENT_BENCH_REPEATS / dual_time);
+    printf("    reverse mode tape:                                    %10.0lf gradients/sec\n",
+           GRADIENT_BENCH_REPEATS / tape_time);
+    printf("    tape capacity after first call %zu, after all calls %zu\n", tape_capacity, tape.capacity);
+    printf("    max relative difference: %lg from forward mode, %lg from symbolic\n",
+           max_dual_error, max_symbolic_error);
+
+    op_delete_dftr_tape(&tape);
+    op_delete_tree(&tree);
+}
+
+
+static DError_t bench_symbolic_gradient(const Tree * tree, const double * variables, size_t variables_number,
+                                        double * gradient)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(variables);
+    MY_ASSERT(gradient);
+
+    DError_t dftr_errors = 0;
+    DftrContext context = {};
+    op_new_dftr_context(&context);
+
+    for (size_t i = 0; i < variables_number && !dftr_errors; i++)
+    {
+        Tree d_tree = {};
+        DftrProgram program = {};
+        op_new_tree(&d_tree, TREE_NULL);
+        op_new_dftr_program(&program);
+
+        if (!(dftr_errors = dftr_create_partial_diff_tree(tree, &d_tree, i)) &&
+            !(dftr_errors = dftr_optimization(&context, &d_tree, NULL)) &&
+            !(dftr_errors = dftr_compile(&d_tree, &program)))
+        {
+            dftr_errors = dftr_program_eval(&program, variables, &gradient[i]);
+        }
+
+        op_delete_dftr_program(&program);
+        op_delete_tree(&d_tree);
+    }
+
+    return dftr_errors;
+}
+
+
+static double bench_relative_error(double answer, double expected)
+{
+    return fabs(answer - expected) / (1 + fabs(expected));
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "bytecode.h"
+#include "thread_pool.h"
+#include "differenciator.h"
+#include "my_assert.h"
+
+const size_t GRID_BENCH_DEPTH = 6;
+const size_t GRID_BENCH_SAMPLES = 1 << 18;
+const size_t GRID_BENCH_MIN_THREADS = 4;             ///< Exercise stealing even on small machines.
+
+
+void bench_grid(void)
+{
+    Tree tree = {};
+    Tree d_tree = {};
+    DftrProgram program = {};
+    op_new_tree(&tree, TREE_NULL);
+    op_new_tree(&d_tree, TREE_NULL);
+    op_new_dftr_program(&program);
+
+    double * expected = (double *) calloc(GRID_BENCH_SAMPLES, sizeof(double));
+    double * answers = (double *) calloc(GRID_BENCH_SAMPLES, sizeof(double));
+
+    if (!expected || !answers ||
+        bench_make_tree(&tree, GRID_BENCH_DEPTH) ||
+        dftr_create_diff_tree(&tree, &d_tree) ||
+        dftr_compile(&d_tree, &program))
+    {
+        printf("Error. Can't build the benchmark program.\n");
+    }
+    else
+    {
+        size_t cpus_number = thread_pool_get_cpus_number();
+        size_t max_threads = cpus_number > GRID_BENCH_MIN_THREADS ? cpus_number : GRID_BENCH_MIN_THREADS;
+        double variables[] = {SUPPORTED_VARIABLES[0].value};
+        double single_time = 0;
+
+        printf("f': %zu instructions, %zu samples, %zu cpus\n", program.size, GRID_BENCH_SAMPLES, cpus_number);
+
+        for (size_t threads_number = 1; threads_number <= max_threads; threads_number++)
+        {
+            ThreadPool pool = {};
+            if (op_new_thread_pool(&pool, threads_number))
+            {
+                printf("Error. Can't create a pool of %zu threads.\n", threads_number);
+                op_delete_thread_pool(&pool);
+                break;
+            }
+
+            double start = bench_now();
+            dftr_program_eval_grid(&pool, &program, variables, 0, -1, 1,
+                                   threads_number == 1 ? expected : answers, GRID_BENCH_SAMPLES);
+            double time = bench_now() - start;
+
+            double max_difference = 0;
+            for (size_t i = 0; threads_number > 1 && i < GRID_BENCH_SAMPLES; i++)
+                if (fabs(answers[i] - expected[i]) > max_difference)
+                    max_difference = fabs(answers[i] - expected[i]);
+
+            if (threads_number == 1)
+                single_time = time;
+
+            printf("    %2zu threads: %8.2lf Msamples/sec, speedup %5.2lf, %3zu steals, max difference %lg%s\n",
+                   threads_number, GRID_BENCH_SAMPLES / time / 1e6, single_time / time, pool.steals_number,
+                   max_difference, threads_number > cpus_number ? " (oversubscribed)" : "");
+
+            op_delete_thread_pool(&pool);
+        }
+    }
+
+    free(expected);
+    free(answers);
+    op_delete_dftr_program(&program);
+    op_delete_tree(&tree);
+    op_delete_tree(&d_tree);
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "horner.h"
+#include "bytecode.h"
+#include "libdifferenciator.h"
+#include "double_comparing.h"
+#include "my_assert.h"
+
+const size_t HORNER_BENCH_DEGREES[] = {8, 16, 32};
+const size_t HORNER_BENCH_DEGREES_NUMBER = sizeof(HORNER_BENCH_DEGREES) / sizeof(HORNER_BENCH_DEGREES[0]);
+const size_t HORNER_BENCH_REPEATS = 100000;
+const size_t HORNER_BENCH_TERM_SIZE = 64;
+const double HORNER_BENCH_X = 0.7;
+
+static char * bench_horner_make_polynomial(size_t degree);
+static void bench_horner_compare(const char * name, const Tree * tree);
+
+
+void bench_horner(void)
+{
+    for (size_t d = 0; d < HORNER_BENCH_DEGREES_NUMBER; d++)
+    {
+        char name[64] = "";
+        char * buffer = NULL;
+        DftrContext context = {};
+        Tree tree = {};
+        Tree d_tree = {};
+        op_new_dftr_context(&context);
+        op_new_tree(&tree, TREE_NULL);
+        op_new_tree(&d_tree, TREE_NULL);
+
+        if (!(buffer = bench_horner_make_polynomial(HORNER_BENCH_DEGREES[d])) ||
+            create_dftr_tree(&tree, buffer) ||
+            dftr_create_diff_tree(&tree, &d_tree) ||
+            dftr_optimization(&context, &tree, NULL) ||
+            dftr_optimization(&context, &d_tree, NULL))
+        {
+            printf("Error. Can't build the benchmark trees.\n");
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "degree %zu, f", HORNER_BENCH_DEGREES[d]);
+            bench_horner_compare(name, &tree);
+            snprintf(name, sizeof(name), "degree %zu, f'", HORNER_BENCH_DEGREES[d]);
+            bench_horner_compare(name, &d_tree);
+        }
+
+        free(buffer);
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+    }
+}
+
+
+/// Sum of (k + 1) * x ^ k written term by term, as a user would.
+static char * bench_horner_make_polynomial(size_t degree)
+{
+    size_t size = (degree + 2) * HORNER_BENCH_TERM_SIZE;
+    char * buffer = NULL;
+
+    if (!(buffer = (char *) calloc(size, sizeof(char))))
+        return NULL;
+
+    size_t length = 0;
+    for (size_t k = 0; k < degree; k++)
+        length += (size_t) snprintf(buffer + length, size - length, "{ ");
+
+    length += (size_t) snprintf(buffer + length, size - length, "{ 1 } ");
+
+    for (size_t k = 1; k <= degree; k++)
+        length += (size_t) snprintf(buffer + length, size - length, "+ { { %zu } * { { x } ^ { %zu } } } } ",
+                                    k + 1, k);
+
+    return buffer;
+}
+
+
+static void bench_horner_compare(const char * name, const Tree * tree)
+{
+    MY_ASSERT(name);
+    MY_ASSERT(tree);
+
+    DftrProgram program = {};
+    DftrCse cse = {};
+    DftrHornerStats stats = {};
+    double variables[] = {HORNER_BENCH_X};
+    double vm_answer = 0;
+    double cse_answer = 0;
+    double horner_answer = 0;
+
+    printf("%s\n", name);
+
+    op_new_dftr_program(&program);
+    op_new_dftr_cse(&cse);
+
+    if (dftr_compile(tree, &program) || dftr_cse_build(&cse, tree, DFTR_CSE_DEFAULT_MIN_SIZE))
+    {
+        printf("Error. Can't compile the tree.\n");
+        op_delete_dftr_cse(&cse);
+        op_delete_dftr_program(&program);
+        return;
+    }
+
+    double start = bench_now();
+    for (size_t i = 0; i < HORNER_BENCH_REPEATS; i++)
+        dftr_program_eval(&program, variables, &vm_answer);
+    double vm_time = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < HORNER_BENCH_REPEATS; i++)
+        dftr_cse_eval(&cse, variables, &cse_answer);
+    double cse_time = bench_now() - start;
+
+    if (dftr_cse_horner(&cse, &stats))
+    {
+        printf("Error. Can't find polynomials.\n");
+        op_delete_dftr_cse(&cse);
+        op_delete_dftr_program(&program);
+        return;
+    }
+
+    start = bench_now();
+    for (size_t i = 0; i < HORNER_BENCH_REPEATS; i++)
+        dftr_cse_eval(&cse, variables, &horner_answer);
+    double horner_time = bench_now() - start;
+
+    printf("  polynomials:          %zu, max degree %zu\n", stats.polynomials_number, stats.max_degree);
+    printf("  stack machine:        %.0lf evals/sec, f = %lg\n", HORNER_BENCH_REPEATS / vm_time, vm_answer);
+    printf("  cse:                  %.0lf evals/sec, f = %lg\n", HORNER_BENCH_REPEATS / cse_time, cse_answer);
+    printf("  horner:               %.0lf evals/sec, f = %lg%s\n", HORNER_BENCH_REPEATS / horner_time, horner_answer,
+           is_equal_double(vm_answer, horner_answer) ? "" : " (MISMATCH)");
+
+    op_delete_dftr_cse(&cse);
+    op_delete_dftr_program(&program);
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "differenciator.h"
+#include "structural_index.h"
+#include "file_processing.h"
+#include "my_assert.h"
+
+const size_t INPUT_BENCH_DEPTH = 18;
+const size_t INPUT_BENCH_INDENT = 4;
+
+static void bench_input_write(FILE * fp, size_t depth, size_t indent);
+static void bench_input_run(const char * name, char * file_name, bool is_mapped);
+
+
+/// fread() into a heap copy against a read-only mapping of the same file.
+void bench_input(void)
+{
+    char file_name[] = "/tmp/differenciator_bench_XXXXXX";
+    int fd = -1;
+
+    if ((fd = mkstemp(file_name)) < 0)
+    {
+        printf("Error. Can't create a temporary file.\n");
+        return;
+    }
+
+    FILE * fp = NULL;
+    if (!(fp = fdopen(fd, "w")))
+    {
+        printf("Error. Can't open the temporary file.\n");
+        close(fd);
+        unlink(file_name);
+        return;
+    }
+
+    bench_input_write(fp, INPUT_BENCH_DEPTH, 0);
+    fclose(fp);
+
+    bench_input_run("read", file_name, false);
+    bench_input_run("mmap", file_name, true);
+
+    unlink(file_name);
+}
+
+
+static void bench_input_write(FILE * fp, size_t depth, size_t indent)
+{
+    MY_ASSERT(fp);
+
+    if (depth == 0)
+    {
+        fprintf(fp, "%*s{ x }\n", (int) indent, "");
+        return;
+    }
+
+    fprintf(fp, "%*s{\n", (int) indent, "");
+    bench_input_write(fp, depth - 1, indent + INPUT_BENCH_INDENT);
+    fprintf(fp, "%*s%s\n", (int) (indent + INPUT_BENCH_INDENT), "", depth % 2 ? "+" : "*");
+    bench_input_write(fp, depth - 1, indent + INPUT_BENCH_INDENT);
+    fprintf(fp, "%*s}\n", (int) indent, "");
+}
+
+
+/// ready is the time until the parser has its first token: the file is loaded or mapped,
+/// the first page is read and the first window of the index is classified.
+static void bench_input_run(const char * name, char * file_name, bool is_mapped)
+{
+    MY_ASSERT(name);
+    MY_ASSERT(file_name);
+
+    char * buffer = NULL;
+    const char * text = NULL;
+    size_t size = 0;
+
+    double start = bench_now();
+
+    if (is_mapped)
+        text = map_text_file(file_name, &size);
+    else
+    {
+        long buffer_size = text_file_to_buffer(file_name, &buffer);
+        text = buffer;
+        size = buffer_size ? (size_t) buffer_size - 1 : 0;
+    }
+
+    if (!text)
+    {
+        printf("Error. Can't load %s.\n", file_name);
+        return;
+    }
+
+    Tree tree = {};
+    DftrLexer lexer = {};
+    StructuralIndex index = {};
+    op_new_tree(&tree, TREE_NULL);
+
+    if (!op_new_structural_index(&index) && !structural_index_start(&index, text, size, simd_get_supported_level()))
+        dftr_lexer_init_indexed(&lexer, text, size, &index);
+    else
+        dftr_lexer_init(&lexer, text, size);
+
+    double ready_time = bench_now() - start;
+
+    DError_t dftr_errors = create_dftr_tree_tokens(&tree, &lexer);
+    double time = bench_now() - start;
+
+    op_delete_structural_index(&index);
+
+    if (dftr_errors)
+        printf("Error. Can't parse the %s input.\n", name);
+    else
+        printf("%-4s %10zu bytes, %8zu nodes: ready %7.2lf ms, total %7.1lf ms, %7.1lf MB/s\n", name, size,
+               tree.size, ready_time * 1e3, time * 1e3, (double) size / time / 1e6);
+
+    op_delete_tree(&tree);
+
+    if (is_mapped)
+        unmap_text_file(text, size);
+    else
+        free(buffer);
+}
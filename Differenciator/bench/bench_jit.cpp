@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "jit.h"
+#include "differenciator.h"
+#include "my_assert.h"
+
+const size_t JIT_BENCH_DEPTH = 8;
+const size_t JIT_BENCH_REPEATS = 200;
+const size_t JIT_BENCH_CHECKS = 1000;
+
+static void bench_jit_tree(const char * name, const Tree * tree);
+
+
+void bench_jit(void)
+{
+    Tree tree = {};
+    Tree d_tree = {};
+    op_new_tree(&tree, TREE_NULL);
+    op_new_tree(&d_tree, TREE_NULL);
+
+    if (bench_make_tree(&tree, JIT_BENCH_DEPTH) ||
+        dftr_create_diff_tree(&tree, &d_tree))
+    {
+        printf("Error. Can't build the benchmark trees.\n");
+    }
+    else
+    {
+        bench_jit_tree("f", &tree);
+        bench_jit_tree("f'", &d_tree);
+    }
+
+    op_delete_tree(&tree);
+    op_delete_tree(&d_tree);
+}
+
+
+static void bench_jit_tree(const char * name, const Tree * tree)
+{
+    MY_ASSERT(name);
+    MY_ASSERT(tree);
+
+    DftrJit jit = {};
+    op_new_dftr_jit(&jit);
+
+    if (dftr_jit_compile(tree, &jit))
+    {
+        printf("Error. Can't compile %s.\n", name);
+        op_delete_dftr_jit(&jit);
+        return;
+    }
+
+    double variables[] = {SUPPORTED_VARIABLES[0].value};
+    double tree_answer = 0;
+    double vm_answer = 0;
+    double jit_answer = 0;
+
+    double start = bench_now();
+    for (size_t i = 0; i < JIT_BENCH_REPEATS; i++)
+        dftr_eval(tree, &tree_answer);
+    double tree_time = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < JIT_BENCH_REPEATS; i++)
+        dftr_program_eval(&jit.program, variables, &vm_answer);
+    double vm_time = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < JIT_BENCH_REPEATS; i++)
+        dftr_jit_eval(&jit, variables, &jit_answer);
+    double jit_time = bench_now() - start;
+
+    printf("%s: %zu nodes, %zu instructions, %zu bytes of %s code\n", name, tree->size, jit.program.size,
+           jit.memory_size, jit.function ? "native" : "no");
+    printf("    tree walker:      %.0lf evals/sec, %s = %lg\n", JIT_BENCH_REPEATS / tree_time, name, tree_answer);
+    printf("    stack machine:    %.0lf evals/sec, %s = %lg\n", JIT_BENCH_REPEATS / vm_time, name, vm_answer);
+    printf("    jit:              %.0lf evals/sec, %s = %lg\n", JIT_BENCH_REPEATS / jit_time, name, jit_answer);
+
+    double max_difference = 0;
+    for (size_t i = 0; i < JIT_BENCH_CHECKS; i++)
+    {
+        variables[0] = -1 + 2.0 * (double) i / JIT_BENCH_CHECKS;
+        dftr_program_eval(&jit.program, variables, &vm_answer);
+        dftr_jit_eval(&jit, variables, &jit_answer);
+
+        if (fabs(vm_answer - jit_answer) > max_difference)
+            max_difference = fabs(vm_answer - jit_answer);
+    }
+
+    printf("    max difference from the stack machine on [-1, 1]: %lg\n", max_difference);
+
+    op_delete_dftr_jit(&jit);
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+
+Benchmark BENCHMARKS[] = {
+    {.name = "arena",        .run = bench_arena},
+    {.name = "compact_tree", .run = bench_compact_tree},
+    {.name = "bytecode",     .run = bench_bytecode},
+    {.name = "batch",        .run = bench_batch},
+    {.name = "jit",          .run = bench_jit},
+    {.name = "grid",         .run = bench_grid},
+    {.name = "autodiff",     .run = bench_autodiff},
+    {.name = "gradient",     .run = bench_gradient},
+    {.name = "dag",          .run = bench_dag},
+    {.name = "simplify",     .run = bench_simplify},
+    {.name = "rewrite",      .run = bench_rewrite},
+    {.name = "egraph",       .run = bench_egraph},
+    {.name = "canonical",    .run = bench_canonical},
+    {.name = "cse",          .run = bench_cse},
+    {.name = "strength",     .run = bench_strength},
+    {.name = "horner",       .run = bench_horner},
+    {.name = "parse",        .run = bench_parse},
+    {.name = "traversal",    .run = bench_traversal},
+    {.name = "input",        .run = bench_input},
+    {.name = "batch_mode",   .run = bench_batch_mode},
+    {.name = "context",      .run = bench_context},
+};
+size_t BENCHMARKS_NUMBER = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+
+
+int main(int argc, char * argv[])
+{
+    bool is_found = false;
+
+    for (size_t i = 0; i < BENCHMARKS_NUMBER; i++)
+    {
+        if (argc > 1 && strcmp(argv[1], BENCHMARKS[i].name))
+            continue;
+
+        printf("---------%s----------\n", BENCHMARKS[i].name);
+        BENCHMARKS[i].run();
+        is_found = true;
+    }
+
+    if (!is_found)
+    {
+        printf("Error. Unknown benchmark %s\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
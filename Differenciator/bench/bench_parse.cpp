@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "differenciator.h"
+#include "lexer.h"
+#include "structural_index.h"
+#include "simd_kernels.h"
+#include "my_assert.h"
+
+const size_t PARSE_BENCH_DEEP_LEVELS = 200000;
+const size_t PARSE_BENCH_WIDE_DEPTH = 17;
+const size_t PARSE_BENCH_REPEATS = 5;
+const size_t PARSE_BENCH_LEVEL_SIZE = 16;
+const size_t PARSE_BENCH_INDENT = 4;
+const size_t PARSE_BENCH_NUMBERS_NUMBER = 1 << 20;
+const char * PARSE_BENCH_NUMBERS[] = {"2", "0.5", "3.14159", "-1.25e-3", "1024", "0.333333", "6.02e23", "12.75"};
+const size_t PARSE_BENCH_NUMBERS_SIZE = sizeof(PARSE_BENCH_NUMBERS) / sizeof(PARSE_BENCH_NUMBERS[0]);
+
+static char * bench_parse_make_deep(size_t levels, size_t * size);
+static char * bench_parse_make_wide(size_t depth, const char * leaf, size_t * size);
+static size_t bench_parse_write_wide(char * buffer, size_t depth, const char * leaf);
+static char * bench_parse_make_indented(size_t depth, size_t * size);
+static size_t bench_parse_write_indented(char * buffer, size_t depth, size_t indent);
+static void bench_parse_run(const char * name, const char * text, size_t size);
+static void bench_parse_numbers(void);
+
+
+void bench_parse(void)
+{
+    size_t size = 0;
+    char * text = NULL;
+
+    if (!(text = bench_parse_make_deep(PARSE_BENCH_DEEP_LEVELS, &size)))
+    {
+        printf("Error. Can't allocate the deep input.\n");
+        return;
+    }
+    bench_parse_run("deep", text, size);
+    free(text);
+
+    if (!(text = bench_parse_make_wide(PARSE_BENCH_WIDE_DEPTH, "x", &size)))
+    {
+        printf("Error. Can't allocate the wide input.\n");
+        return;
+    }
+    bench_parse_run("wide", text, size);
+    free(text);
+
+    if (!(text = bench_parse_make_wide(PARSE_BENCH_WIDE_DEPTH, "3.14159", &size)))
+    {
+        printf("Error. Can't allocate the constants input.\n");
+        return;
+    }
+    bench_parse_run("const", text, size);
+    free(text);
+
+    if (!(text = bench_parse_make_indented(PARSE_BENCH_WIDE_DEPTH, &size)))
+    {
+        printf("Error. Can't allocate the indented input.\n");
+        return;
+    }
+    bench_parse_run("indent", text, size);
+    free(text);
+
+    bench_parse_numbers();
+}
+
+
+/// { { ... { x } + { 1 } } + { 1 } } with the given nesting depth.
+static char * bench_parse_make_deep(size_t levels, size_t * size)
+{
+    MY_ASSERT(size);
+
+    char * text = NULL;
+    if (!(text = (char *) calloc((levels + 1) * PARSE_BENCH_LEVEL_SIZE, sizeof(char))))
+        return NULL;
+
+    char * text_ptr = text;
+    for (size_t i = 0; i < levels; i++)
+        text_ptr += sprintf(text_ptr, "{ ");
+
+    text_ptr += sprintf(text_ptr, "{ x } ");
+
+    for (size_t i = 0; i < levels; i++)
+        text_ptr += sprintf(text_ptr, "+ { 1 } } ");
+
+    *size = (size_t) (text_ptr - text);
+
+    return text;
+}
+
+
+/// Balanced sum of products with 2 ^ depth leaves.
+static char * bench_parse_make_wide(size_t depth, const char * leaf, size_t * size)
+{
+    MY_ASSERT(leaf);
+    MY_ASSERT(size);
+
+    char * text = NULL;
+    if (!(text = (char *) calloc(((size_t) 2 << depth) * PARSE_BENCH_LEVEL_SIZE, sizeof(char))))
+        return NULL;
+
+    *size = bench_parse_write_wide(text, depth, leaf);
+
+    return text;
+}
+
+
+/// The wide input with one node per line, indented by its depth: mostly whitespace.
+static char * bench_parse_make_indented(size_t depth, size_t * size)
+{
+    MY_ASSERT(size);
+
+    char * text = NULL;
+    size_t line_size = PARSE_BENCH_LEVEL_SIZE + PARSE_BENCH_INDENT * depth;
+    if (!(text = (char *) calloc(((size_t) 4 << depth) * line_size, sizeof(char))))
+        return NULL;
+
+    *size = bench_parse_write_indented(text, depth, 0);
+
+    return text;
+}
+
+
+static size_t bench_parse_write_indented(char * buffer, size_t depth, size_t indent)
+{
+    MY_ASSERT(buffer);
+
+    if (depth == 0)
+        return (size_t) sprintf(buffer, "%*s{ x }\n", (int) indent, "");
+
+    size_t size = (size_t) sprintf(buffer, "%*s{\n", (int) indent, "");
+    size += bench_parse_write_indented(buffer + size, depth - 1, indent + PARSE_BENCH_INDENT);
+    size += (size_t) sprintf(buffer + size, "%*s%s\n", (int) (indent + PARSE_BENCH_INDENT), "",
+                             depth % 2 ? "+" : "*");
+    size += bench_parse_write_indented(buffer + size, depth - 1, indent + PARSE_BENCH_INDENT);
+    size += (size_t) sprintf(buffer + size, "%*s}\n", (int) indent, "");
+
+    return size;
+}
+
+
+static size_t bench_parse_write_wide(char * buffer, size_t depth, const char * leaf)
+{
+    MY_ASSERT(buffer);
+    MY_ASSERT(leaf);
+
+    if (depth == 0)
+        return (size_t) sprintf(buffer, "{ %s } ", leaf);
+
+    size_t size = (size_t) sprintf(buffer, "{ ");
+    size += bench_parse_write_wide(buffer + size, depth - 1, leaf);
+    size += (size_t) sprintf(buffer + size, depth % 2 ? "+ " : "* ");
+    size += bench_parse_write_wide(buffer + size, depth - 1, leaf);
+    size += (size_t) sprintf(buffer + size, "} ");
+
+    return size;
+}
+
+
+/// The lexer skipping whitespace itself against the structural index at every SIMD level,
+/// classified window by window as the parser reaches it. index is the whole text classified alone.
+static void bench_parse_run(const char * name, const char * text, size_t size)
+{
+    MY_ASSERT(name);
+    MY_ASSERT(text);
+
+    StructuralIndex index = {};
+    if (op_new_structural_index(&index))
+    {
+        printf("Error. Can't allocate the index.\n");
+        return;
+    }
+
+    printf("%-6s %9zu bytes\n", name, size);
+
+    for (int level = -1; level <= (int) simd_get_supported_level(); level++)
+    {
+        size_t nodes_number = 0;
+        double parse_time = 0;
+        double index_time = 0;
+
+        for (size_t i = 0; i < PARSE_BENCH_REPEATS; i++)
+        {
+            Tree tree = {};
+            DftrLexer lexer = {};
+            op_new_tree(&tree, TREE_NULL);
+
+            double start = bench_now();
+
+            if (level < 0)
+                dftr_lexer_init(&lexer, text, size);
+            else
+            {
+                structural_index_start(&index, text, size, (SimdLevels) level);
+                dftr_lexer_init_indexed(&lexer, text, size, &index);
+            }
+
+            DError_t dftr_errors = create_dftr_tree_tokens(&tree, &lexer);
+            parse_time += bench_now() - start;
+
+            if (level >= 0)
+            {
+                start = bench_now();
+                structural_index_build(&index, text, size, (SimdLevels) level);
+                index_time += bench_now() - start;
+            }
+
+            nodes_number = tree.size;
+            op_delete_tree(&tree);
+
+            if (dftr_errors)
+            {
+                printf("Error. Can't parse the %s input.\n", name);
+                op_delete_structural_index(&index);
+                return;
+            }
+        }
+
+        if (level < 0)
+            printf("    %-8s %8zu nodes: %7.1lf MB/s\n", "lexer", nodes_number,
+                   (double) (size * PARSE_BENCH_REPEATS) / parse_time / 1e6);
+        else
+            printf("    %-8s %8zu nodes: %7.1lf MB/s, index %7.1lf MB/s\n",
+                   simd_get_kernels((SimdLevels) level)->name, nodes_number,
+                   (double) (size * PARSE_BENCH_REPEATS) / parse_time / 1e6,
+                   (double) (size * PARSE_BENCH_REPEATS) / index_time / 1e6);
+    }
+
+    op_delete_structural_index(&index);
+}
+
+
+/// The number scanner against the libc routines it replaced, on the same tokens.
+static void bench_parse_numbers(void)
+{
+    double sums[3] = {};
+    double times[3] = {};
+    const char * names[3] = {"sscanf", "strtod", "lexer"};
+
+    for (size_t method = 0; method < 3; method++)
+    {
+        double start = bench_now();
+
+        for (size_t i = 0; i < PARSE_BENCH_NUMBERS_NUMBER; i++)
+        {
+            const char * text = PARSE_BENCH_NUMBERS[i % PARSE_BENCH_NUMBERS_SIZE];
+            double number = 0;
+            const char * number_end = NULL;
+            int token_size = 0;
+
+            switch (method)
+            {
+                case 0:
+                    sscanf(text, "%lf%n", &number, &token_size);
+                    break;
+                case 1:
+                    number = strtod(text, NULL);
+                    break;
+                case 2:
+                    dftr_parse_number(text, text + strlen(text), &number, &number_end);
+                    break;
+                default:
+                    MY_ASSERT(0 && "UNREACHABLE");
+                    break;
+            }
+
+            sums[method] += number;
+        }
+
+        times[method] = bench_now() - start;
+    }
+
+    for (size_t method = 0; method < 3; method++)
+    {
+        printf("%-6s %8zu numbers: %7.1lf Mnumbers/s%s\n", names[method], PARSE_BENCH_NUMBERS_NUMBER,
+               (double) PARSE_BENCH_NUMBERS_NUMBER / times[method] / 1e6,
+               memcmp(&sums[method], &sums[0], sizeof(double)) ? " MISMATCH" : "");
+    }
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "rewrite.h"
+#include "my_assert.h"
+
+const size_t REWRITE_BENCH_DEPTHS[] = {4, 6, 8};
+const size_t REWRITE_BENCH_DEPTHS_NUMBER = sizeof(REWRITE_BENCH_DEPTHS) / sizeof(REWRITE_BENCH_DEPTHS[0]);
+const double REWRITE_BENCH_NEVER_NUMBER = -12345.5;
+
+static DftrRule * bench_make_padded_rules(size_t * rules_number);
+static void bench_rewrite_run(const Tree * d_tree, const Tree * expected, const char * name,
+                              const DftrRule * rules, size_t rules_number, bool is_indexed);
+
+
+void bench_rewrite(void)
+{
+    size_t padded_rules_number = 0;
+    DftrRule * padded_rules = bench_make_padded_rules(&padded_rules_number);
+
+    if (!padded_rules)
+    {
+        printf("Error. Can't allocate the rules.\n");
+        return;
+    }
+
+    for (size_t d = 0; d < REWRITE_BENCH_DEPTHS_NUMBER; d++)
+    {
+        Tree tree = {};
+        Tree d_tree = {};
+        Tree d2_tree = {};
+        Tree worklist_tree = {};
+        op_new_tree(&tree, TREE_NULL);
+        op_new_tree(&d_tree, TREE_NULL);
+        op_new_tree(&d2_tree, TREE_NULL);
+        op_new_tree(&worklist_tree, TREE_NULL);
+
+        if (bench_make_tree(&tree, REWRITE_BENCH_DEPTHS[d]) ||
+            dftr_create_diff_tree(&tree, &d_tree) ||
+            dftr_create_diff_tree(&d_tree, &d2_tree) ||
+            tree_copy_branch(&worklist_tree, worklist_tree.root, d2_tree.root))
+        {
+            printf("Error. Can't build the benchmark trees.\n");
+        }
+        else
+        {
+            DftrOptimizationStats stats = {};
+
+            double start = bench_now();
+            dftr_worklist_optimization(&worklist_tree, &stats);
+            double worklist_time = bench_now() - start;
+
+            printf("depth %zu, f'': %zu nodes -> %zu\n", REWRITE_BENCH_DEPTHS[d], d2_tree.size, worklist_tree.size);
+            printf("    %-30s %9zu visits %7zu rewrites                    %8.3lf ms\n",
+                   "worklist (try_replace_node)", stats.visits, stats.rewrites, worklist_time * 1e3);
+
+            bench_rewrite_run(&d2_tree, &worklist_tree, "rules, indexed",
+                              DFTR_DEFAULT_RULES, DFTR_DEFAULT_RULES_NUMBER, true);
+            bench_rewrite_run(&d2_tree, &worklist_tree, "rules, linear scan",
+                              DFTR_DEFAULT_RULES, DFTR_DEFAULT_RULES_NUMBER, false);
+            bench_rewrite_run(&d2_tree, &worklist_tree, "padded rules, indexed",
+                              padded_rules, padded_rules_number, true);
+            bench_rewrite_run(&d2_tree, &worklist_tree, "padded rules, linear scan",
+                              padded_rules, padded_rules_number, false);
+        }
+
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+        op_delete_tree(&d2_tree);
+        op_delete_tree(&worklist_tree);
+    }
+
+    free(padded_rules);
+}
+
+
+/// The default rules followed by op1(op2(x, #), op3(y, z)) rules with a number
+/// no benchmark tree holds, so they never fire but have to be looked through.
+static DftrRule * bench_make_padded_rules(size_t * rules_number)
+{
+    MY_ASSERT(rules_number);
+
+    size_t padding_number = MATH_OPERATIONS_ARRAY_SIZE * MATH_OPERATIONS_ARRAY_SIZE * MATH_OPERATIONS_ARRAY_SIZE;
+    DftrRule * rules = (DftrRule *) calloc(DFTR_DEFAULT_RULES_NUMBER + padding_number, sizeof(DftrRule));
+    if (!rules)
+        return NULL;
+
+    memcpy(rules, DFTR_DEFAULT_RULES, DFTR_DEFAULT_RULES_NUMBER * sizeof(DftrRule));
+    *rules_number = DFTR_DEFAULT_RULES_NUMBER;
+
+    for (size_t op1 = 0; op1 < MATH_OPERATIONS_ARRAY_SIZE; op1++)
+    {
+        if (MATH_OPERATIONS_ARRAY[op1].type != MATH_OPERATION_TYPES_BINARY)
+            continue;
+
+        for (size_t op2 = 0; op2 < MATH_OPERATIONS_ARRAY_SIZE; op2++)
+        {
+            for (size_t op3 = 0; op3 < MATH_OPERATIONS_ARRAY_SIZE; op3++)
+            {
+                DftrRule * rule = &rules[(*rules_number)++];
+                DftrPatternNode * pattern = rule->pattern;
+                size_t size = 0;
+
+                rule->name = "padding";
+
+                pattern[size].type = DFTR_PATTERN_OPERATION;
+                pattern[size++].op_id = MATH_OPERATIONS_ARRAY[op1].id;
+
+                pattern[size].type = DFTR_PATTERN_OPERATION;
+                pattern[size++].op_id = MATH_OPERATIONS_ARRAY[op2].id;
+                if (MATH_OPERATIONS_ARRAY[op2].type == MATH_OPERATION_TYPES_BINARY)
+                {
+                    pattern[size].type = DFTR_PATTERN_ANY;
+                    pattern[size++].wildcard = 0;
+                }
+                pattern[size].type = DFTR_PATTERN_NUMBER;
+                pattern[size++].number = REWRITE_BENCH_NEVER_NUMBER;
+
+                pattern[size].type = DFTR_PATTERN_OPERATION;
+                pattern[size++].op_id = MATH_OPERATIONS_ARRAY[op3].id;
+                pattern[size].type = DFTR_PATTERN_ANY;
+                pattern[size++].wildcard = 1;
+                if (MATH_OPERATIONS_ARRAY[op3].type == MATH_OPERATION_TYPES_BINARY)
+                {
+                    pattern[size].type = DFTR_PATTERN_ANY;
+                    pattern[size++].wildcard = 2;
+                }
+
+                rule->replacement[0].type = DFTR_PATTERN_ANY;
+                rule->replacement[0].wildcard = 1;
+            }
+        }
+    }
+
+    return rules;
+}
+
+
+static void bench_rewrite_run(const Tree * d_tree, const Tree * expected, const char * name,
+                              const DftrRule * rules, size_t rules_number, bool is_indexed)
+{
+    MY_ASSERT(d_tree);
+    MY_ASSERT(expected);
+    MY_ASSERT(name);
+    MY_ASSERT(rules);
+
+    Tree tree = {};
+    DftrRuleSet set = {};
+    DftrOptimizationStats stats = {};
+    op_new_tree(&tree, TREE_NULL);
+
+    if (tree_copy_branch(&tree, tree.root, d_tree->root) || op_new_dftr_rule_set(&set, rules, rules_number))
+    {
+        printf("Error. Can't prepare the rewrite benchmark.\n");
+    }
+    else
+    {
+        set.is_indexed = is_indexed;
+
+        double start = bench_now();
+        DError_t dftr_errors = dftr_rewrite_optimization(&tree, &set, &stats);
+        double rewrite_time = bench_now() - start;
+
+        char title[64] = "";
+        snprintf(title, sizeof(title), "%3zu %s", rules_number, name);
+
+        printf("    %-30s %9zu visits %7zu rewrites %6.1lf checks/lookup %8.3lf ms, %s\n",
+               title, stats.visits, stats.rewrites, (double) set.checks_number / (double) set.lookups_number,
+               rewrite_time * 1e3,
+               !dftr_errors && bench_is_equal_branch(tree.root, expected->root) ? "same result" : "DIFFERENT result");
+    }
+
+    op_delete_dftr_rule_set(&set);
+    op_delete_tree(&tree);
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+
+#include "bench.h"
+#include "differenciator.h"
+#include "my_assert.h"
+
+const size_t SIMPLIFY_BENCH_DEPTHS[] = {4, 6, 8};
+const size_t SIMPLIFY_BENCH_DEPTHS_NUMBER = sizeof(SIMPLIFY_BENCH_DEPTHS) / sizeof(SIMPLIFY_BENCH_DEPTHS[0]);
+
+void bench_simplify(void)
+{
+    for (size_t d = 0; d < SIMPLIFY_BENCH_DEPTHS_NUMBER; d++)
+    {
+        Tree tree = {};
+        Tree d_tree = {};
+        Tree fixpoint_tree = {};
+        Tree worklist_tree = {};
+        op_new_tree(&tree, TREE_NULL);
+        op_new_tree(&d_tree, TREE_NULL);
+        op_new_tree(&fixpoint_tree, TREE_NULL);
+        op_new_tree(&worklist_tree, TREE_NULL);
+
+        if (bench_make_tree(&tree, SIMPLIFY_BENCH_DEPTHS[d]) ||
+            dftr_create_diff_tree(&tree, &d_tree) ||
+            dftr_create_diff_tree(&d_tree, &fixpoint_tree) ||
+            dftr_create_diff_tree(&d_tree, &worklist_tree))
+        {
+            printf("Error. Can't build the benchmark trees.\n");
+        }
+        else
+        {
+            DftrOptimizationStats fixpoint_stats = {};
+            DftrOptimizationStats worklist_stats = {};
+            size_t d_tree_size = fixpoint_tree.size;
+
+            double start = bench_now();
+            dftr_fixpoint_optimization(&fixpoint_tree, &fixpoint_stats);
+            double fixpoint_time = bench_now() - start;
+
+            start = bench_now();
+            dftr_worklist_optimization(&worklist_tree, &worklist_stats);
+            double worklist_time = bench_now() - start;
+
+            printf("depth %zu, f'': %zu nodes -> %zu (fixpoint) / %zu (worklist), %s\n",
+                   SIMPLIFY_BENCH_DEPTHS[d], d_tree_size, fixpoint_tree.size, worklist_tree.size,
+                   bench_is_equal_branch(fixpoint_tree.root, worklist_tree.root) ? "same result" : "DIFFERENT result");
+            printf("    fixpoint loop: %2zu rounds %9zu visits                  %8.3lf ms\n",
+                   fixpoint_stats.rounds, fixpoint_stats.visits, fixpoint_time * 1e3);
+            printf("    worklist:      %2zu rounds %9zu visits %7zu rewrites %8.3lf ms\n",
+                   worklist_stats.rounds, worklist_stats.visits, worklist_stats.rewrites, worklist_time * 1e3);
+        }
+
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+        op_delete_tree(&fixpoint_tree);
+        op_delete_tree(&worklist_tree);
+    }
+}
+
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "strength.h"
+#include "libdifferenciator.h"
+#include "double_comparing.h"
+#include "my_assert.h"
+
+const size_t STRENGTH_BENCH_DEPTHS[] = {4, 6, 8};
+const size_t STRENGTH_BENCH_DEPTHS_NUMBER = sizeof(STRENGTH_BENCH_DEPTHS) / sizeof(STRENGTH_BENCH_DEPTHS[0]);
+const size_t STRENGTH_BENCH_REPEATS = 100000;
+const double STRENGTH_BENCH_X = 0.7;
+const char * STRENGTH_BENCH_EXPRESSIONS[] = {
+    "{ { { { x } + { 1 } } ^ { 3 } } + { { x } ^ { 4 } } }",
+    "{ { { { x } sin } + { x } } / { 3 } }",
+    "{ { { { x } sin } * { { x } cos } } + { { { x } ^ { 2 } } cos } }",
+};
+const size_t STRENGTH_BENCH_EXPRESSIONS_NUMBER = sizeof(STRENGTH_BENCH_EXPRESSIONS) /
+                                                 sizeof(STRENGTH_BENCH_EXPRESSIONS[0]);
+
+static void bench_strength_compare(const char * name, const Tree * tree);
+static double bench_strength_eval(DftrCse * cse, double * answer);
+
+
+void bench_strength(void)
+{
+    for (size_t i = 0; i < STRENGTH_BENCH_EXPRESSIONS_NUMBER; i++)
+    {
+        char buffer[128] = "";
+        Tree tree = {};
+        op_new_tree(&tree, TREE_NULL);
+
+        strncpy(buffer, STRENGTH_BENCH_EXPRESSIONS[i], sizeof(buffer) - 1);
+
+        if (create_dftr_tree(&tree, buffer))
+            printf("Error. Can't parse %s\n", STRENGTH_BENCH_EXPRESSIONS[i]);
+        else
+            bench_strength_compare(STRENGTH_BENCH_EXPRESSIONS[i], &tree);
+
+        op_delete_tree(&tree);
+    }
+
+    for (size_t d = 0; d < STRENGTH_BENCH_DEPTHS_NUMBER; d++)
+    {
+        char name[64] = "";
+        DftrContext context = {};
+        Tree tree = {};
+        Tree d_tree = {};
+        op_new_dftr_context(&context);
+        op_new_tree(&tree, TREE_NULL);
+        op_new_tree(&d_tree, TREE_NULL);
+
+        if (bench_make_tree(&tree, STRENGTH_BENCH_DEPTHS[d]) ||
+            dftr_create_diff_tree(&tree, &d_tree) ||
+            dftr_optimization(&context, &d_tree, NULL))
+        {
+            printf("Error. Can't build the benchmark trees.\n");
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "depth %zu, f'", STRENGTH_BENCH_DEPTHS[d]);
+            bench_strength_compare(name, &d_tree);
+        }
+
+        op_delete_tree(&tree);
+        op_delete_tree(&d_tree);
+    }
+}
+
+
+static void bench_strength_compare(const char * name, const Tree * tree)
+{
+    MY_ASSERT(name);
+    MY_ASSERT(tree);
+
+    DftrCse cse = {};
+    DftrStrengthStats stats = {};
+    double plain_answer = 0;
+    double reduced_answer = 0;
+
+    printf("%s\n", name);
+
+    if (op_new_dftr_cse(&cse) || dftr_cse_build(&cse, tree, DFTR_CSE_DEFAULT_MIN_SIZE))
+    {
+        printf("Error. Can't build the DAG.\n");
+        op_delete_dftr_cse(&cse);
+        return;
+    }
+
+    double plain_time = bench_strength_eval(&cse, &plain_answer);
+
+    if (dftr_cse_reduce_strength(&cse, &stats))
+    {
+        printf("Error. Can't reduce strength.\n");
+        op_delete_dftr_cse(&cse);
+        return;
+    }
+
+    double reduced_time = bench_strength_eval(&cse, &reduced_answer);
+
+    printf("  rewritten:            %zu powers, %zu divisions, %zu sincos pairs\n",
+           stats.powers_number, stats.divisions_number, stats.sincos_number);
+    printf("  cse:                  %.0lf evals/sec, f = %lg\n",
+           STRENGTH_BENCH_REPEATS / plain_time, plain_answer);
+    printf("  strength reduced:     %.0lf evals/sec, f = %lg%s\n",
+           STRENGTH_BENCH_REPEATS / reduced_time, reduced_answer,
+           is_equal_double(plain_answer, reduced_answer) ? "" : " (MISMATCH)");
+
+    op_delete_dftr_cse(&cse);
+}
+
+
+static double bench_strength_eval(DftrCse * cse, double * answer)
+{
+    MY_ASSERT(cse);
+    MY_ASSERT(answer);
+
+    double variables[] = {STRENGTH_BENCH_X};
+
+    double start = bench_now();
+    for (size_t i = 0; i < STRENGTH_BENCH_REPEATS; i++)
+        dftr_cse_eval(cse, variables, answer);
+
+    return bench_now() - start;
+}
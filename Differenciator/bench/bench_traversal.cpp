@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "differenciator.h"
+#include "double_comparing.h"
+#include "my_assert.h"
+
+const size_t TRAVERSAL_BENCH_LEVELS = 200000;
+const size_t TRAVERSAL_BENCH_LEVEL_SIZE = 16;
+
+static char * bench_traversal_make_chain(size_t levels);
+static void bench_traversal_print(const char * name, size_t nodes_number, double time);
+
+
+/// Every pass on a chain deep enough to overflow the call stack of a recursive walk.
+void bench_traversal(void)
+{
+    char * text = NULL;
+    if (!(text = bench_traversal_make_chain(TRAVERSAL_BENCH_LEVELS)))
+    {
+        printf("Error. Can't allocate the input.\n");
+        return;
+    }
+
+    Tree tree = {};
+    Tree copy = {};
+    op_new_tree(&tree, TREE_NULL);
+    op_new_tree(&copy, TREE_NULL);
+
+    DError_t dftr_errors = create_dftr_tree(&tree, text);
+    free(text);
+
+    if (dftr_errors)
+    {
+        printf("Error. Can't parse the input.\n");
+        op_delete_tree(&tree);
+        op_delete_tree(&copy);
+        return;
+    }
+
+    size_t nodes_number = tree.size;
+    double answer = 0;
+    DftrOptimizationStats stats = {};
+
+    double start = bench_now();
+    dftr_errors |= dftr_eval(&tree, &answer);
+    bench_traversal_print("eval", nodes_number, bench_now() - start);
+
+    start = bench_now();
+    tree_copy_branch(&copy, copy.root, tree.root);
+    bench_traversal_print("copy", nodes_number, bench_now() - start);
+
+    start = bench_now();
+    dftr_errors |= dftr_fixpoint_optimization(&copy, &stats);
+    bench_traversal_print("optimization", nodes_number, bench_now() - start);
+
+    start = bench_now();
+    op_delete_tree(&tree);
+    bench_traversal_print("delete", nodes_number, bench_now() - start);
+
+    if (dftr_errors)
+        printf("Error. Can't evaluate or optimize the chain.\n");
+    else if (!is_equal_double(answer, (double) TRAVERSAL_BENCH_LEVELS + SUPPORTED_VARIABLES[0].value))
+        printf("MISMATCH: %lf\n", answer);
+
+    op_delete_tree(&copy);
+}
+
+
+/// { { ... { x } + { 1 } } + { 1 } } with the given nesting depth.
+static char * bench_traversal_make_chain(size_t levels)
+{
+    char * text = NULL;
+    if (!(text = (char *) calloc((levels + 1) * TRAVERSAL_BENCH_LEVEL_SIZE, sizeof(char))))
+        return NULL;
+
+    char * text_ptr = text;
+    for (size_t i = 0; i < levels; i++)
+        text_ptr += sprintf(text_ptr, "{ ");
+
+    text_ptr += sprintf(text_ptr, "{ x } ");
+
+    for (size_t i = 0; i < levels; i++)
+        text_ptr += sprintf(text_ptr, "+ { 1 } } ");
+
+    return text;
+}
+
+
+static void bench_traversal_print(const char * name, size_t nodes_number, double time)
+{
+    MY_ASSERT(name);
+
+    printf("%-12s %8zu nodes: %7.2lf ms, %6.1lf Mnodes/s\n", name, nodes_number, time * 1e3,
+           (double) nodes_number / time / 1e6);
+}
@@ -0,0 +1,136 @@
+#include <time.h>
+#include <string.h>
+
+#include "bench.h"
+#include "differenciator.h"
+#include "my_assert.h"
+
+static TError_t bench_make_node(Tree * tree, TreeNode * node, const size_t depth,
+                                const size_t variables_number, size_t * leaves_number);
+static void bench_set_operation(TreeNode * node, MathOperations op_id);
+static void bench_set_number(TreeNode * node, const double number);
+
+
+double bench_now(void)
+{
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double) time.tv_sec + (double) time.tv_nsec * 1e-9;
+}
+
+
+TError_t bench_make_tree(Tree * tree, const size_t depth)
+{
+    return bench_make_tree_variables(tree, depth, 1);
+}
+
+
+/// Same shape as bench_make_tree, leaves cycle through the first variables_number variables.
+TError_t bench_make_tree_variables(Tree * tree, const size_t depth, const size_t variables_number)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(variables_number > 0 && variables_number <= SUPPORTED_VARIABLES_NUMBER);
+
+    size_t leaves_number = 0;
+
+    return bench_make_node(tree, tree->root, depth, variables_number, &leaves_number);
+}
+
+
+static TError_t bench_make_node(Tree * tree, TreeNode * node, const size_t depth,
+                                const size_t variables_number, size_t * leaves_number)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(node);
+    MY_ASSERT(leaves_number);
+
+    TError_t tree_errors = 0;
+
+    if (depth == 0)
+    {
+        dftr_set_variable(&node->value, (*leaves_number)++ % variables_number);
+        return tree_errors;
+    }
+
+    tree_errors |= tree_insert(tree, node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(tree, node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+
+    if (tree_errors)
+        return tree_errors;
+
+    tree_errors |= bench_make_node(tree, node->left, depth - 1, variables_number, leaves_number);
+
+    if (depth % 2)
+    {
+        bench_set_operation(node, MATH_OPERATIONS_MULTIPLICATION);
+        bench_set_operation(node->right, MATH_OPERATIONS_SINUS);
+        tree_errors |= tree_insert(tree, node->right, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+        if (!tree_errors)
+            tree_errors |= bench_make_node(tree, node->right->left, depth - 1, variables_number, leaves_number);
+    }
+    else
+    {
+        bench_set_operation(node, MATH_OPERATIONS_ADDITION);
+        bench_set_operation(node->right, MATH_OPERATIONS_POWER);
+        tree_errors |= tree_insert(tree, node->right, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+        tree_errors |= tree_insert(tree, node->right, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+        if (!tree_errors)
+        {
+            tree_errors |= bench_make_node(tree, node->right->left, depth - 1, variables_number, leaves_number);
+            bench_set_number(node->right->right, 2);
+        }
+    }
+
+    return tree_errors;
+}
+
+
+static void bench_set_operation(TreeNode * node, MathOperations op_id)
+{
+    MY_ASSERT(node);
+
+    dftr_set_operation(&node->value, op_id);
+}
+
+
+static void bench_set_number(TreeNode * node, const double number)
+{
+    MY_ASSERT(node);
+
+    node->value.type = TREE_NODE_TYPES_NUMBER;
+    node->value.value.number = number;
+}
+
+
+/// Exact structural equality, numbers are compared bitwise.
+bool bench_is_equal_branch(const TreeNode * node1, const TreeNode * node2)
+{
+    if (!node1 || !node2)
+        return node1 == node2;
+
+    if (node1->value.type != node2->value.type)
+        return false;
+
+    switch (node1->value.type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+            if (memcmp(&node1->value.value.number, &node2->value.value.number, sizeof(double)))
+                return false;
+            break;
+
+        case TREE_NODE_TYPES_OPERATION:
+        case TREE_NODE_TYPES_VARIABLE:
+            if (node1->value.id != node2->value.id)
+                return false;
+            break;
+
+        case TREE_NODE_TYPES_STRING:
+        case TREE_NODE_TYPES_NO_TYPE:
+        default:
+            break;
+    }
+
+    return bench_is_equal_branch(node1->left, node2->left) &&
+           bench_is_equal_branch(node1->right, node2->right);
+}
@@ -0,0 +1,42 @@
+#ifndef AUTODIFF_H
+    #define AUTODIFF_H
+
+    #include <stdint.h>
+
+    #include "differenciator.h"
+    #include "bytecode.h"
+
+    /// Value of an expression together with its derivative by one variable.
+    struct DftrDual {
+        double value;
+        double derivative;
+    };
+
+    /// One recorded operation. Operands are indices of earlier entries.
+    struct DftrTapeEntry {
+        uint32_t opcode;                             ///< DftrOpcodes.
+        uint32_t arg;                                ///< Variable id for DFTR_OPCODE_VAR.
+        uint32_t left;
+        uint32_t right;
+        double value;
+    };
+
+    /// Reverse mode tape. Keeps its memory between calls, so repeated
+    /// gradients of expressions of the same size don't allocate.
+    struct DftrTape {
+        DftrTapeEntry * entries;
+        double * adjoints;
+        uint32_t * operands;                         ///< Entries not yet used by their node while recording.
+        size_t size;
+        size_t capacity;
+    };
+
+    const size_t DFTR_TAPE_DEFAULT_CAPACITY = 64;
+
+    DError_t dftr_eval_dual(const Tree * tree, const double * variables, size_t variable_id, DftrDual * answer);
+    DError_t op_new_dftr_tape(DftrTape * tape);
+    DError_t op_delete_dftr_tape(DftrTape * tape);
+    DError_t dftr_eval_gradient(DftrTape * tape, const Tree * tree, const double * variables,
+                                size_t variables_number, double * value, double * gradient);
+
+#endif // AUTODIFF_H
@@ -0,0 +1,68 @@
+#ifndef BATCH_MODE_H
+    #define BATCH_MODE_H
+
+    #include <stdio.h>
+
+    #include "differenciator.h"
+    #include "compact_tree.h"
+    #include "structural_index.h"
+    #include "cse.h"
+    #include "thread_pool.h"
+
+    /// One top-level { ... } of the input as a span of the text, up to the start of the next one.
+    struct DftrRecord {
+        size_t begin;
+        size_t size;
+    };
+
+    /// Input text split into records, the index window and the list are reused between files.
+    struct DftrRecords {
+        const char * text;
+        size_t text_size;
+        StructuralIndex index;
+        DftrRecord * records;
+        size_t size;
+        size_t capacity;
+    };
+
+    /// Everything one expression needs, cleared instead of freed between records
+    /// so the allocations stop once it has held the largest expression.
+    struct DftrWorker {
+        Tree tree;
+        Tree d_tree;
+        CompactTree d_ctree;                         ///< Derivative before simplification, in the compact layout.
+        DftrCse cse;
+        StructuralIndex index;                       ///< Windows of the record being parsed.
+    };
+
+    /// Output of one record in flight, kept until the records before it are written.
+    /// Record i uses slot i % slots number, so the slots are a ring sliding over the records.
+    struct DftrReorderSlot {
+        FILE * stream;                               ///< open_memstream() over data.
+        char * data;
+        size_t size;
+        DError_t errors;
+        bool is_done;                                ///< Set by the worker, cleared once written.
+    };
+
+    struct DftrBatchStats {
+        size_t expressions_number;
+        size_t errors_number;                        ///< Records written as an error line.
+        double time;                                 ///< Seconds, splitting included.
+    };
+
+    const size_t DFTR_RECORDS_DEFAULT_CAPACITY = 64;
+    const size_t DFTR_BATCH_OUTPUT_BUFFER_SIZE = 1 << 20;
+    const size_t DFTR_BATCH_SLOTS_PER_THREAD = 64;
+
+    DError_t op_new_dftr_records(DftrRecords * records);
+    DError_t op_delete_dftr_records(DftrRecords * records);
+    DError_t dftr_records_split(DftrRecords * records, const char * text, size_t size);
+    DError_t op_new_dftr_worker(DftrWorker * worker);
+    DError_t op_delete_dftr_worker(DftrWorker * worker);
+    DError_t dftr_worker_process(DftrWorker * worker, const DftrRecords * records, size_t record_id,
+                                 const DftrContext * context, FILE * fp);
+    DError_t dftr_batch_run(const DftrContext * context, const char * text, size_t size, FILE * fp,
+                            DftrBatchStats * stats);
+
+#endif // BATCH_MODE_H
@@ -0,0 +1,71 @@
+#ifndef BYTECODE_H
+    #define BYTECODE_H
+
+    #include <stdint.h>
+
+    #include "differenciator.h"
+    #include "simd_kernels.h"
+    #include "thread_pool.h"
+
+    enum DftrOpcodes {
+        DFTR_OPCODE_CONST          = 0,              ///< Push constants[arg].
+        DFTR_OPCODE_VAR            = 1,              ///< Push variables[arg].
+        DFTR_OPCODE_ADDITION       = 2,
+        DFTR_OPCODE_SUBTRACTION    = 3,
+        DFTR_OPCODE_MULTIPLICATION = 4,
+        DFTR_OPCODE_DIVISION       = 5,
+        DFTR_OPCODE_POWER          = 6,
+        DFTR_OPCODE_SINUS          = 7,
+        DFTR_OPCODE_COSINUS        = 8,
+    };
+
+    struct DftrInstruction {
+        uint32_t opcode;
+        uint32_t arg;
+    };
+
+    /// Postfix form of an expression tree for the stack machine.
+    struct DftrProgram {
+        DftrInstruction * code;
+        size_t size;
+        size_t capacity;
+        double * constants;
+        size_t constants_size;
+        size_t constants_capacity;
+        size_t stack_size;                           ///< Maximal depth of the value stack.
+    };
+
+    /// Value stack entry of the batch evaluator, a column of the block or one value for all of it.
+    struct DftrBatchOperand {
+        const double * column;                       ///< NULL if the operand is value.
+        double value;
+    };
+
+    const size_t DFTR_PROGRAM_DEFAULT_CAPACITY = 64;
+    const size_t DFTR_PROGRAM_LOCAL_STACK_SIZE = 128;
+    const size_t DFTR_BATCH_BLOCK_SIZE = 256;
+    const size_t DFTR_GRID_CHUNK_SIZE = 16 * DFTR_BATCH_BLOCK_SIZE;
+
+    DError_t op_new_dftr_program(DftrProgram * program);
+    DError_t op_delete_dftr_program(DftrProgram * program);
+    DError_t dftr_compile(const Tree * tree, DftrProgram * program);
+    DError_t dftr_program_eval(const DftrProgram * program, const double * variables, double * answer);
+    void dftr_program_dump(const DftrProgram * program, FILE * fp);
+    DftrOpcodes dftr_get_operation_opcode(MathOperations op_id);
+    DError_t dftr_program_eval_batch(const DftrProgram * program, const double * variables,
+                                     size_t variable_id, const double * samples,
+                                     double * answers, size_t samples_number);
+    DError_t dftr_program_eval_batch_kernels(const DftrProgram * program, const double * variables,
+                                             size_t variable_id, const double * samples,
+                                             double * answers, size_t samples_number,
+                                             const SimdKernels * kernels);
+    void dftr_program_eval_batch_columns(const DftrProgram * program, const double * variables,
+                                         size_t variable_id, const double * samples,
+                                         double * answers, size_t samples_number,
+                                         double * columns, DftrBatchOperand * operands,
+                                         const SimdKernels * kernels);
+    DError_t dftr_program_eval_grid(ThreadPool * pool, const DftrProgram * program, const double * variables,
+                                    size_t variable_id, double x_begin, double x_end,
+                                    double * answers, size_t samples_number);
+
+#endif // BYTECODE_H
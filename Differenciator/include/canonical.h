@@ -0,0 +1,24 @@
+#ifndef CANONICAL_H
+    #define CANONICAL_H
+
+    #include "differenciator.h"
+
+    /// Operand of a flattened chain: a term with its coefficient in a sum,
+    /// a base with its exponent in a product. base is NULL for the constant.
+    struct DftrCanonicalTerm {
+        TreeNode * base;
+        double number;
+    };
+
+    struct DftrCanonicalTerms {
+        DftrCanonicalTerm * terms;
+        size_t size;
+        size_t capacity;
+    };
+
+    const size_t DFTR_CANONICAL_DEFAULT_CAPACITY = 64;
+
+    DError_t dftr_canonical_optimization(Tree * tree, DftrOptimizationStats * stats);
+    int dftr_compare_branch(const TreeNode * node1, const TreeNode * node2);
+
+#endif // CANONICAL_H
@@ -0,0 +1,51 @@
+#ifndef CSE_H
+    #define CSE_H
+
+    #include <stdio.h>
+    #include <stdint.h>
+
+    #include "differenciator.h"
+    #include "dag.h"
+
+    enum DftrPrintStyles {
+        DFTR_PRINT_TEXT  = 0,
+        DFTR_PRINT_LATEX = 1,
+    };
+
+    const uint32_t DFTR_CSE_NO_TEMPORARY = 0;
+    const size_t DFTR_CSE_DEFAULT_MIN_SIZE = 3;
+
+    struct DftrPolynomial;                           // Defined in horner.h, only pointed to here.
+
+    /// Expression as a hash-consed DAG where every shared subtree of at least
+    /// min_size nodes is a let-bound temporary, numbered from 1 in evaluation order.
+    struct DftrCse {
+        Dag dag;
+        DagIndex root;
+        uint32_t * temporaries;                      ///< Per DAG node, DFTR_CSE_NO_TEMPORARY if inlined.
+        DagIndex * order;                            ///< DAG node of every temporary.
+        size_t temporaries_number;
+        bool * is_reachable;                         ///< Nodes below root, the rest of the DAG is skipped.
+        DagIndex * schedule;                         ///< Reachable nodes in evaluation order.
+        size_t schedule_size;
+        double * values;                             ///< Evaluation scratch, one per DAG node.
+        DagIndex * partners;                         ///< sin/cos node of the same argument, DAG_NULL_INDEX if none.
+        size_t min_size;
+        bool is_sincos_fused;
+        DftrPolynomial * polynomials;                ///< Per DAG node, a polynomial only on Horner roots.
+        double * coefficients;
+        size_t coefficients_size;
+        size_t coefficients_capacity;
+        bool is_horner;                              ///< Horner roots are evaluated by FMA, their branches skipped.
+    };
+
+    DError_t op_new_dftr_cse(DftrCse * cse);
+    DError_t op_delete_dftr_cse(DftrCse * cse);
+    DError_t dftr_cse_build(DftrCse * cse, const Tree * tree, size_t min_size);
+    DError_t dftr_cse_eval(DftrCse * cse, const double * variables, double * answer);
+    DError_t dftr_cse_analyze(DftrCse * cse);
+    DError_t dftr_cse_print(const DftrCse * cse, FILE * fp, const char * func, DftrPrintStyles style);
+    DError_t dftr_print(const DftrContext * context, const Tree * tree, FILE * fp, const char * func,
+                        DftrPrintStyles style);
+
+#endif // CSE_H
@@ -0,0 +1,9 @@
+#ifndef DAG_DIFF_H
+    #define DAG_DIFF_H
+
+    #include "differenciator.h"
+    #include "dag.h"
+
+    DError_t dftr_dag_diff(Dag * dag, const DagIndex root, size_t variable_id, DagIndex * d_root);
+
+#endif // DAG_DIFF_H
@@ -2,6 +2,8 @@
     #define DIFFERENCIATOR_H
 
     #include "tree.h"
+    #include "math_operations.h"
+    #include "lexer.h"
 
     typedef int DError_t;
 
@@ -10,6 +12,8 @@
         DIFFERENCIATOR_ERRORS_INVALID_SYNTAXIS       = 1 << 1,
         DIFFERENCIATOR_ERRORS_TREE_ERROR             = 1 << 2,
         DIFFERENCIATOR_ERRORS_INVALID_INPUT          = 1 << 3,
+        DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY   = 1 << 4,
+        DIFFERENCIATOR_ERRORS_ASSERT                 = 1 << 5,
     };
 
     enum DifferenciatorInput {
@@ -24,13 +28,61 @@
         double value;
     };
 
-    DError_t create_dftr_tree(Tree * tree, char * buffer);
-    void dftr_dump(Tree * tree);
+    struct DftrOptimizationStats {
+        size_t rounds;                               ///< Whole-tree passes.
+        size_t visits;                               ///< Nodes the rules were tried on.
+        size_t rewrites;                             ///< Successful rule applications.
+    };
+
+    const size_t DFTR_CONTEXT_MAX_VARIABLES = 16;
+
+    struct DftrEGraphStats;                          // Defined in egraph.h, only pointed to here.
+    struct CompactTree;                              // Defined in compact_tree.h, only pointed to here.
+
+    /// State of one library user. Nothing else in the pipeline is mutable and shared,
+    /// so threads that each own a context (and their trees) can run at the same time.
+    struct DftrContext {
+        double variables[DFTR_CONTEXT_MAX_VARIABLES]; ///< Values by variable id.
+        size_t slab_capacity;                        ///< First arena slab of the trees made by the context.
+        bool is_egraph;
+        bool is_compact;                             ///< Derivatives are built and simplified in the compact layout.
+        bool is_canonical;                           ///< Sums and products are flattened and sorted after the worklist.
+        size_t threads_number;                       ///< Batch threads, 0 for one per CPU.
+        size_t cse_min_size;                         ///< Smallest shared subtree printed as a temporary.
+        const char * dump_file_name;                 ///< Graphviz dumps prefix.
+        const char * tree_dump_file_name;            ///< Tree structure dumps prefix.
+        const char * latex_file_name;                ///< LaTeX dumps prefix.
+        size_t dumps_number;                         ///< Numbers the next graphviz dump.
+        size_t tree_dumps_number;                    ///< Numbers the next tree structure dump.
+        size_t latex_number;                         ///< Numbers the next LaTeX dump.
+    };
+
+    extern const char * const DIFFERENCIATOR_DUMP_FILE_NAME;
+    extern const char * const DIFFERENCIATOR_LATEX_DUMP_FILE_NAME;
+    extern const DifferenciatorVariable SUPPORTED_VARIABLES[];
+    extern const size_t SUPPORTED_VARIABLES_NUMBER;
+
+    DError_t create_dftr_tree(Tree * tree, const char * buffer);
+    DError_t create_dftr_tree_span(Tree * tree, const char * buffer, size_t size);
+    DError_t create_dftr_tree_tokens(Tree * tree, DftrLexer * lexer);
+    void dftr_dump(DftrContext * context, const Tree * tree);
     DError_t dftr_eval(const Tree * dftr_tree, double * answer);
+    DError_t dftr_eval_variables(const Tree * dftr_tree, const double * variables, double * answer);
     DError_t dftr_create_diff_tree(const Tree * tree, Tree * d_tree);
-    void dftr_latex(const Tree * tree, const Tree * d_tree);
+    DError_t dftr_create_partial_diff_tree(const Tree * tree, Tree * d_tree, size_t variable_id);
+    DError_t dftr_create_partial_diff_tree(const Tree * tree, CompactTree * d_ctree, size_t variable_id);
+    DError_t dftr_compact_diff(const Tree * tree, Tree * d_tree, CompactTree * d_ctree, size_t variable_id,
+                               DftrOptimizationStats * stats);
+    DError_t dftr_differentiation(const DftrContext * context, const Tree * tree, Tree * d_tree, size_t variable_id,
+                                  CompactTree * d_ctree);
+    void dftr_latex(DftrContext * context, const Tree * tree, const Tree * d_tree);
     DError_t dftr_calculate_optimization(Tree * tree, bool * is_calculated);
     DError_t dftr_replace_optimization(Tree * tree, bool * is_replaced);
-    DError_t dftr_optimization(Tree * tree);
+    DError_t dftr_optimization(const DftrContext * context, Tree * tree, DftrEGraphStats * egraph_stats);
+    DError_t dftr_worklist_optimization(Tree * tree, DftrOptimizationStats * stats);
+    DError_t dftr_worklist_optimization(CompactTree * ctree, DftrOptimizationStats * stats);
+    DError_t dftr_fixpoint_optimization(Tree * tree, DftrOptimizationStats * stats);
+    void dftr_set_operation(Tree_t * value, MathOperations op_id);
+    void dftr_set_variable(Tree_t * value, size_t variable_id);
 
 #endif
@@ -0,0 +1,92 @@
+#ifndef EGRAPH_H
+    #define EGRAPH_H
+
+    #include <stdint.h>
+
+    #include "rewrite.h"
+
+    typedef uint32_t DftrEClassId;
+
+    const DftrEClassId DFTR_ECLASS_NULL = UINT32_MAX;
+
+    /// Operation with the classes of its operands. Congruent nodes are merged
+    /// on rebuild, the later copy stays in its list marked dead.
+    struct DftrENode {
+        Tree_t value;
+        DftrEClassId left;
+        DftrEClassId right;
+        DftrEClassId eclass;                         ///< Class at creation, canonical after find.
+        uint32_t next;                               ///< Next node of the same class.
+        bool is_dead;
+    };
+
+    /// A class is identified by the node that created it, so the class arrays
+    /// are indexed like the nodes.
+    struct DftrEClass {
+        DftrEClassId parent;                         ///< Union-find.
+        uint32_t first_node;
+        uint32_t last_node;
+    };
+
+    struct DftrEMatch {
+        const DftrRule * rule;
+        DftrEClassId eclass;
+        DftrEClassId bindings[DFTR_RULE_MAX_WILDCARDS];
+    };
+
+    struct DftrEGraph {
+        DftrENode * nodes;
+        DftrEClass * classes;
+        size_t size;
+        size_t capacity;
+        uint32_t * table;                            ///< Open addressing hashcons of node indices.
+        size_t table_capacity;                       ///< Power of two.
+        DftrEMatch * matches;
+        size_t matches_number;
+        size_t matches_capacity;
+        size_t unions_number;
+    };
+
+    enum DftrEGraphStops {
+        DFTR_EGRAPH_STOP_SATURATED  = 0,             ///< No rule adds anything new.
+        DFTR_EGRAPH_STOP_NODES      = 1,
+        DFTR_EGRAPH_STOP_TIME       = 2,
+        DFTR_EGRAPH_STOP_ITERATIONS = 3,
+    };
+
+    struct DftrEGraphLimits {
+        size_t max_nodes;
+        size_t max_iterations;
+        double max_time;                             ///< Seconds.
+    };
+
+    struct DftrEGraphStats {
+        size_t iterations;
+        size_t nodes;
+        size_t classes;
+        size_t matches;
+        double cost_before;
+        double cost_after;
+        DftrEGraphStops stop;
+    };
+
+    /// Rough evaluation cost of an operation in additions.
+    struct DftrOperationCost {
+        MathOperations op_id;
+        double cost;
+    };
+
+    const double DFTR_LEAF_COST = 1;
+    const DftrEGraphLimits DFTR_EGRAPH_DEFAULT_LIMITS = {.max_nodes = 50000, .max_iterations = 12, .max_time = 0.5};
+    const size_t DFTR_EGRAPH_DEFAULT_CAPACITY = 256;
+
+    extern const DftrOperationCost DFTR_OPERATION_COSTS[];
+    extern const DftrRule DFTR_EGRAPH_RULES[];
+    extern const size_t DFTR_EGRAPH_RULES_NUMBER;
+
+    DError_t op_new_dftr_egraph(DftrEGraph * egraph);
+    DError_t op_delete_dftr_egraph(DftrEGraph * egraph);
+    double dftr_get_cost(const Tree * tree);
+    DError_t dftr_egraph_optimization(Tree * tree, const DftrEGraphLimits * limits, DftrEGraphStats * stats);
+
+#endif // EGRAPH_H
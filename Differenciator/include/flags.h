@@ -1,17 +1,37 @@
 #ifndef FLAGS_H
     #define FLAGS_H
 
+    #include <stdio.h>
+
     #include "cmd_input.h"
 
     extern CmdLineArg DIFFERENCIATOR_SOURCE_FILE;
+    extern CmdLineArg DIFFERENCIATOR_EGRAPH;
+    extern CmdLineArg DIFFERENCIATOR_MMAP;
+    extern CmdLineArg DIFFERENCIATOR_BATCH;
+    extern CmdLineArg DIFFERENCIATOR_THREADS;
+    extern CmdLineArg DIFFERENCIATOR_COMPACT;
+    extern CmdLineArg DIFFERENCIATOR_CANONICAL;
 
     extern char * SOURCE_FILE_NAME;
+    extern bool IS_EGRAPH_MODE;
+    extern bool IS_MMAP_MODE;
+    extern char * BATCH_OUTPUT_FILE_NAME;
+    extern size_t BATCH_THREADS_NUMBER;
+    extern bool IS_COMPACT_MODE;
+    extern bool IS_CANONICAL_MODE;
 
     extern char * * cmd_input;
     extern CmdLineArg * FLAGS[];
     extern size_t FLAGS_ARRAY_SIZE;
 
     void show_error_message(const char * program_name);
-    void set_differenciator_source_file_name_flag(void);
+    bool set_differenciator_source_file_name_flag(void);
+    bool set_differenciator_egraph_flag(void);
+    bool set_differenciator_mmap_flag(void);
+    bool set_differenciator_batch_flag(void);
+    bool set_differenciator_threads_flag(void);
+    bool set_differenciator_compact_flag(void);
+    bool set_differenciator_canonical_flag(void);
 
 #endif // FLAGS_H
@@ -0,0 +1,27 @@
+#ifndef HORNER_H
+    #define HORNER_H
+
+    #include "cse.h"
+
+    const size_t DFTR_HORNER_MAX_DEGREE = 64;
+    const size_t DFTR_HORNER_DEFAULT_CAPACITY = 256;
+
+    /// Polynomial in one variable, coefficients[offset + k] is the coefficient of x ^ k.
+    struct DftrPolynomial {
+        size_t variable_id;                          ///< DFTR_POLYNOMIAL_NO_VARIABLE for a constant.
+        size_t degree;                               ///< DFTR_NOT_POLYNOMIAL if the node is not one.
+        size_t offset;
+    };
+
+    const size_t DFTR_NOT_POLYNOMIAL = SIZE_MAX;
+    const size_t DFTR_POLYNOMIAL_NO_VARIABLE = SIZE_MAX;
+
+    struct DftrHornerStats {
+        size_t polynomials_number;                   ///< Horner roots in the DAG.
+        size_t max_degree;
+    };
+
+    DError_t dftr_cse_horner(DftrCse * cse, DftrHornerStats * stats);
+    double dftr_horner_eval(const double * coefficients, size_t degree, double x);
+
+#endif // HORNER_H
@@ -0,0 +1,36 @@
+#ifndef JIT_H
+    #define JIT_H
+
+    #include <stdint.h>
+
+    #include "bytecode.h"
+
+    #if defined(__x86_64__) && defined(__linux__)
+        #define DFTR_JIT_NATIVE
+    #endif
+
+    typedef double (*DftrJitFunction)(const double * variables);
+
+    /// Native code for an expression. Falls back to the stack machine when unavailable.
+    struct DftrJit {
+        DftrJitFunction function;                    ///< NULL when running on the fallback.
+        uint8_t * memory;                            ///< Executable page(s): constants, then code.
+        size_t memory_size;
+        DftrProgram program;
+    };
+
+    struct DftrJitBuffer {
+        uint8_t * data;
+        size_t size;
+        size_t capacity;
+    };
+
+    const size_t DFTR_JIT_DEFAULT_CAPACITY = 256;
+    const size_t DFTR_JIT_REGISTERS_NUMBER = 14;     ///< xmm0..xmm13 hold the value stack, xmm14/15 are scratch.
+
+    DError_t op_new_dftr_jit(DftrJit * jit);
+    DError_t op_delete_dftr_jit(DftrJit * jit);
+    DError_t dftr_jit_compile(const Tree * tree, DftrJit * jit);
+    DError_t dftr_jit_eval(const DftrJit * jit, const double * variables, double * answer);
+
+#endif // JIT_H
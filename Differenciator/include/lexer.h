@@ -0,0 +1,44 @@
+#ifndef LEXER_H
+    #define LEXER_H
+
+    #include <stddef.h>
+
+    #include "structural_index.h"
+
+    enum DftrTokenTypes {
+        DFTR_TOKEN_TYPES_END     = 0,
+        DFTR_TOKEN_TYPES_OPEN    = 1,
+        DFTR_TOKEN_TYPES_CLOSE   = 2,
+        DFTR_TOKEN_TYPES_NUMBER  = 3,
+        DFTR_TOKEN_TYPES_NAME    = 4,
+        DFTR_TOKEN_TYPES_INVALID = 5,
+    };
+
+    /// Span of the source, the buffer itself is never written.
+    struct DftrToken {
+        DftrTokenTypes type;
+        const char * begin;
+        size_t length;
+        double number;                               ///< Only for DFTR_TOKEN_TYPES_NUMBER.
+    };
+
+    /// Source text with one token of lookahead. With a structural index the
+    /// lexer jumps between token starts instead of skipping whitespace, and asks
+    /// for the next window of the index when the offsets of the current one run out.
+    struct DftrLexer {
+        const char * begin;
+        const char * ptr;
+        const char * end;
+        DftrToken token;
+        StructuralIndex * index;                     ///< NULL without a structural index.
+        size_t offset_id;                            ///< Next offset of the current window.
+    };
+
+    const size_t DFTR_LEXER_MAX_NUMBER_LENGTH = 64;
+
+    void dftr_lexer_init(DftrLexer * lexer, const char * buffer, size_t size);
+    void dftr_lexer_init_indexed(DftrLexer * lexer, const char * buffer, size_t size, StructuralIndex * index);
+    void dftr_lexer_next(DftrLexer * lexer);
+    bool dftr_parse_number(const char * begin, const char * end, double * number, const char * * number_end);
+
+#endif // LEXER_H
@@ -0,0 +1,40 @@
+#ifndef LIBDIFFERENCIATOR_H
+    #define LIBDIFFERENCIATOR_H
+
+    #include <stdio.h>
+
+    #include "differenciator.h"
+    #include "batch_mode.h"
+    #include "egraph.h"
+
+    // Every call takes the context of its caller and touches nothing else that is shared:
+    // calls on different contexts (and different trees) may run on different threads at once.
+    // Arguments are checked on entry, a NULL pointer or a destroyed tree is DIFFERENCIATOR_ERRORS_INVALID_INPUT.
+    // In the library build a failed internal MY_ASSERT does not end the process, the call returns
+    // DIFFERENCIATOR_ERRORS_ASSERT, batch workers included. The assert marks a bug, not a recovery:
+    // the code it guards still runs, so the results and the trees of that call are not to be trusted.
+    // With is_compact set, dftr_context_diff also applies the local simplifications before the
+    // derivative leaves the compact layout, dftr_context_optimize then starts from a smaller tree.
+    // Batch runs take every option of the context, each record goes through the same steps.
+
+    #define dftr_context_tree_dump(context, tree) \
+        dftr_context_tree_dump_iternal((context), (tree), #tree, __func__, __LINE__, __FILE__)
+
+    DError_t op_new_dftr_context(DftrContext * context);
+    DError_t op_delete_dftr_context(DftrContext * context);
+    DError_t dftr_context_set_variable(DftrContext * context, const char * name, double value);
+    DError_t dftr_context_new_tree(const DftrContext * context, Tree * tree);
+    DError_t dftr_context_parse(DftrContext * context, Tree * tree, const char * text, size_t size);
+    DError_t dftr_context_eval(DftrContext * context, const Tree * tree, double * answer);
+    DError_t dftr_context_diff(DftrContext * context, const Tree * tree, Tree * d_tree, size_t variable_id);
+    DError_t dftr_context_optimize(DftrContext * context, Tree * tree, DftrEGraphStats * egraph_stats);
+    DError_t dftr_context_print(DftrContext * context, const Tree * tree, FILE * fp, const char * func);
+    DError_t dftr_context_dump(DftrContext * context, const Tree * tree);
+    DError_t dftr_context_tree_dump_iternal(DftrContext * context, const Tree * tree,
+                                            const char * tree_name, const char * func,
+                                            const int line, const char * file);
+    DError_t dftr_context_latex(DftrContext * context, const Tree * tree, const Tree * d_tree);
+    DError_t dftr_context_batch(DftrContext * context, const char * text, size_t size, FILE * fp,
+                                DftrBatchStats * stats);
+
+#endif // LIBDIFFERENCIATOR_H
@@ -23,8 +23,10 @@
         double (*operation)(const double, const double);
     };
 
-    extern MathOperation MATH_OPERATIONS_ARRAY[];
-    extern size_t MATH_OPERATIONS_ARRAY_SIZE;
+    extern const MathOperation MATH_OPERATIONS_ARRAY[];
+    extern const size_t MATH_OPERATIONS_ARRAY_SIZE;
+
+    size_t get_math_operation_index(MathOperations op_id);
 
     double math_op_addition       (const double val1, const double val2);
     double math_op_subtraction    (const double val1, const double val2);
@@ -0,0 +1,70 @@
+#ifndef REWRITE_H
+    #define REWRITE_H
+
+    #include <stdint.h>
+
+    #include "differenciator.h"
+
+    enum DftrPatternTypes {
+        DFTR_PATTERN_NONE       = 0,
+        DFTR_PATTERN_OPERATION  = 1,
+        DFTR_PATTERN_NUMBER     = 2,
+        DFTR_PATTERN_ANY        = 3,                 ///< Wildcard, matches any subtree.
+        DFTR_PATTERN_ANY_NUMBER = 4,                 ///< Wildcard, matches a number leaf.
+        DFTR_PATTERN_FOLD       = 5,                 ///< Replacement only, the value of the matched operation.
+    };
+
+    struct DftrPatternNode {
+        DftrPatternTypes type;
+        MathOperations op_id;
+        double number;
+        size_t wildcard;                             ///< Binding slot of ANY and ANY_NUMBER.
+    };
+
+    const size_t DFTR_RULE_MAX_SIZE = 8;
+    const size_t DFTR_RULE_MAX_WILDCARDS = 4;
+
+    /// pattern -> replacement, both in prefix order, the operation arity gives
+    /// the number of children. A pattern must start with an operation. The rewrite
+    /// engine wants each wildcard once in a pattern, the e-graph also takes repeats,
+    /// which then have to bind the same class. A replacement may repeat any wildcard.
+    struct DftrRule {
+        const char * name;
+        DftrPatternNode pattern[DFTR_RULE_MAX_SIZE];
+        DftrPatternNode replacement[DFTR_RULE_MAX_SIZE];
+    };
+
+    const size_t DFTR_RULE_INDEX_NULL = SIZE_MAX;
+
+    /// Discrimination tree node. Edges are pattern symbols in prefix order,
+    /// the children of a node are kept as a sibling list.
+    struct DftrRuleIndexNode {
+        DftrPatternNode symbol;
+        size_t first_child;
+        size_t next_sibling;
+        size_t first_rule;                           ///< Rule whose pattern ends here.
+        size_t min_rule;                             ///< Lowest rule below, to cut the search.
+    };
+
+    /// Rules are tried by priority: the lowest matching index wins.
+    struct DftrRuleSet {
+        const DftrRule * rules;
+        size_t rules_number;
+        DftrRuleIndexNode * index;
+        size_t index_size;
+        size_t index_capacity;
+        bool is_indexed;                             ///< false to scan the rules linearly.
+        size_t lookups_number;
+        size_t checks_number;                        ///< Index edges or rules compared.
+    };
+
+    const size_t DFTR_RULE_INDEX_DEFAULT_CAPACITY = 64;
+
+    extern const DftrRule DFTR_DEFAULT_RULES[];
+    extern const size_t DFTR_DEFAULT_RULES_NUMBER;
+
+    DError_t op_new_dftr_rule_set(DftrRuleSet * set, const DftrRule * rules, size_t rules_number);
+    DError_t op_delete_dftr_rule_set(DftrRuleSet * set);
+    DError_t dftr_rewrite_optimization(Tree * tree, DftrRuleSet * set, DftrOptimizationStats * stats);
+
+#endif // REWRITE_H
@@ -0,0 +1,16 @@
+#ifndef STRENGTH_H
+    #define STRENGTH_H
+
+    #include "cse.h"
+
+    const uint32_t DFTR_STRENGTH_MAX_POWER = 16;
+
+    struct DftrStrengthStats {
+        size_t powers_number;                        ///< u ^ n turned into a multiplication chain.
+        size_t divisions_number;                     ///< u / c turned into u * (1 / c).
+        size_t sincos_number;                        ///< sin(u) and cos(u) pairs evaluated by one sincos().
+    };
+
+    DError_t dftr_cse_reduce_strength(DftrCse * cse, DftrStrengthStats * stats);
+
+#endif // STRENGTH_H
@@ -0,0 +1,171 @@
+#include <stdlib.h>
+
+#include "arena.h"
+#include "my_assert.h"
+
+static ArenaSlab * arena_create_slab(Arena * arena);
+static char * arena_slab_data(ArenaSlab * slab);
+
+
+AError_t op_new_arena(Arena * arena, const size_t elem_size, const size_t slab_capacity)
+{
+    MY_ASSERT(arena);
+
+    AError_t errors = 0;
+
+    if (elem_size == 0)
+    {
+        errors |= ARENA_ERRORS_INVALID_ELEM_SIZE;
+        return errors;
+    }
+
+    size_t aligned_size = elem_size < sizeof(ArenaFreeElem) ? sizeof(ArenaFreeElem) : elem_size;
+    aligned_size = (aligned_size + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+
+    arena->slabs = NULL;
+    arena->current = NULL;
+    arena->free_list = NULL;
+    arena->elem_size = aligned_size;
+    arena->slab_capacity = slab_capacity ? slab_capacity : ARENA_DEFAULT_SLAB_CAPACITY;
+    arena->slabs_count = 0;
+    arena->live_count = 0;
+
+    return errors;
+}
+
+
+AError_t op_delete_arena(Arena * arena)
+{
+    MY_ASSERT(arena);
+
+    AError_t errors = 0;
+
+    if (arena->elem_size == 0)
+    {
+        errors |= ARENA_ERRORS_ALREADY_DESTRUCTED;
+        return errors;
+    }
+
+    ArenaSlab * slab = arena->slabs;
+    while (slab)
+    {
+        ArenaSlab * next_slab = slab->next;
+        free(slab);
+        slab = next_slab;
+    }
+
+    arena->slabs = NULL;
+    arena->current = NULL;
+    arena->free_list = NULL;
+    arena->elem_size = 0;
+    arena->live_count = 0;
+
+    return errors;
+}
+
+
+static char * arena_slab_data(ArenaSlab * slab)
+{
+    MY_ASSERT(slab);
+
+    return (char *) (slab + 1);
+}
+
+
+static ArenaSlab * arena_create_slab(Arena * arena)
+{
+    MY_ASSERT(arena);
+
+    ArenaSlab * slab = NULL;
+
+    if (!(slab = (ArenaSlab *) malloc(sizeof(ArenaSlab) + arena->slab_capacity * arena->elem_size)))
+    {
+        return NULL;
+    }
+
+    slab->next = NULL;
+    slab->capacity = arena->slab_capacity;
+    slab->used = 0;
+    slab->reserved = 0;
+
+    if (arena->current)
+        arena->current->next = slab;
+    else
+        arena->slabs = slab;
+
+    arena->slabs_count++;
+
+    if (arena->slab_capacity < ARENA_MAX_SLAB_CAPACITY)
+        arena->slab_capacity *= 2;
+
+    return slab;
+}
+
+
+void * arena_alloc(Arena * arena)
+{
+    MY_ASSERT(arena);
+    MY_ASSERT(arena->elem_size);
+
+    if (arena->free_list)
+    {
+        ArenaFreeElem * elem = arena->free_list;
+        arena->free_list = elem->next;
+        arena->live_count++;
+
+        return elem;
+    }
+
+    if (!arena->current || arena->current->used == arena->current->capacity)
+    {
+        if (arena->current && arena->current->next)
+        {
+            arena->current = arena->current->next;
+            arena->current->used = 0;
+        }
+        else
+        {
+            ArenaSlab * slab = NULL;
+
+            if (!(slab = arena_create_slab(arena)))
+            {
+                return NULL;
+            }
+
+            arena->current = slab;
+        }
+    }
+
+    void * elem = arena_slab_data(arena->current) + arena->current->used * arena->elem_size;
+    arena->current->used++;
+    arena->live_count++;
+
+    return elem;
+}
+
+
+void arena_free(Arena * arena, void * elem)
+{
+    MY_ASSERT(arena);
+    MY_ASSERT(elem);
+    MY_ASSERT(arena->live_count);
+
+    ArenaFreeElem * free_elem = (ArenaFreeElem *) elem;
+    free_elem->next = arena->free_list;
+    arena->free_list = free_elem;
+
+    arena->live_count--;
+}
+
+
+void arena_reset(Arena * arena)
+{
+    MY_ASSERT(arena);
+
+    arena->free_list = NULL;
+    arena->live_count = 0;
+    arena->current = arena->slabs;
+
+    if (arena->current)
+        arena->current->used = 0;
+}
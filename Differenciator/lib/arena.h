@@ -0,0 +1,44 @@
+#ifndef ARENA_H
+    #define ARENA_H
+
+    #include <stdio.h>
+
+    typedef int AError_t;
+
+    enum ArenaErrorsMasks {
+        ARENA_ERRORS_CANT_ALLOCATE_MEMORY = 1 << 0,
+        ARENA_ERRORS_INVALID_ELEM_SIZE    = 1 << 1,
+        ARENA_ERRORS_ALREADY_DESTRUCTED   = 1 << 2,
+    };
+
+    struct ArenaSlab {
+        ArenaSlab * next;
+        size_t capacity;                             ///< Number of elements in slab.
+        size_t used;                                 ///< Number of bumped elements.
+        size_t reserved;                             ///< Keeps slab data aligned.
+    };
+
+    struct ArenaFreeElem {
+        ArenaFreeElem * next;
+    };
+
+    struct Arena {
+        ArenaSlab * slabs;                           ///< First slab of the list.
+        ArenaSlab * current;                         ///< Slab the pointer is bumped in.
+        ArenaFreeElem * free_list;                   ///< Released elements.
+        size_t elem_size;
+        size_t slab_capacity;                        ///< Capacity of the next new slab.
+        size_t slabs_count;                          ///< Number of system allocations.
+        size_t live_count;                           ///< Number of elements in use.
+    };
+
+    const size_t ARENA_DEFAULT_SLAB_CAPACITY = 64;
+    const size_t ARENA_MAX_SLAB_CAPACITY = 1 << 16;
+
+    AError_t op_new_arena(Arena * arena, const size_t elem_size, const size_t slab_capacity);
+    AError_t op_delete_arena(Arena * arena);
+    void * arena_alloc(Arena * arena);
+    void arena_free(Arena * arena, void * elem);
+    void arena_reset(Arena * arena);
+
+#endif // ARENA_H
@@ -23,9 +23,13 @@ bool check_cmd_input(int argc, char * * argv)
                 {
                     FLAGS[i]->argc_number = j;
 
-                    FLAGS[i]->flag_function();
+                    if (!FLAGS[i]->flag_function())
+                    {
+                        printf("Error. Please, use %s %s\n", program_name, FLAGS[i]->help);
+                        return false;
+                    }
 
-                    FLAGS[i]->is_mandatory = true;
+                    FLAGS[i]->is_given = true;
                 }
                 else
                 {
@@ -38,7 +42,7 @@ bool check_cmd_input(int argc, char * * argv)
 
     for (size_t i = 0; i < FLAGS_ARRAY_SIZE; i++)
     {
-        if (!FLAGS[i]->is_mandatory)
+        if (!FLAGS[i]->is_optional && !FLAGS[i]->is_given)
         {
             show_error_message(program_name);
             return false;
@@ -4,10 +4,11 @@
     struct CmdLineArg {
         const char * name;                           ///< Name of flag.
         int num_of_param;                            ///< Number of flag parameters.
-        void (*flag_function)(void);                 ///< Function of flag.
+        bool (*flag_function)(void);                 ///< Function of flag, false if its parameters are wrong.
         int argc_number;                             ///< Serial number of flag in cmd line.
         const char * help;                           ///< How to use this flag.
-        bool is_mandatory;
+        bool is_optional;                            ///< The program runs without it.
+        bool is_given;                               ///< Set by check_cmd_input().
     };
 
     bool check_cmd_input(int argc, char * * argv);
@@ -0,0 +1,619 @@
+#include <stdlib.h>
+
+#include "compact_tree.h"
+#include "my_assert.h"
+
+/// Nodes of a branch walk still to be visited, popped in pre-order.
+struct CTreeIndexStack {
+    CTreeIndex * nodes;
+    size_t size;
+    size_t capacity;
+};
+
+static TError_t ctree_reserve(CompactTree * ctree, const size_t capacity);
+static TError_t ctree_create_node(CompactTree * ctree, const CTreeIndex parent_node, CTreeIndex * node_ptr);
+static size_t ctree_free(CompactTree * ctree, const CTreeIndex node);
+static TError_t ctree_stack_push(CTreeIndexStack * stack, const CTreeIndex node);
+
+
+TError_t op_new_compact_tree(CompactTree * ctree, const Tree_t root_value, const bool with_parents)
+{
+    MY_ASSERT(ctree);
+
+    TError_t errors = 0;
+
+    if (!ctree_vtor(ctree))
+    {
+        errors |= TREE_ERRORS_ALREADY_CONSTRUCTED;
+        return errors;
+    }
+
+    ctree->types = NULL;
+    ctree->ids = NULL;
+    ctree->values = NULL;
+    ctree->lefts = NULL;
+    ctree->rights = NULL;
+    ctree->parents = NULL;
+    ctree->root = CTREE_NULL_INDEX;
+    ctree->free_list = CTREE_NULL_INDEX;
+    ctree->size = 0;
+    ctree->used = 0;
+    ctree->capacity = 0;
+    ctree->with_parents = with_parents;
+
+    if (errors = ctree_reserve(ctree, CTREE_DEFAULT_CAPACITY))
+    {
+        // The arrays reserved before the failed one are already owned by ctree.
+        free(ctree->types);
+        free(ctree->ids);
+        free(ctree->values);
+        free(ctree->lefts);
+        free(ctree->rights);
+        free(ctree->parents);
+        ctree->types = NULL;
+        ctree->ids = NULL;
+        ctree->values = NULL;
+        ctree->lefts = NULL;
+        ctree->rights = NULL;
+        ctree->parents = NULL;
+        ctree->capacity = 0;
+
+        return errors;
+    }
+
+    if (errors = ctree_create_node(ctree, CTREE_NULL_INDEX, &ctree->root))
+    {
+        op_delete_compact_tree(ctree);
+        return errors;
+    }
+
+    ctree_set_value(ctree, ctree->root, root_value);
+
+    return errors;
+}
+
+
+TError_t op_delete_compact_tree(CompactTree * ctree)
+{
+    MY_ASSERT(ctree);
+
+    TError_t errors = 0;
+
+    if (!ctree->types)
+    {
+        errors |= TREE_ERRORS_ALREADY_DESTRUCTED;
+        return errors;
+    }
+
+    free(ctree->types);
+    free(ctree->ids);
+    free(ctree->values);
+    free(ctree->lefts);
+    free(ctree->rights);
+    free(ctree->parents);
+
+    ctree->types = NULL;
+    ctree->ids = NULL;
+    ctree->values = NULL;
+    ctree->lefts = NULL;
+    ctree->rights = NULL;
+    ctree->parents = NULL;
+    ctree->root = CTREE_NULL_INDEX;
+    ctree->free_list = CTREE_NULL_INDEX;
+    ctree->size = 0;
+    ctree->used = 0;
+    ctree->capacity = 0;
+
+    return errors;
+}
+
+
+/// Drops every node but keeps the arrays, like tree_clear().
+TError_t ctree_clear(CompactTree * ctree, const Tree_t root_value)
+{
+    MY_ASSERT(ctree);
+
+    TError_t errors = 0;
+
+    if (!ctree->types)
+    {
+        errors |= TREE_ERRORS_ALREADY_DESTRUCTED;
+        return errors;
+    }
+
+    ctree->root = CTREE_NULL_INDEX;
+    ctree->free_list = CTREE_NULL_INDEX;
+    ctree->size = 0;
+    ctree->used = 0;
+
+    if (errors = ctree_create_node(ctree, CTREE_NULL_INDEX, &ctree->root))
+    {
+        return errors;
+    }
+
+    ctree_set_value(ctree, ctree->root, root_value);
+
+    return errors;
+}
+
+
+TError_t ctree_vtor(const CompactTree * ctree)
+{
+    MY_ASSERT(ctree);
+
+    TError_t errors = 0;
+
+    if (ctree->size == 0 || ctree->size > ctree->capacity)
+        errors |= TREE_ERRORS_INVALID_SIZE;
+
+    if (!ctree->types || ctree->root >= ctree->used)
+        errors |= TREE_ERRORS_INVALID_ROOT;
+
+    return errors;
+}
+
+
+static TError_t ctree_reserve(CompactTree * ctree, const size_t capacity)
+{
+    MY_ASSERT(ctree);
+
+    TError_t errors = 0;
+
+    if (capacity <= ctree->capacity)
+        return errors;
+
+    if (capacity >= CTREE_NULL_INDEX)
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+
+    uint8_t * types = NULL;
+    uint8_t * ids = NULL;
+    TreeNodeValueUnion * values = NULL;
+    CTreeIndex * lefts = NULL;
+    CTreeIndex * rights = NULL;
+
+    if (!(types = (uint8_t *) realloc(ctree->types, capacity * sizeof(uint8_t))))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+    ctree->types = types;
+
+    if (!(ids = (uint8_t *) realloc(ctree->ids, capacity * sizeof(uint8_t))))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+    ctree->ids = ids;
+
+    if (!(values = (TreeNodeValueUnion *) realloc(ctree->values, capacity * sizeof(TreeNodeValueUnion))))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+    ctree->values = values;
+
+    if (!(lefts = (CTreeIndex *) realloc(ctree->lefts, capacity * sizeof(CTreeIndex))))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+    ctree->lefts = lefts;
+
+    if (!(rights = (CTreeIndex *) realloc(ctree->rights, capacity * sizeof(CTreeIndex))))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+    ctree->rights = rights;
+
+    if (ctree->with_parents)
+    {
+        CTreeIndex * parents = NULL;
+
+        if (!(parents = (CTreeIndex *) realloc(ctree->parents, capacity * sizeof(CTreeIndex))))
+        {
+            errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+            return errors;
+        }
+        ctree->parents = parents;
+    }
+
+    ctree->capacity = capacity;
+
+    return errors;
+}
+
+
+static TError_t ctree_create_node(CompactTree * ctree, const CTreeIndex parent_node, CTreeIndex * node_ptr)
+{
+    MY_ASSERT(ctree);
+    MY_ASSERT(node_ptr);
+    MY_ASSERT(*node_ptr == CTREE_NULL_INDEX);
+
+    TError_t errors = 0;
+    CTreeIndex node = CTREE_NULL_INDEX;
+
+    if (ctree->free_list != CTREE_NULL_INDEX)
+    {
+        node = ctree->free_list;
+        ctree->free_list = ctree->lefts[node];
+    }
+    else
+    {
+        if (ctree->used == ctree->capacity && (errors = ctree_reserve(ctree, ctree->capacity * 2)))
+        {
+            return errors;
+        }
+
+        node = (CTreeIndex) ctree->used++;
+    }
+
+    ctree->types[node] = TREE_NODE_TYPES_NO_TYPE;
+    ctree->ids[node] = 0;
+    ctree->values[node] = TREE_NULL.value;
+    ctree->lefts[node] = CTREE_NULL_INDEX;
+    ctree->rights[node] = CTREE_NULL_INDEX;
+    if (ctree->parents)
+        ctree->parents[node] = parent_node;
+
+    ctree->size++;
+    *node_ptr = node;
+
+    return errors;
+}
+
+
+TError_t tree_insert(CompactTree * ctree, const CTreeIndex node, TreeNodeBranches mode, const Tree_t value)
+{
+    MY_ASSERT(ctree);
+    MY_ASSERT(node != CTREE_NULL_INDEX);
+
+    TError_t errors = 0;
+
+    if (errors = ctree_vtor(ctree))
+    {
+        return errors;
+    }
+
+    CTreeIndex new_node = CTREE_NULL_INDEX;
+
+    switch (mode)
+    {
+        case TREE_NODE_BRANCH_LEFT:
+            if (ctree->lefts[node] != CTREE_NULL_INDEX)
+            {
+                errors |= TREE_ERRORS_INVALID_NODE;
+                return errors;
+            }
+
+            if (errors = ctree_create_node(ctree, node, &new_node))
+                return errors;
+
+            ctree->lefts[node] = new_node;
+
+            break;
+
+        case TREE_NODE_BRANCH_RIGHT:
+            if (ctree->rights[node] != CTREE_NULL_INDEX)
+            {
+                errors |= TREE_ERRORS_INVALID_NODE;
+                return errors;
+            }
+
+            if (errors = ctree_create_node(ctree, node, &new_node))
+                return errors;
+
+            ctree->rights[node] = new_node;
+
+            break;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    ctree_set_value(ctree, new_node, value);
+
+    return errors;
+}
+
+
+/// Rotates every left branch up to the top before releasing a node, so the walk needs
+/// neither a stack nor parent links. The branch is destroyed anyway, its shape may change.
+static size_t ctree_free(CompactTree * ctree, const CTreeIndex node)
+{
+    MY_ASSERT(ctree);
+    MY_ASSERT(node != CTREE_NULL_INDEX);
+
+    size_t count = 0;
+    CTreeIndex top = node;
+
+    while (top != CTREE_NULL_INDEX)
+    {
+        CTreeIndex left = ctree->lefts[top];
+
+        if (left != CTREE_NULL_INDEX)
+        {
+            ctree->lefts[top] = ctree->rights[left];
+            ctree->rights[left] = top;
+            top = left;
+            continue;
+        }
+
+        CTreeIndex right = ctree->rights[top];
+
+        ctree->types[top] = TREE_NODE_TYPES_NO_TYPE;
+        ctree->rights[top] = CTREE_NULL_INDEX;
+        ctree->lefts[top] = ctree->free_list;
+        ctree->free_list = top;
+        count++;
+
+        top = right;
+    }
+
+    return count;
+}
+
+
+TError_t tree_delete_branch(CompactTree * ctree, CTreeIndex * node_slot)
+{
+    MY_ASSERT(ctree);
+    MY_ASSERT(node_slot);
+    MY_ASSERT(*node_slot != CTREE_NULL_INDEX);
+
+    TError_t errors = 0;
+
+    if (errors = ctree_vtor(ctree))
+    {
+        return errors;
+    }
+
+    size_t deleting_nodes_count = ctree_free(ctree, *node_slot);
+    *node_slot = CTREE_NULL_INDEX;
+
+    if (ctree->size < deleting_nodes_count)
+    {
+        errors |= TREE_ERRORS_INVALID_SIZE;
+        return errors;
+    }
+
+    ctree->size -= deleting_nodes_count;
+
+    return errors;
+}
+
+
+/// src_node is walked in pre-order and the stack gives the node of the copy for every one met.
+TError_t tree_copy_branch(CompactTree * dst_ctree, const CTreeIndex dst_node, const TreeNode * src_node)
+{
+    MY_ASSERT(dst_ctree);
+    MY_ASSERT(dst_node != CTREE_NULL_INDEX);
+    MY_ASSERT(src_node);
+
+    TError_t errors = 0;
+
+    // Most copied operands are single leaves, they need no stack.
+    if (!src_node->left && !src_node->right)
+    {
+        ctree_set_value(dst_ctree, dst_node, src_node->value);
+        return errors;
+    }
+
+    CTreeIndexStack stack = {};
+
+    errors |= ctree_stack_push(&stack, dst_node);
+
+    for (const TreeNode * node = src_node; node && !errors; node = tree_preorder_next(node, src_node))
+    {
+        CTreeIndex index = stack.nodes[--stack.size];
+
+        ctree_set_value(dst_ctree, index, node->value);
+
+        if (node->right && !(errors |= tree_insert(dst_ctree, index, TREE_NODE_BRANCH_RIGHT, TREE_NULL)))
+            errors |= ctree_stack_push(&stack, dst_ctree->rights[index]);
+
+        if (node->left && !(errors |= tree_insert(dst_ctree, index, TREE_NODE_BRANCH_LEFT, TREE_NULL)))
+            errors |= ctree_stack_push(&stack, dst_ctree->lefts[index]);
+    }
+
+    free(stack.nodes);
+
+    return errors;
+}
+
+
+/// The glued branch takes the place of node in its parent, so the tree needs parent links.
+TError_t tree_glue_node(CompactTree * ctree, const CTreeIndex node, const TreeNodeBranches glue_branch)
+{
+    MY_ASSERT(ctree);
+    MY_ASSERT(ctree->parents);
+    MY_ASSERT(node != CTREE_NULL_INDEX);
+
+    TError_t errors = 0;
+
+    CTreeIndex glue_node = CTREE_NULL_INDEX;
+    CTreeIndex deleting_node = CTREE_NULL_INDEX;
+
+    switch (glue_branch)
+    {
+        case TREE_NODE_BRANCH_LEFT:
+            glue_node = ctree->lefts[node];
+            deleting_node = ctree->rights[node];
+            break;
+
+        case TREE_NODE_BRANCH_RIGHT:
+            glue_node = ctree->rights[node];
+            deleting_node = ctree->lefts[node];
+            break;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    if (glue_node == CTREE_NULL_INDEX)
+    {
+        errors |= TREE_ERRORS_INVALID_NODE;
+        return errors;
+    }
+
+    if (deleting_node != CTREE_NULL_INDEX)
+        ctree->size -= ctree_free(ctree, deleting_node);
+
+    CTreeIndex parent_node = ctree->parents[node];
+
+    if (parent_node == CTREE_NULL_INDEX)
+        ctree->root = glue_node;
+    else if (ctree->lefts[parent_node] == node)
+        ctree->lefts[parent_node] = glue_node;
+    else
+        ctree->rights[parent_node] = glue_node;
+
+    ctree->parents[glue_node] = parent_node;
+
+    ctree->lefts[node] = CTREE_NULL_INDEX;
+    ctree->rights[node] = CTREE_NULL_INDEX;
+    ctree->size -= ctree_free(ctree, node);
+
+    return errors;
+}
+
+
+Tree_t ctree_get_value(const CompactTree * ctree, const CTreeIndex node)
+{
+    MY_ASSERT(ctree);
+    MY_ASSERT(node < ctree->capacity);
+
+    Tree_t value = {
+        .value = ctree->values[node],
+        .type = (TreeNodeTypes) ctree->types[node],
+        .id = ctree->ids[node],
+    };
+
+    return value;
+}
+
+
+void ctree_set_value(CompactTree * ctree, const CTreeIndex node, const Tree_t value)
+{
+    MY_ASSERT(ctree);
+    MY_ASSERT(node < ctree->capacity);
+
+    MY_ASSERT(value.id >= 0 && (size_t) value.id <= CTREE_MAX_ID);
+
+    ctree->values[node] = value.value;
+    ctree->types[node] = (uint8_t) value.type;
+    ctree->ids[node] = (uint8_t) value.id;
+}
+
+
+TError_t ctree_from_tree(CompactTree * ctree, const Tree * tree, const bool with_parents)
+{
+    MY_ASSERT(ctree);
+    MY_ASSERT(tree);
+
+    TError_t errors = 0;
+
+    if (errors = tree_vtor(tree))
+    {
+        return errors;
+    }
+
+    if (errors = op_new_compact_tree(ctree, TREE_NULL, with_parents))
+    {
+        return errors;
+    }
+
+    if (!(errors |= ctree_reserve(ctree, tree->size)))
+        errors |= tree_copy_branch(ctree, ctree->root, tree->root);
+
+    if (errors)
+        op_delete_compact_tree(ctree);
+
+    return errors;
+}
+
+
+/// tree must be constructed and hold only its root, ctree is copied below it.
+TError_t ctree_to_tree(Tree * tree, const CompactTree * ctree)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(ctree);
+
+    TError_t errors = 0;
+
+    if ((errors = ctree_vtor(ctree)) || (errors = tree_vtor(tree)))
+    {
+        return errors;
+    }
+
+    if (tree->root->left || tree->root->right)
+    {
+        errors |= TREE_ERRORS_INVALID_NODE;
+        return errors;
+    }
+
+    // The copy is walked in pre-order as it grows and the stack gives the compact node of every one met.
+    CTreeIndexStack stack = {};
+    const TreeNode * root = tree->root;
+
+    errors |= ctree_stack_push(&stack, ctree->root);
+
+    for (TreeNode * node = tree->root; node && !errors; node = tree_preorder_next(node, root))
+    {
+        CTreeIndex index = stack.nodes[--stack.size];
+
+        node->value = ctree_get_value(ctree, index);
+
+        if (ctree->rights[index] != CTREE_NULL_INDEX &&
+            !(errors |= tree_insert(tree, node, TREE_NODE_BRANCH_RIGHT, TREE_NULL)))
+            errors |= ctree_stack_push(&stack, ctree->rights[index]);
+
+        if (ctree->lefts[index] != CTREE_NULL_INDEX &&
+            !(errors |= tree_insert(tree, node, TREE_NODE_BRANCH_LEFT, TREE_NULL)))
+            errors |= ctree_stack_push(&stack, ctree->lefts[index]);
+    }
+
+    free(stack.nodes);
+
+    return errors;
+}
+
+
+static TError_t ctree_stack_push(CTreeIndexStack * stack, const CTreeIndex node)
+{
+    MY_ASSERT(stack);
+
+    TError_t errors = 0;
+
+    if (stack->size == stack->capacity)
+    {
+        size_t capacity = stack->capacity ? 2 * stack->capacity : CTREE_DEFAULT_CAPACITY;
+        CTreeIndex * nodes = NULL;
+
+        if (!(nodes = (CTreeIndex *) realloc(stack->nodes, capacity * sizeof(CTreeIndex))))
+        {
+            errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+            return errors;
+        }
+
+        stack->nodes = nodes;
+        stack->capacity = capacity;
+    }
+
+    stack->nodes[stack->size++] = node;
+
+    return errors;
+}
+
+
+size_t ctree_node_size(const CompactTree * ctree)
+{
+    MY_ASSERT(ctree);
+
+    return 2 * sizeof(uint8_t) + sizeof(TreeNodeValueUnion) + 2 * sizeof(CTreeIndex) +
+           (ctree->with_parents ? sizeof(CTreeIndex) : 0);
+}
@@ -0,0 +1,47 @@
+#ifndef COMPACT_TREE_H
+    #define COMPACT_TREE_H
+
+    #include <stdint.h>
+
+    #include "tree.h"
+
+    typedef uint32_t CTreeIndex;
+
+    const CTreeIndex CTREE_NULL_INDEX = UINT32_MAX;
+    const size_t CTREE_DEFAULT_CAPACITY = 64;
+
+    const size_t CTREE_MAX_ID = UINT8_MAX;
+
+    /// Structure-of-arrays tree: 18 bytes per node (22 with parent links)
+    /// instead of the 40 bytes of TreeNode. It is changed through overloads of the
+    /// Tree functions, so code written against them runs on either layout.
+    struct CompactTree {
+        uint8_t * types;                             ///< TreeNodeTypes of the nodes.
+        uint8_t * ids;                               ///< Operation and variable table indices.
+        TreeNodeValueUnion * values;
+        CTreeIndex * lefts;
+        CTreeIndex * rights;
+        CTreeIndex * parents;                        ///< NULL if parent links are off.
+        CTreeIndex root;
+        CTreeIndex free_list;                        ///< Released nodes chained by lefts.
+        size_t size;
+        size_t used;                                 ///< Number of ever allocated slots.
+        size_t capacity;
+        bool with_parents;
+    };
+
+    TError_t op_new_compact_tree(CompactTree * ctree, const Tree_t root_value, const bool with_parents);
+    TError_t op_delete_compact_tree(CompactTree * ctree);
+    TError_t ctree_clear(CompactTree * ctree, const Tree_t root_value);
+    TError_t ctree_vtor(const CompactTree * ctree);
+    TError_t tree_insert(CompactTree * ctree, const CTreeIndex node, TreeNodeBranches mode, const Tree_t value);
+    TError_t tree_delete_branch(CompactTree * ctree, CTreeIndex * node_slot);
+    TError_t tree_copy_branch(CompactTree * dst_ctree, const CTreeIndex dst_node, const TreeNode * src_node);
+    TError_t tree_glue_node(CompactTree * ctree, const CTreeIndex node, const TreeNodeBranches glue_branch);
+    Tree_t ctree_get_value(const CompactTree * ctree, const CTreeIndex node);
+    void ctree_set_value(CompactTree * ctree, const CTreeIndex node, const Tree_t value);
+    TError_t ctree_from_tree(CompactTree * ctree, const Tree * tree, const bool with_parents);
+    TError_t ctree_to_tree(Tree * tree, const CompactTree * ctree);
+    size_t ctree_node_size(const CompactTree * ctree);
+
+#endif // COMPACT_TREE_H
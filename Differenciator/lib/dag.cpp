@@ -0,0 +1,446 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dag.h"
+#include "my_assert.h"
+
+static TError_t dag_reserve(Dag * dag);
+static TError_t dag_rehash(Dag * dag, const size_t table_capacity);
+static uint64_t dag_hash(const Tree_t * value, const DagIndex left, const DagIndex right);
+static bool dag_is_equal(const DagNode * node, const Tree_t * value, const DagIndex left, const DagIndex right);
+static TError_t dag_stack_push(DagIndex * * stack, size_t * size, size_t * capacity, const DagIndex index);
+
+
+TError_t op_new_dag(Dag * dag)
+{
+    MY_ASSERT(dag);
+
+    TError_t errors = 0;
+
+    dag->nodes = NULL;
+    dag->size = 0;
+    dag->capacity = 0;
+    dag->table = NULL;
+    dag->table_capacity = 0;
+    dag->lookups_number = 0;
+    dag->hits_number = 0;
+
+    if (!(dag->nodes = (DagNode *) calloc(DAG_DEFAULT_CAPACITY, sizeof(DagNode))))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+    dag->capacity = DAG_DEFAULT_CAPACITY;
+
+    return dag_rehash(dag, 2 * DAG_DEFAULT_CAPACITY);
+}
+
+
+TError_t op_delete_dag(Dag * dag)
+{
+    MY_ASSERT(dag);
+
+    TError_t errors = 0;
+
+    if (!dag->nodes)
+    {
+        errors |= TREE_ERRORS_ALREADY_DESTRUCTED;
+        return errors;
+    }
+
+    free(dag->nodes);
+    free(dag->table);
+
+    dag->nodes = NULL;
+    dag->size = 0;
+    dag->capacity = 0;
+    dag->table = NULL;
+    dag->table_capacity = 0;
+
+    return errors;
+}
+
+
+/// Forgets all nodes but keeps the memory for the next expression.
+void dag_clear(Dag * dag)
+{
+    MY_ASSERT(dag);
+
+    dag->size = 0;
+    dag->lookups_number = 0;
+    dag->hits_number = 0;
+
+    memset(dag->table, 0xFF, dag->table_capacity * sizeof(DagIndex));
+}
+
+
+/// Returns the existing node equal to (value, left, right) or appends a new one.
+TError_t dag_make_node(Dag * dag, const Tree_t value, const DagIndex left, const DagIndex right,
+                       DagIndex * node)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(node);
+    MY_ASSERT(left == DAG_NULL_INDEX || left < dag->size);
+    MY_ASSERT(right == DAG_NULL_INDEX || right < dag->size);
+
+    TError_t errors = 0;
+    size_t mask = dag->table_capacity - 1;
+    size_t slot = (size_t) dag_hash(&value, left, right) & mask;
+
+    dag->lookups_number++;
+
+    for (; dag->table[slot] != DAG_NULL_INDEX; slot = (slot + 1) & mask)
+    {
+        if (dag_is_equal(&dag->nodes[dag->table[slot]], &value, left, right))
+        {
+            dag->hits_number++;
+            *node = dag->table[slot];
+            return errors;
+        }
+    }
+
+    if (errors = dag_reserve(dag))
+        return errors;
+
+    DagIndex index = (DagIndex) dag->size++;
+    dag->nodes[index].value = value;
+    dag->nodes[index].left = left;
+    dag->nodes[index].right = right;
+
+    // Keep the load factor under 1/2, the slot found above is stale after a rehash.
+    if (2 * dag->size > dag->table_capacity)
+    {
+        if (errors = dag_rehash(dag, 2 * dag->table_capacity))
+            return errors;
+    }
+    else
+    {
+        dag->table[slot] = index;
+    }
+
+    *node = index;
+
+    return errors;
+}
+
+
+static TError_t dag_reserve(Dag * dag)
+{
+    MY_ASSERT(dag);
+
+    TError_t errors = 0;
+
+    if (dag->size < dag->capacity)
+        return errors;
+
+    DagNode * nodes = NULL;
+    if (!(nodes = (DagNode *) realloc(dag->nodes, 2 * dag->capacity * sizeof(DagNode))))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+
+    dag->nodes = nodes;
+    dag->capacity *= 2;
+
+    return errors;
+}
+
+
+static TError_t dag_rehash(Dag * dag, const size_t table_capacity)
+{
+    MY_ASSERT(dag);
+
+    TError_t errors = 0;
+    DagIndex * table = NULL;
+
+    if (!(table = (DagIndex *) malloc(table_capacity * sizeof(DagIndex))))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+
+    memset(table, 0xFF, table_capacity * sizeof(DagIndex));
+
+    size_t mask = table_capacity - 1;
+    for (size_t i = 0; i < dag->size; i++)
+    {
+        const DagNode * node = &dag->nodes[i];
+        size_t slot = (size_t) dag_hash(&node->value, node->left, node->right) & mask;
+
+        while (table[slot] != DAG_NULL_INDEX)
+            slot = (slot + 1) & mask;
+
+        table[slot] = (DagIndex) i;
+    }
+
+    free(dag->table);
+    dag->table = table;
+    dag->table_capacity = table_capacity;
+
+    return errors;
+}
+
+
+static uint64_t dag_hash(const Tree_t * value, const DagIndex left, const DagIndex right)
+{
+    MY_ASSERT(value);
+
+    uint64_t payload = 0;
+
+    switch (value->type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+            memcpy(&payload, &value->value.number, sizeof(payload));
+            break;
+
+        case TREE_NODE_TYPES_OPERATION:
+        case TREE_NODE_TYPES_VARIABLE:
+            payload = (uint64_t) value->id;
+            break;
+
+        case TREE_NODE_TYPES_STRING:
+            for (const char * str = value->value.string; str && *str; str++)
+                payload = payload * 31 + (uint64_t) *str;
+            break;
+
+        case TREE_NODE_TYPES_NO_TYPE:
+            break;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    uint64_t hash = payload ^ ((uint64_t) value->type << 56);
+    hash ^= ((uint64_t) left << 32 | right) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 31;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 29;
+
+    return hash;
+}
+
+
+static bool dag_is_equal(const DagNode * node, const Tree_t * value, const DagIndex left, const DagIndex right)
+{
+    MY_ASSERT(node);
+    MY_ASSERT(value);
+
+    if (node->left != left || node->right != right || node->value.type != value->type)
+        return false;
+
+    switch (value->type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+            return !memcmp(&node->value.value.number, &value->value.number, sizeof(double));
+
+        case TREE_NODE_TYPES_OPERATION:
+        case TREE_NODE_TYPES_VARIABLE:
+            return node->value.id == value->id;
+
+        case TREE_NODE_TYPES_STRING:
+            return node->value.value.string == value->value.string ||
+                   (node->value.value.string && value->value.string &&
+                    !strcmp(node->value.value.string, value->value.string));
+
+        case TREE_NODE_TYPES_NO_TYPE:
+            return true;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    return false;
+}
+
+
+TError_t dag_from_tree(Dag * dag, const Tree * tree, DagIndex * root)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(tree);
+    MY_ASSERT(root);
+
+    TError_t errors = 0;
+
+    // Post-order, the indices of the children of a node are on top of the stack when it is met.
+    DagIndex * stack = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+
+    const TreeNode * top = tree->root;
+
+    for (const TreeNode * node = tree_postorder_first(top); node && !errors; node = tree_postorder_next(node, top))
+    {
+        DagIndex right = node->right ? stack[--size] : DAG_NULL_INDEX;
+        DagIndex left = node->left ? stack[--size] : DAG_NULL_INDEX;
+
+        if (size == capacity)
+        {
+            size_t new_capacity = capacity ? 2 * capacity : DAG_DEFAULT_CAPACITY;
+            DagIndex * new_stack = NULL;
+
+            if (!(new_stack = (DagIndex *) realloc(stack, new_capacity * sizeof(DagIndex))))
+            {
+                errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+                break;
+            }
+
+            stack = new_stack;
+            capacity = new_capacity;
+        }
+
+        errors |= dag_make_node(dag, node->value, left, right, &stack[size]);
+        size++;
+    }
+
+    if (!errors)
+        *root = size ? stack[0] : DAG_NULL_INDEX;
+
+    free(stack);
+
+    return errors;
+}
+
+
+/// Expands the DAG below root into tree, shared nodes are copied once per use.
+/// The tree is built in pre-order as it grows, the stack gives the DAG node of every one met.
+TError_t dag_to_tree(Tree * tree, const Dag * dag, const DagIndex root)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(dag);
+    MY_ASSERT(root < dag->size);
+
+    TError_t errors = 0;
+    DagIndex * stack = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+
+    errors |= dag_stack_push(&stack, &size, &capacity, root);
+
+    for (TreeNode * node = tree->root; node && !errors; node = tree_preorder_next(node, tree->root))
+    {
+        const DagNode * dag_node = &dag->nodes[stack[--size]];
+
+        node->value = dag_node->value;
+
+        if (dag_node->right != DAG_NULL_INDEX &&
+            !(errors |= tree_insert(tree, node, TREE_NODE_BRANCH_RIGHT, TREE_NULL)))
+            errors |= dag_stack_push(&stack, &size, &capacity, dag_node->right);
+
+        if (dag_node->left != DAG_NULL_INDEX && !errors &&
+            !(errors |= tree_insert(tree, node, TREE_NODE_BRANCH_LEFT, TREE_NULL)))
+            errors |= dag_stack_push(&stack, &size, &capacity, dag_node->left);
+    }
+
+    free(stack);
+
+    return errors;
+}
+
+
+static TError_t dag_stack_push(DagIndex * * stack, size_t * size, size_t * capacity, const DagIndex index)
+{
+    MY_ASSERT(stack);
+    MY_ASSERT(size);
+    MY_ASSERT(capacity);
+
+    TError_t errors = 0;
+
+    if (*size == *capacity)
+    {
+        size_t new_capacity = *capacity ? 2 * *capacity : DAG_DEFAULT_CAPACITY;
+        DagIndex * new_stack = NULL;
+
+        if (!(new_stack = (DagIndex *) realloc(*stack, new_capacity * sizeof(DagIndex))))
+        {
+            errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+            return errors;
+        }
+
+        *stack = new_stack;
+        *capacity = new_capacity;
+    }
+
+    (*stack)[(*size)++] = index;
+
+    return errors;
+}
+
+
+/// Number of distinct nodes reachable from root. Children are made before their parents,
+/// so one pass down from root marks every reachable node before it is met.
+size_t dag_count_nodes(const Dag * dag, const DagIndex root)
+{
+    MY_ASSERT(dag);
+
+    if (root == DAG_NULL_INDEX)
+        return 0;
+
+    MY_ASSERT(root < dag->size);
+
+    bool * is_reachable = (bool *) calloc(dag->size, sizeof(bool));
+    if (!is_reachable)
+        return 0;
+
+    size_t count = 0;
+
+    is_reachable[root] = true;
+
+    for (size_t i = (size_t) root + 1; i-- > 0;)
+    {
+        if (!is_reachable[i])
+            continue;
+
+        count++;
+
+        if (dag->nodes[i].left != DAG_NULL_INDEX)
+            is_reachable[dag->nodes[i].left] = true;
+        if (dag->nodes[i].right != DAG_NULL_INDEX)
+            is_reachable[dag->nodes[i].right] = true;
+    }
+
+    free(is_reachable);
+
+    return count;
+}
+
+
+/// Number of nodes the expanded tree below root would have. Double, as it grows exponentially.
+/// Children are made before their parents, so the sizes are filled in index order.
+double dag_count_tree_nodes(const Dag * dag, const DagIndex root)
+{
+    MY_ASSERT(dag);
+
+    if (root == DAG_NULL_INDEX)
+        return 0;
+
+    MY_ASSERT(root < dag->size);
+
+    double * sizes = (double *) calloc((size_t) root + 1, sizeof(double));
+    if (!sizes)
+        return 0;
+
+    for (size_t i = 0; i <= root; i++)
+    {
+        const DagNode * node = &dag->nodes[i];
+
+        sizes[i] = 1 + (node->left != DAG_NULL_INDEX ? sizes[node->left] : 0)
+                     + (node->right != DAG_NULL_INDEX ? sizes[node->right] : 0);
+    }
+
+    double count = sizes[root];
+
+    free(sizes);
+
+    return count;
+}
+
+
+size_t dag_memory_size(const Dag * dag)
+{
+    MY_ASSERT(dag);
+
+    return dag->capacity * sizeof(DagNode) + dag->table_capacity * sizeof(DagIndex);
+}
@@ -0,0 +1,42 @@
+#ifndef DAG_H
+    #define DAG_H
+
+    #include <stdint.h>
+
+    #include "tree.h"
+
+    typedef uint32_t DagIndex;
+
+    const DagIndex DAG_NULL_INDEX = UINT32_MAX;
+    const size_t DAG_DEFAULT_CAPACITY = 64;
+
+    struct DagNode {
+        Tree_t value;
+        DagIndex left;
+        DagIndex right;
+    };
+
+    /// Hash-consed node store: structurally equal subtrees are stored once,
+    /// so a node is identified by its index. Nodes are never removed.
+    struct Dag {
+        DagNode * nodes;
+        size_t size;
+        size_t capacity;
+        DagIndex * table;                            ///< Open addressing table of node indices.
+        size_t table_capacity;                       ///< Power of two.
+        size_t lookups_number;
+        size_t hits_number;                          ///< Lookups answered with an existing node.
+    };
+
+    TError_t op_new_dag(Dag * dag);
+    TError_t op_delete_dag(Dag * dag);
+    void dag_clear(Dag * dag);
+    TError_t dag_make_node(Dag * dag, const Tree_t value, const DagIndex left, const DagIndex right,
+                           DagIndex * node);
+    TError_t dag_from_tree(Dag * dag, const Tree * tree, DagIndex * root);
+    TError_t dag_to_tree(Tree * tree, const Dag * dag, const DagIndex root);
+    size_t dag_count_nodes(const Dag * dag, const DagIndex root);
+    double dag_count_tree_nodes(const Dag * dag, const DagIndex root);
+    size_t dag_memory_size(const Dag * dag);
+
+#endif // DAG_H
@@ -8,3 +8,10 @@ bool is_equal_double(double val1, double val2)
 {
     return (abs(val1 - val2) < EPSILON);
 }
+
+/// Bit-for-bit equality up to the sign of zero, without the tolerance of is_equal_double.
+/// For transforms that must not change a single result. NaN equals nothing.
+bool is_exact_double(double val1, double val2)
+{
+    return val1 <= val2 && val1 >= val2;
+}
@@ -2,5 +2,6 @@
     #define DOUBLE_COMPARING_H
 
     bool is_equal_double(double val1, double val2);
+    bool is_exact_double(double val1, double val2);
 
 #endif
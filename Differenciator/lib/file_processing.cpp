@@ -1,5 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include "file_processing.h"
@@ -93,3 +96,65 @@ long text_file_to_buffer(char * file_name, char * * buffer_ptr)
 
     return buffer_size;
 }
+
+
+/// Read-only mapping of the whole file: pages are read on first touch, shared with
+/// the page cache and never copied, so parsing starts at once whatever the size.
+/// The text is not null-terminated, size bounds it.
+const char * map_text_file(const char * file_name, size_t * size)
+{
+    MY_ASSERT(file_name);
+    MY_ASSERT(size);
+
+    int fd = -1;
+
+    if ((fd = open(file_name, O_RDONLY)) < 0)
+    {
+        printf("Error. Can't open %s\n", file_name);
+        return NULL;
+    }
+
+    struct stat file_stat = {};
+
+    if (fstat(fd, &file_stat))
+    {
+        printf("Error. Can't get the size of %s\n", file_name);
+        close(fd);
+        return NULL;
+    }
+
+    *size = (size_t) file_stat.st_size;
+
+    // mmap() can't map zero bytes.
+    if (!*size)
+    {
+        close(fd);
+        return "";
+    }
+
+    void * buffer = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (buffer == MAP_FAILED)
+    {
+        printf("Error. Can't map %s\n", file_name);
+        return NULL;
+    }
+
+    // Only hints, the mapping works without them.
+    madvise(buffer, *size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(buffer, *size, MADV_HUGEPAGE);
+#endif
+
+    return (const char *) buffer;
+}
+
+
+void unmap_text_file(const char * buffer, size_t size)
+{
+    MY_ASSERT(buffer);
+
+    if (size)
+        munmap((void *) const_cast<char *>(buffer), size);
+}
@@ -8,5 +8,7 @@
     char * read_file(char * buffer, const size_t buffer_size, FILE * fp);
     size_t write_file(char * buffer, const size_t buffer_size, FILE * fp);
     long text_file_to_buffer(char * file_name, char * * buffer_ptr);
+    const char * map_text_file(const char * file_name, size_t * size);
+    void unmap_text_file(const char * buffer, size_t size);
 
 #endif // FILE_PROCESSING_H
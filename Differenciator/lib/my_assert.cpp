@@ -2,14 +2,36 @@
 
 #include "my_assert.h"
 #ifndef NDEBUG
+    #ifdef MY_ASSERT_NO_ABORT
+        static thread_local bool is_assert_failed = false;
+    #endif // MY_ASSERT_NO_ABORT
+
     void my_func_assert(const bool expr, const char * expr_string, const char * date,
                         const int line, const char * file)
     {
         if (!expr)
         {
+    #ifdef MY_ASSERT_NO_ABORT
+            fprintf(stderr, "Assert error: %s, line %d, %s, file %s\n",
+                    expr_string, line, date, file);
+            is_assert_failed = true;
+    #else
             printf("Assert error: %s, line %d, %s, file %s\n",
                     expr_string, line, date, file);
             exit(EXIT_FAILURE);
+    #endif // MY_ASSERT_NO_ABORT
         }
     }
+
+    bool my_assert_take_failure(void)
+    {
+    #ifdef MY_ASSERT_NO_ABORT
+        bool is_failed = is_assert_failed;
+        is_assert_failed = false;
+
+        return is_failed;
+    #else
+        return false;
+    #endif // MY_ASSERT_NO_ABORT
+    }
 #endif // NDEBUG
@@ -11,6 +11,8 @@
 
         /////////////////////////////////////////////////////////////////////////
         /// @brief Function for output assert error and exit.
+        /// @note With MY_ASSERT_NO_ABORT (the library build) it does not exit,
+        ///       the failure is kept per thread for my_assert_take_failure().
         /// @param[in] expr Expression.
         /// @param[in] expr_string Expression in the form of string.
         /// @param[in] date Date of error.
@@ -19,6 +21,12 @@
         /////////////////////////////////////////////////////////////////////////
         void my_func_assert(const bool expr, const char * expr_string, const char * date,
                             const int line, const char * file);
+
+        /////////////////////////////////////////////////////////////////////////
+        /// @brief Tells whether an assert failed on this thread since the last call.
+        /// @return true if it did, the failure is forgotten.
+        /////////////////////////////////////////////////////////////////////////
+        bool my_assert_take_failure(void);
                             
         /////////////////////////////////////////////////////////////////////////
         /// \brief My modified version of assert().
@@ -31,4 +39,3 @@
     #define NDEBUG
 
 #endif // NDEBUG
-
@@ -0,0 +1,242 @@
+#include "simd_kernels.h"
+#include "my_assert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define SIMD_KERNELS_X86
+#endif
+
+#define SCALAR_COLUMN_KERNEL(name, op)                                              \
+    static void name(double * dst, const double * src1, const double * src2, size_t size) \
+    {                                                                               \
+        for (size_t i = 0; i < size; i++)                                           \
+            dst[i] = src1[i] op src2[i];                                            \
+    }
+
+#define SCALAR_VALUE_KERNEL(name, expression)                                       \
+    static void name(double * dst, const double * src, double value, size_t size)  \
+    {                                                                               \
+        for (size_t i = 0; i < size; i++)                                           \
+            dst[i] = expression;                                                    \
+    }
+
+SCALAR_COLUMN_KERNEL(scalar_add, +)
+SCALAR_COLUMN_KERNEL(scalar_sub, -)
+SCALAR_COLUMN_KERNEL(scalar_mul, *)
+SCALAR_COLUMN_KERNEL(scalar_div, /)
+
+SCALAR_VALUE_KERNEL(scalar_add_scalar, src[i] + value)
+SCALAR_VALUE_KERNEL(scalar_sub_scalar, src[i] - value)
+SCALAR_VALUE_KERNEL(scalar_scalar_sub, value - src[i])
+SCALAR_VALUE_KERNEL(scalar_mul_scalar, src[i] * value)
+SCALAR_VALUE_KERNEL(scalar_div_scalar, src[i] / value)
+SCALAR_VALUE_KERNEL(scalar_scalar_div, value / src[i])
+
+#undef SCALAR_COLUMN_KERNEL
+#undef SCALAR_VALUE_KERNEL
+
+
+static void scalar_fill(double * dst, double value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        dst[i] = value;
+}
+
+
+const SimdKernels SCALAR_KERNELS = {
+    .level      = SIMD_LEVEL_SCALAR,
+    .name       = "scalar",
+    .add        = scalar_add,
+    .sub        = scalar_sub,
+    .mul        = scalar_mul,
+    .div        = scalar_div,
+    .add_scalar = scalar_add_scalar,
+    .sub_scalar = scalar_sub_scalar,
+    .scalar_sub = scalar_scalar_sub,
+    .mul_scalar = scalar_mul_scalar,
+    .div_scalar = scalar_div_scalar,
+    .scalar_div = scalar_scalar_div,
+    .fill       = scalar_fill,
+};
+
+
+#ifdef SIMD_KERNELS_X86
+
+#define SIMD_COLUMN_KERNEL(name, isa, vec_t, width, load, store, op, scalar_op, epilogue)  \
+    __attribute__((target(isa)))                                                    \
+    static void name(double * dst, const double * src1, const double * src2, size_t size) \
+    {                                                                               \
+        size_t i = 0;                                                               \
+        for (; i + width <= size; i += width)                                       \
+            store(dst + i, op(load(src1 + i), load(src2 + i)));                     \
+        for (; i < size; i++)                                                       \
+            dst[i] = src1[i] scalar_op src2[i];                                     \
+        epilogue;                                                                   \
+    }
+
+// The value is broadcast once, so src op value costs one load and one store per vector.
+#define SIMD_VALUE_KERNEL(name, isa, vec_t, width, load, store, set1, vec_expression, expression, epilogue) \
+    __attribute__((target(isa)))                                                    \
+    static void name(double * dst, const double * src, double value, size_t size)  \
+    {                                                                               \
+        vec_t vec_value = set1(value);                                              \
+        size_t i = 0;                                                               \
+        for (; i + width <= size; i += width)                                       \
+        {                                                                           \
+            vec_t vec_src = load(src + i);                                          \
+            store(dst + i, vec_expression);                                         \
+        }                                                                           \
+        for (; i < size; i++)                                                       \
+            dst[i] = expression;                                                    \
+        epilogue;                                                                   \
+    }
+
+#define SSE2_COLUMN_KERNEL(name, op, scalar_op) \
+    SIMD_COLUMN_KERNEL(name, "sse2", __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, op, scalar_op, (void) 0)
+#define AVX2_COLUMN_KERNEL(name, op, scalar_op) \
+    SIMD_COLUMN_KERNEL(name, "avx2", __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, op, scalar_op, _mm256_zeroupper())
+#define SSE2_VALUE_KERNEL(name, vec_expression, expression) \
+    SIMD_VALUE_KERNEL(name, "sse2", __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, \
+                      vec_expression, expression, (void) 0)
+#define AVX2_VALUE_KERNEL(name, vec_expression, expression) \
+    SIMD_VALUE_KERNEL(name, "avx2", __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, \
+                      vec_expression, expression, _mm256_zeroupper())
+
+SSE2_COLUMN_KERNEL(sse2_add, _mm_add_pd, +)
+SSE2_COLUMN_KERNEL(sse2_sub, _mm_sub_pd, -)
+SSE2_COLUMN_KERNEL(sse2_mul, _mm_mul_pd, *)
+SSE2_COLUMN_KERNEL(sse2_div, _mm_div_pd, /)
+
+SSE2_VALUE_KERNEL(sse2_add_scalar, _mm_add_pd(vec_src, vec_value), src[i] + value)
+SSE2_VALUE_KERNEL(sse2_sub_scalar, _mm_sub_pd(vec_src, vec_value), src[i] - value)
+SSE2_VALUE_KERNEL(sse2_scalar_sub, _mm_sub_pd(vec_value, vec_src), value - src[i])
+SSE2_VALUE_KERNEL(sse2_mul_scalar, _mm_mul_pd(vec_src, vec_value), src[i] * value)
+SSE2_VALUE_KERNEL(sse2_div_scalar, _mm_div_pd(vec_src, vec_value), src[i] / value)
+SSE2_VALUE_KERNEL(sse2_scalar_div, _mm_div_pd(vec_value, vec_src), value / src[i])
+
+AVX2_COLUMN_KERNEL(avx2_add, _mm256_add_pd, +)
+AVX2_COLUMN_KERNEL(avx2_sub, _mm256_sub_pd, -)
+AVX2_COLUMN_KERNEL(avx2_mul, _mm256_mul_pd, *)
+AVX2_COLUMN_KERNEL(avx2_div, _mm256_div_pd, /)
+
+AVX2_VALUE_KERNEL(avx2_add_scalar, _mm256_add_pd(vec_src, vec_value), src[i] + value)
+AVX2_VALUE_KERNEL(avx2_sub_scalar, _mm256_sub_pd(vec_src, vec_value), src[i] - value)
+AVX2_VALUE_KERNEL(avx2_scalar_sub, _mm256_sub_pd(vec_value, vec_src), value - src[i])
+AVX2_VALUE_KERNEL(avx2_mul_scalar, _mm256_mul_pd(vec_src, vec_value), src[i] * value)
+AVX2_VALUE_KERNEL(avx2_div_scalar, _mm256_div_pd(vec_src, vec_value), src[i] / value)
+AVX2_VALUE_KERNEL(avx2_scalar_div, _mm256_div_pd(vec_value, vec_src), value / src[i])
+
+#undef SSE2_COLUMN_KERNEL
+#undef AVX2_COLUMN_KERNEL
+#undef SSE2_VALUE_KERNEL
+#undef AVX2_VALUE_KERNEL
+#undef SIMD_COLUMN_KERNEL
+#undef SIMD_VALUE_KERNEL
+
+
+__attribute__((target("sse2")))
+static void sse2_fill(double * dst, double value, size_t size)
+{
+    __m128d vec = _mm_set1_pd(value);
+    size_t i = 0;
+
+    for (; i + 2 <= size; i += 2)
+        _mm_storeu_pd(dst + i, vec);
+
+    for (; i < size; i++)
+        dst[i] = value;
+}
+
+
+__attribute__((target("avx2")))
+static void avx2_fill(double * dst, double value, size_t size)
+{
+    __m256d vec = _mm256_set1_pd(value);
+    size_t i = 0;
+
+    for (; i + 4 <= size; i += 4)
+        _mm256_storeu_pd(dst + i, vec);
+
+    for (; i < size; i++)
+        dst[i] = value;
+
+    _mm256_zeroupper();
+}
+
+
+const SimdKernels SSE2_KERNELS = {
+    .level      = SIMD_LEVEL_SSE2,
+    .name       = "sse2",
+    .add        = sse2_add,
+    .sub        = sse2_sub,
+    .mul        = sse2_mul,
+    .div        = sse2_div,
+    .add_scalar = sse2_add_scalar,
+    .sub_scalar = sse2_sub_scalar,
+    .scalar_sub = sse2_scalar_sub,
+    .mul_scalar = sse2_mul_scalar,
+    .div_scalar = sse2_div_scalar,
+    .scalar_div = sse2_scalar_div,
+    .fill       = sse2_fill,
+};
+
+const SimdKernels AVX2_KERNELS = {
+    .level      = SIMD_LEVEL_AVX2,
+    .name       = "avx2",
+    .add        = avx2_add,
+    .sub        = avx2_sub,
+    .mul        = avx2_mul,
+    .div        = avx2_div,
+    .add_scalar = avx2_add_scalar,
+    .sub_scalar = avx2_sub_scalar,
+    .scalar_sub = avx2_scalar_sub,
+    .mul_scalar = avx2_mul_scalar,
+    .div_scalar = avx2_div_scalar,
+    .scalar_div = avx2_scalar_div,
+    .fill       = avx2_fill,
+};
+
+#endif // SIMD_KERNELS_X86
+
+
+SimdLevels simd_get_supported_level(void)
+{
+#ifdef SIMD_KERNELS_X86
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_LEVEL_AVX2;
+
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_LEVEL_SSE2;
+#endif // SIMD_KERNELS_X86
+
+    return SIMD_LEVEL_SCALAR;
+}
+
+
+const SimdKernels * simd_get_kernels(SimdLevels level)
+{
+    if (level > simd_get_supported_level())
+        level = simd_get_supported_level();
+
+    switch (level)
+    {
+#ifdef SIMD_KERNELS_X86
+        case SIMD_LEVEL_AVX2:
+            return &AVX2_KERNELS;
+
+        case SIMD_LEVEL_SSE2:
+            return &SSE2_KERNELS;
+#else
+        case SIMD_LEVEL_AVX2:
+        case SIMD_LEVEL_SSE2:
+#endif // SIMD_KERNELS_X86
+        case SIMD_LEVEL_SCALAR:
+            return &SCALAR_KERNELS;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    return &SCALAR_KERNELS;
+}
@@ -0,0 +1,33 @@
+#ifndef SIMD_KERNELS_H
+    #define SIMD_KERNELS_H
+
+    #include <stdio.h>
+
+    enum SimdLevels {
+        SIMD_LEVEL_SCALAR = 0,
+        SIMD_LEVEL_SSE2   = 1,
+        SIMD_LEVEL_AVX2   = 2,
+    };
+
+    /// Element-wise kernels over columns of doubles. dst may be one of the sources.
+    /// The _scalar forms take one operand as a value, so constants are never written out as columns.
+    struct SimdKernels {
+        SimdLevels level;
+        const char * name;
+        void (*add)(double * dst, const double * src1, const double * src2, size_t size);
+        void (*sub)(double * dst, const double * src1, const double * src2, size_t size);
+        void (*mul)(double * dst, const double * src1, const double * src2, size_t size);
+        void (*div)(double * dst, const double * src1, const double * src2, size_t size);
+        void (*add_scalar)(double * dst, const double * src, double value, size_t size);   ///< src + value
+        void (*sub_scalar)(double * dst, const double * src, double value, size_t size);   ///< src - value
+        void (*scalar_sub)(double * dst, const double * src, double value, size_t size);   ///< value - src
+        void (*mul_scalar)(double * dst, const double * src, double value, size_t size);   ///< src * value
+        void (*div_scalar)(double * dst, const double * src, double value, size_t size);   ///< src / value
+        void (*scalar_div)(double * dst, const double * src, double value, size_t size);   ///< value / src
+        void (*fill)(double * dst, double value, size_t size);
+    };
+
+    SimdLevels simd_get_supported_level(void);
+    const SimdKernels * simd_get_kernels(SimdLevels level);
+
+#endif // SIMD_KERNELS_H
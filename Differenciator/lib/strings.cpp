@@ -126,13 +126,13 @@ size_t get_input(char * buffer, size_t buffer_size)
 {
     MY_ASSERT(buffer);
 
-    char character = 0;
+    int character = 0;
     size_t i = 0;
 
     while ((character = getchar()) != '\n' && character != EOF &&
            i < buffer_size)
     {
-        *buffer = character;
+        *buffer = (char) character;
         buffer++;
         i++;
     }
@@ -0,0 +1,348 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "structural_index.h"
+#include "my_assert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define STRUCTURAL_INDEX_X86
+#endif
+
+/// Bit i of a mask describes byte i of a block.
+struct StructuralMasks {
+    uint64_t open;
+    uint64_t close;
+    uint64_t space;
+};
+
+typedef void (*StructuralClassifier)(const char * block, StructuralMasks * masks);
+
+static SError_t structural_index_reserve(StructuralIndex * index, size_t size);
+static SError_t structural_index_classify(StructuralIndex * index, size_t end);
+static inline SError_t structural_index_build_blocks(StructuralIndex * index, size_t end,
+                                                     StructuralClassifier classify)
+                                                     __attribute__((always_inline));
+static void scalar_classify(const char * block, StructuralMasks * masks);
+static SError_t scalar_build(StructuralIndex * index, size_t end);
+
+
+/// A window never has more offsets than bytes, so the first allocation holds any of them.
+SError_t op_new_structural_index(StructuralIndex * index)
+{
+    MY_ASSERT(index);
+
+    SError_t errors = 0;
+
+    if (!(index->offsets = (uint32_t *) calloc(STRUCTURAL_INDEX_WINDOW_SIZE, sizeof(uint32_t))))
+    {
+        errors |= STRUCTURAL_INDEX_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+
+    index->size = 0;
+    index->capacity = STRUCTURAL_INDEX_WINDOW_SIZE;
+    index->text = NULL;
+    index->text_size = 0;
+    index->base = 0;
+    index->position = 0;
+    index->prev_delimiter = 1;
+    index->level = SIMD_LEVEL_SCALAR;
+
+    return errors;
+}
+
+
+SError_t op_delete_structural_index(StructuralIndex * index)
+{
+    MY_ASSERT(index);
+
+    free(index->offsets);
+
+    index->offsets = NULL;
+    index->size = 0;
+    index->capacity = 0;
+    index->text = NULL;
+    index->text_size = 0;
+
+    return 0;
+}
+
+
+static SError_t structural_index_reserve(StructuralIndex * index, size_t size)
+{
+    MY_ASSERT(index);
+
+    SError_t errors = 0;
+
+    if (index->size + size <= index->capacity)
+        return errors;
+
+    size_t capacity = index->capacity ? index->capacity : STRUCTURAL_INDEX_WINDOW_SIZE;
+    while (capacity < index->size + size)
+        capacity *= 2;
+
+    uint32_t * offsets = NULL;
+    if (!(offsets = (uint32_t *) realloc(index->offsets, capacity * sizeof(uint32_t))))
+    {
+        errors |= STRUCTURAL_INDEX_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+
+    index->offsets = offsets;
+    index->capacity = capacity;
+
+    return errors;
+}
+
+
+/// Classifies the text from index->position up to end, a multiple of the block size or
+/// the end of the text. A token starts at a byte that is not a delimiter and follows one,
+/// the start of the text counts as a delimiter. The last block is padded with spaces.
+static inline SError_t structural_index_build_blocks(StructuralIndex * index, size_t end,
+                                                     StructuralClassifier classify)
+{
+    MY_ASSERT(index);
+    MY_ASSERT(index->text);
+
+    SError_t errors = 0;
+    const char * text = index->text;
+    size_t size = index->text_size;
+    uint64_t prev_delimiter = index->prev_delimiter;
+    char tail[STRUCTURAL_INDEX_BLOCK_SIZE] = {};
+
+    for (size_t base = index->position; base < end; base += STRUCTURAL_INDEX_BLOCK_SIZE)
+    {
+        if (errors = structural_index_reserve(index, STRUCTURAL_INDEX_BLOCK_SIZE))
+        {
+            index->position = base;
+            index->prev_delimiter = prev_delimiter;
+            return errors;
+        }
+
+        const char * block = text + base;
+        if (size - base < STRUCTURAL_INDEX_BLOCK_SIZE)
+        {
+            memset(tail, ' ', STRUCTURAL_INDEX_BLOCK_SIZE);
+            memcpy(tail, block, size - base);
+            block = tail;
+        }
+
+        StructuralMasks masks = {};
+        classify(block, &masks);
+
+        uint64_t delimiters = masks.open | masks.close | masks.space;
+        uint64_t starts = ~delimiters & ((delimiters << 1) | prev_delimiter);
+        prev_delimiter = delimiters >> (STRUCTURAL_INDEX_BLOCK_SIZE - 1);
+
+        uint64_t structurals = masks.open | masks.close | starts;
+        uint32_t * offsets = index->offsets + index->size;
+
+        while (structurals)
+        {
+            *offsets++ = (uint32_t) (base - index->base + (size_t) __builtin_ctzll(structurals));
+            structurals &= structurals - 1;
+        }
+
+        index->size = (size_t) (offsets - index->offsets);
+    }
+
+    index->position = end;
+    index->prev_delimiter = prev_delimiter;
+
+    return errors;
+}
+
+
+static void scalar_classify(const char * block, StructuralMasks * masks)
+{
+    MY_ASSERT(block);
+    MY_ASSERT(masks);
+
+    for (size_t i = 0; i < STRUCTURAL_INDEX_BLOCK_SIZE; i++)
+    {
+        uint64_t bit = (uint64_t) 1 << i;
+        char c = block[i];
+
+        if (c == '{')
+            masks->open |= bit;
+        else if (c == '}')
+            masks->close |= bit;
+        else if (c == ' ' || ('\t' <= c && c <= '\r'))
+            masks->space |= bit;
+    }
+}
+
+
+static SError_t scalar_build(StructuralIndex * index, size_t end)
+{
+    return structural_index_build_blocks(index, end, scalar_classify);
+}
+
+
+#ifdef STRUCTURAL_INDEX_X86
+
+/// Whitespace is ' ' or a byte in '\t'..'\r', signed comparisons leave out bytes above 127.
+__attribute__((target("sse2"), always_inline))
+static inline uint64_t sse2_classify_chunk(__m128i chunk, uint64_t * open, uint64_t * close)
+{
+    *open = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('{')));
+    *close = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('}')));
+
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                                 _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('\t' - 1)),
+                                               _mm_cmpgt_epi8(_mm_set1_epi8('\r' + 1), chunk)));
+
+    return (uint32_t) _mm_movemask_epi8(space);
+}
+
+
+__attribute__((target("sse2")))
+static void sse2_classify(const char * block, StructuralMasks * masks)
+{
+    for (size_t i = 0; i < STRUCTURAL_INDEX_BLOCK_SIZE; i += 16)
+    {
+        uint64_t open = 0, close = 0;
+        uint64_t space = sse2_classify_chunk(_mm_loadu_si128((const __m128i *) (const void *) (block + i)),
+                                             &open, &close);
+
+        masks->open |= open << i;
+        masks->close |= close << i;
+        masks->space |= space << i;
+    }
+}
+
+
+__attribute__((target("sse2")))
+static SError_t sse2_build(StructuralIndex * index, size_t end)
+{
+    return structural_index_build_blocks(index, end, sse2_classify);
+}
+
+
+__attribute__((target("avx2"), always_inline))
+static inline uint64_t avx2_classify_chunk(__m256i chunk, uint64_t * open, uint64_t * close)
+{
+    *open = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('{')));
+    *close = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('}')));
+
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+                                    _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('\t' - 1)),
+                                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), chunk)));
+
+    return (uint32_t) _mm256_movemask_epi8(space);
+}
+
+
+__attribute__((target("avx2")))
+static void avx2_classify(const char * block, StructuralMasks * masks)
+{
+    uint64_t open_low = 0, close_low = 0, open_high = 0, close_high = 0;
+
+    uint64_t space_low = avx2_classify_chunk(_mm256_loadu_si256((const __m256i *) (const void *) block),
+                                             &open_low, &close_low);
+    uint64_t space_high = avx2_classify_chunk(_mm256_loadu_si256((const __m256i *) (const void *) (block + 32)),
+                                              &open_high, &close_high);
+
+    masks->open = open_low | open_high << 32;
+    masks->close = close_low | close_high << 32;
+    masks->space = space_low | space_high << 32;
+}
+
+
+__attribute__((target("avx2")))
+static SError_t avx2_build(StructuralIndex * index, size_t end)
+{
+    SError_t errors = structural_index_build_blocks(index, end, avx2_classify);
+
+    _mm256_zeroupper();
+
+    return errors;
+}
+
+#endif // STRUCTURAL_INDEX_X86
+
+
+/// The whole text in one go. Offsets are 32-bit, so the text is limited to 4 GB.
+SError_t structural_index_build(StructuralIndex * index, const char * text, size_t size, SimdLevels level)
+{
+    MY_ASSERT(index);
+    MY_ASSERT(text);
+
+    SError_t errors = 0;
+
+    if (size > UINT32_MAX)
+    {
+        errors |= STRUCTURAL_INDEX_ERRORS_TOO_LARGE_TEXT;
+        return errors;
+    }
+
+    if (errors = structural_index_start(index, text, size, level))
+        return errors;
+
+    return structural_index_classify(index, size);
+}
+
+
+/// Nothing is classified yet, structural_index_next_window() gives the first offsets.
+/// Offsets are counted from the window, so the text size is not limited.
+SError_t structural_index_start(StructuralIndex * index, const char * text, size_t size, SimdLevels level)
+{
+    MY_ASSERT(index);
+    MY_ASSERT(text);
+
+    index->text = text;
+    index->text_size = size;
+    index->size = 0;
+    index->base = 0;
+    index->position = 0;
+    index->prev_delimiter = 1;
+    index->level = level > simd_get_supported_level() ? simd_get_supported_level() : level;
+
+    return structural_index_reserve(index, STRUCTURAL_INDEX_WINDOW_SIZE);
+}
+
+
+/// Replaces the offsets with those of the next STRUCTURAL_INDEX_WINDOW_SIZE bytes,
+/// none are left once position reaches the end of the text.
+SError_t structural_index_next_window(StructuralIndex * index)
+{
+    MY_ASSERT(index);
+    MY_ASSERT(index->text);
+
+    size_t end = index->text_size - index->position < STRUCTURAL_INDEX_WINDOW_SIZE ?
+                 index->text_size : index->position + STRUCTURAL_INDEX_WINDOW_SIZE;
+
+    index->base = index->position;
+    index->size = 0;
+
+    return structural_index_classify(index, end);
+}
+
+
+static SError_t structural_index_classify(StructuralIndex * index, size_t end)
+{
+    MY_ASSERT(index);
+
+    switch (index->level)
+    {
+#ifdef STRUCTURAL_INDEX_X86
+        case SIMD_LEVEL_AVX2:
+            return avx2_build(index, end);
+
+        case SIMD_LEVEL_SSE2:
+            return sse2_build(index, end);
+#else
+        case SIMD_LEVEL_AVX2:
+        case SIMD_LEVEL_SSE2:
+#endif // STRUCTURAL_INDEX_X86
+        case SIMD_LEVEL_SCALAR:
+            return scalar_build(index, end);
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    return scalar_build(index, end);
+}
@@ -0,0 +1,41 @@
+#ifndef STRUCTURAL_INDEX_H
+    #define STRUCTURAL_INDEX_H
+
+    #include <stdio.h>
+    #include <stdint.h>
+
+    #include "simd_kernels.h"
+
+    typedef int SError_t;
+
+    enum StructuralIndexErrors {
+        STRUCTURAL_INDEX_ERRORS_CANT_ALLOCATE_MEMORY = 1 << 0,
+        STRUCTURAL_INDEX_ERRORS_TOO_LARGE_TEXT       = 1 << 1,
+    };
+
+    /// Offsets of every '{', '}' and first byte of a token in text order,
+    /// so a reader jumps from one to the next without looking at whitespace.
+    /// structural_index_next_window() keeps only the offsets of the next window of text,
+    /// so a reader that consumes them as it goes needs the same memory for any text size.
+    struct StructuralIndex {
+        uint32_t * offsets;                          ///< Counted from base.
+        size_t size;
+        size_t capacity;
+        const char * text;
+        size_t text_size;
+        size_t base;                                 ///< Text offset the offsets are counted from.
+        size_t position;                             ///< Bytes of the text classified so far.
+        uint64_t prev_delimiter;                     ///< 1 if the byte before position is a delimiter.
+        SimdLevels level;
+    };
+
+    const size_t STRUCTURAL_INDEX_BLOCK_SIZE = 64;
+    const size_t STRUCTURAL_INDEX_WINDOW_SIZE = 64 * STRUCTURAL_INDEX_BLOCK_SIZE;
+
+    SError_t op_new_structural_index(StructuralIndex * index);
+    SError_t op_delete_structural_index(StructuralIndex * index);
+    SError_t structural_index_build(StructuralIndex * index, const char * text, size_t size, SimdLevels level);
+    SError_t structural_index_start(StructuralIndex * index, const char * text, size_t size, SimdLevels level);
+    SError_t structural_index_next_window(StructuralIndex * index);
+
+#endif // STRUCTURAL_INDEX_H
@@ -0,0 +1,293 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+#include "my_assert.h"
+
+static void * thread_pool_worker_loop(void * worker_ptr);
+static void thread_pool_work(ThreadPool * pool, size_t worker_id);
+static bool thread_pool_take(ThreadPoolRange * range, size_t * chunk);
+static bool thread_pool_steal(ThreadPool * pool, size_t worker_id, size_t * chunk);
+static uint64_t thread_pool_pack(uint64_t begin, uint64_t end);
+
+
+size_t thread_pool_get_cpus_number(void)
+{
+    long cpus_number = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return cpus_number > 0 ? (size_t) cpus_number : 1;
+}
+
+
+PError_t op_new_thread_pool(ThreadPool * pool, size_t threads_number)
+{
+    MY_ASSERT(pool);
+
+    PError_t errors = 0;
+
+    if (threads_number == 0)
+        threads_number = thread_pool_get_cpus_number();
+
+    pool->threads = NULL;
+    pool->workers = NULL;
+    pool->ranges = NULL;
+    pool->threads_number = 1;
+    pool->task = NULL;
+    pool->context = NULL;
+    pool->generation = 0;
+    pool->active_number = 0;
+    pool->steals_number = 0;
+    pool->is_stopping = false;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->job_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    if (!(pool->threads = (pthread_t *) calloc(threads_number, sizeof(pthread_t))) ||
+        !(pool->workers = (ThreadPoolWorker *) calloc(threads_number, sizeof(ThreadPoolWorker))) ||
+        !(pool->ranges = (ThreadPoolRange *) aligned_alloc(alignof(ThreadPoolRange),
+                                                           threads_number * sizeof(ThreadPoolRange))))
+    {
+        errors |= THREAD_POOL_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+
+    for (size_t i = 0; i < threads_number; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        pool->ranges[i].chunks = 0;
+    }
+
+    for (size_t i = 1; i < threads_number; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker_loop, &pool->workers[i]))
+        {
+            errors |= THREAD_POOL_ERRORS_CANT_CREATE_THREAD;
+            break;
+        }
+
+        pool->threads_number++;
+    }
+
+    return errors;
+}
+
+
+PError_t op_delete_thread_pool(ThreadPool * pool)
+{
+    MY_ASSERT(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->is_stopping = true;
+    pthread_cond_broadcast(&pool->job_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (pool->threads)
+    {
+        for (size_t i = 1; i < pool->threads_number; i++)
+            pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->job_cond);
+    pthread_cond_destroy(&pool->done_cond);
+
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->ranges);
+
+    pool->threads = NULL;
+    pool->workers = NULL;
+    pool->ranges = NULL;
+    pool->threads_number = 0;
+
+    return 0;
+}
+
+
+PError_t thread_pool_run(ThreadPool * pool, size_t chunks_number, ThreadPoolTask task, void * context)
+{
+    MY_ASSERT(pool);
+    MY_ASSERT(task);
+
+    PError_t errors = 0;
+
+    if (chunks_number > THREAD_POOL_MAX_CHUNKS)
+    {
+        errors |= THREAD_POOL_ERRORS_TOO_MANY_CHUNKS;
+        return errors;
+    }
+
+    if (chunks_number == 0)
+        return errors;
+
+    // Each worker starts with an equal contiguous share, imbalance is fixed by stealing.
+    size_t threads_number = pool->threads_number;
+    for (size_t i = 0; i < threads_number; i++)
+    {
+        uint64_t begin = chunks_number * i / threads_number;
+        uint64_t end = chunks_number * (i + 1) / threads_number;
+
+        __atomic_store_n(&pool->ranges[i].chunks, thread_pool_pack(begin, end), __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->context = context;
+    pool->steals_number = 0;
+    pool->active_number = threads_number;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->job_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    thread_pool_work(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->active_number)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+
+    return errors;
+}
+
+
+static void * thread_pool_worker_loop(void * worker_ptr)
+{
+    MY_ASSERT(worker_ptr);
+
+    ThreadPoolWorker * worker = (ThreadPoolWorker *) worker_ptr;
+    ThreadPool * pool = worker->pool;
+    size_t seen_generation = 0;
+
+    while (true)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->is_stopping && pool->generation == seen_generation)
+            pthread_cond_wait(&pool->job_cond, &pool->mutex);
+
+        if (pool->is_stopping)
+        {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        thread_pool_work(pool, worker->id);
+    }
+
+    return NULL;
+}
+
+
+static void thread_pool_work(ThreadPool * pool, size_t worker_id)
+{
+    MY_ASSERT(pool);
+
+    size_t chunk = 0;
+    size_t steals_number = 0;
+
+    while (true)
+    {
+        if (thread_pool_take(&pool->ranges[worker_id], &chunk))
+        {
+            pool->task(pool->context, chunk, worker_id);
+            continue;
+        }
+
+        if (!thread_pool_steal(pool, worker_id, &chunk))
+            break;
+
+        steals_number++;
+        pool->task(pool->context, chunk, worker_id);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->steals_number += steals_number;
+    if (--pool->active_number == 0)
+        pthread_cond_signal(&pool->done_cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+static bool thread_pool_take(ThreadPoolRange * range, size_t * chunk)
+{
+    MY_ASSERT(range);
+    MY_ASSERT(chunk);
+
+    uint64_t chunks = __atomic_load_n(&range->chunks, __ATOMIC_ACQUIRE);
+
+    while (true)
+    {
+        uint64_t begin = chunks >> 32;
+        uint64_t end = chunks & UINT32_MAX;
+
+        if (begin >= end)
+            return false;
+
+        if (__atomic_compare_exchange_n(&range->chunks, &chunks, thread_pool_pack(begin + 1, end),
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            *chunk = (size_t) begin;
+            return true;
+        }
+    }
+}
+
+
+/// Cuts the upper half off the victim with the most chunks left, runs its first chunk
+/// and keeps the rest as the own range. Own range is empty here, so victims
+/// can't steal from it concurrently. A victim that changed since the scan is looked for again.
+static bool thread_pool_steal(ThreadPool * pool, size_t worker_id, size_t * chunk)
+{
+    MY_ASSERT(pool);
+    MY_ASSERT(chunk);
+
+    size_t threads_number = pool->threads_number;
+
+    while (true)
+    {
+        ThreadPoolRange * victim = NULL;
+        uint64_t victim_chunks = 0;
+        uint64_t victim_size = 0;
+
+        for (size_t i = 1; i < threads_number; i++)
+        {
+            ThreadPoolRange * range = &pool->ranges[(worker_id + i) % threads_number];
+            uint64_t chunks = __atomic_load_n(&range->chunks, __ATOMIC_ACQUIRE);
+            uint64_t begin = chunks >> 32;
+            uint64_t end = chunks & UINT32_MAX;
+
+            if (begin < end && end - begin > victim_size)
+            {
+                victim = range;
+                victim_chunks = chunks;
+                victim_size = end - begin;
+            }
+        }
+
+        if (!victim)
+            return false;
+
+        uint64_t begin = victim_chunks >> 32;
+        uint64_t end = victim_chunks & UINT32_MAX;
+        uint64_t middle = end - (end - begin + 1) / 2;
+
+        if (__atomic_compare_exchange_n(&victim->chunks, &victim_chunks, thread_pool_pack(begin, middle),
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n(&pool->ranges[worker_id].chunks, thread_pool_pack(middle + 1, end),
+                             __ATOMIC_RELEASE);
+            *chunk = (size_t) middle;
+            return true;
+        }
+    }
+}
+
+
+static uint64_t thread_pool_pack(uint64_t begin, uint64_t end)
+{
+    return begin << 32 | end;
+}
@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+    #define THREAD_POOL_H
+
+    #include <stdio.h>
+    #include <stdint.h>
+    #include <pthread.h>
+
+    typedef int PError_t;
+
+    enum ThreadPoolErrorsMasks {
+        THREAD_POOL_ERRORS_CANT_ALLOCATE_MEMORY = 1 << 0,
+        THREAD_POOL_ERRORS_CANT_CREATE_THREAD   = 1 << 1,
+        THREAD_POOL_ERRORS_TOO_MANY_CHUNKS      = 1 << 2,
+    };
+
+    typedef void (*ThreadPoolTask)(void * context, size_t chunk, size_t worker_id);
+
+    /// Chunks [begin, end) packed as begin << 32 | end. The owner takes chunks
+    /// from the begin, thieves cut the upper half off the end.
+    struct alignas(64) ThreadPoolRange {
+        uint64_t chunks;
+    };
+
+    struct ThreadPool;
+
+    struct ThreadPoolWorker {
+        ThreadPool * pool;
+        size_t id;
+    };
+
+    struct ThreadPool {
+        pthread_t * threads;
+        ThreadPoolWorker * workers;
+        ThreadPoolRange * ranges;                    ///< One per worker, worker 0 is the caller.
+        size_t threads_number;                       ///< Including the caller.
+        pthread_mutex_t mutex;
+        pthread_cond_t job_cond;                     ///< Signaled when a job starts or the pool stops.
+        pthread_cond_t done_cond;                    ///< Signaled when the last worker finishes a job.
+        ThreadPoolTask task;
+        void * context;
+        size_t generation;                           ///< Number of started jobs.
+        size_t active_number;                        ///< Workers still busy with the current job.
+        size_t steals_number;                        ///< Successful steals during the last job.
+        bool is_stopping;
+    };
+
+    const size_t THREAD_POOL_MAX_CHUNKS = UINT32_MAX;
+
+    size_t thread_pool_get_cpus_number(void);
+    PError_t op_new_thread_pool(ThreadPool * pool, size_t threads_number);
+    PError_t op_delete_thread_pool(ThreadPool * pool);
+    PError_t thread_pool_run(ThreadPool * pool, size_t chunks_number, ThreadPoolTask task, void * context);
+
+#endif // THREAD_POOL_H
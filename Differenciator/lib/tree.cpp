@@ -5,23 +5,32 @@
 #include "file_processing.h"
 #include "strings.h"
 
-const char * TREE_DUMP_FILE_NAME = "./graphviz/tree_dump";
+const char * const TREE_DUMP_FILE_NAME = "./graphviz/tree_dump";
 
 const size_t TRASH_VALUE = 0xAB1BA5;
 const size_t BUFFER_SIZE = 256;
+const size_t TREE_DUMP_SUFFIX_SIZE = 24;
 
-static size_t tree_free(TreeNode * * main_node);
-static size_t tree_free_iternal(TreeNode * * node, size_t * count);
-static void print_tree_nodes(const TreeNode * node, FILE * fp);
-static void print_tree_edges(const TreeNode * node, FILE * fp);
+static size_t tree_free(Tree * tree, TreeNode * * main_node);
+static void print_tree_nodes(const TreeNode * root, FILE * fp);
+static void print_tree_edges(const TreeNode * root, FILE * fp);
 static TError_t tree_create_node(Tree * tree, TreeNode * const parent_node, TreeNode * * node_ptr);
-static void print_text_nodes(const TreeNode * main_node);
+static void print_text_nodes(const TreeNode * root);
 
 
 TError_t op_new_tree(Tree * tree, const Tree_t root_value)
 {
     MY_ASSERT(tree);
 
+    return op_new_tree_slabs(tree, root_value, ARENA_DEFAULT_SLAB_CAPACITY);
+}
+
+
+/// slab_capacity is the node count of the first arena slab, the next ones double it.
+TError_t op_new_tree_slabs(Tree * tree, const Tree_t root_value, const size_t slab_capacity)
+{
+    MY_ASSERT(tree);
+
     TError_t errors = 0;
 
     if (!tree_vtor(tree))
@@ -30,8 +39,15 @@ TError_t op_new_tree(Tree * tree, const Tree_t root_value)
         return errors;
     }
 
-    if (!(tree->root = (TreeNode *) calloc(1, sizeof(TreeNode))))
+    if (op_new_arena(&tree->nodes, sizeof(TreeNode), slab_capacity))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+
+    if (!(tree->root = (TreeNode *) arena_alloc(&tree->nodes)))
     {
+        op_delete_arena(&tree->nodes);
         errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
         return errors;
     }
@@ -47,41 +63,59 @@ TError_t op_new_tree(Tree * tree, const Tree_t root_value)
 }
 
 
-static size_t tree_free(TreeNode * * main_node)
+/// Post-order, so a node is freed after its branches and its parent is still alive.
+static size_t tree_free(Tree * tree, TreeNode * * main_node)
 {
+    MY_ASSERT(tree);
     MY_ASSERT(main_node);
+    MY_ASSERT(*main_node);
 
     size_t count = 0;
+    const TreeNode * root = *main_node;
+    TreeNode * node = tree_postorder_first(*main_node);
+
+    while (node)
+    {
+        TreeNode * next_node = tree_postorder_next(node, root);
 
-    return tree_free_iternal(main_node, &count);
+        arena_free(&tree->nodes, node);
+        count++;
+
+        node = next_node;
+    }
+
+    *main_node = NULL;
+
+    return count;
 }
 
 
-static size_t tree_free_iternal(TreeNode * * node, size_t * count)
+TError_t op_delete_tree(Tree * tree)
 {
-    MY_ASSERT(node);
-    MY_ASSERT(*node);
-    MY_ASSERT(count);
+    MY_ASSERT(tree);
 
-    if ((*node)->left)
-    {
-        tree_free_iternal(&(*node)->left, count);
-    }
+    TError_t errors = 0;
 
-    if ((*node)->right)
+    if (!tree->root)
     {
-        tree_free_iternal(&(*node)->right, count);
+        errors |= TREE_ERRORS_ALREADY_DESTRUCTED;
+        return errors;
     }
 
-    free(*node);
-    *node = NULL;
-    (*count)++;
+    if (tree->nodes.live_count != tree->size)
+        errors |= TREE_ERRORS_INVALID_SIZE;
 
-    return *count;
+    op_delete_arena(&tree->nodes);
+    tree->root = NULL;
+    tree->size = TRASH_VALUE;
+
+    return errors;
 }
 
 
-TError_t op_delete_tree(Tree * tree)
+/// Drops every node but keeps the arena slabs, so a tree reused for many
+/// expressions stops allocating once it has held the largest of them.
+TError_t tree_clear(Tree * tree, const Tree_t root_value)
 {
     MY_ASSERT(tree);
 
@@ -93,9 +127,20 @@ TError_t op_delete_tree(Tree * tree)
         return errors;
     }
 
-    if (tree_free(&(tree->root)) != tree->size)
-        errors |= TREE_ERRORS_INVALID_SIZE;
-    tree->size = TRASH_VALUE;
+    arena_reset(&tree->nodes);
+
+    if (!(tree->root = (TreeNode *) arena_alloc(&tree->nodes)))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+    tree->size = 1;
+
+    tree->root->left = NULL;
+    tree->root->right = NULL;
+    tree->root->parent = NULL;
+
+    tree->root->value = root_value;
 
     return errors;
 }
@@ -124,7 +169,7 @@ static TError_t tree_create_node(Tree * tree, TreeNode * const parent_node, Tree
 
     TError_t errors = 0;
 
-    if (!(*node_ptr = (TreeNode *) calloc(1, sizeof(TreeNode))))
+    if (!(*node_ptr = (TreeNode *) arena_alloc(&tree->nodes)))
     {
         errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
         return errors;
@@ -205,7 +250,7 @@ TError_t tree_delete_branch(Tree * tree, TreeNode * * node)
         return errors;
     }
 
-    size_t deleting_nodes_count = tree_free(node);
+    size_t deleting_nodes_count = tree_free(tree, node);
     *node = NULL;
 
     if (tree->size < deleting_nodes_count)
@@ -220,19 +265,28 @@ TError_t tree_delete_branch(Tree * tree, TreeNode * * node)
 }
 
 
-void tree_dump_iternal(const Tree * tree,
+/// file_name is the prefix of the dump files, dump_id numbers them: the caller owns the count,
+/// so callers on different threads never share a file.
+void tree_dump_iternal(const Tree * tree, const char * file_name, size_t dump_id,
                        const char * tree_name, const char * func,
                        const int line, const char * file)
 {
     MY_ASSERT(tree);
+    MY_ASSERT(file_name);
     MY_ASSERT(tree_name);
     MY_ASSERT(func);
     MY_ASSERT(file);
 
+    if (strlen(file_name) + TREE_DUMP_SUFFIX_SIZE >= BUFFER_SIZE)
+        return;
+
     FILE * fp = NULL;
 
-    char dot_file_name[64] = "";
-    make_file_extension(dot_file_name, TREE_DUMP_FILE_NAME, ".dot");
+    char dot_file_name[BUFFER_SIZE] = "";
+    char extension_string[BUFFER_SIZE] = "";
+
+    sprintf(extension_string, "%zu.dot", dump_id);
+    make_file_extension(dot_file_name, file_name, extension_string);
 
     if (!(fp = file_open(dot_file_name, "wb")))
     {
@@ -267,78 +321,64 @@ void tree_dump_iternal(const Tree * tree,
 
     fclose(fp);
 
-    static size_t dumps_count = 0;
-    char png_dump_file_name[64] = "";
-    char command_string[BUFFER_SIZE] = "";
-    char extension_string[BUFFER_SIZE] = "";
+    char png_dump_file_name[BUFFER_SIZE] = "";
+    char command_string[3 * BUFFER_SIZE] = "";
 
-    sprintf(extension_string, "%zd.png", dumps_count);
-    make_file_extension(png_dump_file_name, TREE_DUMP_FILE_NAME, extension_string);
+    sprintf(extension_string, "%zu.png", dump_id);
+    make_file_extension(png_dump_file_name, file_name, extension_string);
     sprintf(command_string, "dot %s -T png -o %s", dot_file_name, png_dump_file_name);
     system(command_string);
-
-    dumps_count++;
 }
 
 
-static void print_tree_nodes(const TreeNode * node, FILE * fp)
+static void print_tree_nodes(const TreeNode * root, FILE * fp)
 {
-    MY_ASSERT(node);
+    MY_ASSERT(root);
     MY_ASSERT(fp);
 
-    fprintf(fp, "    node%p [ label = \"{[%p] ",
-            node, node);
-
-    switch (node->value.type)
-    {
-        case TREE_NODE_TYPES_NO_TYPE:
-            fprintf(fp, "%lX", TRASH_VALUE);
-            break;
-
-        case TREE_NODE_TYPES_STRING:
-            fprintf(fp, "%s", node->value.value.string);
-            break;
-
-        case TREE_NODE_TYPES_NUMBER:
-            fprintf(fp, "%.2lf", node->value.value.number);
-            break;
-
-        default:
-            MY_ASSERT(0 && "UNREACHABLE");
-            break;
-    }
-
-    // fprintf(fp, "%lf", node->value);
-
-    fprintf(fp, " | parent[%p] | { <l> left[%p] | right[%p]  }}\" ]\n",
-            node->parent, node->left, node->right);
-
-    if (node->right)
+    for (const TreeNode * node = root; node; node = tree_preorder_next(node, root))
     {
-        print_tree_nodes(node->right, fp);
-    }
-
-    if (node->left)
-    {
-        print_tree_nodes(node->left, fp);
+        fprintf(fp, "    node%p [ label = \"{[%p] ",
+                node, node);
+
+        switch (node->value.type)
+        {
+            case TREE_NODE_TYPES_NO_TYPE:
+                fprintf(fp, "%lX", TRASH_VALUE);
+                break;
+
+            case TREE_NODE_TYPES_STRING:
+            case TREE_NODE_TYPES_OPERATION:
+            case TREE_NODE_TYPES_VARIABLE:
+                fprintf(fp, "%s", node->value.value.string);
+                break;
+
+            case TREE_NODE_TYPES_NUMBER:
+                fprintf(fp, "%.2lf", node->value.value.number);
+                break;
+
+            default:
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
+        }
+
+        fprintf(fp, " | parent[%p] | { <l> left[%p] | right[%p]  }}\" ]\n",
+                node->parent, node->left, node->right);
     }
 }
 
 
-static void print_tree_edges(const TreeNode * node, FILE * fp)
+static void print_tree_edges(const TreeNode * root, FILE * fp)
 {
-    MY_ASSERT(node);
+    MY_ASSERT(root);
 
-    if (node->left)
+    for (const TreeNode * node = root; node; node = tree_preorder_next(node, root))
     {
-        fprintf(fp, "    node%p:<l> -> node%p;\n", node, node->left);
-        print_tree_edges(node->left, fp);
-    }
+        if (node->left)
+            fprintf(fp, "    node%p:<l> -> node%p;\n", node, node->left);
 
-    if (node->right)
-    {
-        fprintf(fp, "    node%p:<r> -> node%p;\n", node, node->right);
-        print_tree_edges(node->right, fp);
+        if (node->right)
+            fprintf(fp, "    node%p:<r> -> node%p;\n", node, node->right);
     }
 }
 
@@ -356,26 +396,23 @@ void tree_text_dump(const Tree * tree)
 }
 
 
-static void print_text_nodes(const TreeNode * main_node)
+static void print_text_nodes(const TreeNode * root)
 {
-    MY_ASSERT(main_node);
+    MY_ASSERT(root);
 
-    printf("\tNode[%p]\n", main_node);
-    if (main_node->left)
-    {
-        printf("\r\tLeft:\n\t");
-        print_text_nodes(main_node->left);
-    }
-    if (main_node->right)
+    for (const TreeNode * node = root; node; node = tree_preorder_next(node, root))
     {
-        printf("\r\tRight:\n\t");
-        print_text_nodes(main_node->right);
+        if (node != root)
+            printf(node == node->parent->left ? "\r\tLeft:\n\t" : "\r\tRight:\n\t");
+
+        printf("\tNode[%p]\n", node);
     }
 
     return;
 }
 
 
+/// Pre-order walk of src_node, dst follows it one node behind on the way down and up.
 TError_t tree_copy_branch(Tree * dst_tree, TreeNode * dst_node, const TreeNode * src_node)
 {
     MY_ASSERT(dst_tree);
@@ -383,19 +420,42 @@ TError_t tree_copy_branch(Tree * dst_tree, TreeNode * dst_node, const TreeNode *
     MY_ASSERT(src_node);
 
     TError_t errors = 0;
+    TreeNode * dst = dst_node;
+    TreeWalk walk = {};
 
     dst_node->value = src_node->value;
 
-    if (src_node->left)
+    for (tree_walk_begin(&walk, src_node); walk.node && !errors; tree_walk_next(&walk))
     {
-       errors |= tree_insert(dst_tree, dst_node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-       tree_copy_branch(dst_tree, dst_node->left, src_node->left);
-    }
-
-    if (src_node->right)
-    {
-       errors |= tree_insert(dst_tree, dst_node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
-       tree_copy_branch(dst_tree, dst_node->right, src_node->right);
+        if (walk.node == src_node)
+            continue;
+
+        switch (walk.visit)
+        {
+            case TREE_VISIT_PRE:
+                if (walk.node == walk.node->parent->left)
+                {
+                    errors |= tree_insert(dst_tree, dst, TREE_NODE_BRANCH_LEFT, walk.node->value);
+                    dst = dst->left;
+                }
+                else
+                {
+                    errors |= tree_insert(dst_tree, dst, TREE_NODE_BRANCH_RIGHT, walk.node->value);
+                    dst = dst->right;
+                }
+                break;
+
+            case TREE_VISIT_IN:
+                break;
+
+            case TREE_VISIT_POST:
+                dst = dst->parent;
+                break;
+
+            default:
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
+        }
     }
 
     return errors;
@@ -423,12 +483,22 @@ TError_t tree_glue_node(Tree * tree, TreeNode * node, const TreeNodeBranches glu
             glue_node = node->right;
             deleting_node = &node->left;
             break;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    if (!glue_node)
+    {
+        errors |= TREE_ERRORS_INVALID_NODE;
+        return errors;
     }
 
     if (node == tree->root)
     {
-        free(node);
-        tree->size -= tree_free(deleting_node) + 1;
+        arena_free(&tree->nodes, node);
+        tree->size -= tree_free(tree, deleting_node) + 1;
 
         glue_node->parent = NULL;
         tree->root = glue_node;
@@ -448,11 +518,209 @@ TError_t tree_glue_node(Tree * tree, TreeNode * node, const TreeNodeBranches glu
         parent_branch = &node->parent->right;
     }
 
-    free(node);
-    tree->size -= tree_free(deleting_node) + 1;
+    arena_free(&tree->nodes, node);
+    tree->size -= tree_free(tree, deleting_node) + 1;
 
     *parent_branch = glue_node;
     glue_node->parent = parent_node;
 
     return errors;
 }
+
+
+/// Moves the detached branch src_node into the childless dst_node of the same tree.
+TError_t tree_move_branch(Tree * tree, TreeNode * dst_node, TreeNode * src_node)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(dst_node);
+    MY_ASSERT(src_node);
+
+    TError_t errors = 0;
+
+    if (dst_node->left || dst_node->right)
+    {
+        errors |= TREE_ERRORS_INVALID_NODE;
+        return errors;
+    }
+
+    dst_node->value = src_node->value;
+    dst_node->left = src_node->left;
+    dst_node->right = src_node->right;
+
+    if (dst_node->left)
+        dst_node->left->parent = dst_node;
+    if (dst_node->right)
+        dst_node->right->parent = dst_node;
+
+    arena_free(&tree->nodes, src_node);
+    tree->size--;
+
+    return errors;
+}
+
+
+void tree_walk_begin(TreeWalk * walk, const TreeNode * root)
+{
+    MY_ASSERT(walk);
+    MY_ASSERT(root);
+
+    walk->node = root;
+    walk->root = root;
+    walk->visit = TREE_VISIT_PRE;
+}
+
+
+void tree_walk_next(TreeWalk * walk)
+{
+    MY_ASSERT(walk);
+    MY_ASSERT(walk->node);
+
+    const TreeNode * node = walk->node;
+
+    switch (walk->visit)
+    {
+        case TREE_VISIT_PRE:
+            if (node->left)
+                walk->node = node->left;
+            else
+                walk->visit = TREE_VISIT_IN;
+            break;
+
+        case TREE_VISIT_IN:
+            if (node->right)
+            {
+                walk->node = node->right;
+                walk->visit = TREE_VISIT_PRE;
+            }
+            else
+            {
+                walk->visit = TREE_VISIT_POST;
+            }
+            break;
+
+        case TREE_VISIT_POST:
+            if (node == walk->root)
+            {
+                walk->node = NULL;
+            }
+            else
+            {
+                walk->visit = node == node->parent->left ? TREE_VISIT_IN : TREE_VISIT_POST;
+                walk->node = node->parent;
+            }
+            break;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+}
+
+
+const TreeNode * tree_preorder_next(const TreeNode * node, const TreeNode * root)
+{
+    MY_ASSERT(node);
+    MY_ASSERT(root);
+
+    if (node->left)
+        return node->left;
+    if (node->right)
+        return node->right;
+
+    for (; node != root; node = node->parent)
+    {
+        if (node == node->parent->left && node->parent->right)
+            return node->parent->right;
+    }
+
+    return NULL;
+}
+
+
+const TreeNode * tree_inorder_first(const TreeNode * root)
+{
+    MY_ASSERT(root);
+
+    while (root->left)
+        root = root->left;
+
+    return root;
+}
+
+
+const TreeNode * tree_inorder_next(const TreeNode * node, const TreeNode * root)
+{
+    MY_ASSERT(node);
+    MY_ASSERT(root);
+
+    if (node->right)
+        return tree_inorder_first(node->right);
+
+    for (; node != root; node = node->parent)
+    {
+        if (node == node->parent->left)
+            return node->parent;
+    }
+
+    return NULL;
+}
+
+
+const TreeNode * tree_postorder_first(const TreeNode * root)
+{
+    MY_ASSERT(root);
+
+    while (root->left || root->right)
+        root = root->left ? root->left : root->right;
+
+    return root;
+}
+
+
+/// Reads only the parent of node, so node itself may be freed right after the call.
+const TreeNode * tree_postorder_next(const TreeNode * node, const TreeNode * root)
+{
+    MY_ASSERT(node);
+    MY_ASSERT(root);
+
+    if (node == root)
+        return NULL;
+
+    const TreeNode * parent = node->parent;
+
+    if (node == parent->left && parent->right)
+        return tree_postorder_first(parent->right);
+
+    return parent;
+}
+
+
+// Versions for passes that change the nodes they visit, as strchr() does for strings.
+TreeNode * tree_preorder_next(TreeNode * node, const TreeNode * root)
+{
+    return const_cast<TreeNode *>(tree_preorder_next((const TreeNode *) node, root));
+}
+
+
+TreeNode * tree_inorder_first(TreeNode * root)
+{
+    return const_cast<TreeNode *>(tree_inorder_first((const TreeNode *) root));
+}
+
+
+TreeNode * tree_inorder_next(TreeNode * node, const TreeNode * root)
+{
+    return const_cast<TreeNode *>(tree_inorder_next((const TreeNode *) node, root));
+}
+
+
+TreeNode * tree_postorder_first(TreeNode * root)
+{
+    return const_cast<TreeNode *>(tree_postorder_first((const TreeNode *) root));
+}
+
+
+TreeNode * tree_postorder_next(TreeNode * node, const TreeNode * root)
+{
+    return const_cast<TreeNode *>(tree_postorder_next((const TreeNode *) node, root));
+}
@@ -3,10 +3,14 @@
 
     #include <stdio.h>
 
+    #include "arena.h"
+
     enum TreeNodeTypes {
-        TREE_NODE_TYPES_NO_TYPE = 0,
-        TREE_NODE_TYPES_STRING  = 1,
-        TREE_NODE_TYPES_NUMBER  = 2,
+        TREE_NODE_TYPES_NO_TYPE   = 0,
+        TREE_NODE_TYPES_STRING    = 1,
+        TREE_NODE_TYPES_NUMBER    = 2,
+        TREE_NODE_TYPES_OPERATION = 3,
+        TREE_NODE_TYPES_VARIABLE  = 4,
     };
 
     union TreeNodeValueUnion {
@@ -15,15 +19,17 @@
     };
 
     struct TreeNodeValue {
-        TreeNodeValueUnion value;
+        TreeNodeValueUnion value;                    ///< Operations and variables keep their names for printing.
         TreeNodeTypes type;
+        int id;                                      ///< Table index of an operation or a variable.
     };
 
     typedef TreeNodeValue Tree_t;
     typedef int TError_t;
 
     #define TREE_SPEC "%p"
-    #define tree_dump(tree) tree_dump_iternal((tree), #tree, __func__, __LINE__, __FILE__)
+    #define tree_dump(tree, file_name, dump_id) \
+        tree_dump_iternal((tree), (file_name), (dump_id), #tree, __func__, __LINE__, __FILE__)
 
     enum TreeErrorsMasks {
         TREE_ERRORS_CANT_ALLOCATE_MEMORY = 1 << 0,
@@ -49,21 +55,51 @@
     struct Tree {
         TreeNode * root;
         size_t size;
+        Arena nodes;                                 ///< Storage of the tree nodes.
+    };
+
+    enum TreeVisits {
+        TREE_VISIT_PRE  = 0,                         ///< Before the left branch.
+        TREE_VISIT_IN   = 1,                         ///< Between the branches.
+        TREE_VISIT_POST = 2,                         ///< After the right branch.
+    };
+
+    /// Euler tour of a branch along the parent pointers: every node is met
+    /// before, between and after its branches, with no stack and no recursion.
+    struct TreeWalk {
+        const TreeNode * node;                       ///< NULL when the walk is over.
+        const TreeNode * root;
+        TreeVisits visit;
     };
 
-    extern const char * TREE_DUMP_FILE_NAME;
+    extern const char * const TREE_DUMP_FILE_NAME;
     const size_t MAX_STR_SIZE = 256;
     const TreeNodeValue TREE_NULL = {};
     TError_t op_new_tree(Tree * tree, const Tree_t root_value);
+    TError_t op_new_tree_slabs(Tree * tree, const Tree_t root_value, const size_t slab_capacity);
     TError_t op_delete_tree(Tree * tree);
+    TError_t tree_clear(Tree * tree, const Tree_t root_value);
     TError_t tree_vtor(const Tree * tree);
     TError_t tree_insert(Tree * tree, TreeNode * node, TreeNodeBranches mode, const Tree_t value);
     TError_t tree_delete_branch(Tree * tree, TreeNode * * node);
-    void tree_dump_iternal(const Tree * tree,
+    void tree_dump_iternal(const Tree * tree, const char * file_name, size_t dump_id,
                            const char * tree_name, const char * func,
                            const int line, const char * file);
     void tree_text_dump(const Tree * tree);
     TError_t tree_copy_branch(Tree * dst_tree, TreeNode * dst_node, const TreeNode * src_node);
     TError_t tree_glue_node(Tree * tree, TreeNode * node, const TreeNodeBranches glue_branch);
+    TError_t tree_move_branch(Tree * tree, TreeNode * dst_node, TreeNode * src_node);
+    void tree_walk_begin(TreeWalk * walk, const TreeNode * root);
+    void tree_walk_next(TreeWalk * walk);
+    const TreeNode * tree_preorder_next(const TreeNode * node, const TreeNode * root);
+    const TreeNode * tree_inorder_first(const TreeNode * root);
+    const TreeNode * tree_inorder_next(const TreeNode * node, const TreeNode * root);
+    const TreeNode * tree_postorder_first(const TreeNode * root);
+    const TreeNode * tree_postorder_next(const TreeNode * node, const TreeNode * root);
+    TreeNode * tree_preorder_next(TreeNode * node, const TreeNode * root);
+    TreeNode * tree_inorder_first(TreeNode * root);
+    TreeNode * tree_inorder_next(TreeNode * node, const TreeNode * root);
+    TreeNode * tree_postorder_first(TreeNode * root);
+    TreeNode * tree_postorder_next(TreeNode * node, const TreeNode * root);
 
 #endif // TREE_H
@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "bytecode.h"
+#include "my_assert.h"
+#include "double_comparing.h"
+
+static void dftr_program_eval_block(const DftrProgram * program, const double * variables,
+                                    size_t variable_id, const double * samples,
+                                    double * answers, size_t block_size,
+                                    double * columns, DftrBatchOperand * operands,
+                                    const SimdKernels * kernels);
+static void dftr_batch_binary(DftrOpcodes opcode, DftrBatchOperand * left, const DftrBatchOperand * right,
+                              double * column, size_t block_size, const SimdKernels * kernels);
+static void dftr_batch_power(const DftrBatchOperand * left, const DftrBatchOperand * right,
+                             double * column, size_t block_size, const SimdKernels * kernels);
+static void dftr_batch_unary(DftrOpcodes opcode, DftrBatchOperand * operand, double * column, size_t block_size);
+static double dftr_batch_fold(DftrOpcodes opcode, double left, double right);
+
+
+DError_t dftr_program_eval_batch(const DftrProgram * program, const double * variables,
+                                 size_t variable_id, const double * samples,
+                                 double * answers, size_t samples_number)
+{
+    return dftr_program_eval_batch_kernels(program, variables, variable_id, samples, answers, samples_number,
+                                           simd_get_kernels(simd_get_supported_level()));
+}
+
+
+DError_t dftr_program_eval_batch_kernels(const DftrProgram * program, const double * variables,
+                                         size_t variable_id, const double * samples,
+                                         double * answers, size_t samples_number,
+                                         const SimdKernels * kernels)
+{
+    MY_ASSERT(program);
+    MY_ASSERT(variables);
+    MY_ASSERT(samples);
+    MY_ASSERT(answers);
+    MY_ASSERT(kernels);
+
+    DError_t dftr_errors = 0;
+    double * columns = NULL;
+    DftrBatchOperand * operands = NULL;
+
+    if (!program->size)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+        return dftr_errors;
+    }
+
+    if (!(columns = (double *) calloc(program->stack_size * DFTR_BATCH_BLOCK_SIZE, sizeof(double))) ||
+        !(operands = (DftrBatchOperand *) calloc(program->stack_size, sizeof(DftrBatchOperand))))
+    {
+        free(columns);
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    dftr_program_eval_batch_columns(program, variables, variable_id, samples, answers, samples_number,
+                                    columns, operands, kernels);
+
+    free(columns);
+    free(operands);
+
+    return dftr_errors;
+}
+
+
+/// columns must hold program->stack_size * DFTR_BATCH_BLOCK_SIZE doubles, operands program->stack_size.
+void dftr_program_eval_batch_columns(const DftrProgram * program, const double * variables,
+                                     size_t variable_id, const double * samples,
+                                     double * answers, size_t samples_number,
+                                     double * columns, DftrBatchOperand * operands,
+                                     const SimdKernels * kernels)
+{
+    MY_ASSERT(program);
+    MY_ASSERT(samples);
+    MY_ASSERT(answers);
+    MY_ASSERT(columns);
+    MY_ASSERT(operands);
+    MY_ASSERT(kernels);
+
+    for (size_t i = 0; i < samples_number; i += DFTR_BATCH_BLOCK_SIZE)
+    {
+        size_t block_size = samples_number - i < DFTR_BATCH_BLOCK_SIZE ? samples_number - i : DFTR_BATCH_BLOCK_SIZE;
+
+        dftr_program_eval_block(program, variables, variable_id, samples + i, answers + i,
+                                block_size, columns, operands, kernels);
+    }
+}
+
+
+/// Constants, the other variables and the samples stay operands in place, so a column is
+/// only written by an operation and every operation is one pass over the block.
+static void dftr_program_eval_block(const DftrProgram * program, const double * variables,
+                                    size_t variable_id, const double * samples,
+                                    double * answers, size_t block_size,
+                                    double * columns, DftrBatchOperand * operands,
+                                    const SimdKernels * kernels)
+{
+    MY_ASSERT(program);
+    MY_ASSERT(columns);
+    MY_ASSERT(operands);
+    MY_ASSERT(kernels);
+
+    const DftrInstruction * instruction = program->code;
+    const DftrInstruction * code_end = program->code + program->size;
+    DftrBatchOperand * top = operands - 1;
+    double * column = columns - DFTR_BATCH_BLOCK_SIZE;
+
+    for (; instruction < code_end; instruction++)
+    {
+        DftrOpcodes opcode = (DftrOpcodes) instruction->opcode;
+
+        switch (opcode)
+        {
+            case DFTR_OPCODE_CONST:
+                top++;
+                column += DFTR_BATCH_BLOCK_SIZE;
+                top->column = NULL;
+                top->value = program->constants[instruction->arg];
+                break;
+
+            case DFTR_OPCODE_VAR:
+                top++;
+                column += DFTR_BATCH_BLOCK_SIZE;
+                top->column = instruction->arg == variable_id ? samples : NULL;
+                top->value = instruction->arg == variable_id ? 0 : variables[instruction->arg];
+                break;
+
+            case DFTR_OPCODE_ADDITION:
+            case DFTR_OPCODE_SUBTRACTION:
+            case DFTR_OPCODE_MULTIPLICATION:
+            case DFTR_OPCODE_DIVISION:
+            case DFTR_OPCODE_POWER:
+                top--;
+                column -= DFTR_BATCH_BLOCK_SIZE;
+                dftr_batch_binary(opcode, top, top + 1, column, block_size, kernels);
+                break;
+
+            case DFTR_OPCODE_SINUS:
+            case DFTR_OPCODE_COSINUS:
+                dftr_batch_unary(opcode, top, column, block_size);
+                break;
+
+            default:
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
+        }
+    }
+
+    if (operands[0].column)
+        memcpy(answers, operands[0].column, block_size * sizeof(double));
+    else
+        kernels->fill(answers, operands[0].value, block_size);
+}
+
+
+/// left = left op right, a result that is not one value goes to column.
+static void dftr_batch_binary(DftrOpcodes opcode, DftrBatchOperand * left, const DftrBatchOperand * right,
+                              double * column, size_t block_size, const SimdKernels * kernels)
+{
+    MY_ASSERT(left);
+    MY_ASSERT(right);
+    MY_ASSERT(column);
+    MY_ASSERT(kernels);
+
+    if (!left->column && !right->column)
+    {
+        left->value = dftr_batch_fold(opcode, left->value, right->value);
+        return;
+    }
+
+    const double * left_column = left->column;
+    const double * right_column = right->column;
+
+    switch (opcode)
+    {
+        case DFTR_OPCODE_ADDITION:
+            if (left_column && right_column)
+                kernels->add(column, left_column, right_column, block_size);
+            else if (left_column)
+                kernels->add_scalar(column, left_column, right->value, block_size);
+            else
+                kernels->add_scalar(column, right_column, left->value, block_size);
+            break;
+
+        case DFTR_OPCODE_SUBTRACTION:
+            if (left_column && right_column)
+                kernels->sub(column, left_column, right_column, block_size);
+            else if (left_column)
+                kernels->sub_scalar(column, left_column, right->value, block_size);
+            else
+                kernels->scalar_sub(column, right_column, left->value, block_size);
+            break;
+
+        case DFTR_OPCODE_MULTIPLICATION:
+            if (left_column && right_column)
+                kernels->mul(column, left_column, right_column, block_size);
+            else if (left_column)
+                kernels->mul_scalar(column, left_column, right->value, block_size);
+            else
+                kernels->mul_scalar(column, right_column, left->value, block_size);
+            break;
+
+        case DFTR_OPCODE_DIVISION:
+            if (left_column && right_column)
+                kernels->div(column, left_column, right_column, block_size);
+            else if (left_column)
+                kernels->div_scalar(column, left_column, right->value, block_size);
+            else
+                kernels->scalar_div(column, right_column, left->value, block_size);
+            break;
+
+        case DFTR_OPCODE_POWER:
+            dftr_batch_power(left, right, column, block_size, kernels);
+            break;
+
+        case DFTR_OPCODE_CONST:
+        case DFTR_OPCODE_VAR:
+        case DFTR_OPCODE_SINUS:
+        case DFTR_OPCODE_COSINUS:
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    left->column = column;
+}
+
+
+/// u ^ 2 is squared by the mul kernel, which rounds once where pow() may be an ulp off.
+static void dftr_batch_power(const DftrBatchOperand * left, const DftrBatchOperand * right,
+                             double * column, size_t block_size, const SimdKernels * kernels)
+{
+    MY_ASSERT(left);
+    MY_ASSERT(right);
+    MY_ASSERT(column);
+    MY_ASSERT(kernels);
+
+    if (!right->column)
+    {
+        if (is_exact_double(right->value, 2))
+        {
+            kernels->mul(column, left->column, left->column, block_size);
+            return;
+        }
+
+        for (size_t i = 0; i < block_size; i++)
+            column[i] = pow(left->column[i], right->value);
+    }
+    else if (!left->column)
+    {
+        for (size_t i = 0; i < block_size; i++)
+            column[i] = pow(left->value, right->column[i]);
+    }
+    else
+    {
+        for (size_t i = 0; i < block_size; i++)
+            column[i] = pow(left->column[i], right->column[i]);
+    }
+}
+
+
+static void dftr_batch_unary(DftrOpcodes opcode, DftrBatchOperand * operand, double * column, size_t block_size)
+{
+    MY_ASSERT(operand);
+    MY_ASSERT(column);
+
+    bool is_sinus = opcode == DFTR_OPCODE_SINUS;
+
+    if (!operand->column)
+    {
+        operand->value = is_sinus ? sin(operand->value) : cos(operand->value);
+        return;
+    }
+
+    if (is_sinus)
+    {
+        for (size_t i = 0; i < block_size; i++)
+            column[i] = sin(operand->column[i]);
+    }
+    else
+    {
+        for (size_t i = 0; i < block_size; i++)
+            column[i] = cos(operand->column[i]);
+    }
+
+    operand->column = column;
+}
+
+
+/// Both operands are one value for the whole block, the same arithmetic as dftr_program_eval.
+static double dftr_batch_fold(DftrOpcodes opcode, double left, double right)
+{
+    switch (opcode)
+    {
+        case DFTR_OPCODE_ADDITION:
+            return left + right;
+
+        case DFTR_OPCODE_SUBTRACTION:
+            return left - right;
+
+        case DFTR_OPCODE_MULTIPLICATION:
+            return left * right;
+
+        case DFTR_OPCODE_DIVISION:
+            return left / right;
+
+        case DFTR_OPCODE_POWER:
+            return pow(left, right);
+
+        case DFTR_OPCODE_CONST:
+        case DFTR_OPCODE_VAR:
+        case DFTR_OPCODE_SINUS:
+        case DFTR_OPCODE_COSINUS:
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    return 0;
+}
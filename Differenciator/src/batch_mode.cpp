@@ -0,0 +1,536 @@
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+
+#include "batch_mode.h"
+#include "strength.h"
+#include "my_assert.h"
+
+/// Shared by the pool threads for the whole run, every chunk is one thread taking records until none are left.
+struct DftrBatchJob {
+    const DftrRecords * records;
+    DftrWorker * workers;                        ///< One per pool thread, indexed by the worker id.
+    DftrReorderSlot * slots;
+    size_t slots_number;
+    const DftrContext * context;
+    FILE * fp;
+    DftrBatchStats * stats;
+    pthread_mutex_t write_mutex;                 ///< Held by the thread writing the finished prefix.
+    size_t next_record;                          ///< Next record to take.
+    size_t written_number;                       ///< Records written out, only grows under write_mutex.
+    DError_t errors;                             ///< Under write_mutex.
+    bool is_stopped;                             ///< Out of memory, no more records are taken.
+};
+
+static DError_t dftr_records_push(DftrRecords * records, size_t begin);
+static DError_t dftr_batch_run_sequential(const DftrRecords * records, const DftrContext * context, FILE * fp,
+                                          DftrBatchStats * stats);
+static DError_t dftr_batch_run_parallel(const DftrRecords * records, const DftrContext * context,
+                                        size_t threads_number, FILE * fp, DftrBatchStats * stats);
+static void dftr_batch_task(void * job_ptr, size_t chunk, size_t worker_id);
+static void dftr_batch_write_ready(DftrBatchJob * job);
+static double batch_now(void);
+
+
+DError_t op_new_dftr_records(DftrRecords * records)
+{
+    MY_ASSERT(records);
+
+    DError_t dftr_errors = 0;
+
+    records->text = NULL;
+    records->text_size = 0;
+    records->size = 0;
+    records->capacity = 0;
+
+    if (!(records->records = (DftrRecord *) calloc(DFTR_RECORDS_DEFAULT_CAPACITY, sizeof(DftrRecord))) ||
+        op_new_structural_index(&records->index))
+    {
+        free(records->records);
+        records->records = NULL;
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    records->capacity = DFTR_RECORDS_DEFAULT_CAPACITY;
+
+    return dftr_errors;
+}
+
+
+DError_t op_delete_dftr_records(DftrRecords * records)
+{
+    MY_ASSERT(records);
+
+    op_delete_structural_index(&records->index);
+    free(records->records);
+
+    records->text = NULL;
+    records->text_size = 0;
+    records->records = NULL;
+    records->size = 0;
+    records->capacity = 0;
+
+    return 0;
+}
+
+
+/// A record ends where the bracket depth comes back to zero. A token or a '}'
+/// outside any brackets is a record of its own, it fails to parse but the
+/// records after it are still found. The index is read one window at a time,
+/// every record is indexed again by the worker that parses it.
+DError_t dftr_records_split(DftrRecords * records, const char * text, size_t size)
+{
+    MY_ASSERT(records);
+    MY_ASSERT(text);
+
+    DError_t dftr_errors = 0;
+    StructuralIndex * index = &records->index;
+
+    records->text = text;
+    records->text_size = size;
+    records->size = 0;
+
+    if (structural_index_start(index, text, size, simd_get_supported_level()))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    size_t depth = 0;
+
+    while (index->position < size && !dftr_errors)
+    {
+        if (structural_index_next_window(index))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            break;
+        }
+
+        for (size_t i = 0; i < index->size && !dftr_errors; i++)
+        {
+            size_t offset = index->base + index->offsets[i];
+            char c = text[offset];
+
+            if (depth == 0)
+                dftr_errors |= dftr_records_push(records, offset);
+
+            if (c == '{')
+                depth++;
+            else if (c == '}' && depth)
+                depth--;
+        }
+    }
+
+    // A record runs up to the next one, the last one (unclosed brackets included) to the end of the text.
+    for (size_t i = 0; i < records->size; i++)
+    {
+        size_t end = i + 1 < records->size ? records->records[i + 1].begin : size;
+        records->records[i].size = end - records->records[i].begin;
+    }
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_records_push(DftrRecords * records, size_t begin)
+{
+    MY_ASSERT(records);
+
+    DError_t dftr_errors = 0;
+
+    if (records->size == records->capacity)
+    {
+        size_t capacity = records->capacity ? 2 * records->capacity : DFTR_RECORDS_DEFAULT_CAPACITY;
+        DftrRecord * new_records = NULL;
+
+        if (!(new_records = (DftrRecord *) realloc(records->records, capacity * sizeof(DftrRecord))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+
+        records->records = new_records;
+        records->capacity = capacity;
+    }
+
+    records->records[records->size].begin = begin;
+    records->records[records->size].size = 0;
+    records->size++;
+
+    return dftr_errors;
+}
+
+
+DError_t op_new_dftr_worker(DftrWorker * worker)
+{
+    MY_ASSERT(worker);
+
+    DError_t dftr_errors = 0;
+
+    if (op_new_tree(&worker->tree, TREE_NULL))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+        return dftr_errors;
+    }
+
+    if (op_new_tree(&worker->d_tree, TREE_NULL))
+    {
+        op_delete_tree(&worker->tree);
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+        return dftr_errors;
+    }
+
+    if (op_new_compact_tree(&worker->d_ctree, TREE_NULL, true))
+    {
+        op_delete_tree(&worker->tree);
+        op_delete_tree(&worker->d_tree);
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+        return dftr_errors;
+    }
+
+    if (dftr_errors = op_new_dftr_cse(&worker->cse))
+    {
+        op_delete_compact_tree(&worker->d_ctree);
+        op_delete_tree(&worker->tree);
+        op_delete_tree(&worker->d_tree);
+        return dftr_errors;
+    }
+
+    if (op_new_structural_index(&worker->index))
+    {
+        op_delete_dftr_cse(&worker->cse);
+        op_delete_compact_tree(&worker->d_ctree);
+        op_delete_tree(&worker->tree);
+        op_delete_tree(&worker->d_tree);
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    return dftr_errors;
+}
+
+
+DError_t op_delete_dftr_worker(DftrWorker * worker)
+{
+    MY_ASSERT(worker);
+
+    op_delete_structural_index(&worker->index);
+    op_delete_dftr_cse(&worker->cse);
+    op_delete_compact_tree(&worker->d_ctree);
+
+    op_delete_tree(&worker->tree);
+    op_delete_tree(&worker->d_tree);
+
+    return 0;
+}
+
+
+/// Parse, eval, differentiate, optimize and print one record. A record that fails
+/// gets an error line instead, the error is returned so the caller can count it.
+DError_t dftr_worker_process(DftrWorker * worker, const DftrRecords * records, size_t record_id,
+                             const DftrContext * context, FILE * fp)
+{
+    MY_ASSERT(worker);
+    MY_ASSERT(records);
+    MY_ASSERT(record_id < records->size);
+    MY_ASSERT(context);
+    MY_ASSERT(fp);
+
+    DError_t dftr_errors = 0;
+    const DftrRecord * record = &records->records[record_id];
+    DftrLexer lexer = {};
+    double answer = 0;
+
+    if (tree_clear(&worker->tree, TREE_NULL) || tree_clear(&worker->d_tree, TREE_NULL))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    const char * text = records->text + record->begin;
+
+    if (structural_index_start(&worker->index, text, record->size, simd_get_supported_level()))
+        dftr_lexer_init(&lexer, text, record->size);
+    else
+        dftr_lexer_init_indexed(&lexer, text, record->size, &worker->index);
+
+    if (!(dftr_errors = create_dftr_tree_tokens(&worker->tree, &lexer)) && lexer.token.type != DFTR_TOKEN_TYPES_END)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_SYNTAXIS;
+
+    if (!dftr_errors)
+        dftr_errors |= dftr_eval_variables(&worker->tree, context->variables, &answer);
+
+    if (!dftr_errors)
+        dftr_errors |= dftr_differentiation(context, &worker->tree, &worker->d_tree, 0, &worker->d_ctree);
+
+    if (!dftr_errors)
+        dftr_errors |= dftr_optimization(context, &worker->d_tree, NULL);
+
+    if (!dftr_errors)
+        dftr_errors |= dftr_cse_build(&worker->cse, &worker->d_tree, context->cse_min_size);
+
+    if (!dftr_errors)
+        dftr_errors |= dftr_cse_reduce_strength(&worker->cse, NULL);
+
+    // Pool threads keep their assert failures to themselves, the record carries them back.
+    if (my_assert_take_failure())
+        dftr_errors |= DIFFERENCIATOR_ERRORS_ASSERT;
+
+    if (dftr_errors)
+    {
+        fprintf(fp, "[%zu] Error %d\n", record_id, dftr_errors);
+        return dftr_errors;
+    }
+
+    fprintf(fp, "[%zu] Answer = %.2lf\n", record_id, answer);
+    dftr_errors |= dftr_cse_print(&worker->cse, fp, "f'", DFTR_PRINT_TEXT);
+
+    return dftr_errors;
+}
+
+
+/// Every record of text through the pipeline, the output in input order. Records
+/// that fail are counted and skipped, only running out of memory stops the batch.
+/// DIFFERENCIATOR_ERRORS_ASSERT is returned if any record failed an assert.
+DError_t dftr_batch_run(const DftrContext * context, const char * text, size_t size, FILE * fp,
+                        DftrBatchStats * stats)
+{
+    MY_ASSERT(context);
+    MY_ASSERT(text);
+    MY_ASSERT(fp);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+    DftrRecords records = {};
+
+    double start = batch_now();
+    stats->expressions_number = 0;
+    stats->errors_number = 0;
+
+    if (dftr_errors = op_new_dftr_records(&records))
+        return dftr_errors;
+
+    size_t threads_number = context->threads_number ? context->threads_number : thread_pool_get_cpus_number();
+
+    if (!(dftr_errors = dftr_records_split(&records, text, size)))
+    {
+        if (threads_number == 1)
+            dftr_errors = dftr_batch_run_sequential(&records, context, fp, stats);
+        else
+            dftr_errors = dftr_batch_run_parallel(&records, context, threads_number, fp, stats);
+    }
+
+    stats->time = batch_now() - start;
+
+    op_delete_dftr_records(&records);
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_batch_run_sequential(const DftrRecords * records, const DftrContext * context, FILE * fp,
+                                          DftrBatchStats * stats)
+{
+    MY_ASSERT(records);
+    MY_ASSERT(context);
+    MY_ASSERT(fp);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+    DftrWorker worker = {};
+
+    if (dftr_errors = op_new_dftr_worker(&worker))
+        return dftr_errors;
+
+    for (size_t i = 0; i < records->size && !(dftr_errors & ~DIFFERENCIATOR_ERRORS_ASSERT); i++)
+    {
+        DError_t record_errors = dftr_worker_process(&worker, records, i, context, fp);
+
+        if (record_errors)
+            stats->errors_number++;
+
+        dftr_errors |= record_errors & (DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY | DIFFERENCIATOR_ERRORS_ASSERT);
+        stats->expressions_number++;
+    }
+
+    op_delete_dftr_worker(&worker);
+
+    return dftr_errors;
+}
+
+
+/// Every thread has its own worker, so trees, arenas and the CSE are never shared.
+/// Records are taken one at a time and their output goes to a ring of slots;
+/// the finished prefix is written as soon as it is complete, so a slow record only
+/// holds back the output after it, and the threads stop only once the ring is full.
+static DError_t dftr_batch_run_parallel(const DftrRecords * records, const DftrContext * context,
+                                        size_t threads_number, FILE * fp, DftrBatchStats * stats)
+{
+    MY_ASSERT(records);
+    MY_ASSERT(context);
+    MY_ASSERT(fp);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+    ThreadPool pool = {};
+    DftrWorker * workers = NULL;
+    DftrReorderSlot * slots = NULL;
+    size_t workers_number = 0;
+    size_t slots_number = 0;
+
+    // Fewer threads than asked for still make a working pool.
+    if (op_new_thread_pool(&pool, threads_number) & THREAD_POOL_ERRORS_CANT_ALLOCATE_MEMORY)
+    {
+        op_delete_thread_pool(&pool);
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    if (!(workers = (DftrWorker *) calloc(pool.threads_number, sizeof(DftrWorker))) ||
+        !(slots = (DftrReorderSlot *) calloc(pool.threads_number * DFTR_BATCH_SLOTS_PER_THREAD,
+                                             sizeof(DftrReorderSlot))))
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+
+    for (; !dftr_errors && workers_number < pool.threads_number; workers_number++)
+        if (dftr_errors = op_new_dftr_worker(&workers[workers_number]))
+            break;
+
+    for (; !dftr_errors && slots_number < pool.threads_number * DFTR_BATCH_SLOTS_PER_THREAD; slots_number++)
+    {
+        if (!(slots[slots_number].stream = open_memstream(&slots[slots_number].data, &slots[slots_number].size)))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            break;
+        }
+    }
+
+    DftrBatchJob job = {
+        .records        = records,
+        .workers        = workers,
+        .slots          = slots,
+        .slots_number   = slots_number,
+        .context        = context,
+        .fp             = fp,
+        .stats          = stats,
+        .write_mutex    = {},
+        .next_record    = 0,
+        .written_number = 0,
+        .errors         = 0,
+        .is_stopped     = false,
+    };
+    pthread_mutex_init(&job.write_mutex, NULL);
+
+    if (!dftr_errors)
+    {
+        // One chunk per thread; the pool only fails on resources, the chunks are far below its limit.
+        if (thread_pool_run(&pool, pool.threads_number, dftr_batch_task, &job))
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+
+        // A record finished while another thread was writing may still wait for its turn.
+        dftr_batch_write_ready(&job);
+        dftr_errors |= job.errors;
+    }
+
+    pthread_mutex_destroy(&job.write_mutex);
+    op_delete_thread_pool(&pool);
+
+    for (size_t i = 0; i < slots_number; i++)
+    {
+        fclose(slots[i].stream);
+        free(slots[i].data);
+    }
+
+    for (size_t i = 0; i < workers_number; i++)
+        op_delete_dftr_worker(&workers[i]);
+
+    free(slots);
+    free(workers);
+
+    return dftr_errors;
+}
+
+
+/// Record i may only start once record i - slots_number is written, as they share a slot.
+/// A thread waiting for that writes the finished prefix itself, so the oldest record
+/// in flight is never waiting and the run always moves on.
+static void dftr_batch_task(void * job_ptr, size_t chunk, size_t worker_id)
+{
+    MY_ASSERT(job_ptr);
+    (void) chunk;
+
+    DftrBatchJob * job = (DftrBatchJob *) job_ptr;
+
+    for (;;)
+    {
+        size_t record_id = __atomic_fetch_add(&job->next_record, 1, __ATOMIC_RELAXED);
+        if (record_id >= job->records->size)
+            return;
+
+        while (record_id >= __atomic_load_n(&job->written_number, __ATOMIC_ACQUIRE) + job->slots_number &&
+               !__atomic_load_n(&job->is_stopped, __ATOMIC_ACQUIRE))
+        {
+            dftr_batch_write_ready(job);
+            sched_yield();
+        }
+
+        if (__atomic_load_n(&job->is_stopped, __ATOMIC_ACQUIRE))
+            return;
+
+        DftrReorderSlot * slot = &job->slots[record_id % job->slots_number];
+
+        slot->errors = dftr_worker_process(&job->workers[worker_id], job->records, record_id,
+                                           job->context, slot->stream);
+        __atomic_store_n(&slot->is_done, true, __ATOMIC_RELEASE);
+
+        dftr_batch_write_ready(job);
+    }
+}
+
+
+/// Writes the done records after the last written one, in order. Only one thread writes
+/// at a time, the others go on with their records instead of waiting for the lock.
+/// The slots are rewound, not closed, so their buffers are reused by the records after them.
+static void dftr_batch_write_ready(DftrBatchJob * job)
+{
+    MY_ASSERT(job);
+
+    if (pthread_mutex_trylock(&job->write_mutex))
+        return;
+
+    size_t written_number = job->written_number;
+
+    while (written_number < job->records->size && !job->is_stopped)
+    {
+        DftrReorderSlot * slot = &job->slots[written_number % job->slots_number];
+
+        if (!__atomic_load_n(&slot->is_done, __ATOMIC_ACQUIRE))
+            break;
+
+        fflush(slot->stream);
+        fwrite(slot->data, sizeof(char), slot->size, job->fp);
+        rewind(slot->stream);
+
+        if (slot->errors)
+            job->stats->errors_number++;
+
+        job->errors |= slot->errors & (DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY | DIFFERENCIATOR_ERRORS_ASSERT);
+        job->stats->expressions_number++;
+
+        __atomic_store_n(&slot->is_done, false, __ATOMIC_RELAXED);
+        __atomic_store_n(&job->written_number, ++written_number, __ATOMIC_RELEASE);
+
+        if (job->errors & DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY)
+            __atomic_store_n(&job->is_stopped, true, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&job->write_mutex);
+}
+
+
+static double batch_now(void)
+{
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double) time.tv_sec + (double) time.tv_nsec * 1e-9;
+}
@@ -0,0 +1,414 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "bytecode.h"
+#include "my_assert.h"
+
+static DError_t dftr_compile_node(const TreeNode * node, DftrProgram * program, size_t * height);
+static DError_t dftr_program_emit(DftrProgram * program, DftrOpcodes opcode, uint32_t arg);
+static DError_t dftr_program_add_constant(DftrProgram * program, double constant, uint32_t * slot);
+static const char * get_opcode_name(uint32_t opcode);
+
+
+DError_t op_new_dftr_program(DftrProgram * program)
+{
+    MY_ASSERT(program);
+
+    DError_t dftr_errors = 0;
+
+    program->code = NULL;
+    program->size = 0;
+    program->capacity = 0;
+    program->constants = NULL;
+    program->constants_size = 0;
+    program->constants_capacity = 0;
+    program->stack_size = 0;
+
+    if (!(program->code = (DftrInstruction *) calloc(DFTR_PROGRAM_DEFAULT_CAPACITY, sizeof(DftrInstruction))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    program->capacity = DFTR_PROGRAM_DEFAULT_CAPACITY;
+
+    if (!(program->constants = (double *) calloc(DFTR_PROGRAM_DEFAULT_CAPACITY, sizeof(double))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    program->constants_capacity = DFTR_PROGRAM_DEFAULT_CAPACITY;
+
+    return dftr_errors;
+}
+
+
+DError_t op_delete_dftr_program(DftrProgram * program)
+{
+    MY_ASSERT(program);
+
+    free(program->code);
+    free(program->constants);
+
+    program->code = NULL;
+    program->size = 0;
+    program->capacity = 0;
+    program->constants = NULL;
+    program->constants_size = 0;
+    program->constants_capacity = 0;
+    program->stack_size = 0;
+
+    return 0;
+}
+
+
+DError_t dftr_compile(const Tree * tree, DftrProgram * program)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(program);
+
+    if (tree_vtor(tree))
+        return DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+    program->size = 0;
+    program->constants_size = 0;
+    program->stack_size = 0;
+
+    DError_t dftr_errors = 0;
+    size_t height = 0;
+
+    const TreeNode * root = tree->root;
+
+    for (const TreeNode * node = tree_postorder_first(root); node && !dftr_errors;
+         node = tree_postorder_next(node, root))
+    {
+        dftr_errors |= dftr_compile_node(node, program, &height);
+    }
+
+    return dftr_errors;
+}
+
+
+/// Emits one node after its operands, the tree is walked in post order so deep chains don't recurse.
+/// height is the number of values on the stack before the node runs.
+static DError_t dftr_compile_node(const TreeNode * node, DftrProgram * program, size_t * height)
+{
+    MY_ASSERT(node);
+    MY_ASSERT(program);
+    MY_ASSERT(height);
+
+    DError_t dftr_errors = 0;
+    uint32_t slot = 0;
+
+    switch (node->value.type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+            if (dftr_errors = dftr_program_add_constant(program, node->value.value.number, &slot))
+                return dftr_errors;
+
+            dftr_errors |= dftr_program_emit(program, DFTR_OPCODE_CONST, slot);
+            (*height)++;
+            break;
+
+        case TREE_NODE_TYPES_VARIABLE:
+            dftr_errors |= dftr_program_emit(program, DFTR_OPCODE_VAR, (uint32_t) node->value.id);
+            (*height)++;
+            break;
+
+        case TREE_NODE_TYPES_OPERATION:
+            switch (MATH_OPERATIONS_ARRAY[node->value.id].type)
+            {
+                case MATH_OPERATION_TYPES_UNARY:
+                    if (!node->left || node->right)
+                    {
+                        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                        return dftr_errors;
+                    }
+                    break;
+
+                case MATH_OPERATION_TYPES_BINARY:
+                    if (!node->left || !node->right)
+                    {
+                        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                        return dftr_errors;
+                    }
+
+                    (*height)--;
+                    break;
+
+                default:
+                    MY_ASSERT(0 && "UNREACHABLE");
+                    break;
+            }
+
+            dftr_errors |= dftr_program_emit(program, dftr_get_operation_opcode(MATH_OPERATIONS_ARRAY[node->value.id].id), 0);
+            break;
+
+        case TREE_NODE_TYPES_STRING:
+        case TREE_NODE_TYPES_NO_TYPE:
+            dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+            break;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    if (*height > program->stack_size)
+        program->stack_size = *height;
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_program_emit(DftrProgram * program, DftrOpcodes opcode, uint32_t arg)
+{
+    MY_ASSERT(program);
+
+    DError_t dftr_errors = 0;
+
+    if (program->size == program->capacity)
+    {
+        DftrInstruction * code = NULL;
+
+        if (!(code = (DftrInstruction *) realloc(program->code, 2 * program->capacity * sizeof(DftrInstruction))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+
+        program->code = code;
+        program->capacity *= 2;
+    }
+
+    program->code[program->size].opcode = (uint32_t) opcode;
+    program->code[program->size].arg = arg;
+    program->size++;
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_program_add_constant(DftrProgram * program, double constant, uint32_t * slot)
+{
+    MY_ASSERT(program);
+    MY_ASSERT(slot);
+
+    DError_t dftr_errors = 0;
+
+    if (program->constants_size == program->constants_capacity)
+    {
+        double * constants = NULL;
+
+        if (!(constants = (double *) realloc(program->constants, 2 * program->constants_capacity * sizeof(double))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+
+        program->constants = constants;
+        program->constants_capacity *= 2;
+    }
+
+    program->constants[program->constants_size] = constant;
+    *slot = (uint32_t) program->constants_size;
+    program->constants_size++;
+
+    return dftr_errors;
+}
+
+
+DftrOpcodes dftr_get_operation_opcode(MathOperations op_id)
+{
+    switch (op_id)
+    {
+        case MATH_OPERATIONS_ADDITION:
+            return DFTR_OPCODE_ADDITION;
+
+        case MATH_OPERATIONS_SUBTRACTION:
+            return DFTR_OPCODE_SUBTRACTION;
+
+        case MATH_OPERATIONS_MULTIPLICATION:
+            return DFTR_OPCODE_MULTIPLICATION;
+
+        case MATH_OPERATIONS_DIVISION:
+            return DFTR_OPCODE_DIVISION;
+
+        case MATH_OPERATIONS_POWER:
+            return DFTR_OPCODE_POWER;
+
+        case MATH_OPERATIONS_SINUS:
+            return DFTR_OPCODE_SINUS;
+
+        case MATH_OPERATIONS_COSINUS:
+            return DFTR_OPCODE_COSINUS;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    return DFTR_OPCODE_CONST;
+}
+
+
+DError_t dftr_program_eval(const DftrProgram * program, const double * variables, double * answer)
+{
+    MY_ASSERT(program);
+    MY_ASSERT(variables);
+    MY_ASSERT(answer);
+
+    DError_t dftr_errors = 0;
+
+    if (!program->size)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+        return dftr_errors;
+    }
+
+    double local_stack[DFTR_PROGRAM_LOCAL_STACK_SIZE];
+    double * stack = local_stack;
+
+    if (program->stack_size > DFTR_PROGRAM_LOCAL_STACK_SIZE &&
+        !(stack = (double *) calloc(program->stack_size, sizeof(double))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    const DftrInstruction * instruction = program->code;
+    const DftrInstruction * code_end = program->code + program->size;
+    const double * constants = program->constants;
+    double * top = stack - 1;
+
+    stack[0] = 0;                                    // Written once so the answer slot is never read uninitialized.
+
+    for (; instruction < code_end; instruction++)
+    {
+        switch (instruction->opcode)
+        {
+            case DFTR_OPCODE_CONST:
+                *++top = constants[instruction->arg];
+                break;
+
+            case DFTR_OPCODE_VAR:
+                *++top = variables[instruction->arg];
+                break;
+
+            case DFTR_OPCODE_ADDITION:
+                top--;
+                top[0] += top[1];
+                break;
+
+            case DFTR_OPCODE_SUBTRACTION:
+                top--;
+                top[0] -= top[1];
+                break;
+
+            case DFTR_OPCODE_MULTIPLICATION:
+                top--;
+                top[0] *= top[1];
+                break;
+
+            case DFTR_OPCODE_DIVISION:
+                top--;
+                top[0] /= top[1];
+                break;
+
+            case DFTR_OPCODE_POWER:
+                top--;
+                top[0] = pow(top[0], top[1]);
+                break;
+
+            case DFTR_OPCODE_SINUS:
+                top[0] = sin(top[0]);
+                break;
+
+            case DFTR_OPCODE_COSINUS:
+                top[0] = cos(top[0]);
+                break;
+
+            default:
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
+        }
+    }
+
+    *answer = stack[0];
+
+    if (stack != local_stack)
+        free(stack);
+
+    return dftr_errors;
+}
+
+
+void dftr_program_dump(const DftrProgram * program, FILE * fp)
+{
+    MY_ASSERT(program);
+    MY_ASSERT(fp);
+
+    fprintf(fp, "Program[%p]: %zu instructions, %zu constants, stack %zu\n",
+            program, program->size, program->constants_size, program->stack_size);
+
+    for (size_t i = 0; i < program->size; i++)
+    {
+        const DftrInstruction * instruction = &program->code[i];
+
+        fprintf(fp, "\t%4zu: %-6s", i, get_opcode_name(instruction->opcode));
+
+        switch (instruction->opcode)
+        {
+            case DFTR_OPCODE_CONST:
+                fprintf(fp, " %lg", program->constants[instruction->arg]);
+                break;
+
+            case DFTR_OPCODE_VAR:
+                fprintf(fp, " %s", SUPPORTED_VARIABLES[instruction->arg].name);
+                break;
+
+            default:
+                break;
+        }
+
+        fprintf(fp, "\n");
+    }
+}
+
+
+static const char * get_opcode_name(uint32_t opcode)
+{
+    switch (opcode)
+    {
+        case DFTR_OPCODE_CONST:
+            return "const";
+
+        case DFTR_OPCODE_VAR:
+            return "var";
+
+        case DFTR_OPCODE_ADDITION:
+            return "add";
+
+        case DFTR_OPCODE_SUBTRACTION:
+            return "sub";
+
+        case DFTR_OPCODE_MULTIPLICATION:
+            return "mul";
+
+        case DFTR_OPCODE_DIVISION:
+            return "div";
+
+        case DFTR_OPCODE_POWER:
+            return "pow";
+
+        case DFTR_OPCODE_SINUS:
+            return "sin";
+
+        case DFTR_OPCODE_COSINUS:
+            return "cos";
+
+        default:
+            break;
+    }
+
+    return "???";
+}
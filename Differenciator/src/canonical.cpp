@@ -0,0 +1,615 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "canonical.h"
+#include "my_assert.h"
+#include "math_operations.h"
+#include "double_comparing.h"
+
+static bool canonical_is_operation(const TreeNode * node, MathOperations op_id);
+static bool canonical_is_sum(const TreeNode * node);
+static bool canonical_is_product(const TreeNode * node);
+static DError_t canonical_visit(Tree * tree, TreeNode * node, DftrCanonicalTerms * terms,
+                                DftrOptimizationStats * stats);
+static int canonical_compare_values(const TreeNode * node1, const TreeNode * node2);
+static DError_t canonical_push(DftrCanonicalTerms * terms, TreeNode * base, double number);
+static DError_t canonical_collect_sum(TreeNode * top, DftrCanonicalTerms * terms, double * constant);
+static DError_t canonical_collect_product(TreeNode * top, DftrCanonicalTerms * terms, double * coefficient);
+static DError_t canonical_detach(Tree * tree, TreeNode * node, DftrCanonicalTerms * terms, bool is_product);
+static bool canonical_can_merge_exponents(double exponent1, double exponent2);
+static int canonical_compare_terms(const void * term1, const void * term2);
+static DError_t canonical_build_sum(Tree * tree, TreeNode * node, const DftrCanonicalTerm * terms, size_t terms_number,
+                                   double constant);
+static DError_t canonical_build_term(Tree * tree, TreeNode * node, TreeNode * base, double coefficient);
+static DError_t canonical_build_product(Tree * tree, TreeNode * node, const DftrCanonicalTerm * terms,
+                                       size_t terms_number, double coefficient);
+static DError_t canonical_build_factor(Tree * tree, TreeNode * node, TreeNode * base, double exponent);
+static DError_t canonical_insert_children(Tree * tree, TreeNode * node, MathOperations op_id);
+static void canonical_set_number(TreeNode * node, double number);
+
+
+/// Flattens every chain of + and - and every chain of * (and division by a
+/// number) into a list, folds all its constants, sorts the operands by
+/// dftr_compare_branch, merges like terms and powers of one base with integer
+/// exponents of one sign and rebuilds the chain:
+///     sum:     ((t1 +- c2 * t2) +- ...) +- constant, terms in order;
+///     product: coefficient * (f1 * (f2 * ...)), a factor is a base or base ^ number.
+/// Chains are handled at their top node, after everything below is canonical.
+DError_t dftr_canonical_optimization(Tree * tree, DftrOptimizationStats * stats)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+    DftrCanonicalTerms terms = {};
+
+    if (!(terms.terms = (DftrCanonicalTerm *) calloc(DFTR_CANONICAL_DEFAULT_CAPACITY, sizeof(DftrCanonicalTerm))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    terms.capacity = DFTR_CANONICAL_DEFAULT_CAPACITY;
+
+    stats->rounds++;
+
+    // A chain is rebuilt below its top node only, so the next node is not touched by the visit.
+    TreeNode * root = tree->root;
+    for (TreeNode * node = tree_postorder_first(root); node && !dftr_errors;
+         node = tree_postorder_next(node, root))
+    {
+        dftr_errors |= canonical_visit(tree, node, &terms, stats);
+    }
+
+    free(terms.terms);
+
+    // Chains may have folded into numbers under sin, cos and the like.
+    if (!dftr_errors)
+        dftr_errors |= dftr_worklist_optimization(tree, stats);
+
+    return dftr_errors;
+}
+
+
+/// Total order on branches: numbers, variables, then operations, each by value,
+/// operations then by their children. Both branches are walked in pre-order side by
+/// side, which stays possible as long as every pair of nodes met so far has one shape.
+int dftr_compare_branch(const TreeNode * node1, const TreeNode * node2)
+{
+    if (!node1 || !node2)
+        return (node1 != NULL) - (node2 != NULL);
+
+    const TreeNode * root1 = node1;
+
+    while (true)
+    {
+        int result = canonical_compare_values(node1, node2);
+        if (result)
+            return result;
+
+        if (node1->left || node2->left)
+        {
+            if (!node1->left || !node2->left)
+                return (node1->left != NULL) - (node2->left != NULL);
+
+            node1 = node1->left;
+            node2 = node2->left;
+            continue;
+        }
+
+        // Up to the first node whose right branch is not compared yet.
+        while (!node1->right && !node2->right)
+        {
+            while (node1 != root1 && node1 == node1->parent->right)
+            {
+                node1 = node1->parent;
+                node2 = node2->parent;
+            }
+
+            if (node1 == root1)
+                return 0;
+
+            node1 = node1->parent;
+            node2 = node2->parent;
+        }
+
+        if (!node1->right || !node2->right)
+            return (node1->right != NULL) - (node2->right != NULL);
+
+        node1 = node1->right;
+        node2 = node2->right;
+    }
+}
+
+
+static int canonical_compare_values(const TreeNode * node1, const TreeNode * node2)
+{
+    MY_ASSERT(node1);
+    MY_ASSERT(node2);
+
+    if (node1->value.type != node2->value.type)
+        return node1->value.type < node2->value.type ? -1 : 1;
+
+    switch (node1->value.type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+            if (node1->value.value.number < node2->value.value.number)
+                return -1;
+            if (node1->value.value.number > node2->value.value.number)
+                return 1;
+            break;
+
+        case TREE_NODE_TYPES_OPERATION:
+        case TREE_NODE_TYPES_VARIABLE:
+            if (node1->value.id != node2->value.id)
+                return node1->value.id < node2->value.id ? -1 : 1;
+            break;
+
+        case TREE_NODE_TYPES_STRING:
+        case TREE_NODE_TYPES_NO_TYPE:
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+
+static bool canonical_is_operation(const TreeNode * node, MathOperations op_id)
+{
+    MY_ASSERT(node);
+
+    return node->value.type == TREE_NODE_TYPES_OPERATION && MATH_OPERATIONS_ARRAY[node->value.id].id == op_id;
+}
+
+
+static bool canonical_is_sum(const TreeNode * node)
+{
+    return canonical_is_operation(node, MATH_OPERATIONS_ADDITION) ||
+           canonical_is_operation(node, MATH_OPERATIONS_SUBTRACTION);
+}
+
+
+static bool canonical_is_product(const TreeNode * node)
+{
+    return canonical_is_operation(node, MATH_OPERATIONS_MULTIPLICATION) ||
+           (canonical_is_operation(node, MATH_OPERATIONS_DIVISION) &&
+            node->right->value.type == TREE_NODE_TYPES_NUMBER);
+}
+
+
+static DError_t canonical_visit(Tree * tree, TreeNode * node, DftrCanonicalTerms * terms,
+                                DftrOptimizationStats * stats)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(node);
+    MY_ASSERT(terms);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+
+    stats->visits++;
+
+    if (canonical_is_sum(node) && !(node->parent && canonical_is_sum(node->parent)))
+    {
+        double constant = 0;
+
+        terms->size = 0;
+        if ((dftr_errors = canonical_collect_sum(node, terms, &constant)) ||
+            (dftr_errors = canonical_detach(tree, node, terms, false)))
+        {
+            return dftr_errors;
+        }
+
+        stats->rewrites++;
+        return canonical_build_sum(tree, node, terms->terms, terms->size, constant);
+    }
+
+    if (canonical_is_product(node) && !(node->parent && canonical_is_product(node->parent)))
+    {
+        double coefficient = 1;
+
+        terms->size = 0;
+        if ((dftr_errors = canonical_collect_product(node, terms, &coefficient)) ||
+            (dftr_errors = canonical_detach(tree, node, terms, true)))
+        {
+            return dftr_errors;
+        }
+
+        stats->rewrites++;
+
+        if (is_exact_double(coefficient, 0))
+        {
+            for (size_t i = 0; i < terms->size; i++)
+                tree_delete_branch(tree, &terms->terms[i].base);
+
+            canonical_set_number(node, 0);
+            return dftr_errors;
+        }
+
+        return canonical_build_product(tree, node, terms->terms, terms->size, coefficient);
+    }
+
+    return dftr_errors;
+}
+
+
+static DError_t canonical_push(DftrCanonicalTerms * terms, TreeNode * base, double number)
+{
+    MY_ASSERT(terms);
+
+    DError_t dftr_errors = 0;
+
+    if (terms->size == terms->capacity)
+    {
+        DftrCanonicalTerm * new_terms = NULL;
+        if (!(new_terms = (DftrCanonicalTerm *) realloc(terms->terms, 2 * terms->capacity * sizeof(DftrCanonicalTerm))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+
+        terms->terms = new_terms;
+        terms->capacity *= 2;
+    }
+
+    terms->terms[terms->size].base = base;
+    terms->terms[terms->size].number = number;
+    terms->size++;
+
+    return dftr_errors;
+}
+
+
+/// Operands of the chain under top from left to right. The walk goes by the parent links,
+/// sign flips on the way into the right branch of a subtraction and back on the way out.
+/// A canonical product keeps its coefficient on the left, so c * t is taken as the term t times c.
+static DError_t canonical_collect_sum(TreeNode * top, DftrCanonicalTerms * terms, double * constant)
+{
+    MY_ASSERT(top);
+    MY_ASSERT(terms);
+    MY_ASSERT(constant);
+
+    DError_t dftr_errors = 0;
+    TreeNode * node = top;
+    double sign = 1;
+
+    while (!dftr_errors)
+    {
+        while (canonical_is_sum(node))
+            node = node->left;
+
+        if (node->value.type == TREE_NODE_TYPES_NUMBER)
+            *constant += sign * node->value.value.number;
+        else if (canonical_is_operation(node, MATH_OPERATIONS_MULTIPLICATION) &&
+                 node->left->value.type == TREE_NODE_TYPES_NUMBER)
+            dftr_errors |= canonical_push(terms, node->right, sign * node->left->value.value.number);
+        else
+            dftr_errors |= canonical_push(terms, node, sign);
+
+        while (node != top)
+        {
+            TreeNode * parent = node->parent;
+
+            if (canonical_is_operation(parent, MATH_OPERATIONS_SUBTRACTION))
+                sign = -sign;
+
+            if (node == parent->left)
+                break;
+
+            node = parent;
+        }
+
+        if (node == top)
+            break;
+
+        node = node->parent->right;
+    }
+
+    return dftr_errors;
+}
+
+
+/// Same walk as canonical_collect_sum, a division by a number ends its chain on the left.
+static DError_t canonical_collect_product(TreeNode * top, DftrCanonicalTerms * terms, double * coefficient)
+{
+    MY_ASSERT(top);
+    MY_ASSERT(terms);
+    MY_ASSERT(coefficient);
+
+    DError_t dftr_errors = 0;
+    TreeNode * node = top;
+
+    while (!dftr_errors)
+    {
+        while (canonical_is_product(node))
+            node = node->left;
+
+        if (node->value.type == TREE_NODE_TYPES_NUMBER)
+            *coefficient *= node->value.value.number;
+        else if (canonical_is_operation(node, MATH_OPERATIONS_POWER) &&
+                 node->right->value.type == TREE_NODE_TYPES_NUMBER)
+            dftr_errors |= canonical_push(terms, node->left, node->right->value.value.number);
+        else
+            dftr_errors |= canonical_push(terms, node, 1);
+
+        while (node != top)
+        {
+            TreeNode * parent = node->parent;
+
+            if (node == parent->left && canonical_is_operation(parent, MATH_OPERATIONS_MULTIPLICATION))
+                break;
+
+            if (node == parent->left)
+                *coefficient /= parent->right->value.value.number;
+
+            node = parent;
+        }
+
+        if (node == top)
+            break;
+
+        node = node->parent->right;
+    }
+
+    return dftr_errors;
+}
+
+
+/// Sorts and merges the operands, takes them out of the chain, frees the rest of
+/// the chain and the merged or zeroed operands. Only the kept operands stay in terms.
+static DError_t canonical_detach(Tree * tree, TreeNode * node, DftrCanonicalTerms * terms, bool is_product)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(node);
+    MY_ASSERT(terms);
+
+    DError_t dftr_errors = 0;
+    TError_t tree_errors = 0;
+
+    qsort(terms->terms, terms->size, sizeof(DftrCanonicalTerm), canonical_compare_terms);
+
+    for (size_t i = 0; i < terms->size; i++)
+    {
+        TreeNode * base = terms->terms[i].base;
+
+        if (base->parent->left == base)
+            base->parent->left = NULL;
+        else
+            base->parent->right = NULL;
+    }
+
+    if (node->left)
+        tree_errors |= tree_delete_branch(tree, &node->left);
+    if (node->right)
+        tree_errors |= tree_delete_branch(tree, &node->right);
+
+    size_t kept_number = 0;
+    for (size_t i = 0; i < terms->size; i++)
+    {
+        DftrCanonicalTerm * term = &terms->terms[i];
+
+        if (kept_number && !dftr_compare_branch(terms->terms[kept_number - 1].base, term->base) &&
+            (!is_product || canonical_can_merge_exponents(terms->terms[kept_number - 1].number, term->number)))
+        {
+            terms->terms[kept_number - 1].number += term->number;
+            tree_errors |= tree_delete_branch(tree, &term->base);
+            continue;
+        }
+
+        terms->terms[kept_number++] = *term;
+    }
+
+    terms->size = 0;
+    for (size_t i = 0; i < kept_number; i++)
+    {
+        // A zero coefficient drops the term. A zero exponent stays, x ^ 0 is not 1 where x is not defined.
+        if (!is_product && is_exact_double(terms->terms[i].number, 0))
+        {
+            tree_errors |= tree_delete_branch(tree, &terms->terms[i].base);
+            continue;
+        }
+
+        terms->terms[terms->size++] = terms->terms[i];
+    }
+
+    if (tree_errors)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+    return dftr_errors;
+}
+
+
+/// x ^ a * x ^ b is x ^ (a + b) only for integer exponents of one sign: x ^ 0.5 * x ^ 0.5 is NaN
+/// for a negative x, not x, and x ^ 2 * x ^ -2 is NaN at 0, not 1.
+static bool canonical_can_merge_exponents(double exponent1, double exponent2)
+{
+    return is_exact_double(exponent1, floor(exponent1)) && is_exact_double(exponent2, floor(exponent2)) &&
+           exponent1 * exponent2 >= 0;
+}
+
+
+/// By base, then by number, so factors of one base that can't merge still come out in one order.
+static int canonical_compare_terms(const void * term1, const void * term2)
+{
+    MY_ASSERT(term1);
+    MY_ASSERT(term2);
+
+    const DftrCanonicalTerm * canonical_term1 = (const DftrCanonicalTerm *) term1;
+    const DftrCanonicalTerm * canonical_term2 = (const DftrCanonicalTerm *) term2;
+
+    int result = dftr_compare_branch(canonical_term1->base, canonical_term2->base);
+    if (result)
+        return result;
+
+    return (canonical_term1->number > canonical_term2->number) - (canonical_term1->number < canonical_term2->number);
+}
+
+
+/// The chain is left-deep, so it is built from the top: the constant, then the terms from the last one.
+static DError_t canonical_build_sum(Tree * tree, TreeNode * node, const DftrCanonicalTerm * terms, size_t terms_number,
+                                   double constant)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(node);
+    MY_ASSERT(terms);
+
+    DError_t dftr_errors = 0;
+
+    if (!terms_number)
+    {
+        canonical_set_number(node, constant);
+        return dftr_errors;
+    }
+
+    if (!is_exact_double(constant, 0))
+    {
+        MathOperations op_id = constant < 0 ? MATH_OPERATIONS_SUBTRACTION : MATH_OPERATIONS_ADDITION;
+
+        if (dftr_errors = canonical_insert_children(tree, node, op_id))
+            return dftr_errors;
+
+        canonical_set_number(node->right, fabs(constant));
+        node = node->left;
+    }
+
+    for (size_t i = terms_number - 1; i > 0 && !dftr_errors; i--)
+    {
+        MathOperations op_id = terms[i].number < 0 ? MATH_OPERATIONS_SUBTRACTION : MATH_OPERATIONS_ADDITION;
+
+        if (dftr_errors = canonical_insert_children(tree, node, op_id))
+            return dftr_errors;
+
+        dftr_errors |= canonical_build_term(tree, node->right, terms[i].base, fabs(terms[i].number));
+        node = node->left;
+    }
+
+    if (!dftr_errors)
+        dftr_errors |= canonical_build_term(tree, node, terms[0].base, terms[0].number);
+
+    return dftr_errors;
+}
+
+
+static DError_t canonical_build_term(Tree * tree, TreeNode * node, TreeNode * base, double coefficient)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(node);
+    MY_ASSERT(base);
+
+    DError_t dftr_errors = 0;
+
+    if (is_exact_double(coefficient, 1))
+    {
+        if (tree_move_branch(tree, node, base))
+            dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+        return dftr_errors;
+    }
+
+    if (dftr_errors = canonical_insert_children(tree, node, MATH_OPERATIONS_MULTIPLICATION))
+        return dftr_errors;
+
+    canonical_set_number(node->left, coefficient);
+
+    if (tree_move_branch(tree, node->right, base))
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+    return dftr_errors;
+}
+
+
+/// The chain is right-deep, so it is built from the top: the coefficient, then the factors in order.
+static DError_t canonical_build_product(Tree * tree, TreeNode * node, const DftrCanonicalTerm * terms,
+                                       size_t terms_number, double coefficient)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(node);
+    MY_ASSERT(terms);
+
+    DError_t dftr_errors = 0;
+
+    if (!terms_number)
+    {
+        canonical_set_number(node, coefficient);
+        return dftr_errors;
+    }
+
+    if (!is_exact_double(coefficient, 1))
+    {
+        if (dftr_errors = canonical_insert_children(tree, node, MATH_OPERATIONS_MULTIPLICATION))
+            return dftr_errors;
+
+        canonical_set_number(node->left, coefficient);
+        node = node->right;
+    }
+
+    for (size_t i = 0; i + 1 < terms_number && !dftr_errors; i++)
+    {
+        if (dftr_errors = canonical_insert_children(tree, node, MATH_OPERATIONS_MULTIPLICATION))
+            return dftr_errors;
+
+        dftr_errors |= canonical_build_factor(tree, node->left, terms[i].base, terms[i].number);
+        node = node->right;
+    }
+
+    if (!dftr_errors)
+        dftr_errors |= canonical_build_factor(tree, node, terms[terms_number - 1].base, terms[terms_number - 1].number);
+
+    return dftr_errors;
+}
+
+
+static DError_t canonical_build_factor(Tree * tree, TreeNode * node, TreeNode * base, double exponent)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(node);
+    MY_ASSERT(base);
+
+    DError_t dftr_errors = 0;
+
+    if (is_exact_double(exponent, 1))
+    {
+        if (tree_move_branch(tree, node, base))
+            dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+        return dftr_errors;
+    }
+
+    if (dftr_errors = canonical_insert_children(tree, node, MATH_OPERATIONS_POWER))
+        return dftr_errors;
+
+    canonical_set_number(node->right, exponent);
+
+    if (tree_move_branch(tree, node->left, base))
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+    return dftr_errors;
+}
+
+
+static DError_t canonical_insert_children(Tree * tree, TreeNode * node, MathOperations op_id)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(node);
+
+    DError_t dftr_errors = 0;
+
+    dftr_set_operation(&node->value, op_id);
+
+    if (tree_insert(tree, node, TREE_NODE_BRANCH_LEFT, TREE_NULL) ||
+        tree_insert(tree, node, TREE_NODE_BRANCH_RIGHT, TREE_NULL))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+    }
+
+    return dftr_errors;
+}
+
+
+static void canonical_set_number(TreeNode * node, double number)
+{
+    MY_ASSERT(node);
+
+    node->value.type = TREE_NODE_TYPES_NUMBER;
+    node->value.value.number = number;
+}
@@ -0,0 +1,523 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "cse.h"
+#include "horner.h"
+#include "strength.h"
+#include "my_assert.h"
+#include "math_operations.h"
+
+/// Part of a node dftr_cse_print_node prints next.
+enum DftrCsePrintStates {
+    DFTR_CSE_PRINT_STATES_LEFT  = 0,
+    DFTR_CSE_PRINT_STATES_RIGHT = 1,
+    DFTR_CSE_PRINT_STATES_CLOSE = 2,
+};
+
+struct DftrCsePrintFrame {
+    DagIndex index;
+    DftrCsePrintStates state;
+};
+
+static DError_t dftr_cse_reserve(DftrCse * cse, size_t size);
+static void dftr_cse_pair_sincos(DftrCse * cse);
+static void dftr_cse_print_line(const DftrCse * cse, FILE * fp, const char * name, DagIndex index,
+                                DftrPrintStyles style, DftrCsePrintFrame * frames);
+static void dftr_cse_print_node(const DftrCse * cse, FILE * fp, DagIndex index, DftrPrintStyles style,
+                                DftrCsePrintFrame * frames);
+static void dftr_cse_print_leaf(const DagNode * node, FILE * fp, DftrPrintStyles style);
+static void dftr_cse_print_temporary(FILE * fp, uint32_t temporary, DftrPrintStyles style);
+
+
+DError_t op_new_dftr_cse(DftrCse * cse)
+{
+    MY_ASSERT(cse);
+
+    DError_t dftr_errors = 0;
+
+    cse->root = DAG_NULL_INDEX;
+    cse->temporaries = NULL;
+    cse->order = NULL;
+    cse->temporaries_number = 0;
+    cse->is_reachable = NULL;
+    cse->schedule = NULL;
+    cse->schedule_size = 0;
+    cse->values = NULL;
+    cse->partners = NULL;
+    cse->min_size = DFTR_CSE_DEFAULT_MIN_SIZE;
+    cse->is_sincos_fused = false;
+    cse->polynomials = NULL;
+    cse->coefficients = NULL;
+    cse->coefficients_size = 0;
+    cse->coefficients_capacity = 0;
+    cse->is_horner = false;
+
+    if (op_new_dag(&cse->dag))
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+
+    return dftr_errors;
+}
+
+
+DError_t op_delete_dftr_cse(DftrCse * cse)
+{
+    MY_ASSERT(cse);
+
+    op_delete_dag(&cse->dag);
+
+    free(cse->temporaries);
+    free(cse->order);
+    free(cse->is_reachable);
+    free(cse->schedule);
+    free(cse->values);
+    free(cse->partners);
+    free(cse->polynomials);
+    free(cse->coefficients);
+
+    cse->root = DAG_NULL_INDEX;
+    cse->temporaries = NULL;
+    cse->order = NULL;
+    cse->temporaries_number = 0;
+    cse->is_reachable = NULL;
+    cse->schedule = NULL;
+    cse->schedule_size = 0;
+    cse->values = NULL;
+    cse->partners = NULL;
+    cse->min_size = DFTR_CSE_DEFAULT_MIN_SIZE;
+    cse->is_sincos_fused = false;
+    cse->polynomials = NULL;
+    cse->coefficients = NULL;
+    cse->coefficients_size = 0;
+    cse->coefficients_capacity = 0;
+    cse->is_horner = false;
+
+    return 0;
+}
+
+
+/// Hash-conses the tree and gives a temporary to every operation used more
+/// than once whose expanded subtree has at least min_size nodes. The DAG
+/// appends a node after its children, so index order is an evaluation order.
+DError_t dftr_cse_build(DftrCse * cse, const Tree * tree, size_t min_size)
+{
+    MY_ASSERT(cse);
+    MY_ASSERT(tree);
+
+    DError_t dftr_errors = 0;
+
+    dag_clear(&cse->dag);
+    cse->min_size = min_size;
+    cse->is_sincos_fused = false;
+    cse->is_horner = false;
+
+    if (dag_from_tree(&cse->dag, tree, &cse->root))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+        return dftr_errors;
+    }
+
+    return dftr_cse_analyze(cse);
+}
+
+
+/// Marks the nodes below root, counts their uses and numbers the temporaries.
+DError_t dftr_cse_analyze(DftrCse * cse)
+{
+    MY_ASSERT(cse);
+
+    DError_t dftr_errors = 0;
+
+    size_t size = cse->dag.size;
+    const DagNode * nodes = cse->dag.nodes;
+
+    cse->temporaries_number = 0;
+    cse->schedule_size = 0;
+
+    if (dftr_errors = dftr_cse_reserve(cse, size))
+        return dftr_errors;
+
+    // Expanded sizes are counted in values, uses in temporaries.
+    for (size_t i = 0; i < size; i++)
+    {
+        cse->is_reachable[i] = false;
+        cse->temporaries[i] = 0;
+        cse->partners[i] = DAG_NULL_INDEX;
+    }
+    cse->is_reachable[cse->root] = true;
+
+    for (size_t i = cse->root + 1; i-- > 0;)
+    {
+        if (!cse->is_reachable[i] || (cse->is_horner && cse->polynomials[i].degree != DFTR_NOT_POLYNOMIAL))
+            continue;
+
+        if (nodes[i].left != DAG_NULL_INDEX)
+        {
+            cse->temporaries[nodes[i].left]++;
+            cse->is_reachable[nodes[i].left] = true;
+        }
+
+        if (nodes[i].right != DAG_NULL_INDEX)
+        {
+            cse->temporaries[nodes[i].right]++;
+            cse->is_reachable[nodes[i].right] = true;
+        }
+    }
+
+    if (cse->is_sincos_fused)
+        dftr_cse_pair_sincos(cse);
+
+    // Sizes are counted below unreachable nodes too, the branches of a Horner root are printed.
+    for (size_t i = 0; i <= cse->root; i++)
+    {
+        cse->values[i] = 1;
+        if (nodes[i].left != DAG_NULL_INDEX)
+            cse->values[i] += cse->values[nodes[i].left];
+        if (nodes[i].right != DAG_NULL_INDEX)
+            cse->values[i] += cse->values[nodes[i].right];
+
+        if (!cse->is_reachable[i])
+            continue;
+
+        cse->schedule[cse->schedule_size++] = (DagIndex) i;
+
+        if (cse->temporaries[i] > 1 && nodes[i].left != DAG_NULL_INDEX && cse->values[i] >= (double) cse->min_size)
+        {
+            cse->order[cse->temporaries_number++] = (DagIndex) i;
+            cse->temporaries[i] = (uint32_t) cse->temporaries_number;
+        }
+        else
+        {
+            cse->temporaries[i] = DFTR_CSE_NO_TEMPORARY;
+        }
+    }
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_cse_reserve(DftrCse * cse, size_t size)
+{
+    MY_ASSERT(cse);
+
+    DError_t dftr_errors = 0;
+
+    uint32_t * temporaries = (uint32_t *) realloc(cse->temporaries, size * sizeof(uint32_t));
+    if (temporaries)
+        cse->temporaries = temporaries;
+
+    DagIndex * order = (DagIndex *) realloc(cse->order, size * sizeof(DagIndex));
+    if (order)
+        cse->order = order;
+
+    bool * is_reachable = (bool *) realloc(cse->is_reachable, size * sizeof(bool));
+    if (is_reachable)
+        cse->is_reachable = is_reachable;
+
+    DagIndex * schedule = (DagIndex *) realloc(cse->schedule, size * sizeof(DagIndex));
+    if (schedule)
+        cse->schedule = schedule;
+
+    double * values = (double *) realloc(cse->values, size * sizeof(double));
+    if (values)
+        cse->values = values;
+
+    DagIndex * partners = (DagIndex *) realloc(cse->partners, size * sizeof(DagIndex));
+    if (partners)
+        cse->partners = partners;
+
+    if (!temporaries || !order || !is_reachable || !schedule || !values || !partners)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+
+    return dftr_errors;
+}
+
+
+/// Every distinct subtree is evaluated once, in index order.
+DError_t dftr_cse_eval(DftrCse * cse, const double * variables, double * answer)
+{
+    MY_ASSERT(cse);
+    MY_ASSERT(variables);
+    MY_ASSERT(answer);
+
+    DError_t dftr_errors = 0;
+    const DagNode * nodes = cse->dag.nodes;
+    double * values = cse->values;
+
+    for (size_t k = 0; k < cse->schedule_size; k++)
+    {
+        size_t i = cse->schedule[k];
+
+        switch (nodes[i].value.type)
+        {
+            case TREE_NODE_TYPES_NUMBER:
+                values[i] = nodes[i].value.value.number;
+                break;
+
+            case TREE_NODE_TYPES_VARIABLE:
+                values[i] = variables[nodes[i].value.id];
+                break;
+
+            case TREE_NODE_TYPES_OPERATION:
+                if (cse->is_horner && cse->polynomials[i].degree != DFTR_NOT_POLYNOMIAL)
+                {
+                    const DftrPolynomial * polynomial = &cse->polynomials[i];
+                    values[i] = dftr_horner_eval(cse->coefficients + polynomial->offset, polynomial->degree,
+                                                 variables[polynomial->variable_id]);
+                    break;
+                }
+
+                if (cse->partners[i] != DAG_NULL_INDEX)
+                {
+                    // The first node of the pair computes both values.
+                    if (cse->partners[i] > i)
+                    {
+                        if (MATH_OPERATIONS_ARRAY[nodes[i].value.id].id == MATH_OPERATIONS_SINUS)
+                            sincos(values[nodes[i].left], &values[i], &values[cse->partners[i]]);
+                        else
+                            sincos(values[nodes[i].left], &values[cse->partners[i]], &values[i]);
+                    }
+                    break;
+                }
+
+                values[i] = MATH_OPERATIONS_ARRAY[nodes[i].value.id].operation(
+                                values[nodes[i].left],
+                                nodes[i].right != DAG_NULL_INDEX ? values[nodes[i].right] : 0);
+                break;
+
+            case TREE_NODE_TYPES_STRING:
+            case TREE_NODE_TYPES_NO_TYPE:
+            default:
+                dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                return dftr_errors;
+        }
+    }
+
+    *answer = values[cse->root];
+
+    return dftr_errors;
+}
+
+
+/// Links every reachable sin(u) with the cos(u) of the same argument.
+/// order is free here, it maps an argument to its sine until the temporaries are numbered.
+static void dftr_cse_pair_sincos(DftrCse * cse)
+{
+    MY_ASSERT(cse);
+
+    const DagNode * nodes = cse->dag.nodes;
+
+    for (size_t i = 0; i <= cse->root; i++)
+        cse->order[i] = DAG_NULL_INDEX;
+
+    for (size_t i = 0; i <= cse->root; i++)
+        if (cse->is_reachable[i] && nodes[i].value.type == TREE_NODE_TYPES_OPERATION &&
+            MATH_OPERATIONS_ARRAY[nodes[i].value.id].id == MATH_OPERATIONS_SINUS)
+        {
+            cse->order[nodes[i].left] = (DagIndex) i;
+        }
+
+    for (size_t i = 0; i <= cse->root; i++)
+    {
+        if (!cse->is_reachable[i] || nodes[i].value.type != TREE_NODE_TYPES_OPERATION ||
+            MATH_OPERATIONS_ARRAY[nodes[i].value.id].id != MATH_OPERATIONS_COSINUS)
+        {
+            continue;
+        }
+
+        DagIndex sinus = cse->order[nodes[i].left];
+        if (sinus != DAG_NULL_INDEX)
+        {
+            cse->partners[sinus] = (DagIndex) i;
+            cse->partners[i] = sinus;
+        }
+    }
+}
+
+
+/// Prints the temporaries one per line, then func.
+DError_t dftr_cse_print(const DftrCse * cse, FILE * fp, const char * func, DftrPrintStyles style)
+{
+    MY_ASSERT(cse);
+    MY_ASSERT(fp);
+    MY_ASSERT(func);
+
+    DError_t dftr_errors = 0;
+    DftrCsePrintFrame * frames = NULL;
+
+    // Children have smaller indices, so no path below root is longer than root + 1 nodes.
+    if (!(frames = (DftrCsePrintFrame *) calloc(cse->root + 1, sizeof(DftrCsePrintFrame))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    for (size_t i = 0; i < cse->temporaries_number; i++)
+        dftr_cse_print_line(cse, fp, NULL, cse->order[i], style, frames);
+
+    dftr_cse_print_line(cse, fp, func, cse->root, style, frames);
+
+    free(frames);
+
+    return dftr_errors;
+}
+
+
+/// Prints the strength reduced DAG, the schedule that dftr_cse_eval runs.
+DError_t dftr_print(const DftrContext * context, const Tree * tree, FILE * fp, const char * func,
+                    DftrPrintStyles style)
+{
+    MY_ASSERT(context);
+    MY_ASSERT(tree);
+    MY_ASSERT(fp);
+    MY_ASSERT(func);
+
+    DError_t dftr_errors = 0;
+    DftrCse cse = {};
+
+    if (!(dftr_errors = op_new_dftr_cse(&cse)) &&
+        !(dftr_errors = dftr_cse_build(&cse, tree, context->cse_min_size)) &&
+        !(dftr_errors = dftr_cse_reduce_strength(&cse, NULL)))
+    {
+        dftr_errors = dftr_cse_print(&cse, fp, func, style);
+    }
+
+    op_delete_dftr_cse(&cse);
+
+    return dftr_errors;
+}
+
+
+static void dftr_cse_print_line(const DftrCse * cse, FILE * fp, const char * name, DagIndex index,
+                                DftrPrintStyles style, DftrCsePrintFrame * frames)
+{
+    MY_ASSERT(cse);
+    MY_ASSERT(fp);
+
+    if (style == DFTR_PRINT_LATEX)
+        fprintf(fp, "\t$\\;\\;\\; {");
+
+    if (name)
+        fprintf(fp, "%s", name);
+    else
+        dftr_cse_print_temporary(fp, cse->temporaries[index], style);
+
+    fprintf(fp, style == DFTR_PRINT_LATEX ? "} = " : " = ");
+    dftr_cse_print_node(cse, fp, index, style, frames);
+    fprintf(fp, style == DFTR_PRINT_LATEX ? "\t$;\n\n" : "\n");
+}
+
+
+/// Same layout as latex_print_equation_recursive, a temporary below the top is printed by name.
+/// frames is the path from index down to the node being printed.
+static void dftr_cse_print_node(const DftrCse * cse, FILE * fp, DagIndex index, DftrPrintStyles style,
+                                DftrCsePrintFrame * frames)
+{
+    MY_ASSERT(cse);
+    MY_ASSERT(fp);
+    MY_ASSERT(frames);
+
+    size_t size = 0;
+    frames[size++] = {.index = index, .state = DFTR_CSE_PRINT_STATES_LEFT};
+
+    while (size)
+    {
+        DftrCsePrintFrame * frame = &frames[size - 1];
+        const DagNode * node = &cse->dag.nodes[frame->index];
+
+        switch (frame->state)
+        {
+            case DFTR_CSE_PRINT_STATES_LEFT:
+                if (size > 1 && cse->temporaries[frame->index] != DFTR_CSE_NO_TEMPORARY)
+                {
+                    dftr_cse_print_temporary(fp, cse->temporaries[frame->index], style);
+                    fprintf(fp, " ");
+                    size--;
+                    break;
+                }
+
+                if (node->left == DAG_NULL_INDEX)
+                {
+                    dftr_cse_print_leaf(node, fp, style);
+                    size--;
+                    break;
+                }
+
+                if (node->right != DAG_NULL_INDEX)
+                {
+                    fprintf(fp, "( ");
+                    frame->state = DFTR_CSE_PRINT_STATES_RIGHT;
+                }
+                else
+                {
+                    fprintf(fp, "%s( ", MATH_OPERATIONS_ARRAY[node->value.id].name);
+                    frame->state = DFTR_CSE_PRINT_STATES_CLOSE;
+                }
+
+                frames[size++] = {.index = node->left, .state = DFTR_CSE_PRINT_STATES_LEFT};
+                break;
+
+            case DFTR_CSE_PRINT_STATES_RIGHT:
+                if (style == DFTR_PRINT_LATEX &&
+                    MATH_OPERATIONS_ARRAY[node->value.id].id == MATH_OPERATIONS_MULTIPLICATION)
+                {
+                    fprintf(fp, "\\cdot ");
+                }
+                else
+                {
+                    fprintf(fp, "%s ", MATH_OPERATIONS_ARRAY[node->value.id].name);
+                }
+
+                frame->state = DFTR_CSE_PRINT_STATES_CLOSE;
+                frames[size++] = {.index = node->right, .state = DFTR_CSE_PRINT_STATES_LEFT};
+                break;
+
+            case DFTR_CSE_PRINT_STATES_CLOSE:
+                fprintf(fp, ") ");
+                size--;
+                break;
+
+            default:
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
+        }
+    }
+}
+
+
+static void dftr_cse_print_leaf(const DagNode * node, FILE * fp, DftrPrintStyles style)
+{
+    MY_ASSERT(node);
+    MY_ASSERT(fp);
+
+    if (style == DFTR_PRINT_LATEX)
+        fprintf(fp, "{ ");
+
+    switch (node->value.type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+            fprintf(fp, "%lg ", node->value.value.number);
+            break;
+
+        case TREE_NODE_TYPES_STRING:
+        case TREE_NODE_TYPES_OPERATION:
+        case TREE_NODE_TYPES_VARIABLE:
+            fprintf(fp, "%s ", node->value.value.string);
+            break;
+
+        case TREE_NODE_TYPES_NO_TYPE:
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    if (style == DFTR_PRINT_LATEX)
+        fprintf(fp, "} ");
+}
+
+
+static void dftr_cse_print_temporary(FILE * fp, uint32_t temporary, DftrPrintStyles style)
+{
+    MY_ASSERT(fp);
+
+    fprintf(fp, style == DFTR_PRINT_LATEX ? "t_{%u}" : "t%u", temporary);
+}
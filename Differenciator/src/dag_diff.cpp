@@ -0,0 +1,229 @@
+#include <stdlib.h>
+
+#include "dag_diff.h"
+#include "my_assert.h"
+
+static TError_t dftr_dag_diff_nodes(Dag * dag, const DagIndex root, size_t variable_id, DagIndex * memo);
+static TError_t dftr_dag_diff_node(Dag * dag, const DagIndex node, size_t variable_id,
+                                   const DagIndex * memo, DagIndex * d_node);
+static TError_t dag_number(Dag * dag, double number, DagIndex * node);
+static TError_t dag_operation(Dag * dag, MathOperations op_id, const DagIndex left, const DagIndex right,
+                              DagIndex * node);
+
+
+/// Same rules as dftr_create_diff_tree, but operands are referenced instead of
+/// copied and every shared subtree is differentiated once.
+DError_t dftr_dag_diff(Dag * dag, const DagIndex root, size_t variable_id, DagIndex * d_root)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(root < dag->size);
+    MY_ASSERT(d_root);
+
+    DError_t dftr_errors = 0;
+    DagIndex * memo = NULL;
+
+    if (!(memo = (DagIndex *) malloc(dag->size * sizeof(DagIndex))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    for (size_t i = 0; i < dag->size; i++)
+        memo[i] = DAG_NULL_INDEX;
+
+    TError_t tree_errors = dftr_dag_diff_nodes(dag, root, variable_id, memo);
+
+    if (tree_errors & TREE_ERRORS_INVALID_NODE)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+    else if (tree_errors)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+    else
+        *d_root = memo[root];
+
+    free(memo);
+
+    return dftr_errors;
+}
+
+
+/// Children are made before their parents, so the nodes below root are differentiated
+/// in index order and the derivatives of the operands are in memo when a node is met.
+/// A pass down from root first marks the nodes the rules need the derivative of.
+static TError_t dftr_dag_diff_nodes(Dag * dag, const DagIndex root, size_t variable_id, DagIndex * memo)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(memo);
+
+    TError_t errors = 0;
+    bool * is_needed = NULL;
+
+    if (!(is_needed = (bool *) calloc((size_t) root + 1, sizeof(bool))))
+    {
+        errors |= TREE_ERRORS_CANT_ALLOCATE_MEMORY;
+        return errors;
+    }
+
+    is_needed[root] = true;
+
+    for (size_t i = (size_t) root + 1; i-- > 0;)
+    {
+        const DagNode * node = &dag->nodes[i];
+
+        if (!is_needed[i] || node->value.type != TREE_NODE_TYPES_OPERATION)
+            continue;
+
+        if (node->left != DAG_NULL_INDEX)
+            is_needed[node->left] = true;
+
+        // Exponents are constants, d_power doesn't differentiate them.
+        if (node->right != DAG_NULL_INDEX &&
+            MATH_OPERATIONS_ARRAY[node->value.id].type == MATH_OPERATION_TYPES_BINARY &&
+            MATH_OPERATIONS_ARRAY[node->value.id].id != MATH_OPERATIONS_POWER)
+            is_needed[node->right] = true;
+    }
+
+    for (size_t i = 0; i <= root && !errors; i++)
+    {
+        if (is_needed[i])
+            errors |= dftr_dag_diff_node(dag, (DagIndex) i, variable_id, memo, &memo[i]);
+    }
+
+    free(is_needed);
+
+    return errors;
+}
+
+
+static TError_t dftr_dag_diff_node(Dag * dag, const DagIndex node, size_t variable_id,
+                                   const DagIndex * memo, DagIndex * d_node)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(memo);
+    MY_ASSERT(d_node);
+
+    TError_t errors = 0;
+
+    // Nodes are copied out, dag->nodes moves when the store grows.
+    const Tree_t value = dag->nodes[node].value;
+    const DagIndex u = dag->nodes[node].left;
+    const DagIndex v = dag->nodes[node].right;
+    DagIndex du = DAG_NULL_INDEX;
+    DagIndex dv = DAG_NULL_INDEX;
+    DagIndex left = DAG_NULL_INDEX;
+    DagIndex right = DAG_NULL_INDEX;
+    DagIndex temp = DAG_NULL_INDEX;
+
+    switch (value.type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+            errors |= dag_number(dag, 0, d_node);
+            break;
+
+        case TREE_NODE_TYPES_VARIABLE:
+            errors |= dag_number(dag, (size_t) value.id == variable_id ? 1 : 0, d_node);
+            break;
+
+        case TREE_NODE_TYPES_OPERATION:
+            if (u == DAG_NULL_INDEX ||
+                (MATH_OPERATIONS_ARRAY[value.id].type == MATH_OPERATION_TYPES_BINARY && v == DAG_NULL_INDEX))
+            {
+                errors |= TREE_ERRORS_INVALID_NODE;
+                return errors;
+            }
+
+            // Operands the rule doesn't differentiate were not marked and have no derivative.
+            du = memo[u];
+            dv = v != DAG_NULL_INDEX ? memo[v] : DAG_NULL_INDEX;
+
+            switch (MATH_OPERATIONS_ARRAY[value.id].id)
+            {
+                case MATH_OPERATIONS_ADDITION:
+                    errors |= dag_operation(dag, MATH_OPERATIONS_ADDITION, du, dv, d_node);
+                    break;
+
+                case MATH_OPERATIONS_SUBTRACTION:
+                    errors |= dag_operation(dag, MATH_OPERATIONS_SUBTRACTION, du, dv, d_node);
+                    break;
+
+                case MATH_OPERATIONS_MULTIPLICATION:
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, v, du, &left);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, u, dv, &right);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_ADDITION, left, right, d_node);
+                    break;
+
+                case MATH_OPERATIONS_DIVISION:
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, v, du, &left);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, u, dv, &right);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_SUBTRACTION, left, right, &temp);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, v, v, &right);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_DIVISION, temp, right, d_node);
+                    break;
+
+                case MATH_OPERATIONS_POWER:
+                {
+                    // Like d_power, only constant exponents are supported.
+                    if (dag->nodes[v].value.type != TREE_NODE_TYPES_NUMBER)
+                    {
+                        errors |= TREE_ERRORS_INVALID_NODE;
+                        return errors;
+                    }
+
+                    double exponent = dag->nodes[v].value.value.number;
+
+                    errors |= dag_number(dag, exponent - 1, &temp);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_POWER, u, temp, &right);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, v, right, &left);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, left, du, d_node);
+                    break;
+                }
+
+                case MATH_OPERATIONS_SINUS:
+                    errors |= dag_operation(dag, MATH_OPERATIONS_COSINUS, u, DAG_NULL_INDEX, &left);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, left, du, d_node);
+                    break;
+
+                case MATH_OPERATIONS_COSINUS:
+                    errors |= dag_number(dag, -1, &temp);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_SINUS, u, DAG_NULL_INDEX, &right);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, temp, right, &left);
+                    errors |= dag_operation(dag, MATH_OPERATIONS_MULTIPLICATION, left, du, d_node);
+                    break;
+
+                default:
+                    MY_ASSERT(0 && "UNREACHABLE");
+                    break;
+            }
+            break;
+
+        case TREE_NODE_TYPES_STRING:
+        case TREE_NODE_TYPES_NO_TYPE:
+            errors |= TREE_ERRORS_INVALID_NODE;
+            return errors;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    return errors;
+}
+
+
+static TError_t dag_number(Dag * dag, double number, DagIndex * node)
+{
+    Tree_t value = {};
+    value.type = TREE_NODE_TYPES_NUMBER;
+    value.value.number = number;
+
+    return dag_make_node(dag, value, DAG_NULL_INDEX, DAG_NULL_INDEX, node);
+}
+
+
+static TError_t dag_operation(Dag * dag, MathOperations op_id, const DagIndex left, const DagIndex right,
+                              DagIndex * node)
+{
+    Tree_t value = {};
+    dftr_set_operation(&value, op_id);
+
+    return dag_make_node(dag, value, left, right, node);
+}
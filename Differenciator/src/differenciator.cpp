@@ -1,70 +1,175 @@
 #include <string.h>
-#include <ctype.h>
 
 #include "differenciator.h"
+#include "canonical.h"
+#include "compact_tree.h"
+#include "egraph.h"
+#include "cse.h"
+#include "lexer.h"
+#include "structural_index.h"
 #include "my_assert.h"
 #include "tree.h"
-#include "strings.h"
 #include "file_processing.h"
 #include "math_operations.h"
 #include "double_comparing.h"
 
-const char * DIFFERENCIATOR_DUMP_FILE_NAME = "./graphviz/differenciator_dump";
-const char * DIFFERENCIATOR_LATEX_DUMP_FILE_NAME = "./latex/differenciator_dump";
+const char * const DIFFERENCIATOR_DUMP_FILE_NAME = "./graphviz/differenciator_dump";
+const char * const DIFFERENCIATOR_LATEX_DUMP_FILE_NAME = "./latex/differenciator_dump";
 const size_t MAX_FILE_NAME_SIZE = 64;
+const size_t MAX_FILE_NAME_SUFFIX_SIZE = 24;
 const DifferenciatorVariable SUPPORTED_VARIABLES[] = {
     {.name = "x", .value = 0},
+    {.name = "y", .value = 0},
+    {.name = "z", .value = 0},
+    {.name = "t", .value = 0},
+    {.name = "u", .value = 0},
+    {.name = "v", .value = 0},
+    {.name = "w", .value = 0},
 };
-size_t SUPPORTED_VARIABLES_NUMBER = sizeof(SUPPORTED_VARIABLES) / sizeof(SUPPORTED_VARIABLES[0]);
-
-static DError_t create_dftr_nodes_recursive(Tree * tree, TreeNode * node, char * * buffer_ptr);
-static bool is_open_braket(const char * buffer_ptr);
-static bool is_close_braket(const char * buffer_ptr);
-static bool try_get_number(char * buffer_ptr, Tree_t * val, int * token_size);
-static bool try_get_string(char * buffer_ptr, Tree_t * val, int * token_size);
-static void dftr_print_tree_nodes(const TreeNode * node, FILE * fp);
-static void dftr_print_tree_edges(const TreeNode * node, FILE * fp);
-static DError_t dftr_eval_recursive(const TreeNode * node, double * answer);
-static DError_t get_node_answer(const TreeNode * node, DifferenciatorInput input_type, double * answer, size_t i);
+const size_t SUPPORTED_VARIABLES_NUMBER = sizeof(SUPPORTED_VARIABLES) / sizeof(SUPPORTED_VARIABLES[0]);
+const size_t DFTR_PARSE_STACK_DEFAULT_CAPACITY = 64;
+const size_t DFTR_EVAL_LOCAL_STACK_SIZE = 128;
+
+/// Part of { left? token right? } the parser expects next for a node.
+enum DftrParseStates {
+    DFTR_PARSE_STATES_LEFT  = 0,
+    DFTR_PARSE_STATES_TOKEN = 1,
+    DFTR_PARSE_STATES_CLOSE = 2,
+};
+
+struct DftrParseStack {
+    TreeNode * * nodes;
+    DftrParseStates * states;
+    size_t size;
+    size_t capacity;
+};
+
+/// Derivatives still to build, d_nodes[k] is an empty node of the derivative tree for nodes[k].
+/// DNode is TreeNode * or CTreeIndex, after the layout of the derivative tree.
+template <typename DNode>
+struct DftrDiffStack {
+    const TreeNode * * nodes;
+    DNode * d_nodes;
+    size_t size;
+    size_t capacity;
+};
+
+static DError_t create_dftr_nodes(Tree * tree, DftrLexer * lexer);
+static DError_t dftr_parse_child(Tree * tree, DftrParseStack * stack, TreeNode * node, TreeNodeBranches branch);
+static DError_t dftr_parse_stack_push(DftrParseStack * stack, TreeNode * node, DftrParseStates state);
+static bool try_get_token_value(const DftrToken * token, Tree_t * val);
+static bool has_valid_branches(const TreeNode * node);
+static void dftr_print_tree_nodes(const TreeNode * root, FILE * fp);
+static void dftr_print_tree_edges(const TreeNode * root, FILE * fp);
+static DError_t get_node_answer(const TreeNode * node, DifferenciatorInput input_type, double * stack, size_t * size,
+                                size_t i, const double * variables);
 static DifferenciatorInput get_node_input_type(const TreeNode * node, size_t * i);
-static DError_t dftr_create_diff_node(const TreeNode * node, Tree * d_tree, TreeNode * d_node);
-static DError_t d_addition(const TreeNode * node, Tree * d_tree, TreeNode * d_node);
-static DError_t d_subtraction(const TreeNode * node, Tree * d_tree, TreeNode * d_node);
-static DError_t d_multiplication(const TreeNode * node, Tree * d_tree, TreeNode * d_node);
-static DError_t d_division(const TreeNode * node, Tree * d_tree, TreeNode * d_node);
-static DError_t d_power(const TreeNode * node, Tree * d_tree, TreeNode * d_node);
-static DError_t d_sinus(const TreeNode * node, Tree * d_tree, TreeNode * d_node);
-static DError_t d_cosinus(const TreeNode * node, Tree * d_tree, TreeNode * d_node);
+static DifferenciatorInput get_value_input_type(const Tree_t * value, size_t * i);
+template <typename DTree, typename DNode>
+static DError_t dftr_diff_branch(const TreeNode * root, DTree * d_tree, DNode d_root, size_t variable_id);
+template <typename DTree, typename DNode>
+static DError_t dftr_create_diff_node(const TreeNode * node, DTree * d_tree, DNode d_node,
+                                      DftrDiffStack<DNode> * stack, size_t variable_id);
+template <typename DNode>
+static DError_t dftr_diff_stack_push(DftrDiffStack<DNode> * stack, const TreeNode * node, DNode d_node);
+template <typename DTree, typename DNode>
+static DError_t d_addition(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack);
+template <typename DTree, typename DNode>
+static DError_t d_subtraction(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack);
+template <typename DTree, typename DNode>
+static DError_t d_multiplication(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack);
+template <typename DTree, typename DNode>
+static DError_t d_division(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack);
+template <typename DTree, typename DNode>
+static DError_t d_power(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack);
+template <typename DTree, typename DNode>
+static DError_t d_sinus(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack);
+template <typename DTree, typename DNode>
+static DError_t d_cosinus(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack);
 static void latex_print_equation(const Tree * tree, FILE * fp, const char * func);
-static void latex_print_equation_recursive(const TreeNode * node, FILE * fp);
-static bool try_get_math_operation(const char * math_operation_name, size_t * operation_id);
-static bool try_get_variable(const char * variable_name, size_t * variable_id);
-static DError_t dftr_calculate_optimization_recursive(Tree * tree, TreeNode * node, bool * is_calculated);
-static DError_t try_calculate_branch(Tree * tree, TreeNode * node, bool * success);
-static DError_t dftr_replace_optimization_recursive(Tree * tree, TreeNode * node, bool * is_replaced);
-static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success);
+static void latex_print_equation_nodes(const TreeNode * root, FILE * fp);
+static void latex_print_equation_leaf(const TreeNode * node, FILE * fp);
+static bool try_get_math_operation(const char * math_operation_name, size_t name_length, size_t * operation_id);
+static bool try_get_variable(const char * variable_name, size_t name_length, size_t * variable_id);
+template <typename TreeT, typename NodeT>
+static DError_t try_calculate_branch(TreeT * tree, NodeT node, bool * success);
+template <typename TreeT, typename NodeT>
+static DError_t try_replace_node(TreeT * tree, NodeT node, bool * success, NodeT * new_node);
+template <typename TreeT, typename NodeT>
+static DError_t dftr_worklist_branch(TreeT * tree, NodeT root, DftrOptimizationStats * stats);
+template <typename TreeT, typename NodeT>
+static DError_t dftr_simplify_node(TreeT * tree, NodeT node, DftrOptimizationStats * stats);
+static TreeNode * dftr_left(Tree * tree, TreeNode * node);
+static CTreeIndex dftr_left(CompactTree * ctree, CTreeIndex node);
+static TreeNode * dftr_right(Tree * tree, TreeNode * node);
+static CTreeIndex dftr_right(CompactTree * ctree, CTreeIndex node);
+static TreeNode * * dftr_branch(Tree * tree, TreeNode * node, TreeNodeBranches branch);
+static CTreeIndex * dftr_branch(CompactTree * ctree, CTreeIndex node, TreeNodeBranches branch);
+static Tree_t dftr_get_value(Tree * tree, TreeNode * node);
+static Tree_t dftr_get_value(CompactTree * ctree, CTreeIndex node);
+static void dftr_set_value(Tree * tree, TreeNode * node, const Tree_t value);
+static void dftr_set_value(CompactTree * ctree, CTreeIndex node, const Tree_t value);
+static bool dftr_is_null(const TreeNode * node);
+static bool dftr_is_null(CTreeIndex node);
+template <typename TreeT, typename NodeT>
+static void dftr_set_node_number(TreeT * tree, NodeT node, double number);
+template <typename TreeT, typename NodeT>
+static void dftr_set_node_operation(TreeT * tree, NodeT node, MathOperations op_id);
+template <typename TreeT, typename NodeT>
+static bool dftr_is_number(TreeT * tree, NodeT node, double number);
+
+
+DError_t create_dftr_tree(Tree * tree, const char * buffer)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(buffer);
+
+    return create_dftr_tree_span(tree, buffer, strlen(buffer));
+}
 
 
-DError_t create_dftr_tree(Tree * tree, char * buffer)
+/// Parses size bytes of buffer, which needs no null terminator and is never written,
+/// so a read-only mapped file can be passed as is. Tokens come from a structural
+/// index built with the widest SIMD the CPU has, one window at a time as the lexer
+/// reaches it. Without memory for it the lexer skips whitespace itself.
+DError_t create_dftr_tree_span(Tree * tree, const char * buffer, size_t size)
 {
     MY_ASSERT(tree);
     MY_ASSERT(buffer);
 
-    char * buffer_ptr = buffer;
     DError_t dftr_errors = 0;
+    DftrLexer lexer = {};
+    StructuralIndex index = {};
+
+    if (!op_new_structural_index(&index) &&
+        !structural_index_start(&index, buffer, size, simd_get_supported_level()))
+        dftr_lexer_init_indexed(&lexer, buffer, size, &index);
+    else
+        dftr_lexer_init(&lexer, buffer, size);
+
+    dftr_errors = create_dftr_tree_tokens(tree, &lexer);
+
+    op_delete_structural_index(&index);
+
+    return dftr_errors;
+}
+
+
+DError_t create_dftr_tree_tokens(Tree * tree, DftrLexer * lexer)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(lexer);
 
-    buffer_ptr = skip_spaces(buffer_ptr);
+    DError_t dftr_errors = 0;
 
-    if (!is_open_braket(buffer_ptr))
+    if (lexer->token.type != DFTR_TOKEN_TYPES_OPEN)
     {
         dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_SYNTAXIS;
         return dftr_errors;
     }
-    buffer_ptr++;
-
-    buffer_ptr = skip_spaces(buffer_ptr);
+    dftr_lexer_next(lexer);
 
-    if (dftr_errors = create_dftr_nodes_recursive(tree, tree->root, &buffer_ptr))
+    if (dftr_errors = create_dftr_nodes(tree, lexer))
     {
         return dftr_errors;
     }
@@ -73,165 +178,254 @@ DError_t create_dftr_tree(Tree * tree, char * buffer)
 }
 
 
-static DError_t create_dftr_nodes_recursive(Tree * tree, TreeNode * node, char * * buffer_ptr)
+/// Parses { left? token right? } with an explicit stack of unfinished nodes,
+/// so the nesting depth is limited by memory only. The opening bracket of
+/// the root is already consumed.
+static DError_t create_dftr_nodes(Tree * tree, DftrLexer * lexer)
 {
-    MY_ASSERT(buffer_ptr);
-    MY_ASSERT(node);
+    MY_ASSERT(tree);
+    MY_ASSERT(lexer);
 
     DError_t dftr_errors = 0;
-    TError_t tree_errors  = 0;
+    DftrParseStack stack = {};
 
-    *buffer_ptr = skip_spaces(*buffer_ptr);
+    if (dftr_errors = dftr_parse_stack_push(&stack, tree->root, DFTR_PARSE_STATES_LEFT))
+        return dftr_errors;
 
-    if (is_open_braket(*buffer_ptr))
+    while (stack.size && !dftr_errors)
     {
-        (*buffer_ptr)++;
+        TreeNode * node = stack.nodes[stack.size - 1];
+        DftrParseStates * state = &stack.states[stack.size - 1];
 
-        if (tree_errors = tree_insert(tree, node, TREE_NODE_BRANCH_LEFT, TREE_NULL))
-        // if (tree_errors = tree_insert(tree, node, TREE_NODE_BRANCH_LEFT, 0))
+        switch (*state)
         {
-            tree_dump(tree);
-            dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
-            return dftr_errors;
-        }
+            case DFTR_PARSE_STATES_LEFT:
+                *state = DFTR_PARSE_STATES_TOKEN;
+
+                if (lexer->token.type == DFTR_TOKEN_TYPES_OPEN)
+                {
+                    dftr_lexer_next(lexer);
+                    dftr_errors |= dftr_parse_child(tree, &stack, node, TREE_NODE_BRANCH_LEFT);
+                }
+                break;
 
-        if (dftr_errors = create_dftr_nodes_recursive(tree, node->left, buffer_ptr))
-        {
-            return dftr_errors;
+            case DFTR_PARSE_STATES_TOKEN:
+                if (!try_get_token_value(&lexer->token, &(node->value)))
+                {
+                    dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_SYNTAXIS;
+                    break;
+                }
+
+                dftr_lexer_next(lexer);
+                *state = DFTR_PARSE_STATES_CLOSE;
+
+                if (lexer->token.type == DFTR_TOKEN_TYPES_OPEN)
+                {
+                    dftr_lexer_next(lexer);
+                    dftr_errors |= dftr_parse_child(tree, &stack, node, TREE_NODE_BRANCH_RIGHT);
+                }
+                break;
+
+            case DFTR_PARSE_STATES_CLOSE:
+                if (lexer->token.type != DFTR_TOKEN_TYPES_CLOSE || !has_valid_branches(node))
+                {
+                    dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_SYNTAXIS;
+                    break;
+                }
+
+                dftr_lexer_next(lexer);
+                stack.size--;
+                break;
+
+            default:
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
         }
     }
 
-    *buffer_ptr = skip_spaces(*buffer_ptr);
+    free(stack.nodes);
+    free(stack.states);
 
-    if (is_open_braket(*buffer_ptr) || is_close_braket(*buffer_ptr))
-    {
-        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_SYNTAXIS;
-        return dftr_errors;
-    }
+    return dftr_errors;
+}
 
-    int token_size = 0;
-    bool is_success_read = try_get_number(*buffer_ptr, &(node->value), &token_size);
-    // bool is_success_read = try_get_number(*buffer_ptr, &(node->value), &token_size);
 
-    if (!is_success_read)
-        is_success_read = try_get_string(*buffer_ptr, &(node->value), &token_size);
+static DError_t dftr_parse_child(Tree * tree, DftrParseStack * stack, TreeNode * node, TreeNodeBranches branch)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(stack);
+    MY_ASSERT(node);
+
+    DError_t dftr_errors = 0;
 
-    if (!is_success_read)
+    if (tree_insert(tree, node, branch, TREE_NULL))
     {
-        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_SYNTAXIS;
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
         return dftr_errors;
     }
 
-    *buffer_ptr += token_size;
+    return dftr_parse_stack_push(stack, branch == TREE_NODE_BRANCH_LEFT ? node->left : node->right,
+                                 DFTR_PARSE_STATES_LEFT);
+}
+
 
-    *buffer_ptr = skip_spaces(*buffer_ptr);
+static DError_t dftr_parse_stack_push(DftrParseStack * stack, TreeNode * node, DftrParseStates state)
+{
+    MY_ASSERT(stack);
+    MY_ASSERT(node);
+
+    DError_t dftr_errors = 0;
 
-    if (is_open_braket(*buffer_ptr))
+    if (stack->size == stack->capacity)
     {
-        (*buffer_ptr)++;
+        size_t capacity = stack->capacity ? 2 * stack->capacity : DFTR_PARSE_STACK_DEFAULT_CAPACITY;
+        TreeNode * * nodes = NULL;
+        DftrParseStates * states = NULL;
 
-        // if (tree_errors = tree_insert(tree, node, TREE_NODE_BRANCH_RIGHT, 0))
-        if (tree_errors = tree_insert(tree, node, TREE_NODE_BRANCH_RIGHT, TREE_NULL))
+        if (!(nodes = (TreeNode * *) realloc(stack->nodes, capacity * sizeof(TreeNode *))))
         {
-            tree_dump(tree);
-            dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
             return dftr_errors;
         }
+        stack->nodes = nodes;
 
-        if (dftr_errors = create_dftr_nodes_recursive(tree, node->right, buffer_ptr))
+        if (!(states = (DftrParseStates *) realloc(stack->states, capacity * sizeof(DftrParseStates))))
         {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
             return dftr_errors;
         }
-    }
-
-    *buffer_ptr = skip_spaces(*buffer_ptr);
+        stack->states = states;
 
-    if (!is_close_braket(*buffer_ptr))
-    {
-        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_SYNTAXIS;
-        return dftr_errors;
+        stack->capacity = capacity;
     }
-    (*buffer_ptr)++;
+
+    stack->nodes[stack->size] = node;
+    stack->states[stack->size] = state;
+    stack->size++;
 
     return dftr_errors;
 }
 
 
-static bool is_open_braket(const char * buffer_ptr)
+/// Leaves have no branches, a unary operation has only the left one, a binary both,
+/// so later passes may rely on the shape of every node.
+static bool has_valid_branches(const TreeNode * node)
 {
-    MY_ASSERT(buffer_ptr);
+    MY_ASSERT(node);
 
-    return *buffer_ptr == '{';
-}
+    switch (node->value.type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+        case TREE_NODE_TYPES_VARIABLE:
+            return !node->left && !node->right;
 
+        case TREE_NODE_TYPES_OPERATION:
+            switch (MATH_OPERATIONS_ARRAY[node->value.id].type)
+            {
+                case MATH_OPERATION_TYPES_UNARY:
+                    return node->left && !node->right;
 
-static bool is_close_braket(const char * buffer_ptr)
-{
-    MY_ASSERT(buffer_ptr);
+                case MATH_OPERATION_TYPES_BINARY:
+                    return node->left && node->right;
 
-    return *buffer_ptr == '}';
+                default:
+                    MY_ASSERT(0 && "UNREACHABLE");
+                    return false;
+            }
+
+        case TREE_NODE_TYPES_NO_TYPE:
+        case TREE_NODE_TYPES_STRING:
+            return false;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            return false;
+    }
 }
 
 
-static bool try_get_number(char * buffer_ptr, Tree_t * val, int * token_size)
+static bool try_get_token_value(const DftrToken * token, Tree_t * val)
 {
-    MY_ASSERT(buffer_ptr);
+    MY_ASSERT(token);
     MY_ASSERT(val);
-    MY_ASSERT(token_size);
 
-    double tmp_val = 0;
-    int tmp_token_size = 0;
+    size_t id = 0;
 
-    if (!sscanf(buffer_ptr, "%lf%n", &tmp_val, &tmp_token_size))
+    switch (token->type)
     {
-        return false;
-    }
+        case DFTR_TOKEN_TYPES_NUMBER:
+            val->value.number = token->number;
+            val->type = TREE_NODE_TYPES_NUMBER;
+            return true;
+
+        case DFTR_TOKEN_TYPES_NAME:
+            if (try_get_math_operation(token->begin, token->length, &id))
+            {
+                dftr_set_operation(val, MATH_OPERATIONS_ARRAY[id].id);
+                return true;
+            }
 
-    printf("In try_get_number(): %lf\n", tmp_val);
+            if (try_get_variable(token->begin, token->length, &id))
+            {
+                dftr_set_variable(val, id);
+                return true;
+            }
 
-    val->value.number = tmp_val;
-    val->type = TREE_NODE_TYPES_NUMBER;
-    *token_size = tmp_token_size;
+            return false;
 
-    return true;
+        case DFTR_TOKEN_TYPES_END:
+        case DFTR_TOKEN_TYPES_OPEN:
+        case DFTR_TOKEN_TYPES_CLOSE:
+        case DFTR_TOKEN_TYPES_INVALID:
+            return false;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            return false;
+    }
 }
 
 
-static bool try_get_string(char * buffer_ptr, Tree_t * val, int * token_size)
+void dftr_set_operation(Tree_t * value, MathOperations op_id)
 {
-    MY_ASSERT(buffer_ptr);
-    MY_ASSERT(val);
+    MY_ASSERT(value);
 
-    val->value.string = buffer_ptr;
-    val->type = TREE_NODE_TYPES_STRING;
-    buffer_ptr = skip_no_spaces(buffer_ptr);
+    size_t i = get_math_operation_index(op_id);
 
-    char * tmp_buffer_ptr = buffer_ptr;
-    tmp_buffer_ptr = skip_spaces(tmp_buffer_ptr);
-    while (!is_open_braket(tmp_buffer_ptr) && !is_close_braket(tmp_buffer_ptr))
-    {
-        tmp_buffer_ptr = skip_no_spaces(tmp_buffer_ptr);
-        buffer_ptr = tmp_buffer_ptr;
-        tmp_buffer_ptr = skip_spaces(tmp_buffer_ptr);
-    }
-    *buffer_ptr = '\0';
+    value->type = TREE_NODE_TYPES_OPERATION;
+    value->value.string = MATH_OPERATIONS_ARRAY[i].name;
+    value->id = (int) i;
+}
 
-    printf("In try_get_string(): %s\n", val->value.string);
 
-    *token_size = (int) (buffer_ptr - val->value.string + 1);
+void dftr_set_variable(Tree_t * value, size_t variable_id)
+{
+    MY_ASSERT(value);
+    MY_ASSERT(variable_id < SUPPORTED_VARIABLES_NUMBER);
 
-    return true;
+    value->type = TREE_NODE_TYPES_VARIABLE;
+    value->value.string = SUPPORTED_VARIABLES[variable_id].name;
+    value->id = (int) variable_id;
 }
 
 
-void dftr_dump(Tree * tree)
+void dftr_dump(DftrContext * context, const Tree * tree)
 {
+    MY_ASSERT(context);
+    MY_ASSERT(context->dump_file_name);
     MY_ASSERT(tree);
 
+    if (strlen(context->dump_file_name) + MAX_FILE_NAME_SUFFIX_SIZE >= MAX_FILE_NAME_SIZE)
+        return;
+
     FILE * fp = NULL;
+    size_t dump_id = context->dumps_number++;
 
     char dot_file_name[MAX_FILE_NAME_SIZE] = "";
-    make_file_extension(dot_file_name, DIFFERENCIATOR_DUMP_FILE_NAME, ".dot");
+    char extension_string[MAX_FILE_NAME_SIZE] = "";
+
+    sprintf(extension_string, "%zu.dot", dump_id);
+    make_file_extension(dot_file_name, context->dump_file_name, extension_string);
 
     if (!(fp = file_open(dot_file_name, "wb")))
     {
@@ -261,89 +455,86 @@ void dftr_dump(Tree * tree)
 
     fclose(fp);
 
-    static size_t dftr_dumps_count = 0;
     char png_dump_file_name[MAX_FILE_NAME_SIZE] = "";
     char command_string[MAX_STR_SIZE] = "";
-    char extension_string[MAX_FILE_NAME_SIZE] = "";
 
-    sprintf(extension_string, "%zd.png", dftr_dumps_count);
-    make_file_extension(png_dump_file_name, DIFFERENCIATOR_DUMP_FILE_NAME, extension_string);
+    sprintf(extension_string, "%zu.png", dump_id);
+    make_file_extension(png_dump_file_name, context->dump_file_name, extension_string);
     sprintf(command_string, "dot %s -T png -o %s", dot_file_name, png_dump_file_name);
     system(command_string);
-
-    dftr_dumps_count++;
 }
 
 
-static void dftr_print_tree_nodes(const TreeNode * node, FILE * fp)
+static void dftr_print_tree_nodes(const TreeNode * root, FILE * fp)
 {
-    MY_ASSERT(node);
+    MY_ASSERT(root);
 
-    fprintf(fp, "   node%p [ label = ", node);
-
-    switch (node->value.type)
+    for (const TreeNode * node = root; node; node = tree_preorder_next(node, root))
     {
-        case TREE_NODE_TYPES_NUMBER:
-            fprintf(fp, "\"{ %.2lf }\", color = green ]\n", node->value.value.number);
-            break;
+        fprintf(fp, "   node%p [ label = ", node);
 
-        case TREE_NODE_TYPES_STRING:
-            fprintf(fp, "\"{ %s }\", color = blue ]\n", node->value.value.string);
-            break;
-
-        case TREE_NODE_TYPES_NO_TYPE:
-            MY_ASSERT(0 && "NO TYPE");
-            break;
+        switch (node->value.type)
+        {
+            case TREE_NODE_TYPES_NUMBER:
+                fprintf(fp, "\"{ %.2lf }\", color = green ]\n", node->value.value.number);
+                break;
 
-        default:
-            printf("NODE TYPE: %d\n", (int) node->value.type);
-            printf("NODE VALUE: %lf %s\n", node->value.value.number, node->value.value.string);
-            MY_ASSERT(0 && "UNREACHABLE");
-            break;
-    }
+            case TREE_NODE_TYPES_STRING:
+            case TREE_NODE_TYPES_OPERATION:
+            case TREE_NODE_TYPES_VARIABLE:
+                fprintf(fp, "\"{ %s }\", color = blue ]\n", node->value.value.string);
+                break;
 
-    if (node->left)
-    {
-        dftr_print_tree_nodes(node->left, fp);
-    }
+            case TREE_NODE_TYPES_NO_TYPE:
+                MY_ASSERT(0 && "NO TYPE");
+                break;
 
-    if (node->right)
-    {
-        dftr_print_tree_nodes(node->right, fp);
+            default:
+                printf("NODE TYPE: %d\n", (int) node->value.type);
+                printf("NODE VALUE: %lf %s\n", node->value.value.number, node->value.value.string);
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
+        }
     }
 
     return;
 }
 
-static void dftr_print_tree_edges(const TreeNode * node, FILE * fp)
+static void dftr_print_tree_edges(const TreeNode * root, FILE * fp)
 {
-    MY_ASSERT(node);
+    MY_ASSERT(root);
 
-    if (node->left)
+    for (const TreeNode * node = root; node; node = tree_preorder_next(node, root))
     {
-        fprintf(fp, "    node%p:<l> -> node%p;\n", node, node->left);
-        dftr_print_tree_edges(node->left, fp);
-    }
+        if (node->left)
+            fprintf(fp, "    node%p:<l> -> node%p;\n", node, node->left);
 
-    if (node->right)
-    {
-        fprintf(fp, "    node%p:<r> -> node%p;\n", node, node->right);
-        dftr_print_tree_edges(node->right, fp);
+        if (node->right)
+            fprintf(fp, "    node%p:<r> -> node%p;\n", node, node->right);
     }
 
     return;
 }
 
 
-void dftr_latex(const Tree * tree, const Tree * d_tree)
+void dftr_latex(DftrContext * context, const Tree * tree, const Tree * d_tree)
 {
+    MY_ASSERT(context);
+    MY_ASSERT(context->latex_file_name);
     MY_ASSERT(tree);
     MY_ASSERT(d_tree);
 
+    if (strlen(context->latex_file_name) + MAX_FILE_NAME_SUFFIX_SIZE >= MAX_FILE_NAME_SIZE)
+        return;
+
     FILE * fp = NULL;
+    size_t latex_id = context->latex_number++;
 
     char latex_file_name[MAX_FILE_NAME_SIZE] = "";
-    make_file_extension(latex_file_name, DIFFERENCIATOR_LATEX_DUMP_FILE_NAME, ".tex");
+    char extension_string[MAX_FILE_NAME_SIZE] = "";
+
+    sprintf(extension_string, "%zu.tex", latex_id);
+    make_file_extension(latex_file_name, context->latex_file_name, extension_string);
 
     if (!(fp = file_open(latex_file_name, "wb")))
     {
@@ -369,24 +560,18 @@ void dftr_latex(const Tree * tree, const Tree * d_tree)
     latex_print_equation(tree, fp, "f");
 
     fprintf(fp, "\tDifferenciated equation:\n\n");
-    latex_print_equation(d_tree, fp, "f^{'}");
+    if (dftr_print(context, d_tree, fp, "f^{'}", DFTR_PRINT_LATEX))
+        latex_print_equation(d_tree, fp, "f^{'}");
 
     fprintf(fp, "\t\\end{center}\n"
                 "\\end{document}\n");
 
     fclose(fp);
 
-    static size_t dftr_tex_count = 0;
-    char pdf_latex_file_name[MAX_FILE_NAME_SIZE] = "";
     char command_string[MAX_STR_SIZE] = "";
-    char extension_string[MAX_FILE_NAME_SIZE] = "";
 
-    sprintf(extension_string, "%zd.pdf", dftr_tex_count);
-    make_file_extension(pdf_latex_file_name, DIFFERENCIATOR_LATEX_DUMP_FILE_NAME, extension_string);
     sprintf(command_string, "pdflatex --output-directory=./latex %s", latex_file_name);
     system(command_string);
-
-    dftr_tex_count++;
 }
 
 
@@ -396,88 +581,155 @@ static void latex_print_equation(const Tree * tree, FILE * fp, const char * func
     MY_ASSERT(fp);
 
     fprintf(fp, "\t$\\;\\;\\; {%s} = ", func);
-    latex_print_equation_recursive(tree->root, fp);
+    latex_print_equation_nodes(tree->root, fp);
     fprintf(fp, "\t$;\n\n");
 
     return;
 }
 
 
-static void latex_print_equation_recursive(const TreeNode * node, FILE * fp)
+static void latex_print_equation_nodes(const TreeNode * root, FILE * fp)
 {
-    MY_ASSERT(node);
+    MY_ASSERT(root);
     MY_ASSERT(fp);
 
-    if (node->left && node->right)
-    {
-        fprintf(fp, "( ");
-        latex_print_equation_recursive(node->left, fp);
-        if (node->value.value.string[0] == '*')
-        {
-            fprintf(fp, "\\cdot ");
-        }
-        else
-        {
-            fprintf(fp, "%s ", node->value.value.string);
-        }
-        latex_print_equation_recursive(node->right, fp);
-        fprintf(fp, ") ");
-    }
-    else if (node->left && !node->right)
-    {
-        fprintf(fp, "%s( ", node->value.value.string);
-        latex_print_equation_recursive(node->left, fp);
-        fprintf(fp, ") ");
-    }
-    else if (!node->left && !node->right)
+    TreeWalk walk = {};
+
+    for (tree_walk_begin(&walk, root); walk.node; tree_walk_next(&walk))
     {
-        fprintf(fp, "{ ");
-        switch (node->value.type)
+        const TreeNode * node = walk.node;
+
+        switch (walk.visit)
         {
-            case TREE_NODE_TYPES_NUMBER:
-                fprintf(fp, "%lg ", node->value.value.number);
+            case TREE_VISIT_PRE:
+                if (node->left && node->right)
+                    fprintf(fp, "( ");
+                else if (node->left)
+                    fprintf(fp, "%s( ", node->value.value.string);
+                else if (!node->right)
+                    latex_print_equation_leaf(node, fp);
+                else
+                    MY_ASSERT(0 && "UNREACHABLE");
                 break;
 
-            case TREE_NODE_TYPES_STRING:
-                fprintf(fp, "%s ", node->value.value.string);
+            case TREE_VISIT_IN:
+                if (!node->left || !node->right)
+                    break;
+
+                if (node->value.type == TREE_NODE_TYPES_OPERATION &&
+                    MATH_OPERATIONS_ARRAY[node->value.id].id == MATH_OPERATIONS_MULTIPLICATION)
+                {
+                    fprintf(fp, "\\cdot ");
+                }
+                else
+                {
+                    fprintf(fp, "%s ", node->value.value.string);
+                }
+                break;
+
+            case TREE_VISIT_POST:
+                if (node->left)
+                    fprintf(fp, ") ");
                 break;
 
-            case TREE_NODE_TYPES_NO_TYPE:
             default:
                 MY_ASSERT(0 && "UNREACHABLE");
                 break;
         }
-        fprintf(fp, "} ");
     }
-    else
+
+    return;
+}
+
+
+static void latex_print_equation_leaf(const TreeNode * node, FILE * fp)
+{
+    MY_ASSERT(node);
+    MY_ASSERT(fp);
+
+    fprintf(fp, "{ ");
+    switch (node->value.type)
     {
-        MY_ASSERT(0 && "UNREACHABLE");
+        case TREE_NODE_TYPES_NUMBER:
+            fprintf(fp, "%lg ", node->value.value.number);
+            break;
+
+        case TREE_NODE_TYPES_STRING:
+        case TREE_NODE_TYPES_OPERATION:
+        case TREE_NODE_TYPES_VARIABLE:
+            fprintf(fp, "%s ", node->value.value.string);
+            break;
+
+        case TREE_NODE_TYPES_NO_TYPE:
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
     }
+    fprintf(fp, "} ");
 
     return;
 }
 
 
+/// Post-order walk with a value stack: a node pops the values of its branches and pushes its own.
 DError_t dftr_eval(const Tree * dftr_tree, double * answer)
 {
     MY_ASSERT(dftr_tree);
     MY_ASSERT(answer);
 
-    return dftr_eval_recursive(dftr_tree->root, answer);
+    return dftr_eval_variables(dftr_tree, NULL, answer);
 }
 
 
-static DError_t dftr_eval_recursive(const TreeNode * node, double * answer)
+/// variables are indexed by variable id, NULL takes the SUPPORTED_VARIABLES values.
+DError_t dftr_eval_variables(const Tree * dftr_tree, const double * variables, double * answer)
 {
-    MY_ASSERT(node);
+    MY_ASSERT(dftr_tree);
     MY_ASSERT(answer);
 
     DError_t dftr_errors = 0;
 
-    size_t i = 0;
-    DifferenciatorInput input_type = get_node_input_type(node, &i);
+    double local_stack[DFTR_EVAL_LOCAL_STACK_SIZE];
+    double * stack = local_stack;
+    size_t size = 0;
+    size_t capacity = DFTR_EVAL_LOCAL_STACK_SIZE;
 
-    dftr_errors |= get_node_answer(node, input_type, answer, i);
+    const TreeNode * root = dftr_tree->root;
+
+    for (const TreeNode * node = tree_postorder_first(root); node && !dftr_errors;
+         node = tree_postorder_next(node, root))
+    {
+        if (size == capacity)
+        {
+            double * new_stack = (double *) realloc(stack == local_stack ? NULL : stack,
+                                                    2 * capacity * sizeof(double));
+            if (!new_stack)
+            {
+                dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+                break;
+            }
+
+            if (stack == local_stack)
+                memcpy(new_stack, local_stack, size * sizeof(double));
+
+            stack = new_stack;
+            capacity *= 2;
+        }
+
+        size_t i = 0;
+        DifferenciatorInput input_type = get_node_input_type(node, &i);
+
+        dftr_errors |= get_node_answer(node, input_type, stack, &size, i, variables);
+    }
+
+    if (!dftr_errors && size != 1)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    if (!dftr_errors)
+        *answer = stack[0];
+
+    if (stack != local_stack)
+        free(stack);
 
     return dftr_errors;
 }
@@ -487,52 +739,37 @@ static DifferenciatorInput get_node_input_type(const TreeNode * node, size_t * i
 {
     MY_ASSERT(node);
 
+    return get_value_input_type(&node->value, i);
+}
+
+
+static DifferenciatorInput get_value_input_type(const Tree_t * value, size_t * i)
+{
+    MY_ASSERT(value);
+
     DifferenciatorInput input_type = DIFFERENCIATOR_INPUT_INVALID;
-    bool is_supported_input = false;
 
-    switch (node->value.type)
+    switch (value->type)
     {
         case TREE_NODE_TYPES_NUMBER:
             input_type = DIFFERENCIATOR_INPUT_NUMBER;
             break;
 
-        case TREE_NODE_TYPES_STRING:
-            if (is_supported_input = try_get_math_operation(node->value.value.string, i))
-            {
-                input_type = DIFFERENCIATOR_INPUT_OPERATION;
-            }
-            else if (is_supported_input = try_get_variable(node->value.value.string, i))
-            {
-                input_type = DIFFERENCIATOR_INPUT_VARIABLE;
-            }
-            else
-            {
-                return DIFFERENCIATOR_INPUT_INVALID;
-            }
+        case TREE_NODE_TYPES_OPERATION:
+            input_type = DIFFERENCIATOR_INPUT_OPERATION;
+            if (i)
+                *i = (size_t) value->id;
+            break;
 
-//             for (*i = 0; *i < MATH_OPERATIONS_ARRAY_SIZE; (*i)++)
-//             {
-//                 if (!strcmp(node->value.value.string, MATH_OPERATIONS_ARRAY[*i].name))
-//                 {
-//                     is_supported_input = true;
-//                     input_type = DIFFERENCIATOR_INPUT_OPERATION;
-//                     break;
-//                 }
-//             }
-//
-//             if (!is_supported_input)
-//             {
-//                 for (*i = 0; *i < SUPPORTED_VARIABLES_NUMBER; (*i)++)
-//                 {
-//                     if (!strcmp(node->value.value.string, SUPPORTED_VARIABLES[*i].name))
-//                     {
-//                         is_supported_input = true;
-//                         input_type = DIFFERENCIATOR_INPUT_VARIABLE;
-//                     }
-//                 }
-//             }
+        case TREE_NODE_TYPES_VARIABLE:
+            input_type = DIFFERENCIATOR_INPUT_VARIABLE;
+            if (i)
+                *i = (size_t) value->id;
             break;
 
+        case TREE_NODE_TYPES_STRING:
+            return DIFFERENCIATOR_INPUT_INVALID;
+
         case TREE_NODE_TYPES_NO_TYPE:
         default:
             MY_ASSERT(0 && "UNREACHABLE");
@@ -543,7 +780,7 @@ static DifferenciatorInput get_node_input_type(const TreeNode * node, size_t * i
 }
 
 
-static bool try_get_math_operation(const char * math_operation_name, size_t * operation_id)
+static bool try_get_math_operation(const char * math_operation_name, size_t name_length, size_t * operation_id)
 {
     MY_ASSERT(math_operation_name);
 
@@ -551,7 +788,8 @@ static bool try_get_math_operation(const char * math_operation_name, size_t * op
 
     for (i = 0; i < MATH_OPERATIONS_ARRAY_SIZE; (i)++)
     {
-        if (!strcmp(math_operation_name, MATH_OPERATIONS_ARRAY[i].name))
+        if (!strncmp(math_operation_name, MATH_OPERATIONS_ARRAY[i].name, name_length) &&
+            MATH_OPERATIONS_ARRAY[i].name[name_length] == '\0')
         {
             if (operation_id)
                 *operation_id = i;
@@ -567,7 +805,7 @@ static bool try_get_math_operation(const char * math_operation_name, size_t * op
 }
 
 
-static bool try_get_variable(const char * variable_name, size_t * variable_id)
+static bool try_get_variable(const char * variable_name, size_t name_length, size_t * variable_id)
 {
     MY_ASSERT(variable_name);
 
@@ -575,7 +813,8 @@ static bool try_get_variable(const char * variable_name, size_t * variable_id)
 
     for (i = 0; i < SUPPORTED_VARIABLES_NUMBER; (i)++)
     {
-        if (!strcmp(variable_name, SUPPORTED_VARIABLES[i].name))
+        if (!strncmp(variable_name, SUPPORTED_VARIABLES[i].name, name_length) &&
+            SUPPORTED_VARIABLES[i].name[name_length] == '\0')
         {
             if (variable_id)
                 *variable_id = i;
@@ -591,10 +830,13 @@ static bool try_get_variable(const char * variable_name, size_t * variable_id)
 }
 
 
-static DError_t get_node_answer(const TreeNode * node, DifferenciatorInput input_type, double * answer, size_t i)
+/// The values of the branches of node are on top of the stack, they are replaced by its value.
+static DError_t get_node_answer(const TreeNode * node, DifferenciatorInput input_type, double * stack, size_t * size,
+                                size_t i, const double * variables)
 {
     MY_ASSERT(node);
-    MY_ASSERT(answer);
+    MY_ASSERT(stack);
+    MY_ASSERT(size);
 
     DError_t dftr_errors = 0;
     double left = 0, right = 0;
@@ -602,7 +844,7 @@ static DError_t get_node_answer(const TreeNode * node, DifferenciatorInput input
     switch (input_type)
     {
         case DIFFERENCIATOR_INPUT_NUMBER:
-            *answer = node->value.value.number;
+            stack[(*size)++] = node->value.value.number;
             break;
 
         case DIFFERENCIATOR_INPUT_OPERATION:
@@ -610,16 +852,26 @@ static DError_t get_node_answer(const TreeNode * node, DifferenciatorInput input
             {
                 case MATH_OPERATION_TYPES_UNARY:
                     MY_ASSERT(node->left);
-                    dftr_errors = dftr_eval_recursive(node->left, &left);
+                    if (*size < 1)
+                    {
+                        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                        return dftr_errors;
+                    }
 
+                    left = stack[--(*size)];
                     break;
 
                 case MATH_OPERATION_TYPES_BINARY:
                     MY_ASSERT(node->left);
                     MY_ASSERT(node->right);
-                    dftr_errors |= dftr_eval_recursive(node->left, &left);
-                    dftr_errors |= dftr_eval_recursive(node->right, &right);
-
+                    if (*size < 2)
+                    {
+                        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                        return dftr_errors;
+                    }
+
+                    right = stack[--(*size)];
+                    left = stack[--(*size)];
                     break;
 
                 default:
@@ -627,11 +879,11 @@ static DError_t get_node_answer(const TreeNode * node, DifferenciatorInput input
                     break;
             }
 
-            *answer = MATH_OPERATIONS_ARRAY[i].operation(left, right);
+            stack[(*size)++] = MATH_OPERATIONS_ARRAY[i].operation(left, right);
             break;
 
         case DIFFERENCIATOR_INPUT_VARIABLE:
-            *answer = SUPPORTED_VARIABLES[i].value;
+            stack[(*size)++] = variables ? variables[i] : SUPPORTED_VARIABLES[i].value;
             break;
 
         case DIFFERENCIATOR_INPUT_INVALID:
@@ -648,18 +900,178 @@ static DError_t get_node_answer(const TreeNode * node, DifferenciatorInput input
 
 
 DError_t dftr_create_diff_tree(const Tree * tree, Tree * d_tree)
+{
+    return dftr_create_partial_diff_tree(tree, d_tree, 0);
+}
+
+
+DError_t dftr_create_partial_diff_tree(const Tree * tree, Tree * d_tree, size_t variable_id)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(d_tree);
+
+    return dftr_diff_branch(tree->root, d_tree, d_tree->root, variable_id);
+}
+
+
+/// Same rules as the pointer tree, d_ctree must hold only its root.
+DError_t dftr_create_partial_diff_tree(const Tree * tree, CompactTree * d_ctree, size_t variable_id)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(d_ctree);
+
+    return dftr_diff_branch(tree->root, d_ctree, d_ctree->root, variable_id);
+}
+
+
+/// The derivative in the layout the context asks for, d_tree must hold only its root.
+/// d_ctree is the compact tree to reuse, with parent links, or NULL for a tree of its own.
+DError_t dftr_differentiation(const DftrContext * context, const Tree * tree, Tree * d_tree, size_t variable_id,
+                              CompactTree * d_ctree)
+{
+    MY_ASSERT(context);
+
+    if (!context->is_compact)
+        return dftr_create_partial_diff_tree(tree, d_tree, variable_id);
+
+    DError_t dftr_errors = 0;
+    DftrOptimizationStats stats = {};
+
+    if (d_ctree)
+        return dftr_compact_diff(tree, d_tree, d_ctree, variable_id, &stats);
+
+    CompactTree local_ctree = {};
+
+    if (op_new_compact_tree(&local_ctree, TREE_NULL, true))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+        return dftr_errors;
+    }
+
+    dftr_errors |= dftr_compact_diff(tree, d_tree, &local_ctree, variable_id, &stats);
+
+    op_delete_compact_tree(&local_ctree);
+
+    return dftr_errors;
+}
+
+
+/// dftr_create_partial_diff_tree + dftr_worklist_optimization with the derivative kept in the compact
+/// layout until it is simplified, so the unsimplified tree takes 22 bytes a node instead of 40.
+/// d_tree must hold only its root. d_ctree is cleared first and needs parent links, which let
+/// the simplification glue a branch in place of its node.
+DError_t dftr_compact_diff(const Tree * tree, Tree * d_tree, CompactTree * d_ctree, size_t variable_id,
+                           DftrOptimizationStats * stats)
 {
     MY_ASSERT(tree);
     MY_ASSERT(d_tree);
+    MY_ASSERT(d_ctree);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+
+    if (!d_ctree->with_parents)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+        return dftr_errors;
+    }
+
+    if (ctree_clear(d_ctree, TREE_NULL))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+        return dftr_errors;
+    }
+
+    dftr_errors |= dftr_create_partial_diff_tree(tree, d_ctree, variable_id);
 
-    return dftr_create_diff_node(tree->root, d_tree, d_tree->root);
+    if (!dftr_errors)
+        dftr_errors |= dftr_worklist_optimization(d_ctree, stats);
+
+    if (!dftr_errors && ctree_to_tree(d_tree, d_ctree))
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+    return dftr_errors;
 }
 
 
-static DError_t dftr_create_diff_node(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
+/// The derivative of the branch at root is built in d_root of d_tree, which may be a pointer
+/// tree or a compact one: the rules below only change it through the tree functions and the
+/// layout helpers, so both layouts get the same derivative.
+template <typename DTree, typename DNode>
+static DError_t dftr_diff_branch(const TreeNode * root, DTree * d_tree, DNode d_root, size_t variable_id)
 {
+    MY_ASSERT(root);
+    MY_ASSERT(d_tree);
+    MY_ASSERT(variable_id < SUPPORTED_VARIABLES_NUMBER);
+
+    DError_t dftr_errors = 0;
+    DftrDiffStack<DNode> stack = {};
+
+    if (dftr_errors = dftr_diff_stack_push(&stack, root, d_root))
+        return dftr_errors;
+
+    while (stack.size && !dftr_errors)
+    {
+        stack.size--;
+        dftr_errors |= dftr_create_diff_node(stack.nodes[stack.size], d_tree, stack.d_nodes[stack.size],
+                                             &stack, variable_id);
+    }
+
+    free(stack.nodes);
+    free(stack.d_nodes);
+
+    return dftr_errors;
+}
+
+
+template <typename DNode>
+static DError_t dftr_diff_stack_push(DftrDiffStack<DNode> * stack, const TreeNode * node, DNode d_node)
+{
+    MY_ASSERT(stack);
     MY_ASSERT(node);
-    MY_ASSERT(d_node);
+    MY_ASSERT(!dftr_is_null(d_node));
+
+    DError_t dftr_errors = 0;
+
+    if (stack->size == stack->capacity)
+    {
+        size_t capacity = stack->capacity ? 2 * stack->capacity : DFTR_PARSE_STACK_DEFAULT_CAPACITY;
+        const TreeNode * * nodes = NULL;
+        DNode * d_nodes = NULL;
+
+        if (!(nodes = (const TreeNode * *) realloc(stack->nodes, capacity * sizeof(const TreeNode *))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+        stack->nodes = nodes;
+
+        if (!(d_nodes = (DNode *) realloc(stack->d_nodes, capacity * sizeof(DNode))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+        stack->d_nodes = d_nodes;
+
+        stack->capacity = capacity;
+    }
+
+    stack->nodes[stack->size] = node;
+    stack->d_nodes[stack->size] = d_node;
+    stack->size++;
+
+    return dftr_errors;
+}
+
+
+/// Builds the top of the derivative of node in d_node, the derivatives of the branches
+/// it needs are pushed to stack, so a deep chain does not recurse.
+template <typename DTree, typename DNode>
+static DError_t dftr_create_diff_node(const TreeNode * node, DTree * d_tree, DNode d_node,
+                                      DftrDiffStack<DNode> * stack, size_t variable_id)
+{
+    MY_ASSERT(node);
+    MY_ASSERT(stack);
 
     DError_t dftr_errors = 0;
     size_t i = 0;
@@ -668,44 +1080,42 @@ static DError_t dftr_create_diff_node(const TreeNode * node, Tree * d_tree, Tree
     switch (input_type)
     {
         case DIFFERENCIATOR_INPUT_NUMBER:
-            d_node->value.type = TREE_NODE_TYPES_NUMBER;
-            d_node->value.value.number = 0;
+            dftr_set_node_number(d_tree, d_node, 0);
             break;
 
         case DIFFERENCIATOR_INPUT_VARIABLE:
-            d_node->value.type = TREE_NODE_TYPES_NUMBER;
-            d_node->value.value.number = 1;
+            dftr_set_node_number(d_tree, d_node, i == variable_id ? 1 : 0);
             break;
 
         case DIFFERENCIATOR_INPUT_OPERATION:
             switch (MATH_OPERATIONS_ARRAY[i].id)
             {
                 case MATH_OPERATIONS_ADDITION:
-                    dftr_errors |= d_addition(node, d_tree, d_node);
+                    dftr_errors |= d_addition(node, d_tree, d_node, stack);
                     break;
 
                 case MATH_OPERATIONS_SUBTRACTION:
-                    dftr_errors |= d_subtraction(node, d_tree, d_node);
+                    dftr_errors |= d_subtraction(node, d_tree, d_node, stack);
                     break;
 
                 case MATH_OPERATIONS_MULTIPLICATION:
-                    dftr_errors |= d_multiplication(node, d_tree, d_node);
+                    dftr_errors |= d_multiplication(node, d_tree, d_node, stack);
                     break;
 
                 case MATH_OPERATIONS_DIVISION:
-                    dftr_errors |= d_division(node, d_tree, d_node);
+                    dftr_errors |= d_division(node, d_tree, d_node, stack);
                     break;
 
                 case MATH_OPERATIONS_POWER:
-                    dftr_errors |= d_power(node, d_tree, d_node);
+                    dftr_errors |= d_power(node, d_tree, d_node, stack);
                     break;
 
                 case MATH_OPERATIONS_SINUS:
-                    dftr_errors |= d_sinus(node, d_tree, d_node);
+                    dftr_errors |= d_sinus(node, d_tree, d_node, stack);
                     break;
 
                 case MATH_OPERATIONS_COSINUS:
-                    dftr_errors |= d_cosinus(node, d_tree, d_node);
+                    dftr_errors |= d_cosinus(node, d_tree, d_node, stack);
                     break;
 
                 default:
@@ -724,17 +1134,17 @@ static DError_t dftr_create_diff_node(const TreeNode * node, Tree * d_tree, Tree
 }
 
 
-static DError_t d_addition(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
+template <typename DTree, typename DNode>
+static DError_t d_addition(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack)
 {
     MY_ASSERT(node);
     MY_ASSERT(d_tree);
-    MY_ASSERT(d_node);
+    MY_ASSERT(stack);
 
     DError_t dftr_errors = 0;
     TError_t tree_errors = 0;
 
-    d_node->value.type = TREE_NODE_TYPES_STRING;
-    d_node->value.value.string = "+";
+    dftr_set_node_operation(d_tree, d_node, MATH_OPERATIONS_ADDITION);
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
 
@@ -744,24 +1154,24 @@ static DError_t d_addition(const TreeNode * node, Tree * d_tree, TreeNode * d_no
         return dftr_errors;
     }
 
-    dftr_errors |= dftr_create_diff_node(node->left, d_tree, d_node->left);
-    dftr_errors |= dftr_create_diff_node(node->right, d_tree, d_node->right);
+    dftr_errors |= dftr_diff_stack_push(stack, node->left, dftr_left(d_tree, d_node));
+    dftr_errors |= dftr_diff_stack_push(stack, node->right, dftr_right(d_tree, d_node));
 
     return dftr_errors;
 }
 
 
-static DError_t d_subtraction(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
+template <typename DTree, typename DNode>
+static DError_t d_subtraction(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack)
 {
     MY_ASSERT(node);
     MY_ASSERT(d_tree);
-    MY_ASSERT(d_node);
+    MY_ASSERT(stack);
 
     DError_t dftr_errors = 0;
     TError_t tree_errors = 0;
 
-    d_node->value.type = TREE_NODE_TYPES_STRING;
-    d_node->value.value.string = "-";
+    dftr_set_node_operation(d_tree, d_node, MATH_OPERATIONS_SUBTRACTION);
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
 
@@ -771,24 +1181,24 @@ static DError_t d_subtraction(const TreeNode * node, Tree * d_tree, TreeNode * d
         return dftr_errors;
     }
 
-    dftr_errors |= dftr_create_diff_node(node->left, d_tree, d_node->left);
-    dftr_errors |= dftr_create_diff_node(node->right, d_tree, d_node->right);
+    dftr_errors |= dftr_diff_stack_push(stack, node->left, dftr_left(d_tree, d_node));
+    dftr_errors |= dftr_diff_stack_push(stack, node->right, dftr_right(d_tree, d_node));
 
     return dftr_errors;
 }
 
 
-static DError_t d_multiplication(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
+template <typename DTree, typename DNode>
+static DError_t d_multiplication(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack)
 {
     MY_ASSERT(node);
     MY_ASSERT(d_tree);
-    MY_ASSERT(d_node);
+    MY_ASSERT(stack);
 
     DError_t dftr_errors = 0;
     TError_t tree_errors = 0;
 
-    d_node->value.type = TREE_NODE_TYPES_STRING;
-    d_node->value.value.string = "+";
+    dftr_set_node_operation(d_tree, d_node, MATH_OPERATIONS_ADDITION);
 
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
@@ -799,15 +1209,16 @@ static DError_t d_multiplication(const TreeNode * node, Tree * d_tree, TreeNode
         return dftr_errors;
     }
 
-    d_node->left->value.type = TREE_NODE_TYPES_STRING;
-    d_node->left->value.value.string = "*";
-    d_node->right->value.type = TREE_NODE_TYPES_STRING;
-    d_node->right->value.value.string = "*";
+    DNode left = dftr_left(d_tree, d_node);
+    DNode right = dftr_right(d_tree, d_node);
 
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->right, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->right, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+    dftr_set_node_operation(d_tree, left, MATH_OPERATIONS_MULTIPLICATION);
+    dftr_set_node_operation(d_tree, right, MATH_OPERATIONS_MULTIPLICATION);
+
+    tree_errors |= tree_insert(d_tree, left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, left, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, right, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, right, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
 
     if (tree_errors)
     {
@@ -815,10 +1226,10 @@ static DError_t d_multiplication(const TreeNode * node, Tree * d_tree, TreeNode
         return dftr_errors;
     }
 
-    tree_errors |= tree_copy_branch(d_tree, d_node->left->left, node->left);
-    dftr_errors |= dftr_create_diff_node(node->left, d_tree, d_node->left->right);
-    tree_errors |= tree_copy_branch(d_tree, d_node->right->left, node->right);
-    dftr_errors |= dftr_create_diff_node(node->right, d_tree, d_node->right->right);
+    tree_errors |= tree_copy_branch(d_tree, dftr_left(d_tree, left), node->right);
+    dftr_errors |= dftr_diff_stack_push(stack, node->left, dftr_right(d_tree, left));
+    tree_errors |= tree_copy_branch(d_tree, dftr_left(d_tree, right), node->left);
+    dftr_errors |= dftr_diff_stack_push(stack, node->right, dftr_right(d_tree, right));
 
     if (tree_errors)
     {
@@ -830,17 +1241,17 @@ static DError_t d_multiplication(const TreeNode * node, Tree * d_tree, TreeNode
 }
 
 
-static DError_t d_division(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
+template <typename DTree, typename DNode>
+static DError_t d_division(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack)
 {
     MY_ASSERT(node);
     MY_ASSERT(d_tree);
-    MY_ASSERT(d_node);
+    MY_ASSERT(stack);
 
     DError_t dftr_errors = 0;
     TError_t tree_errors = 0;
 
-    d_node->value.type = TREE_NODE_TYPES_STRING;
-    d_node->value.value.string = "/";
+    dftr_set_node_operation(d_tree, d_node, MATH_OPERATIONS_DIVISION);
 
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
@@ -851,15 +1262,16 @@ static DError_t d_division(const TreeNode * node, Tree * d_tree, TreeNode * d_no
         return dftr_errors;
     }
 
-    d_node->left->value.type = TREE_NODE_TYPES_STRING;
-    d_node->left->value.value.string = "-";
-    d_node->right->value.type = TREE_NODE_TYPES_STRING;
-    d_node->right->value.value.string = "*";
+    DNode left = dftr_left(d_tree, d_node);
+    DNode right = dftr_right(d_tree, d_node);
+
+    dftr_set_node_operation(d_tree, left, MATH_OPERATIONS_SUBTRACTION);
+    dftr_set_node_operation(d_tree, right, MATH_OPERATIONS_MULTIPLICATION);
 
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->right, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->right, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, left, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, right, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, right, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
 
     if (tree_errors)
     {
@@ -867,13 +1279,14 @@ static DError_t d_division(const TreeNode * node, Tree * d_tree, TreeNode * d_no
         return dftr_errors;
     }
 
-    d_node->left->left->value.type = TREE_NODE_TYPES_STRING;
-    d_node->left->left->value.value.string = "*";
-    d_node->left->right->value.type = TREE_NODE_TYPES_STRING;
-    d_node->left->right->value.value.string = "*";
+    DNode minuend = dftr_left(d_tree, left);
+    DNode subtrahend = dftr_right(d_tree, left);
 
-    tree_errors |= tree_copy_branch(d_tree, d_node->right->left, node->right);
-    tree_errors |= tree_copy_branch(d_tree, d_node->right->right, node->right);
+    dftr_set_node_operation(d_tree, minuend, MATH_OPERATIONS_MULTIPLICATION);
+    dftr_set_node_operation(d_tree, subtrahend, MATH_OPERATIONS_MULTIPLICATION);
+
+    tree_errors |= tree_copy_branch(d_tree, dftr_left(d_tree, right), node->right);
+    tree_errors |= tree_copy_branch(d_tree, dftr_right(d_tree, right), node->right);
 
     if (tree_errors)
     {
@@ -881,10 +1294,10 @@ static DError_t d_division(const TreeNode * node, Tree * d_tree, TreeNode * d_no
         return dftr_errors;
     }
 
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->right, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->right, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, minuend, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, minuend, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, subtrahend, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, subtrahend, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
 
     if (tree_errors)
     {
@@ -892,10 +1305,10 @@ static DError_t d_division(const TreeNode * node, Tree * d_tree, TreeNode * d_no
         return dftr_errors;
     }
 
-    tree_errors |= tree_copy_branch(d_tree, d_node->left->left->left, node->left);
-    dftr_errors |= dftr_create_diff_node(node->left, d_tree, d_node->left->left->right);
-    tree_errors |= tree_copy_branch(d_tree, d_node->left->right->left, node->right);
-    dftr_errors |= dftr_create_diff_node(node->right, d_tree, d_node->left->right->right);
+    tree_errors |= tree_copy_branch(d_tree, dftr_left(d_tree, minuend), node->right);
+    dftr_errors |= dftr_diff_stack_push(stack, node->left, dftr_right(d_tree, minuend));
+    tree_errors |= tree_copy_branch(d_tree, dftr_left(d_tree, subtrahend), node->left);
+    dftr_errors |= dftr_diff_stack_push(stack, node->right, dftr_right(d_tree, subtrahend));
 
     if (tree_errors)
     {
@@ -907,17 +1320,17 @@ static DError_t d_division(const TreeNode * node, Tree * d_tree, TreeNode * d_no
 }
 
 
-static DError_t d_power(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
+template <typename DTree, typename DNode>
+static DError_t d_power(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack)
 {
     MY_ASSERT(node);
     MY_ASSERT(d_tree);
-    MY_ASSERT(d_node);
+    MY_ASSERT(stack);
 
     DError_t dftr_errors = 0;
     TError_t tree_errors = 0;
 
-    d_node->value.type = TREE_NODE_TYPES_STRING;
-    d_node->value.value.string = "*";
+    dftr_set_node_operation(d_tree, d_node, MATH_OPERATIONS_MULTIPLICATION);
 
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
@@ -928,12 +1341,13 @@ static DError_t d_power(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
         return dftr_errors;
     }
 
-    d_node->left->value.type = TREE_NODE_TYPES_STRING;
-    d_node->left->value.value.string = "*";
-    dftr_errors |= dftr_create_diff_node(node->left, d_tree, d_node->right);
+    DNode left = dftr_left(d_tree, d_node);
+
+    dftr_set_node_operation(d_tree, left, MATH_OPERATIONS_MULTIPLICATION);
+    dftr_errors |= dftr_diff_stack_push(stack, node->left, dftr_right(d_tree, d_node));
 
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, left, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
 
     if (tree_errors)
     {
@@ -941,13 +1355,13 @@ static DError_t d_power(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
         return dftr_errors;
     }
 
-    d_node->left->left->value.type = TREE_NODE_TYPES_NUMBER;
-    d_node->left->left->value.value.number = node->right->value.value.number;
-    d_node->left->right->value.type = TREE_NODE_TYPES_STRING;
-    d_node->left->right->value.value.string = "^";
+    DNode power = dftr_right(d_tree, left);
 
-    tree_errors |= tree_insert(d_tree, d_node->left->right, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->left->right, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+    dftr_set_node_number(d_tree, dftr_left(d_tree, left), node->right->value.value.number);
+    dftr_set_node_operation(d_tree, power, MATH_OPERATIONS_POWER);
+
+    tree_errors |= tree_insert(d_tree, power, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, power, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
 
     if (tree_errors)
     {
@@ -955,9 +1369,8 @@ static DError_t d_power(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
         return dftr_errors;
     }
 
-    tree_errors |= tree_copy_branch(d_tree, d_node->left->right->left, node->left);
-    d_node->left->right->right->value.type = TREE_NODE_TYPES_NUMBER;
-    d_node->left->right->right->value.value.number = node->right->value.value.number - 1;
+    tree_errors |= tree_copy_branch(d_tree, dftr_left(d_tree, power), node->left);
+    dftr_set_node_number(d_tree, dftr_right(d_tree, power), node->right->value.value.number - 1);
 
     if (tree_errors)
     {
@@ -969,17 +1382,17 @@ static DError_t d_power(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
 }
 
 
-static DError_t d_sinus(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
+template <typename DTree, typename DNode>
+static DError_t d_sinus(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack)
 {
     MY_ASSERT(node);
     MY_ASSERT(d_tree);
-    MY_ASSERT(d_node);
+    MY_ASSERT(stack);
 
     DError_t dftr_errors = 0;
     TError_t tree_errors = 0;
 
-    d_node->value.type = TREE_NODE_TYPES_STRING;
-    d_node->value.value.string = "*";
+    dftr_set_node_operation(d_tree, d_node, MATH_OPERATIONS_MULTIPLICATION);
 
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
@@ -990,11 +1403,12 @@ static DError_t d_sinus(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
         return dftr_errors;
     }
 
-    d_node->left->value.type = TREE_NODE_TYPES_STRING;
-    d_node->left->value.value.string = "cos";
-    dftr_errors |= dftr_create_diff_node(node->left, d_tree, d_node->right);
+    DNode left = dftr_left(d_tree, d_node);
+
+    dftr_set_node_operation(d_tree, left, MATH_OPERATIONS_COSINUS);
+    dftr_errors |= dftr_diff_stack_push(stack, node->left, dftr_right(d_tree, d_node));
 
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
 
     if (tree_errors)
     {
@@ -1002,7 +1416,7 @@ static DError_t d_sinus(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
         return dftr_errors;
     }
 
-    tree_errors |= tree_copy_branch(d_tree, d_node->left->left, node->left);
+    tree_errors |= tree_copy_branch(d_tree, dftr_left(d_tree, left), node->left);
 
     if (tree_errors)
     {
@@ -1014,17 +1428,17 @@ static DError_t d_sinus(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
 }
 
 
-static DError_t d_cosinus(const TreeNode * node, Tree * d_tree, TreeNode * d_node)
+template <typename DTree, typename DNode>
+static DError_t d_cosinus(const TreeNode * node, DTree * d_tree, DNode d_node, DftrDiffStack<DNode> * stack)
 {
     MY_ASSERT(node);
     MY_ASSERT(d_tree);
-    MY_ASSERT(d_node);
+    MY_ASSERT(stack);
 
     DError_t dftr_errors = 0;
     TError_t tree_errors = 0;
 
-    d_node->value.type = TREE_NODE_TYPES_STRING;
-    d_node->value.value.string = "*";
+    dftr_set_node_operation(d_tree, d_node, MATH_OPERATIONS_MULTIPLICATION);
 
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_LEFT, TREE_NULL);
     tree_errors |= tree_insert(d_tree, d_node, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
@@ -1035,12 +1449,13 @@ static DError_t d_cosinus(const TreeNode * node, Tree * d_tree, TreeNode * d_nod
         return dftr_errors;
     }
 
-    d_node->left->value.type = TREE_NODE_TYPES_STRING;
-    d_node->left->value.value.string = "*";
-    dftr_errors |= dftr_create_diff_node(node->left, d_tree, d_node->right);
+    DNode left = dftr_left(d_tree, d_node);
 
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
-    tree_errors |= tree_insert(d_tree, d_node->left, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
+    dftr_set_node_operation(d_tree, left, MATH_OPERATIONS_MULTIPLICATION);
+    dftr_errors |= dftr_diff_stack_push(stack, node->left, dftr_right(d_tree, d_node));
+
+    tree_errors |= tree_insert(d_tree, left, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, left, TREE_NODE_BRANCH_RIGHT, TREE_NULL);
 
     if (tree_errors)
     {
@@ -1048,12 +1463,12 @@ static DError_t d_cosinus(const TreeNode * node, Tree * d_tree, TreeNode * d_nod
         return dftr_errors;
     }
 
-    d_node->left->left->value.type = TREE_NODE_TYPES_NUMBER;
-    d_node->left->left->value.value.number = -1;
-    d_node->left->right->value.type = TREE_NODE_TYPES_STRING;
-    d_node->left->right->value.value.string = "sin";
+    DNode sinus = dftr_right(d_tree, left);
+
+    dftr_set_node_number(d_tree, dftr_left(d_tree, left), -1);
+    dftr_set_node_operation(d_tree, sinus, MATH_OPERATIONS_SINUS);
 
-    tree_errors |= tree_insert(d_tree, d_node->left->right, TREE_NODE_BRANCH_LEFT, TREE_NULL);
+    tree_errors |= tree_insert(d_tree, sinus, TREE_NODE_BRANCH_LEFT, TREE_NULL);
 
     if (tree_errors)
     {
@@ -1061,7 +1476,7 @@ static DError_t d_cosinus(const TreeNode * node, Tree * d_tree, TreeNode * d_nod
         return dftr_errors;
     }
 
-    tree_errors |= tree_copy_branch(d_tree, d_node->left->right->left, node->left);
+    tree_errors |= tree_copy_branch(d_tree, dftr_left(d_tree, sinus), node->left);
 
     if (tree_errors)
     {
@@ -1073,71 +1488,69 @@ static DError_t d_cosinus(const TreeNode * node, Tree * d_tree, TreeNode * d_nod
 }
 
 
+/// Post-order, the next node is taken before try_calculate_branch() frees the branches of this one.
 DError_t dftr_calculate_optimization(Tree * tree, bool * is_calculated)
 {
     MY_ASSERT(tree);
 
-    return dftr_calculate_optimization_recursive(tree, tree->root, is_calculated);
-}
-
-
-static DError_t dftr_calculate_optimization_recursive(Tree * tree, TreeNode * node, bool * is_calculated)
-{
-    MY_ASSERT(node);
-    MY_ASSERT(tree);
-
     DError_t dftr_errors = 0;
+    const TreeNode * root = tree->root;
 
-    if (node->left)
-        dftr_errors |= dftr_calculate_optimization_recursive(tree, node->left, is_calculated);
-    if (node->right)
-        dftr_errors |= dftr_calculate_optimization_recursive(tree, node->right, is_calculated);
+    for (TreeNode * node = tree_postorder_first(tree->root); node && !dftr_errors;)
+    {
+        TreeNode * next_node = tree_postorder_next(node, root);
 
-    if (dftr_errors)
-        return dftr_errors;
+        dftr_errors |= try_calculate_branch(tree, node, is_calculated);
 
-    dftr_errors |= try_calculate_branch(tree, node, is_calculated);
+        node = next_node;
+    }
 
     return dftr_errors;
 }
 
 
-static DError_t try_calculate_branch(Tree * tree, TreeNode * node, bool * success)
+template <typename TreeT, typename NodeT>
+static DError_t try_calculate_branch(TreeT * tree, NodeT node, bool * success)
 {
-    MY_ASSERT(node);
+    MY_ASSERT(tree);
     MY_ASSERT(success);
 
     DError_t dftr_errors = 0;
     TError_t tree_errors = 0;
+    NodeT left = dftr_left(tree, node);
 
-    if (!node->left || node->left->value.type != TREE_NODE_TYPES_NUMBER)
+    if (dftr_is_null(left) || dftr_get_value(tree, left).type != TREE_NODE_TYPES_NUMBER)
     {
         return dftr_errors;
     }
 
     size_t math_operation_id = 0;
-    if (!try_get_math_operation(node->value.value.string, &math_operation_id))
+    Tree_t value = dftr_get_value(tree, node);
+
+    if (get_value_input_type(&value, &math_operation_id) != DIFFERENCIATOR_INPUT_OPERATION)
     {
         dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
         return dftr_errors;
     }
 
+    double left_number = dftr_get_value(tree, left).value.number;
+    Tree_t right_value = {};
+
     switch (MATH_OPERATIONS_ARRAY[math_operation_id].type)
     {
         case MATH_OPERATION_TYPES_UNARY:
-            node->value.type = TREE_NODE_TYPES_NUMBER;
-            node->value.value.number = MATH_OPERATIONS_ARRAY[math_operation_id].operation(node->left->value.value.number, 0);
+            dftr_set_node_number(tree, node, MATH_OPERATIONS_ARRAY[math_operation_id].operation(left_number, 0));
             break;
 
         case MATH_OPERATION_TYPES_BINARY:
-            if (node->right->value.type != TREE_NODE_TYPES_NUMBER)
+            right_value = dftr_get_value(tree, dftr_right(tree, node));
+            if (right_value.type != TREE_NODE_TYPES_NUMBER)
             {
                 return dftr_errors;
             }
-            node->value.type = TREE_NODE_TYPES_NUMBER;
-            node->value.value.number = MATH_OPERATIONS_ARRAY[math_operation_id].operation(node->left->value.value.number,
-                                                                                          node->right->value.value.number);
-            tree_errors |= tree_delete_branch(tree, &node->right);
+            dftr_set_node_number(tree, node, MATH_OPERATIONS_ARRAY[math_operation_id].operation(left_number,
+                                                                                                 right_value.value.number));
+            tree_errors |= tree_delete_branch(tree, dftr_branch(tree, node, TREE_NODE_BRANCH_RIGHT));
             break;
 
         default:
@@ -1145,7 +1558,7 @@ static DError_t try_calculate_branch(Tree * tree, TreeNode * node, bool * succes
             break;
     }
 
-    tree_errors |= tree_delete_branch(tree, &node->left);
+    tree_errors |= tree_delete_branch(tree, dftr_branch(tree, node, TREE_NODE_BRANCH_LEFT));
 
     if (tree_errors)
         dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
@@ -1156,40 +1569,37 @@ static DError_t try_calculate_branch(Tree * tree, TreeNode * node, bool * succes
 }
 
 
+/// Post-order, the next node is taken before try_replace_node() glues a branch in place of this one.
 DError_t dftr_replace_optimization(Tree * tree, bool * is_replaced)
 {
     MY_ASSERT(tree);
 
-    return dftr_replace_optimization_recursive(tree, tree->root, is_replaced);
-}
-
-
-static DError_t dftr_replace_optimization_recursive(Tree * tree, TreeNode * node, bool * is_replaced)
-{
-    MY_ASSERT(tree);
-    MY_ASSERT(node);
-
     DError_t dftr_errors = 0;
+    const TreeNode * root = tree->root;
 
-    if (node->left)
-        dftr_errors |= dftr_replace_optimization_recursive(tree, node->left, is_replaced);
-    if (node->right)
-        dftr_errors |= dftr_replace_optimization_recursive(tree, node->right, is_replaced);
+    for (TreeNode * node = tree_postorder_first(tree->root); node && !dftr_errors;)
+    {
+        TreeNode * next_node = tree_postorder_next(node, root);
+        TreeNode * new_node = NULL;
 
-    if (dftr_errors)
-        return dftr_errors;
+        dftr_errors |= try_replace_node(tree, node, is_replaced, &new_node);
 
-    dftr_errors |= try_replace_node(tree, node, is_replaced);
+        node = next_node;
+    }
 
     return dftr_errors;
 }
 
 
-static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success)
+/// *new_node is the node that took the place of node, which is freed if a branch was glued.
+template <typename TreeT, typename NodeT>
+static DError_t try_replace_node(TreeT * tree, NodeT node, bool * success, NodeT * new_node)
 {
-    MY_ASSERT(node);
     MY_ASSERT(tree);
     MY_ASSERT(success);
+    MY_ASSERT(new_node);
+
+    *new_node = node;
 
     DError_t dftr_errors = 0;
     TError_t tree_errors = 0;
@@ -1197,65 +1607,32 @@ static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success)
     bool l_delete_neccessary = false;
     bool r_delete_neccessary = false;
     size_t math_operation_id = 0;
+    Tree_t value = dftr_get_value(tree, node);
 
-
-    DifferenciatorInput input_type = get_node_input_type(node, &math_operation_id);
-    // DifferenciatorInput l_input_type = DIFFERENCIATOR_INPUT_INVALID;
-    // DifferenciatorInput r_input_type = DIFFERENCIATOR_INPUT_INVALID;
+    DifferenciatorInput input_type = get_value_input_type(&value, &math_operation_id);
 
     if (input_type != DIFFERENCIATOR_INPUT_OPERATION)
     {
         return dftr_errors;
     }
 
-//     if (node->left)
-//         l_input_type = get_node_input_type(node->left, NULL);
-//
-//     if (node->right)
-//         r_input_type = get_node_input_type(node->right, NULL);
-
-//     switch (MATH_OPERATIONS_ARRAY[math_operation_id].type)
-//     {
-//         case MATH_OPERATION_TYPES_BINARY:
-//             if (l_input_type == DIFFERENCIATOR_INPUT_OPERATION ||
-//                 r_input_type == DIFFERENCIATOR_INPUT_OPERATION)
-//             {
-//                 return dftr_errors;
-//             }
-//
-//             break;
-//
-//         case MATH_OPERATION_TYPES_UNARY:
-//             if (l_input_type == DIFFERENCIATOR_INPUT_OPERATION)
-//             {
-//                 return dftr_errors;
-//             }
-//
-//             break;
-//
-//         default:
-//             MY_ASSERT(0 && "UNREACHABLE");
-//             break;
-//     }
+    NodeT left = dftr_left(tree, node);
+    NodeT right = dftr_right(tree, node);
 
     switch (MATH_OPERATIONS_ARRAY[math_operation_id].id)
     {
         case MATH_OPERATIONS_ADDITION:
-            if (node->right->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->right->value.value.number, 0))
+            if (dftr_is_number(tree, right, 0))
             {
-                // node->value.type = node->left->value.type;
-                // node->value.value = node->left->value.value;
+                *new_node = left;
                 tree_errors |= tree_glue_node(tree, node, TREE_NODE_BRANCH_LEFT);
                 is_replaced = true;
                 break;
             }
 
-            if (node->left->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->left->value.value.number, 0))
+            if (dftr_is_number(tree, left, 0))
             {
-                // node->value.type = node->right->value.type;
-                // node->value.value = node->right->value.value;
+                *new_node = right;
                 tree_errors |= tree_glue_node(tree, node, TREE_NODE_BRANCH_RIGHT);
                 is_replaced = true;
                 break;
@@ -1264,11 +1641,9 @@ static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success)
             break;
 
         case MATH_OPERATIONS_SUBTRACTION:
-            if (node->right->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->right->value.value.number, 0))
+            if (dftr_is_number(tree, right, 0))
             {
-                // node->value.type = node->left->value.type;
-                // node->value.value = node->left->value.value;
+                *new_node = left;
                 tree_errors |= tree_glue_node(tree, node, TREE_NODE_BRANCH_LEFT);
                 is_replaced = true;
                 break;
@@ -1277,42 +1652,25 @@ static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success)
             break;
 
         case MATH_OPERATIONS_MULTIPLICATION:
-            if (node->right->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->right->value.value.number, 1))
+            if (dftr_is_number(tree, right, 1))
             {
-                // node->value.type = node->left->value.type;
-                // node->value.value = node->left->value.value;
+                *new_node = left;
                 tree_errors |= tree_glue_node(tree, node, TREE_NODE_BRANCH_LEFT);
                 is_replaced = true;
                 break;
             }
 
-            if (node->left->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->left->value.value.number, 1))
+            if (dftr_is_number(tree, left, 1))
             {
-                // node->value.type = node->right->value.type;
-                // node->value.value = node->right->value.value;
+                *new_node = right;
                 tree_errors |= tree_glue_node(tree, node, TREE_NODE_BRANCH_RIGHT);
                 is_replaced = true;
                 break;
             }
 
-            if (node->right->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->right->value.value.number, 0))
+            if (dftr_is_number(tree, right, 0) || dftr_is_number(tree, left, 0))
             {
-                node->value.type = TREE_NODE_TYPES_NUMBER;
-                node->value.value.number = 0;
-                l_delete_neccessary = true;
-                r_delete_neccessary = true;
-                is_replaced = true;
-                break;
-            }
-
-            if (node->left->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->left->value.value.number, 0))
-            {
-                node->value.type = TREE_NODE_TYPES_NUMBER;
-                node->value.value.number = 0;
+                dftr_set_node_number(tree, node, 0);
                 l_delete_neccessary = true;
                 r_delete_neccessary = true;
                 is_replaced = true;
@@ -1322,21 +1680,17 @@ static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success)
             break;
 
         case MATH_OPERATIONS_DIVISION:
-            if (node->right->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->right->value.value.number, 1))
+            if (dftr_is_number(tree, right, 1))
             {
-                // node->value.type = node->left->value.type;
-                // node->value.value = node->left->value.value;
+                *new_node = left;
                 tree_errors |= tree_glue_node(tree, node, TREE_NODE_BRANCH_LEFT);
                 is_replaced = true;
                 break;
             }
 
-            if (node->left->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->left->value.value.number, 0))
+            if (dftr_is_number(tree, left, 0))
             {
-                node->value.type = TREE_NODE_TYPES_NUMBER;
-                node->value.value.number = 0;
+                dftr_set_node_number(tree, node, 0);
                 l_delete_neccessary = true;
                 r_delete_neccessary = true;
                 is_replaced = true;
@@ -1346,32 +1700,26 @@ static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success)
             break;
 
         case MATH_OPERATIONS_POWER:
-            if (node->left->value.type == TREE_NODE_TYPES_NUMBER &&
-                (is_equal_double(node->left->value.value.number, 1) || is_equal_double(node->left->value.value.number, 0)))
+            if (dftr_is_number(tree, left, 1) || dftr_is_number(tree, left, 0))
             {
-                node->value.type = TREE_NODE_TYPES_NUMBER;
-                node->value.value = node->left->value.value;
+                dftr_set_node_number(tree, node, dftr_get_value(tree, left).value.number);
                 l_delete_neccessary = true;
                 r_delete_neccessary = true;
                 is_replaced = true;
                 break;
             }
 
-            if (node->right->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->right->value.value.number, 1))
+            if (dftr_is_number(tree, right, 1))
             {
-                // node->value.type = node->left->value.type;
-                // node->value.value = node->left->value.value;
+                *new_node = left;
                 tree_errors |= tree_glue_node(tree, node, TREE_NODE_BRANCH_LEFT);
                 is_replaced = true;
                 break;
             }
 
-            if (node->right->value.type == TREE_NODE_TYPES_NUMBER &&
-                is_equal_double(node->right->value.value.number, 0))
+            if (dftr_is_number(tree, right, 0))
             {
-                node->value.type = TREE_NODE_TYPES_NUMBER;
-                node->value.value.number = 1;
+                dftr_set_node_number(tree, node, 1);
                 l_delete_neccessary = true;
                 r_delete_neccessary = true;
                 is_replaced = true;
@@ -1399,8 +1747,7 @@ static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success)
         case MATH_OPERATION_TYPES_BINARY:
             if (r_delete_neccessary)
             {
-                printf("DELETING BRANCH:\n\t%.2lf\n\t%s\n", node ? node->right->value.value.number : 0, node ? (node->right->value.type == TREE_NODE_TYPES_STRING ? node->right->value.value.string : "-") : "-");
-                tree_errors |= tree_delete_branch(tree, &node->right);
+                tree_errors |= tree_delete_branch(tree, dftr_branch(tree, node, TREE_NODE_BRANCH_RIGHT));
             }
             break;
 
@@ -1414,12 +1761,9 @@ static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success)
 
     if (l_delete_neccessary)
     {
-        printf("DELETING BRANCH:\n\t%.2lf\n\t%s\n", node ? node->right->value.value.number : 0, node ? (node->right->value.type == TREE_NODE_TYPES_STRING ? node->right->value.value.string : "-") : "-");
-        tree_errors |= tree_delete_branch(tree, &node->left);
+        tree_errors |= tree_delete_branch(tree, dftr_branch(tree, node, TREE_NODE_BRANCH_LEFT));
     }
 
-    printf("NEW CUR BRANCH:\n\t%.2lf\n\t%s\n\n", node ? node->value.value.number : 0, node ? (node->value.type == TREE_NODE_TYPES_STRING ? node->value.value.string : "-") : "-");
-
     if (tree_errors)
         dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
 
@@ -1429,9 +1773,142 @@ static DError_t try_replace_node(Tree * tree, TreeNode * node, bool * success)
 }
 
 
-DError_t dftr_optimization(Tree * tree)
+/// The optimizer the context asks for, the worklist unless the e-graph or the canonical form is asked.
+/// egraph_stats may be NULL, it is only filled by the e-graph.
+DError_t dftr_optimization(const DftrContext * context, Tree * tree, DftrEGraphStats * egraph_stats)
+{
+    MY_ASSERT(context);
+    MY_ASSERT(tree);
+
+    if (context->is_egraph)
+    {
+        DftrEGraphStats local_stats = {};
+
+        return dftr_egraph_optimization(tree, &DFTR_EGRAPH_DEFAULT_LIMITS, egraph_stats ? egraph_stats : &local_stats);
+    }
+
+    DftrOptimizationStats stats = {};
+
+    if (!context->is_canonical)
+        return dftr_worklist_optimization(tree, &stats);
+
+    // The canonical pass starts from the simplified tree, so the order it sorts
+    // into does not depend on the layout the derivative was built in.
+    DError_t dftr_errors = 0;
+
+    if (!(dftr_errors = dftr_worklist_optimization(tree, &stats)))
+        dftr_errors |= dftr_canonical_optimization(tree, &stats);
+
+    return dftr_errors;
+}
+
+
+/// Fixpoint of dftr_calculate_optimization and dftr_replace_optimization in one bottom-up pass.
+/// Both only look at a node and its children, so once the children are final a node needs
+/// rechecking only while it changes itself, and a changed node's parent is always still queued.
+DError_t dftr_worklist_optimization(Tree * tree, DftrOptimizationStats * stats)
+{
+    MY_ASSERT(tree);
+
+    return dftr_worklist_branch(tree, tree->root, stats);
+}
+
+
+/// Same rules as the pointer tree, ctree needs parent links to glue a branch in place of its node.
+DError_t dftr_worklist_optimization(CompactTree * ctree, DftrOptimizationStats * stats)
+{
+    MY_ASSERT(ctree);
+    MY_ASSERT(ctree->with_parents);
+
+    return dftr_worklist_branch(ctree, ctree->root, stats);
+}
+
+
+template <typename TreeT, typename NodeT>
+static DError_t dftr_worklist_branch(TreeT * tree, NodeT root, DftrOptimizationStats * stats)
 {
     MY_ASSERT(tree);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+
+    // Every node is pushed once to be expanded and once to be simplified.
+    size_t stack_capacity = 2 * tree->size;
+    NodeT * stack = NULL;
+    bool * is_expanded = NULL;
+
+    if (!(stack = (NodeT *) calloc(stack_capacity, sizeof(NodeT))) ||
+        !(is_expanded = (bool *) calloc(stack_capacity, sizeof(bool))))
+    {
+        free(stack);
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    size_t stack_size = 0;
+    stack[stack_size++] = root;
+    stats->rounds = 1;
+
+    while (stack_size && !dftr_errors)
+    {
+        stack_size--;
+        NodeT node = stack[stack_size];
+
+        if (is_expanded[stack_size])
+        {
+            is_expanded[stack_size] = false;
+            dftr_errors |= dftr_simplify_node(tree, node, stats);
+            continue;
+        }
+
+        is_expanded[stack_size] = true;
+        stack_size++;
+
+        if (!dftr_is_null(dftr_right(tree, node)))
+            stack[stack_size++] = dftr_right(tree, node);
+        if (!dftr_is_null(dftr_left(tree, node)))
+            stack[stack_size++] = dftr_left(tree, node);
+    }
+
+    free(stack);
+    free(is_expanded);
+
+    return dftr_errors;
+}
+
+
+template <typename TreeT, typename NodeT>
+static DError_t dftr_simplify_node(TreeT * tree, NodeT node, DftrOptimizationStats * stats)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+    bool is_changed = true;
+
+    while (is_changed && !dftr_errors)
+    {
+        is_changed = false;
+        stats->visits++;
+
+        dftr_errors |= try_calculate_branch(tree, node, &is_changed);
+
+        if (!is_changed && !dftr_errors)
+            dftr_errors |= try_replace_node(tree, node, &is_changed, &node);
+
+        if (is_changed)
+            stats->rewrites++;
+    }
+
+    return dftr_errors;
+}
+
+
+/// The former whole-tree loop, kept to compare against dftr_worklist_optimization.
+DError_t dftr_fixpoint_optimization(Tree * tree, DftrOptimizationStats * stats)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(stats);
 
     bool is_changed = false;
     DError_t dftr_errors = 0;
@@ -1439,8 +1916,11 @@ DError_t dftr_optimization(Tree * tree)
     do
     {
         is_changed = false;
+        stats->rounds++;
 
+        stats->visits += tree->size;
         dftr_errors |= dftr_calculate_optimization(tree, &is_changed);
+        stats->visits += tree->size;
         dftr_errors |= dftr_replace_optimization(tree, &is_changed);
 
         if (dftr_errors)
@@ -1449,3 +1929,120 @@ DError_t dftr_optimization(Tree * tree)
 
     return dftr_errors;
 }
+
+
+// Layout helpers of the diff and simplification rules: a node is a TreeNode *
+// of a Tree or a CTreeIndex of a CompactTree, the rules are written once on these.
+
+static TreeNode * dftr_left(Tree * tree, TreeNode * node)
+{
+    (void) tree;
+
+    return node->left;
+}
+
+
+static CTreeIndex dftr_left(CompactTree * ctree, CTreeIndex node)
+{
+    return ctree->lefts[node];
+}
+
+
+static TreeNode * dftr_right(Tree * tree, TreeNode * node)
+{
+    (void) tree;
+
+    return node->right;
+}
+
+
+static CTreeIndex dftr_right(CompactTree * ctree, CTreeIndex node)
+{
+    return ctree->rights[node];
+}
+
+
+/// The link that holds the branch, for tree_delete_branch().
+static TreeNode * * dftr_branch(Tree * tree, TreeNode * node, TreeNodeBranches branch)
+{
+    (void) tree;
+
+    return branch == TREE_NODE_BRANCH_LEFT ? &node->left : &node->right;
+}
+
+
+static CTreeIndex * dftr_branch(CompactTree * ctree, CTreeIndex node, TreeNodeBranches branch)
+{
+    return branch == TREE_NODE_BRANCH_LEFT ? &ctree->lefts[node] : &ctree->rights[node];
+}
+
+
+static Tree_t dftr_get_value(Tree * tree, TreeNode * node)
+{
+    (void) tree;
+
+    return node->value;
+}
+
+
+static Tree_t dftr_get_value(CompactTree * ctree, CTreeIndex node)
+{
+    return ctree_get_value(ctree, node);
+}
+
+
+static void dftr_set_value(Tree * tree, TreeNode * node, const Tree_t value)
+{
+    (void) tree;
+
+    node->value = value;
+}
+
+
+static void dftr_set_value(CompactTree * ctree, CTreeIndex node, const Tree_t value)
+{
+    ctree_set_value(ctree, node, value);
+}
+
+
+static bool dftr_is_null(const TreeNode * node)
+{
+    return !node;
+}
+
+
+static bool dftr_is_null(CTreeIndex node)
+{
+    return node == CTREE_NULL_INDEX;
+}
+
+
+template <typename TreeT, typename NodeT>
+static void dftr_set_node_number(TreeT * tree, NodeT node, double number)
+{
+    Tree_t value = {.value = {.number = number}, .type = TREE_NODE_TYPES_NUMBER, .id = 0};
+
+    dftr_set_value(tree, node, value);
+}
+
+
+template <typename TreeT, typename NodeT>
+static void dftr_set_node_operation(TreeT * tree, NodeT node, MathOperations op_id)
+{
+    Tree_t value = {};
+
+    dftr_set_operation(&value, op_id);
+    dftr_set_value(tree, node, value);
+}
+
+
+template <typename TreeT, typename NodeT>
+static bool dftr_is_number(TreeT * tree, NodeT node, double number)
+{
+    if (dftr_is_null(node))
+        return false;
+
+    Tree_t value = dftr_get_value(tree, node);
+
+    return value.type == TREE_NODE_TYPES_NUMBER && is_equal_double(value.value.number, number);
+}
@@ -0,0 +1,987 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "egraph.h"
+#include "my_assert.h"
+#include "math_operations.h"
+#include "double_comparing.h"
+
+#define RULE_OP(op)      {.type = DFTR_PATTERN_OPERATION,  .op_id = MATH_OPERATIONS_##op}
+#define RULE_NUM(n)      {.type = DFTR_PATTERN_NUMBER,     .number = (n)}
+#define RULE_ANY(i)      {.type = DFTR_PATTERN_ANY,        .wildcard = (i)}
+
+const DftrOperationCost DFTR_OPERATION_COSTS[] = {
+    {.op_id = MATH_OPERATIONS_ADDITION,       .cost = 1},
+    {.op_id = MATH_OPERATIONS_SUBTRACTION,    .cost = 1},
+    {.op_id = MATH_OPERATIONS_MULTIPLICATION, .cost = 2},
+    {.op_id = MATH_OPERATIONS_DIVISION,       .cost = 8},
+    {.op_id = MATH_OPERATIONS_POWER,          .cost = 40},
+    {.op_id = MATH_OPERATIONS_SINUS,          .cost = 30},
+    {.op_id = MATH_OPERATIONS_COSINUS,        .cost = 30},
+};
+const size_t DFTR_OPERATION_COSTS_NUMBER = sizeof(DFTR_OPERATION_COSTS) / sizeof(DFTR_OPERATION_COSTS[0]);
+
+/// Equalities the greedy rewriter can't use, as they don't make a term simpler
+/// by themselves. Applied together with DFTR_DEFAULT_RULES.
+const DftrRule DFTR_EGRAPH_RULES[] = {
+    {.name = "a + b -> b + a",
+     .pattern = {RULE_OP(ADDITION), RULE_ANY(0), RULE_ANY(1)},
+     .replacement = {RULE_OP(ADDITION), RULE_ANY(1), RULE_ANY(0)}},
+    {.name = "a * b -> b * a",
+     .pattern = {RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_ANY(1)},
+     .replacement = {RULE_OP(MULTIPLICATION), RULE_ANY(1), RULE_ANY(0)}},
+    {.name = "(a + b) + c -> a + (b + c)",
+     .pattern = {RULE_OP(ADDITION), RULE_OP(ADDITION), RULE_ANY(0), RULE_ANY(1), RULE_ANY(2)},
+     .replacement = {RULE_OP(ADDITION), RULE_ANY(0), RULE_OP(ADDITION), RULE_ANY(1), RULE_ANY(2)}},
+    {.name = "a + (b + c) -> (a + b) + c",
+     .pattern = {RULE_OP(ADDITION), RULE_ANY(0), RULE_OP(ADDITION), RULE_ANY(1), RULE_ANY(2)},
+     .replacement = {RULE_OP(ADDITION), RULE_OP(ADDITION), RULE_ANY(0), RULE_ANY(1), RULE_ANY(2)}},
+    {.name = "(a * b) * c -> a * (b * c)",
+     .pattern = {RULE_OP(MULTIPLICATION), RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_ANY(1), RULE_ANY(2)},
+     .replacement = {RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_OP(MULTIPLICATION), RULE_ANY(1), RULE_ANY(2)}},
+    {.name = "a * (b * c) -> (a * b) * c",
+     .pattern = {RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_OP(MULTIPLICATION), RULE_ANY(1), RULE_ANY(2)},
+     .replacement = {RULE_OP(MULTIPLICATION), RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_ANY(1), RULE_ANY(2)}},
+    {.name = "a * b + a * c -> a * (b + c)",
+     .pattern = {RULE_OP(ADDITION), RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_ANY(1),
+                                    RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_ANY(2)},
+     .replacement = {RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_OP(ADDITION), RULE_ANY(1), RULE_ANY(2)}},
+    {.name = "a * b - a * c -> a * (b - c)",
+     .pattern = {RULE_OP(SUBTRACTION), RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_ANY(1),
+                                       RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_ANY(2)},
+     .replacement = {RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_OP(SUBTRACTION), RULE_ANY(1), RULE_ANY(2)}},
+    {.name = "a / c + b / c -> (a + b) / c",
+     .pattern = {RULE_OP(ADDITION), RULE_OP(DIVISION), RULE_ANY(0), RULE_ANY(2),
+                                    RULE_OP(DIVISION), RULE_ANY(1), RULE_ANY(2)},
+     .replacement = {RULE_OP(DIVISION), RULE_OP(ADDITION), RULE_ANY(0), RULE_ANY(1), RULE_ANY(2)}},
+    {.name = "x ^ a * x ^ b -> x ^ (a + b)",
+     .pattern = {RULE_OP(MULTIPLICATION), RULE_OP(POWER), RULE_ANY(0), RULE_ANY(1),
+                                          RULE_OP(POWER), RULE_ANY(0), RULE_ANY(2)},
+     .replacement = {RULE_OP(POWER), RULE_ANY(0), RULE_OP(ADDITION), RULE_ANY(1), RULE_ANY(2)}},
+    {.name = "x * x ^ a -> x ^ (a + 1)",
+     .pattern = {RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_OP(POWER), RULE_ANY(0), RULE_ANY(1)},
+     .replacement = {RULE_OP(POWER), RULE_ANY(0), RULE_OP(ADDITION), RULE_ANY(1), RULE_NUM(1)}},
+    {.name = "x ^ 2 -> x * x",
+     .pattern = {RULE_OP(POWER), RULE_ANY(0), RULE_NUM(2)},
+     .replacement = {RULE_OP(MULTIPLICATION), RULE_ANY(0), RULE_ANY(0)}},
+    {.name = "x + x -> 2 * x",
+     .pattern = {RULE_OP(ADDITION), RULE_ANY(0), RULE_ANY(0)},
+     .replacement = {RULE_OP(MULTIPLICATION), RULE_NUM(2), RULE_ANY(0)}},
+    {.name = "x - x -> 0",
+     .pattern = {RULE_OP(SUBTRACTION), RULE_ANY(0), RULE_ANY(0)},
+     .replacement = {RULE_NUM(0)}},
+};
+const size_t DFTR_EGRAPH_RULES_NUMBER = sizeof(DFTR_EGRAPH_RULES) / sizeof(DFTR_EGRAPH_RULES[0]);
+
+static double egraph_now(void);
+static DError_t egraph_reserve(DftrEGraph * egraph);
+static DError_t egraph_rehash(DftrEGraph * egraph, size_t table_capacity);
+static uint64_t egraph_hash(const Tree_t * value, DftrEClassId left, DftrEClassId right);
+static bool egraph_is_equal_value(const Tree_t * value1, const Tree_t * value2);
+static DftrEClassId egraph_find(DftrEGraph * egraph, DftrEClassId eclass);
+static DftrEClassId egraph_canonical(DftrEGraph * egraph, DftrEClassId eclass);
+static DError_t egraph_add(DftrEGraph * egraph, const Tree_t value, DftrEClassId left, DftrEClassId right,
+                           DftrEClassId * eclass);
+static bool egraph_union(DftrEGraph * egraph, DftrEClassId eclass1, DftrEClassId eclass2);
+static DError_t egraph_rebuild(DftrEGraph * egraph);
+static DError_t egraph_add_tree(DftrEGraph * egraph, const Tree * tree, DftrEClassId * eclass);
+static DError_t egraph_match_rules(DftrEGraph * egraph, const DftrRule * rules, size_t rules_number);
+static DError_t egraph_match(DftrEGraph * egraph, const DftrRule * rule, size_t position, DftrEClassId root,
+                             const DftrEClassId * pending, size_t pending_size, const DftrEClassId * bindings);
+static DError_t egraph_push_match(DftrEGraph * egraph, const DftrRule * rule, DftrEClassId root,
+                                  const DftrEClassId * bindings);
+static bool egraph_get_number(DftrEGraph * egraph, DftrEClassId eclass, double * number);
+static DError_t egraph_apply(DftrEGraph * egraph, const DftrEMatch * match);
+static DError_t egraph_instantiate(DftrEGraph * egraph, const DftrPatternNode * replacement, size_t * position,
+                                   const DftrEClassId * bindings, DftrEClassId * eclass);
+static double egraph_get_value_cost(const Tree_t * value);
+static DError_t egraph_extract(DftrEGraph * egraph, DftrEClassId root, Tree * tree, double * cost);
+static DError_t egraph_extract_tree(DftrEGraph * egraph, const uint32_t * best_nodes, DftrEClassId root,
+                                    Tree * tree);
+static DError_t egraph_push_eclass(DftrEClassId * * stack, size_t * size, size_t * capacity, DftrEClassId eclass);
+
+
+DError_t op_new_dftr_egraph(DftrEGraph * egraph)
+{
+    MY_ASSERT(egraph);
+
+    DError_t dftr_errors = 0;
+
+    egraph->nodes = NULL;
+    egraph->classes = NULL;
+    egraph->size = 0;
+    egraph->capacity = 0;
+    egraph->table = NULL;
+    egraph->table_capacity = 0;
+    egraph->matches = NULL;
+    egraph->matches_number = 0;
+    egraph->matches_capacity = 0;
+    egraph->unions_number = 0;
+
+    if (!(egraph->nodes = (DftrENode *) calloc(DFTR_EGRAPH_DEFAULT_CAPACITY, sizeof(DftrENode))) ||
+        !(egraph->classes = (DftrEClass *) calloc(DFTR_EGRAPH_DEFAULT_CAPACITY, sizeof(DftrEClass))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    egraph->capacity = DFTR_EGRAPH_DEFAULT_CAPACITY;
+
+    return egraph_rehash(egraph, 2 * DFTR_EGRAPH_DEFAULT_CAPACITY);
+}
+
+
+DError_t op_delete_dftr_egraph(DftrEGraph * egraph)
+{
+    MY_ASSERT(egraph);
+
+    free(egraph->nodes);
+    free(egraph->classes);
+    free(egraph->table);
+    free(egraph->matches);
+
+    egraph->nodes = NULL;
+    egraph->classes = NULL;
+    egraph->size = 0;
+    egraph->capacity = 0;
+    egraph->table = NULL;
+    egraph->table_capacity = 0;
+    egraph->matches = NULL;
+    egraph->matches_number = 0;
+    egraph->matches_capacity = 0;
+
+    return 0;
+}
+
+
+/// Greedy simplification, then equality saturation with DFTR_DEFAULT_RULES and
+/// DFTR_EGRAPH_RULES until nothing changes or a limit is hit, then the cheapest
+/// tree by DFTR_OPERATION_COSTS is extracted. The greedy result stays in the
+/// e-graph, so the extracted tree never costs more.
+DError_t dftr_egraph_optimization(Tree * tree, const DftrEGraphLimits * limits, DftrEGraphStats * stats)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(limits);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+    DftrOptimizationStats greedy_stats = {};
+    DftrEGraph egraph = {};
+    DftrEClassId root = DFTR_ECLASS_NULL;
+
+    if (dftr_errors = dftr_worklist_optimization(tree, &greedy_stats))
+        return dftr_errors;
+
+    stats->cost_before = dftr_get_cost(tree);
+    stats->stop = DFTR_EGRAPH_STOP_ITERATIONS;
+
+    double start = egraph_now();
+
+    if ((dftr_errors = op_new_dftr_egraph(&egraph)) ||
+        (dftr_errors = egraph_add_tree(&egraph, tree, &root)))
+    {
+        op_delete_dftr_egraph(&egraph);
+        return dftr_errors;
+    }
+
+    while (stats->iterations < limits->max_iterations && !dftr_errors)
+    {
+        if (egraph.size >= limits->max_nodes)
+        {
+            stats->stop = DFTR_EGRAPH_STOP_NODES;
+            break;
+        }
+
+        if (egraph_now() - start > limits->max_time)
+        {
+            stats->stop = DFTR_EGRAPH_STOP_TIME;
+            break;
+        }
+
+        stats->iterations++;
+
+        size_t size = egraph.size;
+        size_t unions_number = egraph.unions_number;
+
+        egraph.matches_number = 0;
+        dftr_errors |= egraph_match_rules(&egraph, DFTR_DEFAULT_RULES, DFTR_DEFAULT_RULES_NUMBER);
+        dftr_errors |= egraph_match_rules(&egraph, DFTR_EGRAPH_RULES, DFTR_EGRAPH_RULES_NUMBER);
+        stats->matches += egraph.matches_number;
+
+        // Matches are collected first, so they all see the same e-graph.
+        for (size_t i = 0; i < egraph.matches_number && egraph.size < limits->max_nodes && !dftr_errors; i++)
+            dftr_errors |= egraph_apply(&egraph, &egraph.matches[i]);
+
+        dftr_errors |= egraph_rebuild(&egraph);
+
+        if (egraph.size == size && egraph.unions_number == unions_number)
+        {
+            stats->stop = DFTR_EGRAPH_STOP_SATURATED;
+            break;
+        }
+    }
+
+    stats->nodes = egraph.size;
+    for (size_t i = 0; i < egraph.size; i++)
+    {
+        if (egraph.classes[i].parent == i)
+            stats->classes++;
+    }
+
+    if (!dftr_errors)
+        dftr_errors |= egraph_extract(&egraph, root, tree, &stats->cost_after);
+
+    op_delete_dftr_egraph(&egraph);
+
+    return dftr_errors;
+}
+
+
+static double egraph_now(void)
+{
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double) time.tv_sec + (double) time.tv_nsec * 1e-9;
+}
+
+
+static DError_t egraph_reserve(DftrEGraph * egraph)
+{
+    MY_ASSERT(egraph);
+
+    DError_t dftr_errors = 0;
+
+    if (egraph->size < egraph->capacity)
+        return dftr_errors;
+
+    DftrENode * nodes = NULL;
+    DftrEClass * classes = NULL;
+
+    if (!(nodes = (DftrENode *) realloc(egraph->nodes, 2 * egraph->capacity * sizeof(DftrENode))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    egraph->nodes = nodes;
+
+    if (!(classes = (DftrEClass *) realloc(egraph->classes, 2 * egraph->capacity * sizeof(DftrEClass))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    egraph->classes = classes;
+
+    egraph->capacity *= 2;
+
+    return dftr_errors;
+}
+
+
+static DError_t egraph_rehash(DftrEGraph * egraph, size_t table_capacity)
+{
+    MY_ASSERT(egraph);
+
+    DError_t dftr_errors = 0;
+    uint32_t * table = NULL;
+
+    if (!(table = (uint32_t *) malloc(table_capacity * sizeof(uint32_t))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    memset(table, 0xFF, table_capacity * sizeof(uint32_t));
+
+    size_t mask = table_capacity - 1;
+    for (size_t i = 0; i < egraph->size; i++)
+    {
+        DftrENode * node = &egraph->nodes[i];
+        if (node->is_dead)
+            continue;
+
+        size_t slot = (size_t) egraph_hash(&node->value, egraph_canonical(egraph, node->left),
+                                           egraph_canonical(egraph, node->right)) & mask;
+
+        while (table[slot] != DFTR_ECLASS_NULL)
+            slot = (slot + 1) & mask;
+
+        table[slot] = (uint32_t) i;
+    }
+
+    free(egraph->table);
+    egraph->table = table;
+    egraph->table_capacity = table_capacity;
+
+    return dftr_errors;
+}
+
+
+static uint64_t egraph_hash(const Tree_t * value, DftrEClassId left, DftrEClassId right)
+{
+    MY_ASSERT(value);
+
+    uint64_t payload = 0;
+
+    if (value->type == TREE_NODE_TYPES_NUMBER)
+        memcpy(&payload, &value->value.number, sizeof(payload));
+    else
+        payload = (uint64_t) value->id;
+
+    uint64_t hash = payload ^ ((uint64_t) value->type << 56);
+    hash ^= ((uint64_t) left << 32 | right) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 31;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 29;
+
+    return hash;
+}
+
+
+static bool egraph_is_equal_value(const Tree_t * value1, const Tree_t * value2)
+{
+    MY_ASSERT(value1);
+    MY_ASSERT(value2);
+
+    if (value1->type != value2->type)
+        return false;
+
+    if (value1->type == TREE_NODE_TYPES_NUMBER)
+        return !memcmp(&value1->value.number, &value2->value.number, sizeof(double));
+
+    return value1->id == value2->id;
+}
+
+
+static DftrEClassId egraph_find(DftrEGraph * egraph, DftrEClassId eclass)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(eclass < egraph->size);
+
+    while (egraph->classes[eclass].parent != eclass)
+    {
+        egraph->classes[eclass].parent = egraph->classes[egraph->classes[eclass].parent].parent;
+        eclass = egraph->classes[eclass].parent;
+    }
+
+    return eclass;
+}
+
+
+static DftrEClassId egraph_canonical(DftrEGraph * egraph, DftrEClassId eclass)
+{
+    return eclass == DFTR_ECLASS_NULL ? eclass : egraph_find(egraph, eclass);
+}
+
+
+/// Class of the node (value, left, right), a new one if no equal node is known.
+/// Unions since the last rebuild may hide an equal node, the rebuild merges such copies.
+static DError_t egraph_add(DftrEGraph * egraph, const Tree_t value, DftrEClassId left, DftrEClassId right,
+                           DftrEClassId * eclass)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(eclass);
+
+    DError_t dftr_errors = 0;
+
+    left = egraph_canonical(egraph, left);
+    right = egraph_canonical(egraph, right);
+
+    size_t mask = egraph->table_capacity - 1;
+    size_t slot = (size_t) egraph_hash(&value, left, right) & mask;
+
+    for (; egraph->table[slot] != DFTR_ECLASS_NULL; slot = (slot + 1) & mask)
+    {
+        DftrENode * node = &egraph->nodes[egraph->table[slot]];
+
+        if (!node->is_dead && egraph_is_equal_value(&node->value, &value) &&
+            egraph_canonical(egraph, node->left) == left && egraph_canonical(egraph, node->right) == right)
+        {
+            *eclass = egraph_find(egraph, node->eclass);
+            return dftr_errors;
+        }
+    }
+
+    if (dftr_errors = egraph_reserve(egraph))
+        return dftr_errors;
+
+    uint32_t index = (uint32_t) egraph->size++;
+    egraph->nodes[index].value = value;
+    egraph->nodes[index].left = left;
+    egraph->nodes[index].right = right;
+    egraph->nodes[index].eclass = index;
+    egraph->nodes[index].next = DFTR_ECLASS_NULL;
+    egraph->nodes[index].is_dead = false;
+    egraph->classes[index].parent = index;
+    egraph->classes[index].first_node = index;
+    egraph->classes[index].last_node = index;
+
+    // Keep the load factor under 1/2, the slot found above is stale after a rehash.
+    if (2 * egraph->size > egraph->table_capacity)
+        dftr_errors |= egraph_rehash(egraph, 2 * egraph->table_capacity);
+    else
+        egraph->table[slot] = index;
+
+    *eclass = index;
+
+    return dftr_errors;
+}
+
+
+static bool egraph_union(DftrEGraph * egraph, DftrEClassId eclass1, DftrEClassId eclass2)
+{
+    MY_ASSERT(egraph);
+
+    eclass1 = egraph_find(egraph, eclass1);
+    eclass2 = egraph_find(egraph, eclass2);
+
+    if (eclass1 == eclass2)
+        return false;
+
+    if (eclass2 < eclass1)
+    {
+        DftrEClassId temp = eclass1;
+        eclass1 = eclass2;
+        eclass2 = temp;
+    }
+
+    egraph->classes[eclass2].parent = eclass1;
+    egraph->nodes[egraph->classes[eclass1].last_node].next = egraph->classes[eclass2].first_node;
+    egraph->classes[eclass1].last_node = egraph->classes[eclass2].last_node;
+    egraph->unions_number++;
+
+    return true;
+}
+
+
+/// Restores congruence: nodes equal up to the classes of their children are
+/// merged, which may make more nodes equal, so it repeats until nothing merges.
+static DError_t egraph_rebuild(DftrEGraph * egraph)
+{
+    MY_ASSERT(egraph);
+
+    DError_t dftr_errors = 0;
+    bool is_changed = true;
+    size_t mask = egraph->table_capacity - 1;
+
+    while (is_changed)
+    {
+        is_changed = false;
+        memset(egraph->table, 0xFF, egraph->table_capacity * sizeof(uint32_t));
+
+        for (size_t i = 0; i < egraph->size; i++)
+        {
+            DftrENode * node = &egraph->nodes[i];
+            if (node->is_dead)
+                continue;
+
+            node->left = egraph_canonical(egraph, node->left);
+            node->right = egraph_canonical(egraph, node->right);
+
+            size_t slot = (size_t) egraph_hash(&node->value, node->left, node->right) & mask;
+            bool is_found = false;
+
+            for (; egraph->table[slot] != DFTR_ECLASS_NULL; slot = (slot + 1) & mask)
+            {
+                DftrENode * other = &egraph->nodes[egraph->table[slot]];
+
+                if (egraph_is_equal_value(&other->value, &node->value) &&
+                    egraph_canonical(egraph, other->left) == node->left &&
+                    egraph_canonical(egraph, other->right) == node->right)
+                {
+                    if (egraph_union(egraph, other->eclass, node->eclass))
+                        is_changed = true;
+                    else
+                        node->is_dead = true;
+
+                    is_found = true;
+                    break;
+                }
+            }
+
+            if (!is_found)
+                egraph->table[slot] = (uint32_t) i;
+        }
+    }
+
+    return dftr_errors;
+}
+
+
+/// The tree is walked in post order, so the classes of the branches are on top of the stack
+/// when their node is added and deep chains don't recurse.
+static DError_t egraph_add_tree(DftrEGraph * egraph, const Tree * tree, DftrEClassId * eclass)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(tree);
+    MY_ASSERT(eclass);
+
+    DError_t dftr_errors = 0;
+    DftrEClassId * stack = NULL;
+    size_t size = 0;
+
+    if (!(stack = (DftrEClassId *) calloc(tree->size + 1, sizeof(DftrEClassId))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    const TreeNode * root = tree->root;
+
+    for (const TreeNode * node = tree_postorder_first(root); node && !dftr_errors;
+         node = tree_postorder_next(node, root))
+    {
+        DftrEClassId left = DFTR_ECLASS_NULL;
+        DftrEClassId right = DFTR_ECLASS_NULL;
+
+        if (node->right)
+            right = stack[--size];
+        if (node->left)
+            left = stack[--size];
+
+        dftr_errors |= egraph_add(egraph, node->value, left, right, &stack[size++]);
+    }
+
+    if (!dftr_errors)
+        *eclass = stack[0];
+
+    free(stack);
+
+    return dftr_errors;
+}
+
+
+static DError_t egraph_match_rules(DftrEGraph * egraph, const DftrRule * rules, size_t rules_number)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(rules);
+
+    DError_t dftr_errors = 0;
+    const DftrEClassId bindings[DFTR_RULE_MAX_WILDCARDS] = {DFTR_ECLASS_NULL, DFTR_ECLASS_NULL,
+                                                            DFTR_ECLASS_NULL, DFTR_ECLASS_NULL};
+
+    for (size_t i = 0; i < rules_number && !dftr_errors; i++)
+    {
+        for (DftrEClassId eclass = 0; eclass < egraph->size && !dftr_errors; eclass++)
+        {
+            if (egraph->classes[eclass].parent != eclass)
+                continue;
+
+            dftr_errors |= egraph_match(egraph, &rules[i], 0, eclass, &eclass, 1, bindings);
+        }
+    }
+
+    return dftr_errors;
+}
+
+
+/// Like the rule index search in rewrite.cpp, but a class holds several nodes
+/// to try and a repeated wildcard has to meet the class it bound before.
+static DError_t egraph_match(DftrEGraph * egraph, const DftrRule * rule, size_t position, DftrEClassId root,
+                             const DftrEClassId * pending, size_t pending_size, const DftrEClassId * bindings)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(rule);
+    MY_ASSERT(pending);
+    MY_ASSERT(bindings);
+
+    DError_t dftr_errors = 0;
+
+    if (!pending_size)
+        return egraph_push_match(egraph, rule, root, bindings);
+
+    if (position == DFTR_RULE_MAX_SIZE)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+        return dftr_errors;
+    }
+
+    const DftrPatternNode * symbol = &rule->pattern[position];
+    DftrEClassId eclass = egraph_find(egraph, pending[pending_size - 1]);
+    DftrEClassId next_pending[DFTR_RULE_MAX_SIZE] = {};
+    DftrEClassId next_bindings[DFTR_RULE_MAX_WILDCARDS] = {};
+    size_t next_size = pending_size - 1;
+    double number = 0;
+
+    memcpy(next_pending, pending, next_size * sizeof(DftrEClassId));
+    memcpy(next_bindings, bindings, sizeof(next_bindings));
+
+    switch (symbol->type)
+    {
+        case DFTR_PATTERN_ANY_NUMBER:
+            if (!egraph_get_number(egraph, eclass, &number))
+                return dftr_errors;
+            // fallthrough
+
+        case DFTR_PATTERN_ANY:
+            if (bindings[symbol->wildcard] != DFTR_ECLASS_NULL)
+            {
+                if (egraph_find(egraph, bindings[symbol->wildcard]) != eclass)
+                    return dftr_errors;
+            }
+            next_bindings[symbol->wildcard] = eclass;
+            return egraph_match(egraph, rule, position + 1, root, next_pending, next_size, next_bindings);
+
+        case DFTR_PATTERN_NUMBER:
+            if (!egraph_get_number(egraph, eclass, &number) || !is_equal_double(number, symbol->number))
+                return dftr_errors;
+            return egraph_match(egraph, rule, position + 1, root, next_pending, next_size, next_bindings);
+
+        case DFTR_PATTERN_OPERATION:
+            for (uint32_t i = egraph->classes[eclass].first_node; i != DFTR_ECLASS_NULL && !dftr_errors;
+                 i = egraph->nodes[i].next)
+            {
+                const DftrENode * node = &egraph->nodes[i];
+
+                if (node->is_dead || node->value.type != TREE_NODE_TYPES_OPERATION ||
+                    MATH_OPERATIONS_ARRAY[node->value.id].id != symbol->op_id)
+                {
+                    continue;
+                }
+
+                next_size = pending_size - 1;
+                if (node->right != DFTR_ECLASS_NULL)
+                    next_pending[next_size++] = node->right;
+                next_pending[next_size++] = node->left;
+
+                dftr_errors |= egraph_match(egraph, rule, position + 1, root, next_pending, next_size, next_bindings);
+            }
+            return dftr_errors;
+
+        case DFTR_PATTERN_NONE:
+        case DFTR_PATTERN_FOLD:
+        default:
+            dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+            return dftr_errors;
+    }
+}
+
+
+static DError_t egraph_push_match(DftrEGraph * egraph, const DftrRule * rule, DftrEClassId root,
+                                  const DftrEClassId * bindings)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(rule);
+    MY_ASSERT(bindings);
+
+    DError_t dftr_errors = 0;
+
+    if (egraph->matches_number == egraph->matches_capacity)
+    {
+        size_t capacity = egraph->matches_capacity ? 2 * egraph->matches_capacity : DFTR_EGRAPH_DEFAULT_CAPACITY;
+        DftrEMatch * matches = NULL;
+
+        if (!(matches = (DftrEMatch *) realloc(egraph->matches, capacity * sizeof(DftrEMatch))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+
+        egraph->matches = matches;
+        egraph->matches_capacity = capacity;
+    }
+
+    DftrEMatch * match = &egraph->matches[egraph->matches_number++];
+    match->rule = rule;
+    match->eclass = root;
+    memcpy(match->bindings, bindings, sizeof(match->bindings));
+
+    return dftr_errors;
+}
+
+
+static bool egraph_get_number(DftrEGraph * egraph, DftrEClassId eclass, double * number)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(number);
+
+    eclass = egraph_find(egraph, eclass);
+
+    for (uint32_t i = egraph->classes[eclass].first_node; i != DFTR_ECLASS_NULL; i = egraph->nodes[i].next)
+    {
+        if (!egraph->nodes[i].is_dead && egraph->nodes[i].value.type == TREE_NODE_TYPES_NUMBER)
+        {
+            *number = egraph->nodes[i].value.value.number;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static DError_t egraph_apply(DftrEGraph * egraph, const DftrEMatch * match)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(match);
+
+    DError_t dftr_errors = 0;
+    const DftrRule * rule = match->rule;
+    DftrEClassId eclass = DFTR_ECLASS_NULL;
+
+    if (rule->replacement[0].type == DFTR_PATTERN_FOLD)
+    {
+        const MathOperation * operation = &MATH_OPERATIONS_ARRAY[get_math_operation_index(rule->pattern[0].op_id)];
+        double left_number = 0;
+        double right_number = 0;
+
+        egraph_get_number(egraph, match->bindings[0], &left_number);
+        if (operation->type == MATH_OPERATION_TYPES_BINARY)
+            egraph_get_number(egraph, match->bindings[1], &right_number);
+
+        Tree_t value = TREE_NULL;
+        value.type = TREE_NODE_TYPES_NUMBER;
+        value.value.number = operation->operation(left_number, right_number);
+
+        dftr_errors |= egraph_add(egraph, value, DFTR_ECLASS_NULL, DFTR_ECLASS_NULL, &eclass);
+    }
+    else
+    {
+        size_t position = 0;
+        dftr_errors |= egraph_instantiate(egraph, rule->replacement, &position, match->bindings, &eclass);
+    }
+
+    if (!dftr_errors)
+        egraph_union(egraph, match->eclass, eclass);
+
+    return dftr_errors;
+}
+
+
+static DError_t egraph_instantiate(DftrEGraph * egraph, const DftrPatternNode * replacement, size_t * position,
+                                   const DftrEClassId * bindings, DftrEClassId * eclass)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(replacement);
+    MY_ASSERT(position);
+    MY_ASSERT(bindings);
+    MY_ASSERT(eclass);
+
+    DError_t dftr_errors = 0;
+
+    if (*position == DFTR_RULE_MAX_SIZE)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+        return dftr_errors;
+    }
+
+    const DftrPatternNode * symbol = &replacement[(*position)++];
+    DftrEClassId left = DFTR_ECLASS_NULL;
+    DftrEClassId right = DFTR_ECLASS_NULL;
+    Tree_t value = TREE_NULL;
+
+    switch (symbol->type)
+    {
+        case DFTR_PATTERN_OPERATION:
+            dftr_errors |= egraph_instantiate(egraph, replacement, position, bindings, &left);
+            if (MATH_OPERATIONS_ARRAY[get_math_operation_index(symbol->op_id)].type == MATH_OPERATION_TYPES_BINARY &&
+                !dftr_errors)
+            {
+                dftr_errors |= egraph_instantiate(egraph, replacement, position, bindings, &right);
+            }
+
+            if (dftr_errors)
+                return dftr_errors;
+
+            dftr_set_operation(&value, symbol->op_id);
+            return egraph_add(egraph, value, left, right, eclass);
+
+        case DFTR_PATTERN_NUMBER:
+            value.type = TREE_NODE_TYPES_NUMBER;
+            value.value.number = symbol->number;
+            return egraph_add(egraph, value, DFTR_ECLASS_NULL, DFTR_ECLASS_NULL, eclass);
+
+        case DFTR_PATTERN_ANY:
+        case DFTR_PATTERN_ANY_NUMBER:
+            if (bindings[symbol->wildcard] == DFTR_ECLASS_NULL)
+            {
+                dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                return dftr_errors;
+            }
+            *eclass = bindings[symbol->wildcard];
+            return dftr_errors;
+
+        case DFTR_PATTERN_NONE:
+        case DFTR_PATTERN_FOLD:
+        default:
+            dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+            return dftr_errors;
+    }
+}
+
+
+static double egraph_get_value_cost(const Tree_t * value)
+{
+    MY_ASSERT(value);
+
+    if (value->type != TREE_NODE_TYPES_OPERATION)
+        return DFTR_LEAF_COST;
+
+    for (size_t i = 0; i < DFTR_OPERATION_COSTS_NUMBER; i++)
+    {
+        if (DFTR_OPERATION_COSTS[i].op_id == MATH_OPERATIONS_ARRAY[value->id].id)
+            return DFTR_OPERATION_COSTS[i].cost;
+    }
+
+    return DFTR_LEAF_COST;
+}
+
+
+/// Cheapest node of every class by relaxation. Costs are positive, so the
+/// chosen nodes can't form a cycle and the tree below root is finite.
+static DError_t egraph_extract(DftrEGraph * egraph, DftrEClassId root, Tree * tree, double * cost)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(tree);
+    MY_ASSERT(cost);
+
+    DError_t dftr_errors = 0;
+    TError_t tree_errors = 0;
+    double * costs = NULL;
+    uint32_t * best_nodes = NULL;
+
+    if (!(costs = (double *) calloc(egraph->size, sizeof(double))) ||
+        !(best_nodes = (uint32_t *) calloc(egraph->size, sizeof(uint32_t))))
+    {
+        free(costs);
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    for (size_t i = 0; i < egraph->size; i++)
+        costs[i] = HUGE_VAL;
+
+    bool is_changed = true;
+    while (is_changed)
+    {
+        is_changed = false;
+
+        for (size_t i = 0; i < egraph->size; i++)
+        {
+            const DftrENode * node = &egraph->nodes[i];
+            if (node->is_dead)
+                continue;
+
+            double node_cost = egraph_get_value_cost(&node->value);
+            if (node->left != DFTR_ECLASS_NULL)
+                node_cost += costs[egraph_find(egraph, node->left)];
+            if (node->right != DFTR_ECLASS_NULL)
+                node_cost += costs[egraph_find(egraph, node->right)];
+
+            DftrEClassId eclass = egraph_find(egraph, node->eclass);
+            if (node_cost < costs[eclass])
+            {
+                costs[eclass] = node_cost;
+                best_nodes[eclass] = (uint32_t) i;
+                is_changed = true;
+            }
+        }
+    }
+
+    root = egraph_find(egraph, root);
+    *cost = costs[root];
+
+    if (tree->root->left)
+        tree_errors |= tree_delete_branch(tree, &tree->root->left);
+    if (tree->root->right)
+        tree_errors |= tree_delete_branch(tree, &tree->root->right);
+
+    if (tree_errors)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+    else
+        dftr_errors |= egraph_extract_tree(egraph, best_nodes, root, tree);
+
+    free(costs);
+    free(best_nodes);
+
+    return dftr_errors;
+}
+
+
+/// The tree is built in pre-order as it grows, the stack gives the class of every node met.
+static DError_t egraph_extract_tree(DftrEGraph * egraph, const uint32_t * best_nodes, DftrEClassId root,
+                                    Tree * tree)
+{
+    MY_ASSERT(egraph);
+    MY_ASSERT(best_nodes);
+    MY_ASSERT(tree);
+
+    DError_t dftr_errors = 0;
+    DftrEClassId * stack = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+
+    dftr_errors |= egraph_push_eclass(&stack, &size, &capacity, root);
+
+    for (TreeNode * node = tree->root; node && !dftr_errors; node = tree_preorder_next(node, tree->root))
+    {
+        const DftrENode * best_node = &egraph->nodes[best_nodes[egraph_find(egraph, stack[--size])]];
+
+        node->value = best_node->value;
+
+        if (best_node->right != DFTR_ECLASS_NULL)
+        {
+            if (tree_insert(tree, node, TREE_NODE_BRANCH_RIGHT, TREE_NULL))
+                dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+            else
+                dftr_errors |= egraph_push_eclass(&stack, &size, &capacity, best_node->right);
+        }
+
+        if (best_node->left != DFTR_ECLASS_NULL && !dftr_errors)
+        {
+            if (tree_insert(tree, node, TREE_NODE_BRANCH_LEFT, TREE_NULL))
+                dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+            else
+                dftr_errors |= egraph_push_eclass(&stack, &size, &capacity, best_node->left);
+        }
+    }
+
+    free(stack);
+
+    return dftr_errors;
+}
+
+
+static DError_t egraph_push_eclass(DftrEClassId * * stack, size_t * size, size_t * capacity, DftrEClassId eclass)
+{
+    MY_ASSERT(stack);
+    MY_ASSERT(size);
+    MY_ASSERT(capacity);
+
+    DError_t dftr_errors = 0;
+
+    if (*size == *capacity)
+    {
+        size_t new_capacity = *capacity ? 2 * *capacity : DFTR_EGRAPH_DEFAULT_CAPACITY;
+        DftrEClassId * new_stack = NULL;
+
+        if (!(new_stack = (DftrEClassId *) realloc(*stack, new_capacity * sizeof(DftrEClassId))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+
+        *stack = new_stack;
+        *capacity = new_capacity;
+    }
+
+    (*stack)[(*size)++] = eclass;
+
+    return dftr_errors;
+}
+
+
+/// Evaluation cost of the tree by DFTR_OPERATION_COSTS. It is a sum over the nodes,
+/// so they are visited in pre-order along the parent pointers.
+double dftr_get_cost(const Tree * tree)
+{
+    MY_ASSERT(tree);
+
+    double cost = 0;
+
+    for (const TreeNode * node = tree->root; node; node = tree_preorder_next(node, tree->root))
+        cost += egraph_get_value_cost(&node->value);
+
+    return cost;
+}
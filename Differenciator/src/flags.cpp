@@ -1,11 +1,20 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
 
 #include "cmd_input.h"
 #include "my_assert.h"
 #include "flags.h"
 
 char * SOURCE_FILE_NAME = NULL;
+bool IS_EGRAPH_MODE = false;
+bool IS_MMAP_MODE = false;
+char * BATCH_OUTPUT_FILE_NAME = NULL;
+size_t BATCH_THREADS_NUMBER = 0;
+bool IS_COMPACT_MODE = false;
+bool IS_CANONICAL_MODE = false;
 char * * cmd_input = NULL;
 
 CmdLineArg DIFFERENCIATOR_SOURCE_FILE = {
@@ -14,19 +23,137 @@ CmdLineArg DIFFERENCIATOR_SOURCE_FILE = {
     .flag_function = set_differenciator_source_file_name_flag,
     .argc_number =   0,
     .help =          "--source *file name*",
-    .is_mandatory = false,
+    .is_optional =   false,
+    .is_given =      false,
 };
 
-CmdLineArg * FLAGS[] = {&DIFFERENCIATOR_SOURCE_FILE};
+CmdLineArg DIFFERENCIATOR_EGRAPH = {
+    .name =          "--egraph",
+    .num_of_param =  0,
+    .flag_function = set_differenciator_egraph_flag,
+    .argc_number =   0,
+    .help =          "--egraph",
+    .is_optional =   true,
+    .is_given =      false,
+};
+
+CmdLineArg DIFFERENCIATOR_MMAP = {
+    .name =          "--mmap",
+    .num_of_param =  0,
+    .flag_function = set_differenciator_mmap_flag,
+    .argc_number =   0,
+    .help =          "--mmap",
+    .is_optional =   true,
+    .is_given =      false,
+};
+
+CmdLineArg DIFFERENCIATOR_BATCH = {
+    .name =          "--batch",
+    .num_of_param =  1,
+    .flag_function = set_differenciator_batch_flag,
+    .argc_number =   0,
+    .help =          "--batch *output file name*",
+    .is_optional =   true,
+    .is_given =      false,
+};
+
+CmdLineArg DIFFERENCIATOR_THREADS = {
+    .name =          "--threads",
+    .num_of_param =  1,
+    .flag_function = set_differenciator_threads_flag,
+    .argc_number =   0,
+    .help =          "--threads *number, 0 for one per cpu*",
+    .is_optional =   true,
+    .is_given =      false,
+};
+
+CmdLineArg DIFFERENCIATOR_COMPACT = {
+    .name =          "--compact",
+    .num_of_param =  0,
+    .flag_function = set_differenciator_compact_flag,
+    .argc_number =   0,
+    .help =          "--compact",
+    .is_optional =   true,
+    .is_given =      false,
+};
+
+CmdLineArg DIFFERENCIATOR_CANONICAL = {
+    .name =          "--canonical",
+    .num_of_param =  0,
+    .flag_function = set_differenciator_canonical_flag,
+    .argc_number =   0,
+    .help =          "--canonical",
+    .is_optional =   true,
+    .is_given =      false,
+};
+
+CmdLineArg * FLAGS[] = {&DIFFERENCIATOR_SOURCE_FILE, &DIFFERENCIATOR_EGRAPH, &DIFFERENCIATOR_MMAP,
+                        &DIFFERENCIATOR_BATCH, &DIFFERENCIATOR_THREADS, &DIFFERENCIATOR_COMPACT,
+                        &DIFFERENCIATOR_CANONICAL};
 size_t FLAGS_ARRAY_SIZE = sizeof(FLAGS) / sizeof(FLAGS[0]);
 
 
 void show_error_message(const char * program_name)
 {
-    printf("Error. Please, use %s %s\n", program_name, DIFFERENCIATOR_SOURCE_FILE.help);
+    printf("Error. Please, use %s %s [%s] [%s] [%s] [%s] [%s [%s]]\n", program_name, DIFFERENCIATOR_SOURCE_FILE.help,
+                                                                        DIFFERENCIATOR_EGRAPH.help, DIFFERENCIATOR_MMAP.help,
+                                                                        DIFFERENCIATOR_COMPACT.help, DIFFERENCIATOR_CANONICAL.help,
+                                                                        DIFFERENCIATOR_BATCH.help, DIFFERENCIATOR_THREADS.help);
 }
 
-void set_differenciator_source_file_name_flag()
+bool set_differenciator_source_file_name_flag()
 {
     SOURCE_FILE_NAME = cmd_input[DIFFERENCIATOR_SOURCE_FILE.argc_number + 1];
+
+    return true;
+}
+
+bool set_differenciator_egraph_flag()
+{
+    IS_EGRAPH_MODE = true;
+
+    return true;
+}
+
+bool set_differenciator_mmap_flag()
+{
+    IS_MMAP_MODE = true;
+
+    return true;
+}
+
+bool set_differenciator_compact_flag()
+{
+    IS_COMPACT_MODE = true;
+
+    return true;
+}
+
+bool set_differenciator_canonical_flag()
+{
+    IS_CANONICAL_MODE = true;
+
+    return true;
+}
+
+bool set_differenciator_batch_flag()
+{
+    BATCH_OUTPUT_FILE_NAME = cmd_input[DIFFERENCIATOR_BATCH.argc_number + 1];
+
+    return true;
+}
+
+/// A plain decimal number, strtoul() alone would take "abc" as 0 and "-1" as SIZE_MAX.
+bool set_differenciator_threads_flag()
+{
+    const char * number = cmd_input[DIFFERENCIATOR_THREADS.argc_number + 1];
+    char * number_end = NULL;
+
+    if (!isdigit((unsigned char) number[0]))
+        return false;
+
+    errno = 0;
+    BATCH_THREADS_NUMBER = strtoul(number, &number_end, 10);
+
+    return errno != ERANGE && *number_end == '\0';
 }
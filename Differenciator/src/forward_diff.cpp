@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "autodiff.h"
+#include "double_comparing.h"
+#include "my_assert.h"
+
+const size_t DFTR_DUAL_LOCAL_STACK_SIZE = 64;
+
+static void dftr_dual_operation(MathOperations op_id, const DftrDual * left, const DftrDual * right,
+                                DftrDual * answer);
+
+
+/// Forward mode: f and df/d(variables[variable_id]) in one traversal, no nodes allocated.
+/// The tree is walked in post order, the duals of the branches are on top of the stack
+/// when their node is met, so deep chains don't recurse.
+DError_t dftr_eval_dual(const Tree * tree, const double * variables, size_t variable_id, DftrDual * answer)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(variables);
+    MY_ASSERT(answer);
+
+    DError_t dftr_errors = 0;
+
+    DftrDual local_stack[DFTR_DUAL_LOCAL_STACK_SIZE];
+    DftrDual * stack = local_stack;
+    size_t size = 0;
+    size_t capacity = DFTR_DUAL_LOCAL_STACK_SIZE;
+
+    const TreeNode * root = tree->root;
+
+    for (const TreeNode * node = tree_postorder_first(root); node && !dftr_errors;
+         node = tree_postorder_next(node, root))
+    {
+        if (size == capacity)
+        {
+            DftrDual * new_stack = (DftrDual *) realloc(stack == local_stack ? NULL : stack,
+                                                        2 * capacity * sizeof(DftrDual));
+            if (!new_stack)
+            {
+                dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+                break;
+            }
+
+            if (stack == local_stack)
+                memcpy(new_stack, local_stack, size * sizeof(DftrDual));
+
+            stack = new_stack;
+            capacity *= 2;
+        }
+
+        DftrDual left = {};
+        DftrDual right = {};
+
+        if (node->right)
+            right = stack[--size];
+        if (node->left)
+            left = stack[--size];
+
+        DftrDual * dual = &stack[size++];
+
+        switch (node->value.type)
+        {
+            case TREE_NODE_TYPES_NUMBER:
+                dual->value = node->value.value.number;
+                dual->derivative = 0;
+                break;
+
+            case TREE_NODE_TYPES_VARIABLE:
+                dual->value = variables[node->value.id];
+                dual->derivative = (size_t) node->value.id == variable_id ? 1 : 0;
+                break;
+
+            case TREE_NODE_TYPES_OPERATION:
+                if (!node->left ||
+                    (MATH_OPERATIONS_ARRAY[node->value.id].type == MATH_OPERATION_TYPES_BINARY && !node->right))
+                {
+                    dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                    break;
+                }
+
+                dftr_dual_operation(MATH_OPERATIONS_ARRAY[node->value.id].id, &left, &right, dual);
+                break;
+
+            case TREE_NODE_TYPES_STRING:
+            case TREE_NODE_TYPES_NO_TYPE:
+                dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                break;
+
+            default:
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
+        }
+    }
+
+    if (!dftr_errors)
+        *answer = stack[0];
+
+    if (stack != local_stack)
+        free(stack);
+
+    return dftr_errors;
+}
+
+
+static void dftr_dual_operation(MathOperations op_id, const DftrDual * left, const DftrDual * right,
+                                DftrDual * answer)
+{
+    MY_ASSERT(left);
+    MY_ASSERT(right);
+    MY_ASSERT(answer);
+
+    double u = left->value;
+    double du = left->derivative;
+    double v = right->value;
+    double dv = right->derivative;
+
+    switch (op_id)
+    {
+        case MATH_OPERATIONS_ADDITION:
+            answer->value = u + v;
+            answer->derivative = du + dv;
+            break;
+
+        case MATH_OPERATIONS_SUBTRACTION:
+            answer->value = u - v;
+            answer->derivative = du - dv;
+            break;
+
+        case MATH_OPERATIONS_MULTIPLICATION:
+            answer->value = u * v;
+            answer->derivative = du * v + u * dv;
+            break;
+
+        case MATH_OPERATIONS_DIVISION:
+            answer->value = u / v;
+            answer->derivative = (du * v - u * dv) / (v * v);
+            break;
+
+        case MATH_OPERATIONS_POWER:
+            answer->value = pow(u, v);
+
+            // Constant exponent is the only case the symbolic rule supports, keep it exact for u <= 0.
+            if (is_equal_double(dv, 0))
+                answer->derivative = v * pow(u, v - 1) * du;
+            else
+                answer->derivative = answer->value * (dv * log(u) + v * du / u);
+            break;
+
+        case MATH_OPERATIONS_SINUS:
+            answer->value = sin(u);
+            answer->derivative = cos(u) * du;
+            break;
+
+        case MATH_OPERATIONS_COSINUS:
+            answer->value = cos(u);
+            answer->derivative = -sin(u) * du;
+            break;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+}
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+
+#include "bytecode.h"
+#include "my_assert.h"
+
+/// Shared by all workers. Each chunk writes its own slice of answers and each
+/// worker owns its slice of samples and columns, so no locks are taken.
+struct DftrGridJob {
+    const DftrProgram * program;
+    const double * variables;
+    size_t variable_id;
+    double x_begin;
+    double step;
+    double * answers;
+    size_t samples_number;
+    double * samples;                                ///< DFTR_GRID_CHUNK_SIZE per worker.
+    double * columns;                                ///< stack_size * DFTR_BATCH_BLOCK_SIZE per worker.
+    DftrBatchOperand * operands;                     ///< stack_size per worker.
+    const SimdKernels * kernels;
+};
+
+static void dftr_grid_eval_chunk(void * job_ptr, size_t chunk, size_t worker_id);
+
+
+DError_t dftr_program_eval_grid(ThreadPool * pool, const DftrProgram * program, const double * variables,
+                                size_t variable_id, double x_begin, double x_end,
+                                double * answers, size_t samples_number)
+{
+    MY_ASSERT(pool);
+    MY_ASSERT(program);
+    MY_ASSERT(variables);
+    MY_ASSERT(answers);
+
+    DError_t dftr_errors = 0;
+
+    if (!program->size)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+        return dftr_errors;
+    }
+
+    size_t threads_number = pool->threads_number;
+    size_t columns_size = program->stack_size * DFTR_BATCH_BLOCK_SIZE;
+
+    DftrGridJob job = {
+        .program        = program,
+        .variables      = variables,
+        .variable_id    = variable_id,
+        .x_begin        = x_begin,
+        .step           = samples_number ? (x_end - x_begin) / (double) samples_number : 0,
+        .answers        = answers,
+        .samples_number = samples_number,
+        .samples        = (double *) calloc(threads_number * DFTR_GRID_CHUNK_SIZE, sizeof(double)),
+        .columns        = (double *) calloc(threads_number * columns_size, sizeof(double)),
+        .operands       = (DftrBatchOperand *) calloc(threads_number * program->stack_size,
+                                                     sizeof(DftrBatchOperand)),
+        .kernels        = simd_get_kernels(simd_get_supported_level()),
+    };
+
+    if (!job.samples || !job.columns || !job.operands)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+    }
+    else
+    {
+        size_t chunks_number = (samples_number + DFTR_GRID_CHUNK_SIZE - 1) / DFTR_GRID_CHUNK_SIZE;
+
+        if (thread_pool_run(pool, chunks_number, dftr_grid_eval_chunk, &job))
+            dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+    }
+
+    free(job.samples);
+    free(job.columns);
+    free(job.operands);
+
+    return dftr_errors;
+}
+
+
+static void dftr_grid_eval_chunk(void * job_ptr, size_t chunk, size_t worker_id)
+{
+    MY_ASSERT(job_ptr);
+
+    DftrGridJob * job = (DftrGridJob *) job_ptr;
+    size_t begin = chunk * DFTR_GRID_CHUNK_SIZE;
+    size_t size = job->samples_number - begin < DFTR_GRID_CHUNK_SIZE ? job->samples_number - begin
+                                                                     : DFTR_GRID_CHUNK_SIZE;
+    double * samples = job->samples + worker_id * DFTR_GRID_CHUNK_SIZE;
+    double * columns = job->columns + worker_id * job->program->stack_size * DFTR_BATCH_BLOCK_SIZE;
+    DftrBatchOperand * operands = job->operands + worker_id * job->program->stack_size;
+
+    for (size_t i = 0; i < size; i++)
+        samples[i] = job->x_begin + job->step * (double) (begin + i);
+
+    dftr_program_eval_batch_columns(job->program, job->variables, job->variable_id, samples,
+                                    job->answers + begin, size, columns, operands, job->kernels);
+}
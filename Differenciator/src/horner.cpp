@@ -0,0 +1,408 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "horner.h"
+#include "my_assert.h"
+#include "math_operations.h"
+#include "double_comparing.h"
+
+static DError_t dftr_horner_find(DftrCse * cse, const DagNode * node, const DftrPolynomial * polynomials,
+                                 DftrPolynomial * polynomial);
+static DError_t dftr_horner_append(DftrCse * cse, const double * coefficients, size_t degree, size_t variable_id,
+                                   DftrPolynomial * polynomial);
+static void dftr_horner_multiply(const double * coefficients1, size_t degree1,
+                                 const double * coefficients2, size_t degree2, double * answer);
+static TError_t dftr_horner_build(Dag * dag, const DftrPolynomial * polynomial, const double * coefficients,
+                                  DagIndex * node);
+static TError_t dftr_horner_make_operation(Dag * dag, MathOperations op_id, DagIndex left, DagIndex right,
+                                           DagIndex * node);
+static TError_t dftr_horner_make_number(Dag * dag, double number, DagIndex * node);
+
+
+/// Finds the maximal one-variable polynomial branches of the DAG, rebuilds
+/// them as ((c_n * x + c_n-1) * x + ...) + c_0 and marks their roots, so that
+/// dftr_cse_eval runs them as an FMA loop over the coefficients.
+DError_t dftr_cse_horner(DftrCse * cse, DftrHornerStats * stats)
+{
+    MY_ASSERT(cse);
+
+    DError_t dftr_errors = 0;
+    TError_t tree_errors = 0;
+
+    size_t size = cse->dag.size;
+    DftrPolynomial * polynomials = NULL;
+
+    if (!(polynomials = (DftrPolynomial *) calloc(size, sizeof(DftrPolynomial))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    cse->coefficients_size = 0;
+
+    // Children have smaller indices, so one pass in index order sees them first.
+    for (size_t i = 0; i < size && !dftr_errors; i++)
+        dftr_errors |= dftr_horner_find(cse, &cse->dag.nodes[i], polynomials, &polynomials[i]);
+
+    if (dftr_errors)
+    {
+        free(polynomials);
+        return dftr_errors;
+    }
+
+    // The roots are the first polynomials met from the top. is_reachable and
+    // temporaries are free until the DAG is analyzed again, temporaries flags the roots.
+    for (size_t i = 0; i < size; i++)
+    {
+        cse->is_reachable[i] = false;
+        cse->temporaries[i] = 0;
+    }
+    cse->is_reachable[cse->root] = true;
+
+    for (size_t i = cse->root + 1; i-- > 0;)
+    {
+        const DagNode * node = &cse->dag.nodes[i];
+
+        if (!cse->is_reachable[i])
+            continue;
+
+        if (node->value.type == TREE_NODE_TYPES_OPERATION &&
+            polynomials[i].degree != DFTR_NOT_POLYNOMIAL &&
+            polynomials[i].variable_id != DFTR_POLYNOMIAL_NO_VARIABLE)
+        {
+            cse->temporaries[i] = 1;
+            continue;
+        }
+
+        if (node->left != DAG_NULL_INDEX)
+            cse->is_reachable[node->left] = true;
+        if (node->right != DAG_NULL_INDEX)
+            cse->is_reachable[node->right] = true;
+    }
+
+    // Rebuilt nodes are appended, so order maps every old node to its new copy.
+    DagIndex * map = cse->order;
+
+    for (size_t i = 0; i < size && !tree_errors; i++)
+    {
+        if (cse->temporaries[i])
+        {
+            tree_errors |= dftr_horner_build(&cse->dag, &polynomials[i], cse->coefficients, &map[i]);
+            continue;
+        }
+
+        DagNode node = cse->dag.nodes[i];
+        DagIndex left = node.left != DAG_NULL_INDEX ? map[node.left] : DAG_NULL_INDEX;
+        DagIndex right = node.right != DAG_NULL_INDEX ? map[node.right] : DAG_NULL_INDEX;
+
+        tree_errors |= dag_make_node(&cse->dag, node.value, left, right, &map[i]);
+    }
+
+    DftrPolynomial * roots = NULL;
+
+    if (tree_errors)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+    else if (!(roots = (DftrPolynomial *) realloc(cse->polynomials, cse->dag.size * sizeof(DftrPolynomial))))
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+
+    if (dftr_errors)
+    {
+        free(polynomials);
+        return dftr_errors;
+    }
+
+    cse->polynomials = roots;
+
+    for (size_t i = 0; i < cse->dag.size; i++)
+        cse->polynomials[i].degree = DFTR_NOT_POLYNOMIAL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if (!cse->temporaries[i])
+            continue;
+
+        cse->polynomials[map[i]] = polynomials[i];
+
+        if (stats)
+        {
+            stats->polynomials_number++;
+            if (polynomials[i].degree > stats->max_degree)
+                stats->max_degree = polynomials[i].degree;
+        }
+    }
+
+    cse->root = map[cse->root];
+    cse->is_horner = true;
+
+    free(polynomials);
+
+    return dftr_cse_analyze(cse);
+}
+
+
+__attribute__((target_clones("fma", "default")))
+double dftr_horner_eval(const double * coefficients, size_t degree, double x)
+{
+    MY_ASSERT(coefficients);
+
+    double answer = coefficients[degree];
+
+    for (size_t k = degree; k-- > 0;)
+        answer = fma(answer, x, coefficients[k]);
+
+    return answer;
+}
+
+
+/// Polynomial of a node from the polynomials of its children.
+static DError_t dftr_horner_find(DftrCse * cse, const DagNode * node, const DftrPolynomial * polynomials,
+                                 DftrPolynomial * polynomial)
+{
+    MY_ASSERT(cse);
+    MY_ASSERT(node);
+    MY_ASSERT(polynomials);
+    MY_ASSERT(polynomial);
+
+    double coefficients[DFTR_HORNER_MAX_DEGREE + 1] = {};
+    double power[DFTR_HORNER_MAX_DEGREE + 1] = {};
+
+    polynomial->degree = DFTR_NOT_POLYNOMIAL;
+
+    switch (node->value.type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+            coefficients[0] = node->value.value.number;
+            return dftr_horner_append(cse, coefficients, 0, DFTR_POLYNOMIAL_NO_VARIABLE, polynomial);
+
+        case TREE_NODE_TYPES_VARIABLE:
+            coefficients[1] = 1;
+            return dftr_horner_append(cse, coefficients, 1, (size_t) node->value.id, polynomial);
+
+        case TREE_NODE_TYPES_OPERATION:
+            break;
+
+        case TREE_NODE_TYPES_STRING:
+        case TREE_NODE_TYPES_NO_TYPE:
+        default:
+            return 0;
+    }
+
+    if (node->left == DAG_NULL_INDEX || node->right == DAG_NULL_INDEX ||
+        polynomials[node->left].degree == DFTR_NOT_POLYNOMIAL ||
+        polynomials[node->right].degree == DFTR_NOT_POLYNOMIAL)
+    {
+        return 0;
+    }
+
+    const DftrPolynomial * left = &polynomials[node->left];
+    const DftrPolynomial * right = &polynomials[node->right];
+    const double * left_coefficients = cse->coefficients + left->offset;
+    const double * right_coefficients = cse->coefficients + right->offset;
+
+    size_t variable_id = left->variable_id;
+    if (variable_id == DFTR_POLYNOMIAL_NO_VARIABLE)
+        variable_id = right->variable_id;
+    else if (right->variable_id != DFTR_POLYNOMIAL_NO_VARIABLE && right->variable_id != variable_id)
+        return 0;
+
+    size_t degree = 0;
+
+    switch (MATH_OPERATIONS_ARRAY[node->value.id].id)
+    {
+        case MATH_OPERATIONS_ADDITION:
+        case MATH_OPERATIONS_SUBTRACTION:
+        {
+            double sign = MATH_OPERATIONS_ARRAY[node->value.id].id == MATH_OPERATIONS_ADDITION ? 1 : -1;
+
+            degree = left->degree > right->degree ? left->degree : right->degree;
+            for (size_t k = 0; k <= left->degree; k++)
+                coefficients[k] += left_coefficients[k];
+            for (size_t k = 0; k <= right->degree; k++)
+                coefficients[k] += sign * right_coefficients[k];
+            break;
+        }
+
+        case MATH_OPERATIONS_MULTIPLICATION:
+            degree = left->degree + right->degree;
+            if (degree > DFTR_HORNER_MAX_DEGREE)
+                return 0;
+
+            dftr_horner_multiply(left_coefficients, left->degree, right_coefficients, right->degree, coefficients);
+            break;
+
+        case MATH_OPERATIONS_DIVISION:
+            if (right->degree != 0 || is_exact_double(right_coefficients[0], 0))
+                return 0;
+
+            degree = left->degree;
+            for (size_t k = 0; k <= degree; k++)
+                coefficients[k] = left_coefficients[k] / right_coefficients[0];
+            break;
+
+        case MATH_OPERATIONS_POWER:
+        {
+            double number = right_coefficients[0];
+
+            if (right->degree != 0 || number < 0 || !is_exact_double(number, floor(number)) ||
+                (double) left->degree * number > (double) DFTR_HORNER_MAX_DEGREE)
+            {
+                return 0;
+            }
+
+            coefficients[0] = 1;
+            for (size_t n = (size_t) number; n > 0; n--)
+            {
+                dftr_horner_multiply(coefficients, degree, left_coefficients, left->degree, power);
+                degree += left->degree;
+
+                for (size_t k = 0; k <= degree; k++)
+                    coefficients[k] = power[k];
+            }
+            break;
+        }
+
+        case MATH_OPERATIONS_SINUS:
+        case MATH_OPERATIONS_COSINUS:
+            return 0;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            return 0;
+    }
+
+    while (degree > 0 && is_exact_double(coefficients[degree], 0))
+        degree--;
+
+    if (degree == 0)
+        variable_id = DFTR_POLYNOMIAL_NO_VARIABLE;
+
+    return dftr_horner_append(cse, coefficients, degree, variable_id, polynomial);
+}
+
+
+static DError_t dftr_horner_append(DftrCse * cse, const double * coefficients, size_t degree, size_t variable_id,
+                                   DftrPolynomial * polynomial)
+{
+    MY_ASSERT(cse);
+    MY_ASSERT(coefficients);
+    MY_ASSERT(polynomial);
+
+    DError_t dftr_errors = 0;
+
+    if (cse->coefficients_size + degree + 1 > cse->coefficients_capacity)
+    {
+        size_t capacity = cse->coefficients_capacity ? 2 * cse->coefficients_capacity : DFTR_HORNER_DEFAULT_CAPACITY;
+        while (capacity < cse->coefficients_size + degree + 1)
+            capacity *= 2;
+
+        double * new_coefficients = NULL;
+        if (!(new_coefficients = (double *) realloc(cse->coefficients, capacity * sizeof(double))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+
+        cse->coefficients = new_coefficients;
+        cse->coefficients_capacity = capacity;
+    }
+
+    polynomial->variable_id = variable_id;
+    polynomial->degree = degree;
+    polynomial->offset = cse->coefficients_size;
+
+    for (size_t k = 0; k <= degree; k++)
+        cse->coefficients[cse->coefficients_size++] = coefficients[k];
+
+    return dftr_errors;
+}
+
+
+static void dftr_horner_multiply(const double * coefficients1, size_t degree1,
+                                 const double * coefficients2, size_t degree2, double * answer)
+{
+    MY_ASSERT(coefficients1);
+    MY_ASSERT(coefficients2);
+    MY_ASSERT(answer);
+
+    for (size_t k = 0; k <= degree1 + degree2; k++)
+        answer[k] = 0;
+
+    for (size_t i = 0; i <= degree1; i++)
+        for (size_t j = 0; j <= degree2; j++)
+            answer[i + j] += coefficients1[i] * coefficients2[j];
+}
+
+
+static TError_t dftr_horner_build(Dag * dag, const DftrPolynomial * polynomial, const double * coefficients,
+                                  DagIndex * node)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(polynomial);
+    MY_ASSERT(coefficients);
+    MY_ASSERT(node);
+
+    TError_t tree_errors = 0;
+    const double * c = coefficients + polynomial->offset;
+    size_t degree = polynomial->degree;
+
+    Tree_t value = {};
+    DagIndex x = DAG_NULL_INDEX;
+    DagIndex number = DAG_NULL_INDEX;
+    DagIndex answer = DAG_NULL_INDEX;
+
+    dftr_set_variable(&value, polynomial->variable_id);
+    if (tree_errors = dag_make_node(dag, value, DAG_NULL_INDEX, DAG_NULL_INDEX, &x))
+        return tree_errors;
+
+    if (is_exact_double(c[degree], 1))
+    {
+        answer = x;
+    }
+    else
+    {
+        tree_errors |= dftr_horner_make_number(dag, c[degree], &number);
+        tree_errors |= dftr_horner_make_operation(dag, MATH_OPERATIONS_MULTIPLICATION, number, x, &answer);
+    }
+
+    for (size_t k = degree; k-- > 0 && !tree_errors;)
+    {
+        if (!is_exact_double(c[k], 0))
+        {
+            tree_errors |= dftr_horner_make_number(dag, c[k], &number);
+            tree_errors |= dftr_horner_make_operation(dag, MATH_OPERATIONS_ADDITION, answer, number, &answer);
+        }
+
+        if (k > 0)
+            tree_errors |= dftr_horner_make_operation(dag, MATH_OPERATIONS_MULTIPLICATION, answer, x, &answer);
+    }
+
+    *node = answer;
+
+    return tree_errors;
+}
+
+
+static TError_t dftr_horner_make_operation(Dag * dag, MathOperations op_id, DagIndex left, DagIndex right,
+                                           DagIndex * node)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(node);
+
+    Tree_t value = {};
+    dftr_set_operation(&value, op_id);
+
+    return dag_make_node(dag, value, left, right, node);
+}
+
+
+static TError_t dftr_horner_make_number(Dag * dag, double number, DagIndex * node)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(node);
+
+    Tree_t value = {};
+    value.type = TREE_NODE_TYPES_NUMBER;
+    value.value.number = number;
+
+    return dag_make_node(dag, value, DAG_NULL_INDEX, DAG_NULL_INDEX, node);
+}
@@ -0,0 +1,420 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "jit.h"
+#include "my_assert.h"
+
+#ifdef DFTR_JIT_NATIVE
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif // DFTR_JIT_NATIVE
+
+#ifdef DFTR_JIT_NATIVE
+
+enum DftrJitBases {
+    DFTR_JIT_BASE_RBX = 3,                           ///< Variables array.
+    DFTR_JIT_BASE_RSP = 4,                           ///< Spill slots of the value stack.
+    DFTR_JIT_BASE_RIP = 5,                           ///< Constants placed before the code.
+};
+
+const uint8_t SSE_PREFIX_SD  = 0xF2;
+const uint8_t SSE_PREFIX_PD  = 0x66;
+const uint8_t SSE_MOVSD_LOAD  = 0x10;
+const uint8_t SSE_MOVSD_STORE = 0x11;
+const uint8_t SSE_MOVAPD      = 0x28;
+const uint8_t SSE_ADDSD       = 0x58;
+const uint8_t SSE_MULSD       = 0x59;
+const uint8_t SSE_SUBSD       = 0x5C;
+const uint8_t SSE_DIVSD       = 0x5E;
+const unsigned JIT_SCRATCH_LEFT = 14;
+const unsigned JIT_SCRATCH      = 15;
+const size_t JIT_MAX_INSTRUCTION_CODE_SIZE = 512;  ///< Worst case: spill and reload every register around a call.
+
+static DError_t dftr_jit_generate(const DftrProgram * program, DftrJitBuffer * buffer, size_t code_offset);
+static DError_t dftr_jit_reserve(DftrJitBuffer * buffer, size_t size);
+static void jit_emit_byte(DftrJitBuffer * buffer, uint8_t byte);
+static void jit_emit_u32(DftrJitBuffer * buffer, uint32_t value);
+static void jit_emit_u64(DftrJitBuffer * buffer, uint64_t value);
+static void jit_emit_sse_rr(DftrJitBuffer * buffer, uint8_t prefix, uint8_t opcode, unsigned reg, unsigned rm);
+static void jit_emit_sse_mem(DftrJitBuffer * buffer, uint8_t opcode, unsigned reg, DftrJitBases base, int32_t disp);
+static void jit_load_slot(DftrJitBuffer * buffer, unsigned xmm, size_t slot);
+static void jit_store_slot(DftrJitBuffer * buffer, size_t slot, unsigned xmm);
+static void jit_emit_binary(DftrJitBuffer * buffer, uint8_t opcode, size_t slot);
+static void jit_emit_call(DftrJitBuffer * buffer, const void * function, size_t slot, size_t args_number);
+
+#endif // DFTR_JIT_NATIVE
+
+
+DError_t op_new_dftr_jit(DftrJit * jit)
+{
+    MY_ASSERT(jit);
+
+    jit->function = NULL;
+    jit->memory = NULL;
+    jit->memory_size = 0;
+
+    return op_new_dftr_program(&jit->program);
+}
+
+
+DError_t op_delete_dftr_jit(DftrJit * jit)
+{
+    MY_ASSERT(jit);
+
+#ifdef DFTR_JIT_NATIVE
+    if (jit->memory)
+        munmap(jit->memory, jit->memory_size);
+#endif // DFTR_JIT_NATIVE
+
+    jit->function = NULL;
+    jit->memory = NULL;
+    jit->memory_size = 0;
+
+    return op_delete_dftr_program(&jit->program);
+}
+
+
+DError_t dftr_jit_compile(const Tree * tree, DftrJit * jit)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(jit);
+
+    DError_t dftr_errors = 0;
+
+    if (dftr_errors = dftr_compile(tree, &jit->program))
+        return dftr_errors;
+
+#ifdef DFTR_JIT_NATIVE
+    if (jit->memory)
+        munmap(jit->memory, jit->memory_size);
+
+    jit->function = NULL;
+    jit->memory = NULL;
+    jit->memory_size = 0;
+
+    const DftrProgram * program = &jit->program;
+    size_t constants_size = program->constants_size * sizeof(double);
+    size_t code_offset = (constants_size + 15) & ~(size_t) 15;
+
+    DftrJitBuffer buffer = {};
+    if (!(buffer.data = (uint8_t *) calloc(DFTR_JIT_DEFAULT_CAPACITY, sizeof(uint8_t))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    buffer.capacity = DFTR_JIT_DEFAULT_CAPACITY;
+
+    if (dftr_errors = dftr_jit_generate(program, &buffer, code_offset))
+    {
+        free(buffer.data);
+        return dftr_errors;
+    }
+
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t memory_size = (code_offset + buffer.size + page_size - 1) / page_size * page_size;
+
+    void * memory = mmap(NULL, memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (memory != MAP_FAILED)
+    {
+        memcpy(memory, program->constants, constants_size);
+        memcpy((uint8_t *) memory + code_offset, buffer.data, buffer.size);
+
+        if (mprotect(memory, memory_size, PROT_READ | PROT_EXEC))
+        {
+            munmap(memory, memory_size);
+        }
+        else
+        {
+            jit->memory = (uint8_t *) memory;
+            jit->memory_size = memory_size;
+            jit->function = (DftrJitFunction) (jit->memory + code_offset);
+        }
+    }
+
+    free(buffer.data);
+#endif // DFTR_JIT_NATIVE
+
+    return dftr_errors;
+}
+
+
+DError_t dftr_jit_eval(const DftrJit * jit, const double * variables, double * answer)
+{
+    MY_ASSERT(jit);
+    MY_ASSERT(variables);
+    MY_ASSERT(answer);
+
+    if (!jit->function)
+        return dftr_program_eval(&jit->program, variables, answer);
+
+    *answer = jit->function(variables);
+
+    return 0;
+}
+
+
+#ifdef DFTR_JIT_NATIVE
+
+static DError_t dftr_jit_generate(const DftrProgram * program, DftrJitBuffer * buffer, size_t code_offset)
+{
+    MY_ASSERT(program);
+    MY_ASSERT(buffer);
+
+    DError_t dftr_errors = 0;
+    uint32_t frame_size = (uint32_t) ((program->stack_size * sizeof(double) + 15) & ~(size_t) 15);
+    size_t top = 0;
+
+    if (dftr_errors = dftr_jit_reserve(buffer, JIT_MAX_INSTRUCTION_CODE_SIZE))
+        return dftr_errors;
+
+    jit_emit_byte(buffer, 0x53);                                    // push rbx
+    jit_emit_byte(buffer, 0x48);                                    // mov rbx, rdi
+    jit_emit_byte(buffer, 0x89);
+    jit_emit_byte(buffer, 0xFB);
+    jit_emit_byte(buffer, 0x48);                                    // sub rsp, frame_size
+    jit_emit_byte(buffer, 0x81);
+    jit_emit_byte(buffer, 0xEC);
+    jit_emit_u32(buffer, frame_size);
+
+    for (size_t i = 0; i < program->size; i++)
+    {
+        const DftrInstruction * instruction = &program->code[i];
+
+        if (dftr_errors = dftr_jit_reserve(buffer, JIT_MAX_INSTRUCTION_CODE_SIZE))
+            return dftr_errors;
+
+        switch (instruction->opcode)
+        {
+            case DFTR_OPCODE_CONST:
+            {
+                unsigned xmm = top < DFTR_JIT_REGISTERS_NUMBER ? (unsigned) top : JIT_SCRATCH;
+                int32_t disp = (int32_t) (instruction->arg * sizeof(double)) - (int32_t) code_offset;
+
+                jit_emit_sse_mem(buffer, SSE_MOVSD_LOAD, xmm, DFTR_JIT_BASE_RIP, disp);
+                jit_store_slot(buffer, top, xmm);
+                top++;
+                break;
+            }
+
+            case DFTR_OPCODE_VAR:
+            {
+                unsigned xmm = top < DFTR_JIT_REGISTERS_NUMBER ? (unsigned) top : JIT_SCRATCH;
+
+                jit_emit_sse_mem(buffer, SSE_MOVSD_LOAD, xmm, DFTR_JIT_BASE_RBX,
+                                 (int32_t) (instruction->arg * sizeof(double)));
+                jit_store_slot(buffer, top, xmm);
+                top++;
+                break;
+            }
+
+            case DFTR_OPCODE_ADDITION:
+                top--;
+                jit_emit_binary(buffer, SSE_ADDSD, top - 1);
+                break;
+
+            case DFTR_OPCODE_SUBTRACTION:
+                top--;
+                jit_emit_binary(buffer, SSE_SUBSD, top - 1);
+                break;
+
+            case DFTR_OPCODE_MULTIPLICATION:
+                top--;
+                jit_emit_binary(buffer, SSE_MULSD, top - 1);
+                break;
+
+            case DFTR_OPCODE_DIVISION:
+                top--;
+                jit_emit_binary(buffer, SSE_DIVSD, top - 1);
+                break;
+
+            case DFTR_OPCODE_POWER:
+                top--;
+                jit_emit_call(buffer, (const void *) (double (*)(double, double)) pow, top - 1, 2);
+                break;
+
+            case DFTR_OPCODE_SINUS:
+                jit_emit_call(buffer, (const void *) (double (*)(double)) sin, top - 1, 1);
+                break;
+
+            case DFTR_OPCODE_COSINUS:
+                jit_emit_call(buffer, (const void *) (double (*)(double)) cos, top - 1, 1);
+                break;
+
+            default:
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
+        }
+    }
+
+    // The answer is slot 0, which already lives in xmm0.
+    jit_emit_byte(buffer, 0x48);                                    // add rsp, frame_size
+    jit_emit_byte(buffer, 0x81);
+    jit_emit_byte(buffer, 0xC4);
+    jit_emit_u32(buffer, frame_size);
+    jit_emit_byte(buffer, 0x5B);                                    // pop rbx
+    jit_emit_byte(buffer, 0xC3);                                    // ret
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_jit_reserve(DftrJitBuffer * buffer, size_t size)
+{
+    MY_ASSERT(buffer);
+
+    DError_t dftr_errors = 0;
+
+    if (buffer->size + size <= buffer->capacity)
+        return dftr_errors;
+
+    size_t capacity = buffer->capacity;
+    while (buffer->size + size > capacity)
+        capacity *= 2;
+
+    uint8_t * data = NULL;
+    if (!(data = (uint8_t *) realloc(buffer->data, capacity)))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+
+    buffer->data = data;
+    buffer->capacity = capacity;
+
+    return dftr_errors;
+}
+
+
+static void jit_emit_byte(DftrJitBuffer * buffer, uint8_t byte)
+{
+    MY_ASSERT(buffer);
+    MY_ASSERT(buffer->size < buffer->capacity);
+
+    buffer->data[buffer->size++] = byte;
+}
+
+
+static void jit_emit_u32(DftrJitBuffer * buffer, uint32_t value)
+{
+    for (size_t i = 0; i < sizeof(value); i++)
+        jit_emit_byte(buffer, (uint8_t) (value >> (8 * i)));
+}
+
+
+static void jit_emit_u64(DftrJitBuffer * buffer, uint64_t value)
+{
+    for (size_t i = 0; i < sizeof(value); i++)
+        jit_emit_byte(buffer, (uint8_t) (value >> (8 * i)));
+}
+
+
+static void jit_emit_sse_rr(DftrJitBuffer * buffer, uint8_t prefix, uint8_t opcode, unsigned reg, unsigned rm)
+{
+    jit_emit_byte(buffer, prefix);
+
+    if (reg >= 8 || rm >= 8)
+        jit_emit_byte(buffer, (uint8_t) (0x40 | ((reg >> 3) << 2) | (rm >> 3)));
+
+    jit_emit_byte(buffer, 0x0F);
+    jit_emit_byte(buffer, opcode);
+    jit_emit_byte(buffer, (uint8_t) (0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+
+static void jit_emit_sse_mem(DftrJitBuffer * buffer, uint8_t opcode, unsigned reg, DftrJitBases base, int32_t disp)
+{
+    jit_emit_byte(buffer, SSE_PREFIX_SD);
+
+    if (reg >= 8)
+        jit_emit_byte(buffer, 0x44);
+
+    jit_emit_byte(buffer, 0x0F);
+    jit_emit_byte(buffer, opcode);
+
+    switch (base)
+    {
+        case DFTR_JIT_BASE_RBX:
+            jit_emit_byte(buffer, (uint8_t) (0x80 | ((reg & 7) << 3) | DFTR_JIT_BASE_RBX));
+            break;
+
+        case DFTR_JIT_BASE_RSP:
+            jit_emit_byte(buffer, (uint8_t) (0x80 | ((reg & 7) << 3) | DFTR_JIT_BASE_RSP));
+            jit_emit_byte(buffer, 0x24);
+            break;
+
+        case DFTR_JIT_BASE_RIP:
+            // disp is relative to the code start, rip points past the displacement.
+            jit_emit_byte(buffer, (uint8_t) (((reg & 7) << 3) | DFTR_JIT_BASE_RIP));
+            disp -= (int32_t) (buffer->size + sizeof(uint32_t));
+            break;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    jit_emit_u32(buffer, (uint32_t) disp);
+}
+
+
+static void jit_load_slot(DftrJitBuffer * buffer, unsigned xmm, size_t slot)
+{
+    if (slot >= DFTR_JIT_REGISTERS_NUMBER)
+        jit_emit_sse_mem(buffer, SSE_MOVSD_LOAD, xmm, DFTR_JIT_BASE_RSP, (int32_t) (slot * sizeof(double)));
+    else if (xmm != slot)
+        jit_emit_sse_rr(buffer, SSE_PREFIX_PD, SSE_MOVAPD, xmm, (unsigned) slot);
+}
+
+
+static void jit_store_slot(DftrJitBuffer * buffer, size_t slot, unsigned xmm)
+{
+    if (slot >= DFTR_JIT_REGISTERS_NUMBER)
+        jit_emit_sse_mem(buffer, SSE_MOVSD_STORE, xmm, DFTR_JIT_BASE_RSP, (int32_t) (slot * sizeof(double)));
+    else if (xmm != slot)
+        jit_emit_sse_rr(buffer, SSE_PREFIX_PD, SSE_MOVAPD, (unsigned) slot, xmm);
+}
+
+
+/// slot op= slot + 1
+static void jit_emit_binary(DftrJitBuffer * buffer, uint8_t opcode, size_t slot)
+{
+    unsigned left = slot < DFTR_JIT_REGISTERS_NUMBER ? (unsigned) slot : JIT_SCRATCH_LEFT;
+
+    jit_load_slot(buffer, left, slot);
+
+    if (slot + 1 < DFTR_JIT_REGISTERS_NUMBER)
+        jit_emit_sse_rr(buffer, SSE_PREFIX_SD, opcode, left, (unsigned) slot + 1);
+    else
+        jit_emit_sse_mem(buffer, opcode, left, DFTR_JIT_BASE_RSP, (int32_t) ((slot + 1) * sizeof(double)));
+
+    jit_store_slot(buffer, slot, left);
+}
+
+
+/// slot = function(slot[, slot + 1]). Every xmm register is caller-saved, so the
+/// registers below the arguments are spilled to their stack homes around the call.
+static void jit_emit_call(DftrJitBuffer * buffer, const void * function, size_t slot, size_t args_number)
+{
+    size_t live_number = slot < DFTR_JIT_REGISTERS_NUMBER ? slot : DFTR_JIT_REGISTERS_NUMBER;
+
+    for (size_t i = 0; i < live_number; i++)
+        jit_emit_sse_mem(buffer, SSE_MOVSD_STORE, (unsigned) i, DFTR_JIT_BASE_RSP, (int32_t) (i * sizeof(double)));
+
+    for (size_t i = 0; i < args_number; i++)
+        jit_load_slot(buffer, (unsigned) i, slot + i);
+
+    jit_emit_byte(buffer, 0x48);                                    // mov rax, function
+    jit_emit_byte(buffer, 0xB8);
+    jit_emit_u64(buffer, (uint64_t) (uintptr_t) function);
+    jit_emit_byte(buffer, 0xFF);                                    // call rax
+    jit_emit_byte(buffer, 0xD0);
+
+    jit_store_slot(buffer, slot, 0);
+
+    for (size_t i = 0; i < live_number; i++)
+        jit_emit_sse_mem(buffer, SSE_MOVSD_LOAD, (unsigned) i, DFTR_JIT_BASE_RSP, (int32_t) (i * sizeof(double)));
+}
+
+#endif // DFTR_JIT_NATIVE
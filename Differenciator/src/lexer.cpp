@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "my_assert.h"
+
+/// Mantissas up to 2 ^ 53 and powers of ten up to 1e22 are exact doubles,
+/// so their product or quotient is rounded once, as strtod() would.
+const uint64_t DFTR_LEXER_MAX_EXACT_MANTISSA = (uint64_t) 1 << 53;
+const int DFTR_LEXER_MAX_EXACT_EXPONENT = 22;
+const size_t DFTR_LEXER_MAX_MANTISSA_DIGITS = 19;
+const int DFTR_LEXER_MAX_EXPONENT = 100000;
+const double DFTR_LEXER_POWERS_OF_TEN[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static bool is_digit(char c);
+static bool is_space(char c);
+static bool is_delimiter(char c);
+static void lexer_read_number(DftrLexer * lexer);
+static void lexer_read_name(DftrLexer * lexer);
+
+
+void dftr_lexer_init(DftrLexer * lexer, const char * buffer, size_t size)
+{
+    MY_ASSERT(lexer);
+    MY_ASSERT(buffer);
+
+    lexer->begin = buffer;
+    lexer->ptr = buffer;
+    lexer->end = buffer + size;
+    lexer->token = {};
+    lexer->index = NULL;
+    lexer->offset_id = 0;
+
+    dftr_lexer_next(lexer);
+}
+
+
+/// index must be started or built on the same buffer, the lexer moves it through the windows.
+void dftr_lexer_init_indexed(DftrLexer * lexer, const char * buffer, size_t size, StructuralIndex * index)
+{
+    MY_ASSERT(lexer);
+    MY_ASSERT(buffer);
+    MY_ASSERT(index);
+    MY_ASSERT(index->text == buffer && index->text_size == size);
+
+    lexer->begin = buffer;
+    lexer->ptr = buffer;
+    lexer->end = buffer + size;
+    lexer->token = {};
+    lexer->index = index;
+    lexer->offset_id = 0;
+
+    dftr_lexer_next(lexer);
+}
+
+
+/// Reads the token after the current one, its type is decided by the first byte alone.
+void dftr_lexer_next(DftrLexer * lexer)
+{
+    MY_ASSERT(lexer);
+
+    StructuralIndex * index = lexer->index;
+
+    // If the next window can't be classified the lexer goes on from ptr without the index.
+    while (index && lexer->offset_id == index->size && index->position < index->text_size)
+    {
+        lexer->offset_id = 0;
+
+        if (structural_index_next_window(index))
+            lexer->index = index = NULL;
+    }
+
+    if (index)
+    {
+        if (lexer->offset_id < index->size)
+            lexer->ptr = lexer->begin + index->base + index->offsets[lexer->offset_id++];
+        else
+            lexer->ptr = lexer->end;
+    }
+    else
+    {
+        while (lexer->ptr < lexer->end && is_space(*lexer->ptr))
+            lexer->ptr++;
+    }
+
+    DftrToken * token = &lexer->token;
+    token->begin = lexer->ptr;
+    token->length = 0;
+
+    if (lexer->ptr == lexer->end)
+    {
+        token->type = DFTR_TOKEN_TYPES_END;
+        return;
+    }
+
+    switch (*lexer->ptr)
+    {
+        case '\0':
+            token->type = DFTR_TOKEN_TYPES_END;
+            return;
+
+        case '{':
+            token->type = DFTR_TOKEN_TYPES_OPEN;
+            token->length = 1;
+            lexer->ptr++;
+            return;
+
+        case '}':
+            token->type = DFTR_TOKEN_TYPES_CLOSE;
+            token->length = 1;
+            lexer->ptr++;
+            return;
+
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+        case '.':
+            lexer_read_number(lexer);
+            return;
+
+        // A sign starts a number only when a digit follows, otherwise it is an operation.
+        case '+':
+        case '-':
+            if (lexer->ptr + 1 < lexer->end && (is_digit(lexer->ptr[1]) || lexer->ptr[1] == '.'))
+                lexer_read_number(lexer);
+            else
+                lexer_read_name(lexer);
+            return;
+
+        default:
+            lexer_read_name(lexer);
+            return;
+    }
+}
+
+
+/// [+-]? digits? (. digits?)? ([eE] [+-]? digits)? with at least one digit in the mantissa.
+/// The mantissa and exponent are gathered in one pass, inexact cases fall back to strtod()
+/// on a copy of the span.
+bool dftr_parse_number(const char * begin, const char * end, double * number, const char * * number_end)
+{
+    MY_ASSERT(begin);
+    MY_ASSERT(end);
+    MY_ASSERT(number);
+    MY_ASSERT(number_end);
+
+    const char * ptr = begin;
+    bool is_negative = false;
+
+    if (ptr < end && (*ptr == '+' || *ptr == '-'))
+        is_negative = *ptr++ == '-';
+
+    uint64_t mantissa = 0;
+    size_t mantissa_digits = 0;
+    size_t digits_number = 0;
+    int exponent = 0;
+
+    for (; ptr < end && is_digit(*ptr); ptr++, digits_number++)
+    {
+        if (mantissa_digits < DFTR_LEXER_MAX_MANTISSA_DIGITS)
+        {
+            mantissa = 10 * mantissa + (uint64_t) (*ptr - '0');
+            mantissa_digits += mantissa != 0;
+        }
+        else
+            exponent++;
+    }
+
+    if (ptr < end && *ptr == '.')
+    {
+        for (ptr++; ptr < end && is_digit(*ptr); ptr++, digits_number++)
+        {
+            if (mantissa_digits < DFTR_LEXER_MAX_MANTISSA_DIGITS)
+            {
+                mantissa = 10 * mantissa + (uint64_t) (*ptr - '0');
+                mantissa_digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+
+    if (!digits_number)
+        return false;
+
+    if (ptr < end && (*ptr == 'e' || *ptr == 'E'))
+    {
+        const char * exponent_ptr = ptr + 1;
+        bool is_negative_exponent = false;
+
+        if (exponent_ptr < end && (*exponent_ptr == '+' || *exponent_ptr == '-'))
+            is_negative_exponent = *exponent_ptr++ == '-';
+
+        if (exponent_ptr < end && is_digit(*exponent_ptr))
+        {
+            int exponent_value = 0;
+
+            for (ptr = exponent_ptr; ptr < end && is_digit(*ptr); ptr++)
+                if (exponent_value < DFTR_LEXER_MAX_EXPONENT)
+                    exponent_value = 10 * exponent_value + (*ptr - '0');
+
+            exponent += is_negative_exponent ? -exponent_value : exponent_value;
+        }
+    }
+
+    *number_end = ptr;
+
+    if (mantissa_digits < DFTR_LEXER_MAX_MANTISSA_DIGITS && mantissa <= DFTR_LEXER_MAX_EXACT_MANTISSA &&
+        -DFTR_LEXER_MAX_EXACT_EXPONENT <= exponent && exponent <= DFTR_LEXER_MAX_EXACT_EXPONENT)
+    {
+        double value = (double) mantissa;
+
+        if (exponent < 0)
+            value /= DFTR_LEXER_POWERS_OF_TEN[-exponent];
+        else
+            value *= DFTR_LEXER_POWERS_OF_TEN[exponent];
+
+        *number = is_negative ? -value : value;
+
+        return true;
+    }
+
+    size_t length = (size_t) (ptr - begin);
+    if (length >= DFTR_LEXER_MAX_NUMBER_LENGTH)
+        return false;
+
+    char copy[DFTR_LEXER_MAX_NUMBER_LENGTH] = {};
+    memcpy(copy, begin, length);
+    *number = strtod(copy, NULL);
+
+    return true;
+}
+
+
+static void lexer_read_number(DftrLexer * lexer)
+{
+    MY_ASSERT(lexer);
+
+    DftrToken * token = &lexer->token;
+    const char * number_end = lexer->ptr;
+
+    if (!dftr_parse_number(lexer->ptr, lexer->end, &token->number, &number_end) ||
+        (number_end < lexer->end && !is_delimiter(*number_end)))
+    {
+        lexer_read_name(lexer);
+        token->type = DFTR_TOKEN_TYPES_INVALID;
+        return;
+    }
+
+    token->type = DFTR_TOKEN_TYPES_NUMBER;
+    token->length = (size_t) (number_end - lexer->ptr);
+    lexer->ptr = number_end;
+}
+
+
+static void lexer_read_name(DftrLexer * lexer)
+{
+    MY_ASSERT(lexer);
+
+    const char * ptr = lexer->ptr;
+    while (ptr < lexer->end && !is_delimiter(*ptr))
+        ptr++;
+
+    lexer->token.type = DFTR_TOKEN_TYPES_NAME;
+    lexer->token.length = (size_t) (ptr - lexer->ptr);
+    lexer->ptr = ptr;
+}
+
+
+static bool is_digit(char c)
+{
+    return '0' <= c && c <= '9';
+}
+
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+
+static bool is_delimiter(char c)
+{
+    return is_space(c) || c == '{' || c == '}' || c == '\0';
+}
@@ -0,0 +1,181 @@
+#include <string.h>
+
+#include "libdifferenciator.h"
+#include "egraph.h"
+#include "cse.h"
+#include "my_assert.h"
+
+static DError_t dftr_context_check(DError_t dftr_errors);
+
+
+DError_t op_new_dftr_context(DftrContext * context)
+{
+    MY_ASSERT(SUPPORTED_VARIABLES_NUMBER <= DFTR_CONTEXT_MAX_VARIABLES);
+
+    if (!context)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    for (size_t i = 0; i < DFTR_CONTEXT_MAX_VARIABLES; i++)
+        context->variables[i] = i < SUPPORTED_VARIABLES_NUMBER ? SUPPORTED_VARIABLES[i].value : 0;
+
+    context->slab_capacity = ARENA_DEFAULT_SLAB_CAPACITY;
+    context->is_egraph = false;
+    context->is_compact = false;
+    context->is_canonical = false;
+    context->threads_number = 1;
+    context->cse_min_size = DFTR_CSE_DEFAULT_MIN_SIZE;
+    context->dump_file_name = DIFFERENCIATOR_DUMP_FILE_NAME;
+    context->tree_dump_file_name = TREE_DUMP_FILE_NAME;
+    context->latex_file_name = DIFFERENCIATOR_LATEX_DUMP_FILE_NAME;
+    context->dumps_number = 0;
+    context->tree_dumps_number = 0;
+    context->latex_number = 0;
+
+    return dftr_context_check(0);
+}
+
+
+DError_t op_delete_dftr_context(DftrContext * context)
+{
+    if (!context)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    context->dump_file_name = NULL;
+    context->tree_dump_file_name = NULL;
+    context->latex_file_name = NULL;
+
+    return 0;
+}
+
+
+DError_t dftr_context_set_variable(DftrContext * context, const char * name, double value)
+{
+    if (!context || !name)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    for (size_t i = 0; i < SUPPORTED_VARIABLES_NUMBER; i++)
+    {
+        if (!strcmp(SUPPORTED_VARIABLES[i].name, name))
+        {
+            context->variables[i] = value;
+            return dftr_context_check(0);
+        }
+    }
+
+    return dftr_context_check(DIFFERENCIATOR_ERRORS_INVALID_INPUT);
+}
+
+
+DError_t dftr_context_new_tree(const DftrContext * context, Tree * tree)
+{
+    if (!context || !tree)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    DError_t dftr_errors = 0;
+
+    if (op_new_tree_slabs(tree, TREE_NULL, context->slab_capacity))
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+    return dftr_context_check(dftr_errors);
+}
+
+
+DError_t dftr_context_parse(DftrContext * context, Tree * tree, const char * text, size_t size)
+{
+    if (!context || !tree || !tree->root || !text)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    return dftr_context_check(create_dftr_tree_span(tree, text, size));
+}
+
+
+DError_t dftr_context_eval(DftrContext * context, const Tree * tree, double * answer)
+{
+    if (!context || !tree || !tree->root || !answer)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    return dftr_context_check(dftr_eval_variables(tree, context->variables, answer));
+}
+
+
+DError_t dftr_context_diff(DftrContext * context, const Tree * tree, Tree * d_tree, size_t variable_id)
+{
+    if (!context || !tree || !tree->root || !d_tree || !d_tree->root || variable_id >= SUPPORTED_VARIABLES_NUMBER)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    return dftr_context_check(dftr_differentiation(context, tree, d_tree, variable_id, NULL));
+}
+
+
+/// egraph_stats may be NULL, it is only filled when the context asks for the e-graph.
+DError_t dftr_context_optimize(DftrContext * context, Tree * tree, DftrEGraphStats * egraph_stats)
+{
+    if (!context || !tree || !tree->root)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    return dftr_context_check(dftr_optimization(context, tree, egraph_stats));
+}
+
+
+DError_t dftr_context_print(DftrContext * context, const Tree * tree, FILE * fp, const char * func)
+{
+    if (!context || !tree || !tree->root || !fp || !func)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    return dftr_context_check(dftr_print(context, tree, fp, func, DFTR_PRINT_TEXT));
+}
+
+
+DError_t dftr_context_dump(DftrContext * context, const Tree * tree)
+{
+    if (!context || !context->dump_file_name || !tree || !tree->root)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    dftr_dump(context, tree);
+
+    return dftr_context_check(0);
+}
+
+
+DError_t dftr_context_tree_dump_iternal(DftrContext * context, const Tree * tree,
+                                        const char * tree_name, const char * func,
+                                        const int line, const char * file)
+{
+    if (!context || !context->tree_dump_file_name || !tree || !tree_name || !func || !file)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    tree_dump_iternal(tree, context->tree_dump_file_name, context->tree_dumps_number++, tree_name, func, line, file);
+
+    return dftr_context_check(0);
+}
+
+
+DError_t dftr_context_latex(DftrContext * context, const Tree * tree, const Tree * d_tree)
+{
+    if (!context || !context->latex_file_name || !tree || !tree->root || !d_tree || !d_tree->root)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    dftr_latex(context, tree, d_tree);
+
+    return dftr_context_check(0);
+}
+
+
+DError_t dftr_context_batch(DftrContext * context, const char * text, size_t size, FILE * fp,
+                            DftrBatchStats * stats)
+{
+    if (!context || !text || !fp || !stats)
+        return DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+
+    return dftr_context_check(dftr_batch_run(context, text, size, fp, stats));
+}
+
+
+/// Turns an assert that failed inside the call on this thread into an error instead of an exit.
+static DError_t dftr_context_check(DError_t dftr_errors)
+{
+    if (my_assert_take_failure())
+        dftr_errors |= DIFFERENCIATOR_ERRORS_ASSERT;
+
+    return dftr_errors;
+}
@@ -1,11 +1,13 @@
 #include <stdlib.h>
 
-#include "differenciator.h"
+#include "libdifferenciator.h"
 #include "cmd_input.h"
 #include "flags.h"
 #include "file_processing.h"
 #include "my_assert.h"
 
+static DError_t run_batch(DftrContext * context, const char * text, size_t text_size);
+
 int main(int argc, char * argv[])
 {
     if (!check_cmd_input(argc, argv))
@@ -13,58 +15,141 @@ int main(int argc, char * argv[])
         return 1;
     }
 
+    // The flags are read once here, the rest of the run only sees the context.
+    DftrContext context = {};
+    op_new_dftr_context(&context);
+    context.is_egraph = IS_EGRAPH_MODE;
+    context.is_compact = IS_COMPACT_MODE;
+    context.is_canonical = IS_CANONICAL_MODE;
+    context.threads_number = BATCH_THREADS_NUMBER;
+
     DError_t dftr_errors = 0;
     char * buffer = NULL;
+    const char * text = NULL;
+    size_t text_size = 0;
 
-    long buffer_size = 0;
-    if (!(buffer_size = text_file_to_buffer(SOURCE_FILE_NAME, &buffer)))
+    if (IS_MMAP_MODE)
     {
-        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_CONVERT_TEXT_FILE;
+        if (!(text = map_text_file(SOURCE_FILE_NAME, &text_size)))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_CONVERT_TEXT_FILE;
+            return dftr_errors;
+        }
+    }
+    else
+    {
+        long buffer_size = 0;
+        if (!(buffer_size = text_file_to_buffer(SOURCE_FILE_NAME, &buffer)))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_CONVERT_TEXT_FILE;
+            return dftr_errors;
+        }
+
+        text = buffer;
+        text_size = (size_t) buffer_size - 1;
+    }
+
+    if (BATCH_OUTPUT_FILE_NAME)
+    {
+        dftr_errors = run_batch(&context, text, text_size);
+
+        if (IS_MMAP_MODE)
+            unmap_text_file(text, text_size);
+        else
+            free(buffer);
+
         return dftr_errors;
     }
 
     Tree dftr_tree = {};
-    op_new_tree(&dftr_tree, TREE_NULL);
-    // op_new_tree(&dftr_tree, 0);
+    dftr_context_new_tree(&context, &dftr_tree);
+
+    dftr_errors = dftr_context_parse(&context, &dftr_tree, text, text_size);
+
+    // The tree keeps no pointers into the text.
+    if (IS_MMAP_MODE)
+        unmap_text_file(text, text_size);
+    else
+        free(buffer);
 
-    if (dftr_errors = create_dftr_tree(&dftr_tree, buffer))
+    if (dftr_errors)
     {
         printf("Syntaxis error.\n");
-        tree_dump(&dftr_tree);
+        dftr_context_tree_dump(&context, &dftr_tree);
         return dftr_errors;
     }
 
     double answer = 0;
 
-    dftr_errors |= dftr_eval(&dftr_tree, &answer);
+    dftr_errors |= dftr_context_eval(&context, &dftr_tree, &answer);
     if (dftr_errors)
         return dftr_errors;
     printf("Answer = %.2lf\n", answer);
 
     Tree dftr_d_tree = {};
-    op_new_tree(&dftr_d_tree, TREE_NULL);
+    dftr_context_new_tree(&context, &dftr_d_tree);
 
-    if (dftr_errors = dftr_create_diff_tree(&dftr_tree, &dftr_d_tree))
+    if (dftr_errors = dftr_context_diff(&context, &dftr_tree, &dftr_d_tree, 0))
     {
         return dftr_errors;
     }
 
-    dftr_dump(&dftr_tree);
-    dftr_dump(&dftr_d_tree);
+    dftr_context_dump(&context, &dftr_tree);
+    dftr_context_dump(&context, &dftr_d_tree);
+
+    DftrEGraphStats egraph_stats = {};
 
-    if (dftr_errors = dftr_optimization(&dftr_d_tree))
+    if (dftr_errors = dftr_context_optimize(&context, &dftr_d_tree, &egraph_stats))
     {
         return dftr_errors;
     }
 
-    dftr_dump(&dftr_d_tree);
-    tree_dump(&dftr_tree);
-    tree_dump(&dftr_d_tree);
-    dftr_latex(&dftr_tree, &dftr_d_tree);
+    if (context.is_egraph)
+        printf("Cost = %.0lf (greedy %.0lf)\n", egraph_stats.cost_after, egraph_stats.cost_before);
+
+    dftr_context_dump(&context, &dftr_d_tree);
+    dftr_context_tree_dump(&context, &dftr_tree);
+    dftr_context_tree_dump(&context, &dftr_d_tree);
+    dftr_context_latex(&context, &dftr_tree, &dftr_d_tree);
+
+    if (dftr_errors = dftr_context_print(&context, &dftr_d_tree, stdout, "f'"))
+    {
+        return dftr_errors;
+    }
 
-    free(buffer);
     op_delete_tree(&dftr_tree);
     op_delete_tree(&dftr_d_tree);
+    op_delete_dftr_context(&context);
 
     return 0;
 }
+
+
+/// Every expression of the text through the pipeline, results go to one file.
+static DError_t run_batch(DftrContext * context, const char * text, size_t text_size)
+{
+    MY_ASSERT(context);
+    MY_ASSERT(text);
+
+    DError_t dftr_errors = 0;
+    FILE * fp = NULL;
+
+    if (!(fp = file_open(BATCH_OUTPUT_FILE_NAME, "w")))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_CONVERT_TEXT_FILE;
+        return dftr_errors;
+    }
+
+    setvbuf(fp, NULL, _IOFBF, DFTR_BATCH_OUTPUT_BUFFER_SIZE);
+
+    DftrBatchStats stats = {};
+
+    dftr_errors = dftr_context_batch(context, text, text_size, fp, &stats);
+
+    fclose(fp);
+
+    printf("Batch: %zu expressions, %zu errors, %.3lf s, %.0lf expressions/s\n", stats.expressions_number,
+           stats.errors_number, stats.time, (double) stats.expressions_number / stats.time);
+
+    return dftr_errors;
+}
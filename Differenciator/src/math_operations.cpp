@@ -7,7 +7,7 @@
 static MathOperation create_math_operation(const char * op_name, MathOperationTypes op_type,
                                            MathOperations id, double (*operation)(const double, const double));
 
-MathOperation MATH_OPERATIONS_ARRAY[] = {
+const MathOperation MATH_OPERATIONS_ARRAY[] = {
     create_math_operation("+", MATH_OPERATION_TYPES_BINARY, MATH_OPERATIONS_ADDITION, math_op_addition),
     create_math_operation("-", MATH_OPERATION_TYPES_BINARY, MATH_OPERATIONS_SUBTRACTION, math_op_subtraction),
     create_math_operation("*", MATH_OPERATION_TYPES_BINARY, MATH_OPERATIONS_MULTIPLICATION, math_op_multiplication),
@@ -16,7 +16,7 @@ MathOperation MATH_OPERATIONS_ARRAY[] = {
     create_math_operation("sin", MATH_OPERATION_TYPES_UNARY, MATH_OPERATIONS_SINUS, math_op_sinus),
     create_math_operation("cos", MATH_OPERATION_TYPES_UNARY, MATH_OPERATIONS_COSINUS, math_op_cosinus),
 };
-size_t MATH_OPERATIONS_ARRAY_SIZE = sizeof(MATH_OPERATIONS_ARRAY) / sizeof(MATH_OPERATIONS_ARRAY[0]);
+const size_t MATH_OPERATIONS_ARRAY_SIZE = sizeof(MATH_OPERATIONS_ARRAY) / sizeof(MATH_OPERATIONS_ARRAY[0]);
 
 
 static MathOperation create_math_operation(const char * op_name, MathOperationTypes op_type,
@@ -35,6 +35,20 @@ static MathOperation create_math_operation(const char * op_name, MathOperationTy
 }
 
 
+size_t get_math_operation_index(MathOperations op_id)
+{
+    for (size_t i = 0; i < MATH_OPERATIONS_ARRAY_SIZE; i++)
+    {
+        if (MATH_OPERATIONS_ARRAY[i].id == op_id)
+            return i;
+    }
+
+    MY_ASSERT(0 && "UNKNOWN OPERATION");
+
+    return 0;
+}
+
+
 double math_op_addition(const double val1, const double val2)
 {
     return val1 + val2;
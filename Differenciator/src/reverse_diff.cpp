@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "autodiff.h"
+#include "my_assert.h"
+
+static DError_t dftr_tape_record(DftrTape * tape, const Tree * tree, const double * variables);
+static DError_t dftr_tape_record_node(DftrTape * tape, const TreeNode * node, const double * variables,
+                                      size_t * operands_number);
+static DError_t dftr_tape_push(DftrTape * tape, const DftrTapeEntry * entry);
+static void dftr_tape_backward(DftrTape * tape, size_t variables_number, double * gradient);
+
+
+DError_t op_new_dftr_tape(DftrTape * tape)
+{
+    MY_ASSERT(tape);
+
+    DError_t dftr_errors = 0;
+
+    tape->entries = NULL;
+    tape->adjoints = NULL;
+    tape->operands = NULL;
+    tape->size = 0;
+    tape->capacity = 0;
+
+    if (!(tape->entries = (DftrTapeEntry *) calloc(DFTR_TAPE_DEFAULT_CAPACITY, sizeof(DftrTapeEntry))) ||
+        !(tape->adjoints = (double *) calloc(DFTR_TAPE_DEFAULT_CAPACITY, sizeof(double))) ||
+        !(tape->operands = (uint32_t *) calloc(DFTR_TAPE_DEFAULT_CAPACITY, sizeof(uint32_t))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    tape->capacity = DFTR_TAPE_DEFAULT_CAPACITY;
+
+    return dftr_errors;
+}
+
+
+DError_t op_delete_dftr_tape(DftrTape * tape)
+{
+    MY_ASSERT(tape);
+
+    free(tape->entries);
+    free(tape->adjoints);
+    free(tape->operands);
+
+    tape->entries = NULL;
+    tape->adjoints = NULL;
+    tape->operands = NULL;
+    tape->size = 0;
+    tape->capacity = 0;
+
+    return 0;
+}
+
+
+/// Reverse mode: one forward pass records the tape, one backward sweep fills
+/// gradient[0..variables_number) with the partial derivatives.
+DError_t dftr_eval_gradient(DftrTape * tape, const Tree * tree, const double * variables,
+                            size_t variables_number, double * value, double * gradient)
+{
+    MY_ASSERT(tape);
+    MY_ASSERT(tree);
+    MY_ASSERT(variables);
+    MY_ASSERT(value);
+    MY_ASSERT(gradient);
+
+    DError_t dftr_errors = 0;
+
+    tape->size = 0;
+
+    if (dftr_errors = dftr_tape_record(tape, tree, variables))
+        return dftr_errors;
+
+    // The root is recorded last.
+    *value = tape->entries[tape->size - 1].value;
+    dftr_tape_backward(tape, variables_number, gradient);
+
+    return dftr_errors;
+}
+
+
+/// The tree is recorded in post order, the operands stack keeps the entries of the branches
+/// until their node is recorded, so deep chains don't recurse.
+static DError_t dftr_tape_record(DftrTape * tape, const Tree * tree, const double * variables)
+{
+    MY_ASSERT(tape);
+    MY_ASSERT(tree);
+
+    DError_t dftr_errors = 0;
+    size_t operands_number = 0;
+
+    const TreeNode * root = tree->root;
+
+    for (const TreeNode * node = tree_postorder_first(root); node && !dftr_errors;
+         node = tree_postorder_next(node, root))
+    {
+        dftr_errors |= dftr_tape_record_node(tape, node, variables, &operands_number);
+    }
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_tape_record_node(DftrTape * tape, const TreeNode * node, const double * variables,
+                                      size_t * operands_number)
+{
+    MY_ASSERT(tape);
+    MY_ASSERT(node);
+    MY_ASSERT(operands_number);
+
+    DError_t dftr_errors = 0;
+    DftrTapeEntry entry = {};
+
+    if (node->right)
+        entry.right = tape->operands[--*operands_number];
+    if (node->left)
+        entry.left = tape->operands[--*operands_number];
+
+    switch (node->value.type)
+    {
+        case TREE_NODE_TYPES_NUMBER:
+            entry.opcode = DFTR_OPCODE_CONST;
+            entry.value = node->value.value.number;
+            break;
+
+        case TREE_NODE_TYPES_VARIABLE:
+            entry.opcode = DFTR_OPCODE_VAR;
+            entry.arg = (uint32_t) node->value.id;
+            entry.value = variables[node->value.id];
+            break;
+
+        case TREE_NODE_TYPES_OPERATION:
+        {
+            const MathOperation * operation = &MATH_OPERATIONS_ARRAY[node->value.id];
+            double right_value = 0;
+
+            if (!node->left || (operation->type == MATH_OPERATION_TYPES_BINARY && !node->right))
+            {
+                dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                return dftr_errors;
+            }
+
+            if (operation->type == MATH_OPERATION_TYPES_BINARY)
+                right_value = tape->entries[entry.right].value;
+            else
+                entry.right = 0;
+
+            entry.opcode = dftr_get_operation_opcode(operation->id);
+            entry.value = operation->operation(tape->entries[entry.left].value, right_value);
+            break;
+        }
+
+        case TREE_NODE_TYPES_STRING:
+        case TREE_NODE_TYPES_NO_TYPE:
+            dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+            return dftr_errors;
+
+        default:
+            MY_ASSERT(0 && "UNREACHABLE");
+            break;
+    }
+
+    if (dftr_errors = dftr_tape_push(tape, &entry))
+        return dftr_errors;
+
+    // The operands stack never holds more than the tape, so it grows with it.
+    tape->operands[(*operands_number)++] = (uint32_t) (tape->size - 1);
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_tape_push(DftrTape * tape, const DftrTapeEntry * entry)
+{
+    MY_ASSERT(tape);
+    MY_ASSERT(entry);
+
+    DError_t dftr_errors = 0;
+
+    if (tape->size == tape->capacity)
+    {
+        DftrTapeEntry * entries = NULL;
+        double * adjoints = NULL;
+        uint32_t * operands = NULL;
+
+        if (!(entries = (DftrTapeEntry *) realloc(tape->entries, 2 * tape->capacity * sizeof(DftrTapeEntry))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+        tape->entries = entries;
+
+        if (!(adjoints = (double *) realloc(tape->adjoints, 2 * tape->capacity * sizeof(double))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+        tape->adjoints = adjoints;
+
+        if (!(operands = (uint32_t *) realloc(tape->operands, 2 * tape->capacity * sizeof(uint32_t))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+        tape->operands = operands;
+
+        tape->capacity *= 2;
+    }
+
+    tape->entries[tape->size++] = *entry;
+
+    return dftr_errors;
+}
+
+
+static void dftr_tape_backward(DftrTape * tape, size_t variables_number, double * gradient)
+{
+    MY_ASSERT(tape);
+    MY_ASSERT(gradient);
+
+    const DftrTapeEntry * entries = tape->entries;
+    double * adjoints = tape->adjoints;
+
+    memset(gradient, 0, variables_number * sizeof(double));
+    memset(adjoints, 0, tape->size * sizeof(double));
+    adjoints[tape->size - 1] = 1;
+
+    for (size_t i = tape->size; i-- > 0;)
+    {
+        const DftrTapeEntry * entry = &entries[i];
+        double adjoint = adjoints[i];
+        double left = entries[entry->left].value;
+        double right = entries[entry->right].value;
+
+        switch (entry->opcode)
+        {
+            case DFTR_OPCODE_CONST:
+                break;
+
+            case DFTR_OPCODE_VAR:
+                if (entry->arg < variables_number)
+                    gradient[entry->arg] += adjoint;
+                break;
+
+            case DFTR_OPCODE_ADDITION:
+                adjoints[entry->left] += adjoint;
+                adjoints[entry->right] += adjoint;
+                break;
+
+            case DFTR_OPCODE_SUBTRACTION:
+                adjoints[entry->left] += adjoint;
+                adjoints[entry->right] -= adjoint;
+                break;
+
+            case DFTR_OPCODE_MULTIPLICATION:
+                adjoints[entry->left] += adjoint * right;
+                adjoints[entry->right] += adjoint * left;
+                break;
+
+            case DFTR_OPCODE_DIVISION:
+                adjoints[entry->left] += adjoint / right;
+                adjoints[entry->right] -= adjoint * entry->value / right;
+                break;
+
+            case DFTR_OPCODE_POWER:
+                adjoints[entry->left] += adjoint * right * pow(left, right - 1);
+
+                // Constant exponents are the common case and log() of a negative base would poison them.
+                if (entries[entry->right].opcode != DFTR_OPCODE_CONST)
+                    adjoints[entry->right] += adjoint * entry->value * log(left);
+                break;
+
+            case DFTR_OPCODE_SINUS:
+                adjoints[entry->left] += adjoint * cos(left);
+                break;
+
+            case DFTR_OPCODE_COSINUS:
+                adjoints[entry->left] -= adjoint * sin(left);
+                break;
+
+            default:
+                MY_ASSERT(0 && "UNREACHABLE");
+                break;
+        }
+    }
+}
@@ -0,0 +1,685 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewrite.h"
+#include "my_assert.h"
+#include "math_operations.h"
+#include "double_comparing.h"
+
+#define RULE_OP(op)      {.type = DFTR_PATTERN_OPERATION,  .op_id = MATH_OPERATIONS_##op}
+#define RULE_NUM(n)      {.type = DFTR_PATTERN_NUMBER,     .number = (n)}
+#define RULE_ANY(i)      {.type = DFTR_PATTERN_ANY,        .wildcard = (i)}
+#define RULE_ANY_NUM(i)  {.type = DFTR_PATTERN_ANY_NUMBER, .wildcard = (i)}
+#define RULE_FOLD        {.type = DFTR_PATTERN_FOLD}
+
+/// The rules of try_calculate_branch and try_replace_node in their priority.
+const DftrRule DFTR_DEFAULT_RULES[] = {
+    {.name = "# + #",   .pattern = {RULE_OP(ADDITION),       RULE_ANY_NUM(0), RULE_ANY_NUM(1)}, .replacement = {RULE_FOLD}},
+    {.name = "# - #",   .pattern = {RULE_OP(SUBTRACTION),    RULE_ANY_NUM(0), RULE_ANY_NUM(1)}, .replacement = {RULE_FOLD}},
+    {.name = "# * #",   .pattern = {RULE_OP(MULTIPLICATION), RULE_ANY_NUM(0), RULE_ANY_NUM(1)}, .replacement = {RULE_FOLD}},
+    {.name = "# / #",   .pattern = {RULE_OP(DIVISION),       RULE_ANY_NUM(0), RULE_ANY_NUM(1)}, .replacement = {RULE_FOLD}},
+    {.name = "# ^ #",   .pattern = {RULE_OP(POWER),          RULE_ANY_NUM(0), RULE_ANY_NUM(1)}, .replacement = {RULE_FOLD}},
+    {.name = "sin(#)",  .pattern = {RULE_OP(SINUS),          RULE_ANY_NUM(0)},                  .replacement = {RULE_FOLD}},
+    {.name = "cos(#)",  .pattern = {RULE_OP(COSINUS),        RULE_ANY_NUM(0)},                  .replacement = {RULE_FOLD}},
+
+    {.name = "x + 0",   .pattern = {RULE_OP(ADDITION),       RULE_ANY(0),     RULE_NUM(0)},     .replacement = {RULE_ANY(0)}},
+    {.name = "0 + x",   .pattern = {RULE_OP(ADDITION),       RULE_NUM(0),     RULE_ANY(0)},     .replacement = {RULE_ANY(0)}},
+    {.name = "x - 0",   .pattern = {RULE_OP(SUBTRACTION),    RULE_ANY(0),     RULE_NUM(0)},     .replacement = {RULE_ANY(0)}},
+    {.name = "x * 1",   .pattern = {RULE_OP(MULTIPLICATION), RULE_ANY(0),     RULE_NUM(1)},     .replacement = {RULE_ANY(0)}},
+    {.name = "1 * x",   .pattern = {RULE_OP(MULTIPLICATION), RULE_NUM(1),     RULE_ANY(0)},     .replacement = {RULE_ANY(0)}},
+    {.name = "x * 0",   .pattern = {RULE_OP(MULTIPLICATION), RULE_ANY(0),     RULE_NUM(0)},     .replacement = {RULE_NUM(0)}},
+    {.name = "0 * x",   .pattern = {RULE_OP(MULTIPLICATION), RULE_NUM(0),     RULE_ANY(0)},     .replacement = {RULE_NUM(0)}},
+    {.name = "x / 1",   .pattern = {RULE_OP(DIVISION),       RULE_ANY(0),     RULE_NUM(1)},     .replacement = {RULE_ANY(0)}},
+    {.name = "0 / x",   .pattern = {RULE_OP(DIVISION),       RULE_NUM(0),     RULE_ANY(0)},     .replacement = {RULE_NUM(0)}},
+    {.name = "1 ^ x",   .pattern = {RULE_OP(POWER),          RULE_NUM(1),     RULE_ANY(0)},     .replacement = {RULE_NUM(1)}},
+    {.name = "0 ^ x",   .pattern = {RULE_OP(POWER),          RULE_NUM(0),     RULE_ANY(0)},     .replacement = {RULE_NUM(0)}},
+    {.name = "x ^ 1",   .pattern = {RULE_OP(POWER),          RULE_ANY(0),     RULE_NUM(1)},     .replacement = {RULE_ANY(0)}},
+    {.name = "x ^ 0",   .pattern = {RULE_OP(POWER),          RULE_ANY(0),     RULE_NUM(0)},     .replacement = {RULE_NUM(1)}},
+};
+const size_t DFTR_DEFAULT_RULES_NUMBER = sizeof(DFTR_DEFAULT_RULES) / sizeof(DFTR_DEFAULT_RULES[0]);
+
+struct DftrRewriteStack {
+    TreeNode * * nodes;
+    bool * is_expanded;
+    size_t size;
+    size_t capacity;
+};
+
+static DError_t dftr_rule_set_insert(DftrRuleSet * set, size_t rule_id);
+static DError_t dftr_rule_index_add(DftrRuleSet * set, size_t parent, const DftrPatternNode * symbol, size_t rule_id,
+                                    size_t * child);
+static bool dftr_is_same_symbol(const DftrPatternNode * symbol1, const DftrPatternNode * symbol2);
+static size_t dftr_get_arity(MathOperations op_id);
+static bool dftr_is_symbol_match(const DftrPatternNode * symbol, const TreeNode * node);
+static size_t dftr_rule_set_find(DftrRuleSet * set, TreeNode * node, TreeNode * * bindings);
+static void dftr_rule_index_find(DftrRuleSet * set, size_t index_node, const TreeNode * const * pending,
+                                 size_t pending_size, size_t * rule_id);
+static bool dftr_rule_match(const DftrPatternNode * pattern, size_t * position, TreeNode * node, TreeNode * * bindings);
+static DError_t dftr_rule_apply(Tree * tree, const DftrRule * rule, TreeNode * node, TreeNode * * bindings);
+static DError_t dftr_rule_instantiate(Tree * tree, const DftrPatternNode * replacement, size_t * position,
+                                      TreeNode * node, TreeNode * * bindings, size_t * uses);
+static bool dftr_rule_is_deep(const DftrRule * rule);
+static DError_t dftr_rewrite_stack_push(DftrRewriteStack * stack, TreeNode * node, bool is_expanded);
+
+
+DError_t op_new_dftr_rule_set(DftrRuleSet * set, const DftrRule * rules, size_t rules_number)
+{
+    MY_ASSERT(set);
+    MY_ASSERT(rules);
+
+    DError_t dftr_errors = 0;
+
+    set->rules = rules;
+    set->rules_number = rules_number;
+    set->index = NULL;
+    set->index_size = 0;
+    set->index_capacity = 0;
+    set->is_indexed = true;
+    set->lookups_number = 0;
+    set->checks_number = 0;
+
+    if (!(set->index = (DftrRuleIndexNode *) calloc(DFTR_RULE_INDEX_DEFAULT_CAPACITY, sizeof(DftrRuleIndexNode))))
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+        return dftr_errors;
+    }
+    set->index_capacity = DFTR_RULE_INDEX_DEFAULT_CAPACITY;
+
+    set->index[0].symbol.type = DFTR_PATTERN_NONE;
+    set->index[0].first_child = DFTR_RULE_INDEX_NULL;
+    set->index[0].next_sibling = DFTR_RULE_INDEX_NULL;
+    set->index[0].first_rule = DFTR_RULE_INDEX_NULL;
+    set->index[0].min_rule = 0;
+    set->index_size = 1;
+
+    for (size_t i = 0; i < rules_number; i++)
+    {
+        if (dftr_errors = dftr_rule_set_insert(set, i))
+            return dftr_errors;
+    }
+
+    return dftr_errors;
+}
+
+
+DError_t op_delete_dftr_rule_set(DftrRuleSet * set)
+{
+    MY_ASSERT(set);
+
+    DError_t dftr_errors = 0;
+
+    free(set->index);
+
+    set->rules = NULL;
+    set->rules_number = 0;
+    set->index = NULL;
+    set->index_size = 0;
+    set->index_capacity = 0;
+
+    return dftr_errors;
+}
+
+
+/// Adds the pattern of the rule to the discrimination tree, wildcard slots are not part of the key.
+static DError_t dftr_rule_set_insert(DftrRuleSet * set, size_t rule_id)
+{
+    MY_ASSERT(set);
+    MY_ASSERT(rule_id < set->rules_number);
+
+    DError_t dftr_errors = 0;
+    const DftrPatternNode * pattern = set->rules[rule_id].pattern;
+
+    if (pattern[0].type != DFTR_PATTERN_OPERATION)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+        return dftr_errors;
+    }
+
+    size_t index_node = 0;
+    size_t needed_number = 1;
+
+    for (size_t i = 0; needed_number; i++)
+    {
+        if (i == DFTR_RULE_MAX_SIZE)
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+            return dftr_errors;
+        }
+
+        needed_number--;
+
+        switch (pattern[i].type)
+        {
+            case DFTR_PATTERN_OPERATION:
+                needed_number += dftr_get_arity(pattern[i].op_id);
+                break;
+
+            case DFTR_PATTERN_ANY:
+            case DFTR_PATTERN_ANY_NUMBER:
+                if (pattern[i].wildcard >= DFTR_RULE_MAX_WILDCARDS)
+                {
+                    dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                    return dftr_errors;
+                }
+                break;
+
+            case DFTR_PATTERN_NUMBER:
+                break;
+
+            case DFTR_PATTERN_NONE:
+            case DFTR_PATTERN_FOLD:
+            default:
+                dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                return dftr_errors;
+        }
+
+        if (dftr_errors = dftr_rule_index_add(set, index_node, &pattern[i], rule_id, &index_node))
+            return dftr_errors;
+    }
+
+    // An equal pattern of an earlier rule shadows this one.
+    if (set->index[index_node].first_rule == DFTR_RULE_INDEX_NULL)
+        set->index[index_node].first_rule = rule_id;
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_rule_index_add(DftrRuleSet * set, size_t parent, const DftrPatternNode * symbol, size_t rule_id,
+                                    size_t * child)
+{
+    MY_ASSERT(set);
+    MY_ASSERT(symbol);
+    MY_ASSERT(child);
+
+    DError_t dftr_errors = 0;
+    size_t last_child = DFTR_RULE_INDEX_NULL;
+
+    for (size_t i = set->index[parent].first_child; i != DFTR_RULE_INDEX_NULL; i = set->index[i].next_sibling)
+    {
+        if (dftr_is_same_symbol(&set->index[i].symbol, symbol))
+        {
+            *child = i;
+            return dftr_errors;
+        }
+
+        last_child = i;
+    }
+
+    if (set->index_size == set->index_capacity)
+    {
+        DftrRuleIndexNode * index = NULL;
+        if (!(index = (DftrRuleIndexNode *) realloc(set->index, 2 * set->index_capacity * sizeof(DftrRuleIndexNode))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+
+        set->index = index;
+        set->index_capacity *= 2;
+    }
+
+    // Rules come in priority order, so the sibling lists stay sorted by min_rule.
+    size_t new_node = set->index_size++;
+    set->index[new_node].symbol = *symbol;
+    set->index[new_node].first_child = DFTR_RULE_INDEX_NULL;
+    set->index[new_node].next_sibling = DFTR_RULE_INDEX_NULL;
+    set->index[new_node].first_rule = DFTR_RULE_INDEX_NULL;
+    set->index[new_node].min_rule = rule_id;
+
+    if (last_child == DFTR_RULE_INDEX_NULL)
+        set->index[parent].first_child = new_node;
+    else
+        set->index[last_child].next_sibling = new_node;
+
+    *child = new_node;
+
+    return dftr_errors;
+}
+
+
+static bool dftr_is_same_symbol(const DftrPatternNode * symbol1, const DftrPatternNode * symbol2)
+{
+    MY_ASSERT(symbol1);
+    MY_ASSERT(symbol2);
+
+    if (symbol1->type != symbol2->type)
+        return false;
+
+    switch (symbol1->type)
+    {
+        case DFTR_PATTERN_OPERATION:
+            return symbol1->op_id == symbol2->op_id;
+
+        case DFTR_PATTERN_NUMBER:
+            return is_equal_double(symbol1->number, symbol2->number);
+
+        case DFTR_PATTERN_NONE:
+        case DFTR_PATTERN_ANY:
+        case DFTR_PATTERN_ANY_NUMBER:
+        case DFTR_PATTERN_FOLD:
+        default:
+            return true;
+    }
+}
+
+
+static size_t dftr_get_arity(MathOperations op_id)
+{
+    return (size_t) MATH_OPERATIONS_ARRAY[get_math_operation_index(op_id)].type;
+}
+
+
+static bool dftr_is_symbol_match(const DftrPatternNode * symbol, const TreeNode * node)
+{
+    MY_ASSERT(symbol);
+    MY_ASSERT(node);
+
+    switch (symbol->type)
+    {
+        case DFTR_PATTERN_OPERATION:
+            return node->value.type == TREE_NODE_TYPES_OPERATION &&
+                   MATH_OPERATIONS_ARRAY[node->value.id].id == symbol->op_id;
+
+        case DFTR_PATTERN_NUMBER:
+            return node->value.type == TREE_NODE_TYPES_NUMBER &&
+                   is_equal_double(node->value.value.number, symbol->number);
+
+        case DFTR_PATTERN_ANY:
+            return true;
+
+        case DFTR_PATTERN_ANY_NUMBER:
+            return node->value.type == TREE_NODE_TYPES_NUMBER;
+
+        case DFTR_PATTERN_NONE:
+        case DFTR_PATTERN_FOLD:
+        default:
+            return false;
+    }
+}
+
+
+/// Returns the id of the highest priority rule matching node or DFTR_RULE_INDEX_NULL.
+static size_t dftr_rule_set_find(DftrRuleSet * set, TreeNode * node, TreeNode * * bindings)
+{
+    MY_ASSERT(set);
+    MY_ASSERT(node);
+    MY_ASSERT(bindings);
+
+    size_t rule_id = DFTR_RULE_INDEX_NULL;
+    size_t position = 0;
+
+    set->lookups_number++;
+
+    if (!set->is_indexed)
+    {
+        for (size_t i = 0; i < set->rules_number; i++)
+        {
+            set->checks_number++;
+            position = 0;
+
+            if (dftr_rule_match(set->rules[i].pattern, &position, node, bindings))
+                return i;
+        }
+
+        return rule_id;
+    }
+
+    const TreeNode * pending[DFTR_RULE_MAX_SIZE] = {node};
+    dftr_rule_index_find(set, 0, pending, 1, &rule_id);
+
+    if (rule_id != DFTR_RULE_INDEX_NULL)
+        dftr_rule_match(set->rules[rule_id].pattern, &position, node, bindings);
+
+    return rule_id;
+}
+
+
+/// pending holds the subject subtrees still to be matched, the next one on top.
+/// Every edge that fits the next subtree is followed, so the search is bounded
+/// by the pattern depth and the symbols used at each position, not the number of rules.
+static void dftr_rule_index_find(DftrRuleSet * set, size_t index_node, const TreeNode * const * pending,
+                                 size_t pending_size, size_t * rule_id)
+{
+    MY_ASSERT(set);
+    MY_ASSERT(pending);
+    MY_ASSERT(rule_id);
+
+    if (!pending_size)
+    {
+        if (set->index[index_node].first_rule < *rule_id)
+            *rule_id = set->index[index_node].first_rule;
+
+        return;
+    }
+
+    const TreeNode * node = pending[pending_size - 1];
+    const TreeNode * next_pending[DFTR_RULE_MAX_SIZE] = {};
+
+    for (size_t child = set->index[index_node].first_child; child != DFTR_RULE_INDEX_NULL;
+         child = set->index[child].next_sibling)
+    {
+        const DftrRuleIndexNode * edge = &set->index[child];
+
+        // Siblings are sorted by min_rule, nothing further can win.
+        if (edge->min_rule >= *rule_id)
+            break;
+
+        set->checks_number++;
+
+        if (!dftr_is_symbol_match(&edge->symbol, node))
+            continue;
+
+        size_t next_size = pending_size - 1;
+        memcpy(next_pending, pending, next_size * sizeof(TreeNode *));
+
+        if (edge->symbol.type == DFTR_PATTERN_OPERATION)
+        {
+            if (node->right)
+                next_pending[next_size++] = node->right;
+            next_pending[next_size++] = node->left;
+        }
+
+        dftr_rule_index_find(set, child, next_pending, next_size, rule_id);
+    }
+}
+
+
+static bool dftr_rule_match(const DftrPatternNode * pattern, size_t * position, TreeNode * node, TreeNode * * bindings)
+{
+    MY_ASSERT(pattern);
+    MY_ASSERT(position);
+    MY_ASSERT(node);
+    MY_ASSERT(bindings);
+
+    const DftrPatternNode * symbol = &pattern[(*position)++];
+
+    if (!dftr_is_symbol_match(symbol, node))
+        return false;
+
+    switch (symbol->type)
+    {
+        case DFTR_PATTERN_OPERATION:
+            if (!dftr_rule_match(pattern, position, node->left, bindings))
+                return false;
+            if (node->right && !dftr_rule_match(pattern, position, node->right, bindings))
+                return false;
+            break;
+
+        case DFTR_PATTERN_ANY:
+        case DFTR_PATTERN_ANY_NUMBER:
+            bindings[symbol->wildcard] = node;
+            break;
+
+        case DFTR_PATTERN_NUMBER:
+        case DFTR_PATTERN_NONE:
+        case DFTR_PATTERN_FOLD:
+        default:
+            break;
+    }
+
+    return true;
+}
+
+
+/// Rewrites node in place, so its parent and the worklist entries stay valid.
+/// Bound subtrees are detached first and moved into the result, a wildcard
+/// used more than once is copied for all but its last use.
+static DError_t dftr_rule_apply(Tree * tree, const DftrRule * rule, TreeNode * node, TreeNode * * bindings)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(rule);
+    MY_ASSERT(node);
+    MY_ASSERT(bindings);
+
+    DError_t dftr_errors = 0;
+    TError_t tree_errors = 0;
+
+    if (rule->replacement[0].type == DFTR_PATTERN_FOLD)
+    {
+        const MathOperation * operation = &MATH_OPERATIONS_ARRAY[node->value.id];
+        double right_number = node->right ? node->right->value.value.number : 0;
+
+        node->value.type = TREE_NODE_TYPES_NUMBER;
+        node->value.value.number = operation->operation(node->left->value.value.number, right_number);
+
+        if (node->right)
+            tree_errors |= tree_delete_branch(tree, &node->right);
+        tree_errors |= tree_delete_branch(tree, &node->left);
+
+        if (tree_errors)
+            dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+        return dftr_errors;
+    }
+
+    size_t uses[DFTR_RULE_MAX_WILDCARDS] = {};
+    for (size_t i = 0; i < DFTR_RULE_MAX_SIZE && rule->replacement[i].type != DFTR_PATTERN_NONE; i++)
+    {
+        if (rule->replacement[i].type == DFTR_PATTERN_ANY || rule->replacement[i].type == DFTR_PATTERN_ANY_NUMBER)
+            uses[rule->replacement[i].wildcard]++;
+    }
+
+    for (size_t i = 0; i < DFTR_RULE_MAX_WILDCARDS; i++)
+    {
+        if (!bindings[i])
+            continue;
+
+        if (bindings[i]->parent->left == bindings[i])
+            bindings[i]->parent->left = NULL;
+        else
+            bindings[i]->parent->right = NULL;
+    }
+
+    if (node->left)
+        tree_errors |= tree_delete_branch(tree, &node->left);
+    if (node->right)
+        tree_errors |= tree_delete_branch(tree, &node->right);
+
+    if (tree_errors)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+        return dftr_errors;
+    }
+
+    size_t position = 0;
+    dftr_errors |= dftr_rule_instantiate(tree, rule->replacement, &position, node, bindings, uses);
+
+    // Bound but unused subtrees.
+    for (size_t i = 0; i < DFTR_RULE_MAX_WILDCARDS; i++)
+    {
+        if (bindings[i])
+            tree_errors |= tree_delete_branch(tree, &bindings[i]);
+    }
+
+    if (tree_errors)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_rule_instantiate(Tree * tree, const DftrPatternNode * replacement, size_t * position,
+                                      TreeNode * node, TreeNode * * bindings, size_t * uses)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(replacement);
+    MY_ASSERT(position);
+    MY_ASSERT(node);
+    MY_ASSERT(bindings);
+    MY_ASSERT(uses);
+
+    DError_t dftr_errors = 0;
+    TError_t tree_errors = 0;
+
+    if (*position == DFTR_RULE_MAX_SIZE)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+        return dftr_errors;
+    }
+
+    const DftrPatternNode * symbol = &replacement[(*position)++];
+
+    switch (symbol->type)
+    {
+        case DFTR_PATTERN_OPERATION:
+            dftr_set_operation(&node->value, symbol->op_id);
+
+            if (tree_errors = tree_insert(tree, node, TREE_NODE_BRANCH_LEFT, TREE_NULL))
+                break;
+            dftr_errors |= dftr_rule_instantiate(tree, replacement, position, node->left, bindings, uses);
+
+            if (dftr_get_arity(symbol->op_id) == MATH_OPERATION_TYPES_BINARY && !dftr_errors)
+            {
+                if (tree_errors = tree_insert(tree, node, TREE_NODE_BRANCH_RIGHT, TREE_NULL))
+                    break;
+                dftr_errors |= dftr_rule_instantiate(tree, replacement, position, node->right, bindings, uses);
+            }
+            break;
+
+        case DFTR_PATTERN_NUMBER:
+            node->value.type = TREE_NODE_TYPES_NUMBER;
+            node->value.value.number = symbol->number;
+            break;
+
+        case DFTR_PATTERN_ANY:
+        case DFTR_PATTERN_ANY_NUMBER:
+            if (!bindings[symbol->wildcard])
+            {
+                dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+                break;
+            }
+
+            if (--uses[symbol->wildcard])
+            {
+                tree_errors |= tree_copy_branch(tree, node, bindings[symbol->wildcard]);
+                break;
+            }
+
+            tree_errors |= tree_move_branch(tree, node, bindings[symbol->wildcard]);
+            bindings[symbol->wildcard] = NULL;
+            break;
+
+        case DFTR_PATTERN_NONE:
+        case DFTR_PATTERN_FOLD:
+        default:
+            dftr_errors |= DIFFERENCIATOR_ERRORS_INVALID_INPUT;
+            break;
+    }
+
+    if (tree_errors)
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+
+    return dftr_errors;
+}
+
+
+/// Whether the replacement builds operations below its root, which then need simplifying too.
+static bool dftr_rule_is_deep(const DftrRule * rule)
+{
+    MY_ASSERT(rule);
+
+    for (size_t i = 1; i < DFTR_RULE_MAX_SIZE; i++)
+    {
+        if (rule->replacement[i].type == DFTR_PATTERN_OPERATION)
+            return true;
+    }
+
+    return false;
+}
+
+
+/// Bottom-up worklist like dftr_worklist_optimization with the rules of set.
+/// The rules must terminate: no chain of them may lead back to a term it started from.
+DError_t dftr_rewrite_optimization(Tree * tree, DftrRuleSet * set, DftrOptimizationStats * stats)
+{
+    MY_ASSERT(tree);
+    MY_ASSERT(set);
+    MY_ASSERT(stats);
+
+    DError_t dftr_errors = 0;
+    DftrRewriteStack stack = {};
+
+    if (dftr_errors = dftr_rewrite_stack_push(&stack, tree->root, false))
+        return dftr_errors;
+
+    stats->rounds = 1;
+
+    while (stack.size && !dftr_errors)
+    {
+        stack.size--;
+        TreeNode * node = stack.nodes[stack.size];
+
+        if (!stack.is_expanded[stack.size])
+        {
+            dftr_errors |= dftr_rewrite_stack_push(&stack, node, true);
+            if (node->right)
+                dftr_errors |= dftr_rewrite_stack_push(&stack, node->right, false);
+            if (node->left)
+                dftr_errors |= dftr_rewrite_stack_push(&stack, node->left, false);
+            continue;
+        }
+
+        while (!dftr_errors)
+        {
+            TreeNode * bindings[DFTR_RULE_MAX_WILDCARDS] = {};
+            stats->visits++;
+
+            size_t rule_id = dftr_rule_set_find(set, node, bindings);
+            if (rule_id == DFTR_RULE_INDEX_NULL)
+                break;
+
+            dftr_errors |= dftr_rule_apply(tree, &set->rules[rule_id], node, bindings);
+            stats->rewrites++;
+
+            if (dftr_rule_is_deep(&set->rules[rule_id]))
+            {
+                dftr_errors |= dftr_rewrite_stack_push(&stack, node, false);
+                break;
+            }
+        }
+    }
+
+    free(stack.nodes);
+    free(stack.is_expanded);
+
+    return dftr_errors;
+}
+
+
+static DError_t dftr_rewrite_stack_push(DftrRewriteStack * stack, TreeNode * node, bool is_expanded)
+{
+    MY_ASSERT(stack);
+    MY_ASSERT(node);
+
+    DError_t dftr_errors = 0;
+
+    if (stack->size == stack->capacity)
+    {
+        size_t capacity = stack->capacity ? 2 * stack->capacity : DFTR_RULE_INDEX_DEFAULT_CAPACITY;
+        TreeNode * * nodes = NULL;
+        bool * is_expanded_array = NULL;
+
+        if (!(nodes = (TreeNode * *) realloc(stack->nodes, capacity * sizeof(TreeNode *))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+        stack->nodes = nodes;
+
+        if (!(is_expanded_array = (bool *) realloc(stack->is_expanded, capacity * sizeof(bool))))
+        {
+            dftr_errors |= DIFFERENCIATOR_ERRORS_CANT_ALLOCATE_MEMORY;
+            return dftr_errors;
+        }
+        stack->is_expanded = is_expanded_array;
+
+        stack->capacity = capacity;
+    }
+
+    stack->nodes[stack->size] = node;
+    stack->is_expanded[stack->size] = is_expanded;
+    stack->size++;
+
+    return dftr_errors;
+}
@@ -0,0 +1,158 @@
+#include <math.h>
+
+#include "strength.h"
+#include "my_assert.h"
+#include "math_operations.h"
+#include "double_comparing.h"
+
+static TError_t dftr_cse_power_chain(Dag * dag, DagIndex base, uint32_t power, DagIndex * node);
+static TError_t dftr_cse_make_number(Dag * dag, double number, DagIndex * node);
+static TError_t dftr_cse_make_multiplication(Dag * dag, DagIndex left, DagIndex right, DagIndex * node);
+
+
+/// Rewrites the DAG so that u ^ n with a small natural n is a multiplication
+/// chain of shared squares, u / c is u * (1 / c), and sin(u) and cos(u)
+/// of one argument are evaluated together. Printing is affected as well.
+/// Horner roots are dropped, so dftr_cse_horner goes after this pass.
+DError_t dftr_cse_reduce_strength(DftrCse * cse, DftrStrengthStats * stats)
+{
+    MY_ASSERT(cse);
+
+    DError_t dftr_errors = 0;
+    TError_t tree_errors = 0;
+
+    // Rebuilt nodes are appended, so order maps every old node to its new copy.
+    size_t size = cse->dag.size;
+    DagIndex * map = cse->order;
+
+    for (size_t i = 0; i < size && !tree_errors; i++)
+    {
+        DagNode node = cse->dag.nodes[i];
+        DagIndex left = node.left != DAG_NULL_INDEX ? map[node.left] : DAG_NULL_INDEX;
+        DagIndex right = node.right != DAG_NULL_INDEX ? map[node.right] : DAG_NULL_INDEX;
+        const DagNode * right_node = right != DAG_NULL_INDEX ? &cse->dag.nodes[right] : NULL;
+
+        if (node.value.type == TREE_NODE_TYPES_OPERATION && right_node &&
+            right_node->value.type == TREE_NODE_TYPES_NUMBER)
+        {
+            double number = right_node->value.value.number;
+
+            switch (MATH_OPERATIONS_ARRAY[node.value.id].id)
+            {
+                case MATH_OPERATIONS_POWER:
+                    if (number >= 0 && number <= DFTR_STRENGTH_MAX_POWER && is_exact_double(number, floor(number)))
+                    {
+                        tree_errors |= dftr_cse_power_chain(&cse->dag, left, (uint32_t) number, &map[i]);
+                        if (stats)
+                            stats->powers_number++;
+                        continue;
+                    }
+                    break;
+
+                case MATH_OPERATIONS_DIVISION:
+                    if (!is_equal_double(number, 0))
+                    {
+                        tree_errors |= dftr_cse_make_number(&cse->dag, 1 / number, &right);
+                        if (!tree_errors)
+                            tree_errors |= dftr_cse_make_multiplication(&cse->dag, left, right, &map[i]);
+                        if (stats)
+                            stats->divisions_number++;
+                        continue;
+                    }
+                    break;
+
+                case MATH_OPERATIONS_ADDITION:
+                case MATH_OPERATIONS_SUBTRACTION:
+                case MATH_OPERATIONS_MULTIPLICATION:
+                case MATH_OPERATIONS_SINUS:
+                case MATH_OPERATIONS_COSINUS:
+                    break;
+
+                default:
+                    MY_ASSERT(0 && "UNREACHABLE");
+                    break;
+            }
+        }
+
+        tree_errors |= dag_make_node(&cse->dag, node.value, left, right, &map[i]);
+    }
+
+    if (tree_errors)
+    {
+        dftr_errors |= DIFFERENCIATOR_ERRORS_TREE_ERROR;
+        return dftr_errors;
+    }
+
+    cse->root = map[cse->root];
+    cse->is_sincos_fused = true;
+    cse->is_horner = false;
+
+    if (dftr_errors = dftr_cse_analyze(cse))
+        return dftr_errors;
+
+    if (stats)
+        for (size_t i = 0; i <= cse->root; i++)
+            if (cse->partners[i] != DAG_NULL_INDEX && cse->partners[i] > i)
+                stats->sincos_number++;
+
+    return dftr_errors;
+}
+
+
+/// Square-and-multiply, so u ^ 4 is (u * u) * (u * u) with the square shared.
+static TError_t dftr_cse_power_chain(Dag * dag, DagIndex base, uint32_t power, DagIndex * node)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(node);
+
+    TError_t tree_errors = 0;
+
+    if (power == 0)
+        return dftr_cse_make_number(dag, 1, node);
+
+    DagIndex result = DAG_NULL_INDEX;
+
+    while (power && !tree_errors)
+    {
+        if (power & 1)
+        {
+            if (result == DAG_NULL_INDEX)
+                result = base;
+            else
+                tree_errors |= dftr_cse_make_multiplication(dag, result, base, &result);
+        }
+
+        power >>= 1;
+        if (power)
+            tree_errors |= dftr_cse_make_multiplication(dag, base, base, &base);
+    }
+
+    *node = result;
+
+    return tree_errors;
+}
+
+
+static TError_t dftr_cse_make_number(Dag * dag, double number, DagIndex * node)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(node);
+
+    Tree_t value = {};
+    value.type = TREE_NODE_TYPES_NUMBER;
+    value.value.number = number;
+
+    return dag_make_node(dag, value, DAG_NULL_INDEX, DAG_NULL_INDEX, node);
+}
+
+
+static TError_t dftr_cse_make_multiplication(Dag * dag, DagIndex left, DagIndex right, DagIndex * node)
+{
+    MY_ASSERT(dag);
+    MY_ASSERT(node);
+
+    Tree_t value = {};
+    dftr_set_operation(&value, MATH_OPERATIONS_MULTIPLICATION);
+
+    return dag_make_node(dag, value, left, right, node);
+}